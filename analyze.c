@@ -0,0 +1,256 @@
+#include "analyze.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver.h"
+#include "error.h"
+#include "object.h"
+#include "song.h"
+
+// Deeper than any driver's stack, and where recursive calls are cut off
+#define MAX_DEPTH 16
+
+void (*analysis_callback)(const ChannelUsage *usage);
+
+typedef struct Work
+{
+	size_t node;
+	unsigned int depth;
+} Work;
+
+static Song *song;
+static bool *visited;		// Each command at each depth that it can run at
+static Work *pending;
+static size_t pending_count;
+static size_t pending_capacity;
+
+static FlagFlow GetFlow(const SongNode *node)
+{
+	return (node->kind == SONG_NODE_FLAG) ? coordination_flag_layouts[node->flag].flow : FLOW_NEXT;
+}
+
+static bool IsLoop(const SongNode *node)
+{
+	return node->kind == SONG_NODE_FLAG && node->flag == COORDINATION_FLAG_LOOP;
+}
+
+static unsigned int GetLoopIndex(const SongNode *node)
+{
+	return node->bytes[song->driver->coordination_flags[COORDINATION_FLAG_LOOP].size];
+}
+
+// Where a command can go to, which smpsCopyData's pointer to its data isn't
+static size_t GetTarget(const SongNode *node)
+{
+	return (node->pointer != SONG_POINTER_NONE && node->pointer != SONG_POINTER_EXTERNAL && GetFlow(node) != FLOW_NEXT) ? Song_Resolve(song, node->target) : SONG_NONE;
+}
+
+static void Push(size_t node, unsigned int depth)
+{
+	if (node == SONG_NONE || !Song_IsCommand(&song->nodes[node]) || depth > MAX_DEPTH || visited[node * (MAX_DEPTH + 1) + depth])
+		return;
+
+	visited[node * (MAX_DEPTH + 1) + depth] = true;
+
+	if (pending_count == pending_capacity)
+	{
+		pending_capacity *= 2;
+		pending = realloc(pending, sizeof(*pending) * pending_capacity);
+	}
+
+	pending[pending_count++] = (Work){node, depth};
+}
+
+// Follows a channel into every smpsCall and back out again, assuming that
+// each one returns, to find how deeply they nest and which loop indices run.
+// 'deepest' gets the deepest that any channel reaching each command goes.
+static void AnalyzeChannel(size_t root, ChannelUsage *usage, bool *reached, unsigned int *deepest, bool *unbalanced)
+{
+	memset(visited, 0, sizeof(*visited) * song->node_count * (MAX_DEPTH + 1));
+	Push(root, 0);
+
+	while (pending_count != 0)
+	{
+		const Work work = pending[--pending_count];
+		const SongNode *node = &song->nodes[work.node];
+		const FlagFlow flow = GetFlow(node);
+
+		if (work.depth == MAX_DEPTH)
+			usage->recursive = true;
+		else if (work.depth > usage->call_depth)
+			usage->call_depth = work.depth;
+
+		if (IsLoop(node))
+			usage->loop_indices[GetLoopIndex(node)] = true;
+
+		if (flow == FLOW_RETURN && work.depth == 0)
+			unbalanced[work.node] = true;
+
+		Push(GetTarget(node), (flow == FLOW_CALL) ? work.depth + 1 : work.depth);
+
+		if (flow != FLOW_STOP && flow != FLOW_RETURN && flow != FLOW_JUMP)
+			Push(node->next, work.depth);
+	}
+
+	// Anything that the channel reaches shares its stack
+	for (size_t i = 0; i < song->node_count; ++i)
+	{
+		for (unsigned int depth = 0; depth <= MAX_DEPTH; ++depth)
+		{
+			if (visited[i * (MAX_DEPTH + 1) + depth])
+			{
+				reached[i] = true;
+
+				if (deepest[i] < (usage->recursive ? MAX_DEPTH : usage->call_depth))
+					deepest[i] = usage->recursive ? MAX_DEPTH : usage->call_depth;
+			}
+		}
+	}
+}
+
+// Finds the shallowest smpsCall whose return address lands on a loop index.
+// The loop counters come first, and the stack grows down onto them from
+// just past where 'max_call_depth' calls end.
+static unsigned int FindClashingCall(unsigned int index, unsigned int deepest)
+{
+	const Driver *driver = song->driver;
+	const long stack_top = driver->loop_counters + driver->max_call_depth * driver->call_size;
+
+	for (unsigned int depth = 1; depth <= deepest; ++depth)
+	{
+		const long start = stack_top - (long)depth * driver->call_size;
+
+		if ((long)index >= start && (long)index < start + driver->call_size)
+			return depth;
+	}
+
+	return 0;
+}
+
+// Finds an smpsLoop that runs between the start of a loop and its own smpsLoop,
+// and uses the same counter, which the outer loop still needs
+static size_t FindNestedLoop(size_t loop)
+{
+	const unsigned int index = GetLoopIndex(&song->nodes[loop]);
+	size_t nested = SONG_NONE;
+
+	memset(visited, 0, sizeof(*visited) * song->node_count * (MAX_DEPTH + 1));
+	pending_count = 0;
+	Push(GetTarget(&song->nodes[loop]), 0);
+
+	while (pending_count != 0)
+	{
+		const Work work = pending[--pending_count];
+		const SongNode *node = &song->nodes[work.node];
+		const FlagFlow flow = GetFlow(node);
+
+		if (work.node == loop)
+			continue;
+
+		if (IsLoop(node) && GetLoopIndex(node) == index && nested == SONG_NONE)
+			nested = work.node;
+
+		Push(GetTarget(node), 0);
+
+		if (flow != FLOW_STOP && flow != FLOW_RETURN && flow != FLOW_JUMP)
+			Push(node->next, 0);
+	}
+
+	return nested;
+}
+
+// Works out how much of each channel's track RAM its smpsCalls and smpsLoops
+// use, and warns about anything that would overwrite something else: calls
+// nested deeper than the stack has room for, loop indices that the stack
+// grows onto, and loops that share a counter with a loop that they run inside
+bool Analyze(const Object *object, size_t *problem_count)
+{
+	*problem_count = 0;
+	song = Song_Decode(object);
+
+	if (song == NULL)
+		return false;
+
+	const Driver *driver = song->driver;
+	unsigned int *deepest = calloc(song->node_count, sizeof(*deepest));
+	bool *unbalanced = calloc(song->node_count, sizeof(*unbalanced));
+	bool *reached = calloc(song->node_count, sizeof(*reached));
+
+	visited = malloc(sizeof(*visited) * song->node_count * (MAX_DEPTH + 1));
+	pending_capacity = song->node_count + 1;
+	pending = malloc(sizeof(*pending) * pending_capacity);
+	pending_count = 0;
+
+	for (size_t i = 0; i < song->root_count; ++i)
+	{
+		ChannelUsage *usage = calloc(1, sizeof(*usage));
+
+		usage->channel = (unsigned int)i + 1;
+		usage->position = song->nodes[song->roots[i]].position;
+		AnalyzeChannel(song->roots[i], usage, reached, deepest, unbalanced);
+
+		if (analysis_callback != NULL)
+			analysis_callback(usage);
+
+		if (usage->recursive)
+		{
+			PrintWarning("Warning: Channel %u at $%zX calls a subroutine from inside of itself, so its stack has no limit\n", usage->channel, usage->position);
+			++*problem_count;
+		}
+		else if (usage->call_depth > driver->max_call_depth)
+		{
+			PrintWarning("Warning: Channel %u at $%zX nests smpsCalls %u deep, but %s only has room for %u before they overwrite the loop counters\n", usage->channel, usage->position, usage->call_depth, driver->name, driver->max_call_depth);
+			++*problem_count;
+		}
+
+		free(usage);
+	}
+
+	for (size_t i = 0; i < song->node_count; ++i)
+	{
+		const SongNode *node = &song->nodes[i];
+
+		if (unbalanced[i])
+		{
+			PrintWarning("Warning: smpsReturn at $%zX can run without an smpsCall to return to\n", node->position);
+			++*problem_count;
+		}
+
+		if (deepest[i] != 0 && IsLoop(node))
+		{
+			const unsigned int clash = FindClashingCall(GetLoopIndex(node), deepest[i]);
+
+			if (clash != 0)
+			{
+				PrintWarning("Warning: smpsLoop at $%zX uses index %u, which is where the return address of an smpsCall nested %u deep goes\n", node->position, GetLoopIndex(node), clash);
+				++*problem_count;
+			}
+		}
+
+		if (reached[i] && IsLoop(node) && GetTarget(node) != SONG_NONE)
+		{
+			const size_t nested = FindNestedLoop(i);
+
+			if (nested != SONG_NONE)
+			{
+				PrintWarning("Warning: smpsLoop at $%zX uses index %u inside of the loop that ends at $%zX, which is still counting with it\n", song->nodes[nested].position, GetLoopIndex(node), node->position);
+				++*problem_count;
+			}
+		}
+	}
+
+	free(deepest);
+	free(unbalanced);
+	free(reached);
+	free(visited);
+	free(pending);
+	visited = NULL;
+	pending = NULL;
+	Song_Destroy(song);
+	song = NULL;
+
+	return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "object.h"
+
+// What one channel needs of its track's RAM
+typedef struct ChannelUsage
+{
+	unsigned int channel;		// In the order that the header lists them
+	size_t position;		// Of the channel's first command
+	unsigned int call_depth;	// Deepest that its smpsCalls nest
+	bool recursive;			// Its smpsCalls can nest without end
+	bool loop_indices[0x100];	// Which smpsLoop indices it uses
+} ChannelUsage;
+
+// Told about each channel
+extern void (*analysis_callback)(const ChannelUsage *usage);
+
+bool Analyze(const Object *object, size_t *problem_count);
@@ -0,0 +1,386 @@
+#include "build.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver.h"
+#include "error.h"
+#include "json.h"
+#include "object.h"
+#include "pack.h"
+
+#define NO_BANK -1
+
+Object* (*build_callback)(const char *file_name, unsigned int driver, size_t offset);
+
+typedef enum SongList
+{
+	SONG_LIST_MUSIC,
+	SONG_LIST_SFX
+} SongList;
+
+static const char* const list_names[] = {"music", "sfx"};
+
+// Files written so far, so that two songs can't overwrite each other
+static char **output_file_names;
+static size_t output_file_name_count;
+
+// Where a song ended up, for its list's pointer table
+typedef struct PlacedSong
+{
+	long id;
+	size_t address;
+	long bank;
+} PlacedSong;
+
+// Where the next song without an offset of its own goes
+typedef struct BankEnd
+{
+	long bank;
+	size_t offset;
+} BankEnd;
+
+static char* ReadFile(const char *file_name)
+{
+	FILE *file = fopen(file_name, "rb");
+
+	if (file == NULL)
+		return NULL;
+
+	fseek(file, 0, SEEK_END);
+	const size_t size = ftell(file);
+	rewind(file);
+
+	char *buffer = malloc(size + 1);
+	buffer[fread(buffer, 1, size, file)] = '\0';
+	fclose(file);
+
+	return buffer;
+}
+
+// Numbers can be given as JSON numbers, or as strings of hexadecimal, like
+// the command line's offsets
+static bool GetNumber(const char *value, long *number)
+{
+	char *string = JSON_GetString(value);
+
+	if (string == NULL)
+		return JSON_GetLong(value, number);
+
+	const char *digits = (string[0] == '$') ? string + 1 : string;
+	char *end;
+
+	*number = strtol(digits, &end, 0x10);
+
+	const bool valid = end != digits && *end == '\0';
+
+	free(string);
+
+	return valid;
+}
+
+static bool WriteFile(const char *file_name, const unsigned char *data, size_t size)
+{
+	FILE *file = fopen(file_name, "wb");
+
+	if (file == NULL)
+	{
+		PrintError("Error: Couldn't open '%s' for writing\n", file_name);
+		return false;
+	}
+
+	fwrite(data, 1, size, file);
+	fclose(file);
+
+	return true;
+}
+
+// Writes a pointer to each song in ID order, in the driver's byte order,
+// from the lowest ID to the highest. Sonic 1's are longword ROM addresses,
+// and the Z80 drivers' are words within their bank's window. IDs without a song get a null pointer.
+// If 'bank_table_file_name' is given, each song's bank goes there too.
+static bool WriteTables(const Driver *driver, const PlacedSong *songs, size_t song_count, const char *pointer_table_file_name, const char *bank_table_file_name)
+{
+	if (song_count == 0)
+		return true;
+
+	long lowest_id = songs[0].id, highest_id = songs[0].id;
+
+	for (size_t i = 1; i < song_count; ++i)
+	{
+		if (songs[i].id < lowest_id)
+			lowest_id = songs[i].id;
+		if (songs[i].id > highest_id)
+			highest_id = songs[i].id;
+	}
+
+	const size_t entry_count = (size_t)(highest_id - lowest_id) + 1;
+	const size_t entry_size = driver->big_endian ? 4 : 2;
+	unsigned char *pointers = calloc(entry_count, entry_size);
+	unsigned char *banks = calloc(entry_count, 1);
+
+	for (size_t i = 0; i < song_count; ++i)
+	{
+		const size_t entry = (size_t)(songs[i].id - lowest_id);
+		const size_t address = songs[i].address;
+		unsigned char *pointer = &pointers[entry * entry_size];
+
+		if (driver->big_endian)
+		{
+			pointer[0] = (address >> 24) & 0xFF;
+			pointer[1] = (address >> 16) & 0xFF;
+			pointer[2] = (address >> 8) & 0xFF;
+			pointer[3] = address & 0xFF;
+		}
+		else
+		{
+			pointer[0] = address & 0xFF;
+			pointer[1] = (address >> 8) & 0xFF;
+		}
+
+		banks[entry] = (songs[i].bank == NO_BANK) ? 0 : songs[i].bank & 0xFF;
+	}
+
+	bool success = true;
+
+	if (pointer_table_file_name != NULL)
+		success &= WriteFile(pointer_table_file_name, pointers, entry_count * entry_size);
+
+	if (bank_table_file_name != NULL)
+		success &= WriteFile(bank_table_file_name, banks, entry_count);
+
+	free(pointers);
+	free(banks);
+
+	return success;
+}
+
+// Assembles every song in one of the manifest's lists, one after the other
+// so that those without an offset of their own can follow the song before
+// them in their bank
+static bool BuildList(const char *manifest, SongList list, unsigned int default_driver, size_t base_offset, size_t bank_size, PlacedSong **placed_songs, size_t *placed_song_count, BankEnd **bank_ends, size_t *bank_end_count)
+{
+	const char *songs = JSON_Find(manifest, list_names[list]);
+	bool success = true;
+
+	*placed_songs = NULL;
+	*placed_song_count = 0;
+
+	for (unsigned long i = 0; songs != NULL; ++i)
+	{
+		char index[24];
+		sprintf(index, "%lu", i);
+
+		const char *song = JSON_Find(songs, index);
+
+		if (song == NULL)
+			break;
+
+		error = false;
+
+		char *file_name = JSON_GetString(JSON_Find(song, "file"));
+		char *output_file_name = JSON_GetString(JSON_Find(song, "output"));
+		long id, driver = default_driver, offset = -1, bank = NO_BANK;
+
+		if (file_name == NULL || !GetNumber(JSON_Find(song, "id"), &id))
+		{
+			PrintError("Error: Entry %lu of '%s' needs a 'file' and an 'id'\n", i, list_names[list]);
+			success = false;
+			free(file_name);
+			free(output_file_name);
+			continue;
+		}
+
+		const char *value;
+
+		if ((value = JSON_Find(song, "driver")) != NULL && !JSON_GetLong(value, &driver))
+			PrintError("Error: '%s' has an invalid driver\n", file_name);
+
+		if ((value = JSON_Find(song, "offset")) != NULL && (!GetNumber(value, &offset) || offset < 0))
+			PrintError("Error: '%s' has an invalid offset\n", file_name);
+
+		if ((value = JSON_Find(song, "bank")) != NULL && (!GetNumber(value, &bank) || bank < 0))
+			PrintError("Error: '%s' has an invalid bank\n", file_name);
+
+		for (size_t j = 0; j < *placed_song_count; ++j)
+			if ((*placed_songs)[j].id == id)
+				PrintError("Error: '%s' has the same ID as another song in '%s'\n", file_name, list_names[list]);
+
+		if (error)
+		{
+			success = false;
+			free(file_name);
+			free(output_file_name);
+			continue;
+		}
+
+		// Without an offset, the song follows the last one in its bank
+		BankEnd *bank_end = NULL;
+
+		for (size_t j = 0; j < *bank_end_count; ++j)
+			if ((*bank_ends)[j].bank == bank)
+				bank_end = &(*bank_ends)[j];
+
+		if (bank_end == NULL)
+		{
+			*bank_ends = realloc(*bank_ends, sizeof(**bank_ends) * (*bank_end_count + 1));
+			bank_end = &(*bank_ends)[(*bank_end_count)++];
+			bank_end->bank = bank;
+			bank_end->offset = base_offset;
+		}
+
+		if (offset == -1)
+			offset = (long)bank_end->offset;
+
+		Object *object = build_callback(file_name, (unsigned int)driver, (size_t)offset);
+
+		if (object == NULL)
+		{
+			success = false;
+		}
+		else
+		{
+			bank_end->offset = (size_t)offset + object->size;
+
+			if (bank != NO_BANK && ((size_t)offset < base_offset || bank_end->offset > base_offset + bank_size))
+				PrintError("Error: '%s' crosses from bank %ld into the next\n", file_name, bank);
+
+			for (size_t j = 0; j < object->import_count; ++j)
+				PrintError("Error: Symbol '%s' undefined\n", object->imports[j]);
+
+			if (!error)
+			{
+				if (output_file_name == NULL)
+				{
+					output_file_name = malloc(strlen(file_name) + 5);
+					sprintf(output_file_name, "%s.bin", file_name);
+				}
+
+				for (size_t j = 0; j < output_file_name_count; ++j)
+					if (strcmp(output_file_names[j], output_file_name) == 0)
+						PrintError("Error: '%s' would overwrite the output of another song, '%s'\n", file_name, output_file_name);
+
+				if (!error && WriteFile(output_file_name, object->data, object->size))
+				{
+					output_file_names = realloc(output_file_names, sizeof(*output_file_names) * (output_file_name_count + 1));
+					output_file_names[output_file_name_count++] = output_file_name;
+					output_file_name = NULL;
+
+					*placed_songs = realloc(*placed_songs, sizeof(**placed_songs) * (*placed_song_count + 1));
+					(*placed_songs)[*placed_song_count].id = id;
+					(*placed_songs)[*placed_song_count].address = (size_t)offset;
+					(*placed_songs)[*placed_song_count].bank = bank;
+					++*placed_song_count;
+				}
+			}
+
+			success &= !error;
+			Object_Destroy(object);
+		}
+
+		free(file_name);
+		free(output_file_name);
+	}
+
+	return success;
+}
+
+// Assembles every song and sound effect that a manifest lists, and writes
+// their pointer tables. A manifest looks like this:
+//
+// {
+// 	"driver": 3,
+// 	"offset": "8000",
+// 	"music_table": "music_pointers.bin",
+// 	"music_banks": "music_banks.bin",
+// 	"music": [
+// 		{"id": 1, "file": "AIZ1.asm", "bank": 0},
+// 		{"id": 2, "file": "AIZ2.asm", "bank": 0, "output": "AIZ2.bin"}
+// 	],
+// 	"sfx_table": "sfx_pointers.bin",
+// 	"sfx": [
+// 		{"id": "33", "file": "Ring.asm", "offset": "8000"}
+// 	]
+// }
+bool Build(const char *manifest_file_name)
+{
+	error = false;
+
+	char *manifest = ReadFile(manifest_file_name);
+
+	if (manifest == NULL)
+	{
+		PrintError("Error: Couldn't open manifest '%s'\n", manifest_file_name);
+		return false;
+	}
+
+	long default_driver = 1, base_offset = 0, bank_size = Z80_BANK_SIZE;
+	const char *value;
+
+	if (JSON_SkipValue(manifest) == NULL)
+		PrintError("Error: Manifest '%s' isn't valid JSON\n", manifest_file_name);
+
+	if ((value = JSON_Find(manifest, "driver")) != NULL && !JSON_GetLong(value, &default_driver))
+		PrintError("Error: The manifest's driver is invalid\n");
+
+	if ((value = JSON_Find(manifest, "offset")) != NULL && (!GetNumber(value, &base_offset) || base_offset < 0))
+		PrintError("Error: The manifest's offset is invalid\n");
+
+	if ((value = JSON_Find(manifest, "bank_size")) != NULL && (!GetNumber(value, &bank_size) || bank_size <= 0))
+		PrintError("Error: The manifest's bank size is invalid\n");
+
+	const Driver *driver = GetDriver((unsigned int)default_driver);
+
+	if (!error && driver == NULL)
+		PrintError("Error: Unsupported driver version %ld\n", default_driver);
+
+	if (error)
+	{
+		free(manifest);
+		return false;
+	}
+
+	// Both lists share the banks, so sound effects follow the music in them
+	BankEnd *bank_ends = NULL;
+	size_t bank_end_count = 0;
+	bool success = true;
+
+	for (SongList list = SONG_LIST_MUSIC; list <= SONG_LIST_SFX; ++list)
+	{
+		PlacedSong *placed_songs;
+		size_t placed_song_count;
+
+		char table_key[0x20], banks_key[0x20];
+		sprintf(table_key, "%s_table", list_names[list]);
+		sprintf(banks_key, "%s_banks", list_names[list]);
+
+		char *table_file_name = JSON_GetString(JSON_Find(manifest, table_key));
+		char *banks_file_name = JSON_GetString(JSON_Find(manifest, banks_key));
+
+		success &= BuildList(manifest, list, (unsigned int)default_driver, (size_t)base_offset, (size_t)bank_size, &placed_songs, &placed_song_count, &bank_ends, &bank_end_count);
+
+		error = false;
+
+		if (success)
+			success &= WriteTables(driver, placed_songs, placed_song_count, table_file_name, banks_file_name);
+
+		free(placed_songs);
+		free(table_file_name);
+		free(banks_file_name);
+	}
+
+	for (size_t i = 0; i < output_file_name_count; ++i)
+		free(output_file_names[i]);
+
+	free(output_file_names);
+	output_file_names = NULL;
+	output_file_name_count = 0;
+
+	free(bank_ends);
+	free(manifest);
+
+	return success;
+}
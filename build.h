@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "object.h"
+
+// Assembles one song of the manifest, or returns NULL after saying why not
+extern Object* (*build_callback)(const char *file_name, unsigned int driver, size_t offset);
+
+bool Build(const char *manifest_file_name);
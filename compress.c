@@ -0,0 +1,550 @@
+#include "compress.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "memory_stream.h"
+
+// How many earlier occurrences of a pair of bytes the match finder tries
+// before settling for the best that it's found
+#define MAX_CHAIN_LENGTH 0x800
+
+#define LITERAL_COST (1 + 8)
+
+#define SAXMAN_MAX_DISTANCE 0xFFF
+#define SAXMAN_MIN_LENGTH 3
+#define SAXMAN_MAX_LENGTH 0x12
+#define SAXMAN_DICTIONARY_OFFSET 0x12	// Where the first byte goes in the Z80's ring buffer
+
+#define KOSINSKI_MAX_DISTANCE 0x2000
+#define KOSINSKI_MAX_LENGTH 0x100
+#define KOSINSKI_MAX_INLINE_DISTANCE 0x100
+#define KOSINSKI_MAX_INLINE_LENGTH 5
+#define KOSINSKI_MAX_SHORT_LENGTH 9
+
+// A literal byte, or a copy of what came before
+typedef struct Step
+{
+	size_t length;		// 1 for a literal
+	size_t distance;	// 0 for a copy of Saxman's zeroes from before the start
+} Step;
+
+static Compression compression;
+static MemoryStream *output_stream;
+
+// Descriptors are the bitfields that say what each step is
+static size_t descriptor_position;
+static unsigned int descriptor;
+static unsigned int descriptor_bits;	// How many are used, or left when decompressing
+static bool has_descriptor;
+
+static const unsigned char *input;
+static size_t input_size;
+static size_t input_position;
+
+static unsigned long *costs;	// Fewest bits to get to each position
+static Step *steps;		// Last step of the way there
+
+Compression FindCompression(const char *name)
+{
+	if (strcmp(name, "saxman") == 0)
+		return COMPRESSION_SAXMAN;
+	else if (strcmp(name, "kosinski") == 0)
+		return COMPRESSION_KOSINSKI;
+	else
+		return COMPRESSION_NONE;
+}
+
+static unsigned int GetDescriptorSize(void)
+{
+	return (compression == COMPRESSION_KOSINSKI) ? 16 : 8;
+}
+
+static void WriteByte(unsigned char value)
+{
+	MemoryStream_WriteByte(output_stream, value);
+}
+
+// Room is made for a descriptor where the decompressor will read it, and it's filled in once it's full
+static void StartDescriptor(void)
+{
+	descriptor_position = MemoryStream_GetPosition(output_stream);
+	descriptor = 0;
+	descriptor_bits = 0;
+	has_descriptor = true;
+
+	for (unsigned int i = 0; i < GetDescriptorSize(); i += 8)
+		WriteByte(0);
+}
+
+static void FinishDescriptor(void)
+{
+	MemoryStream_SetPosition(output_stream, descriptor_position, MEMORYSTREAM_START);
+
+	for (unsigned int i = 0; i < GetDescriptorSize(); i += 8)
+		WriteByte((descriptor >> i) & 0xFF);
+
+	MemoryStream_SetPosition(output_stream, 0, MEMORYSTREAM_END);
+	has_descriptor = false;
+}
+
+// Kosinski's decompressor reads the next descriptor as soon as the last one
+// runs out, so it goes before the rest of the step that used the last bit.
+// Saxman's waits until it needs another bit.
+static void PutBit(bool bit)
+{
+	if (!has_descriptor)
+		StartDescriptor();
+
+	descriptor |= (unsigned int)bit << descriptor_bits;
+
+	if (++descriptor_bits == GetDescriptorSize())
+	{
+		FinishDescriptor();
+
+		if (compression == COMPRESSION_KOSINSKI)
+			StartDescriptor();
+	}
+}
+
+// How many bits a copy takes, or 0 if one copy can't do it
+static unsigned int GetMatchCost(size_t distance, size_t length)
+{
+	if (compression == COMPRESSION_SAXMAN)
+		return (length >= SAXMAN_MIN_LENGTH && length <= SAXMAN_MAX_LENGTH) ? 1 + 16 : 0;
+	else if (length >= 2 && length <= KOSINSKI_MAX_INLINE_LENGTH && distance <= KOSINSKI_MAX_INLINE_DISTANCE)
+		return 2 + 2 + 8;
+	else if (length >= 3 && length <= KOSINSKI_MAX_SHORT_LENGTH)
+		return 2 + 16;
+	else if (length >= 3)
+		return 2 + 24;
+	else
+		return 0;
+}
+
+static void Relax(size_t position, size_t length, size_t distance, unsigned int cost)
+{
+	if (cost != 0 && costs[position] + cost < costs[position + length])
+	{
+		costs[position + length] = costs[position] + cost;
+		steps[position + length].length = length;
+		steps[position + length].distance = distance;
+	}
+}
+
+// Works out the cheapest way through the data, given every match that the
+// hash chains find, and returns its steps in order
+static Step* FindSteps(const unsigned char *data, size_t size, size_t *step_count)
+{
+	const size_t max_distance = (compression == COMPRESSION_SAXMAN) ? SAXMAN_MAX_DISTANCE : KOSINSKI_MAX_DISTANCE;
+	const size_t max_length = (compression == COMPRESSION_SAXMAN) ? SAXMAN_MAX_LENGTH : KOSINSKI_MAX_LENGTH;
+
+	// Every pair of bytes is its own hash, so chains only hold real matches
+	size_t *heads = malloc(sizeof(*heads) * 0x10000);
+	size_t *chain = malloc(sizeof(*chain) * (size + 1));
+
+	costs = malloc(sizeof(*costs) * (size + 1));
+	steps = malloc(sizeof(*steps) * (size + 1));
+
+	for (size_t i = 0; i < 0x10000; ++i)
+		heads[i] = SIZE_MAX;
+
+	costs[0] = 0;
+
+	for (size_t i = 1; i <= size; ++i)
+		costs[i] = ULONG_MAX;
+
+	for (size_t position = 0; position < size; ++position)
+	{
+		Relax(position, 1, 0, LITERAL_COST);
+
+		if (size - position >= 2)
+		{
+			const unsigned int key = (data[position] << 8) | data[position + 1];
+			const size_t available = (size - position < max_length) ? size - position : max_length;
+			size_t longest = 1;
+			unsigned int chain_length = 0;
+
+			// The chain goes from nearest to furthest, so each length is
+			// first reached at the shortest distance that has it
+			for (size_t candidate = heads[key]; candidate != SIZE_MAX && position - candidate <= max_distance && chain_length < MAX_CHAIN_LENGTH; candidate = chain[candidate], ++chain_length)
+			{
+				size_t length = 2;
+
+				while (length < available && data[candidate + length] == data[position + length])
+					++length;
+
+				if (length > longest)
+				{
+					for (size_t i = longest + 1; i <= length; ++i)
+						Relax(position, i, position - candidate, GetMatchCost(position - candidate, i));
+
+					longest = length;
+
+					if (length == available)
+						break;
+				}
+			}
+
+			chain[position] = heads[key];
+			heads[key] = position;
+		}
+
+		// Saxman's decompressor reads zeroes from before the start of the data
+		if (compression == COMPRESSION_SAXMAN && position < SAXMAN_MAX_DISTANCE)
+			for (size_t length = 1; length <= max_length && position + length <= size && data[position + length - 1] == 0; ++length)
+				Relax(position, length, 0, GetMatchCost(0, length));
+	}
+
+	*step_count = 0;
+
+	for (size_t position = size; position != 0; position -= steps[position].length)
+		++*step_count;
+
+	Step *path = malloc(sizeof(*path) * (*step_count + 1));
+	size_t step = *step_count;
+
+	for (size_t position = size; position != 0; position -= steps[position].length)
+		path[--step] = steps[position];
+
+	free(heads);
+	free(chain);
+	free(costs);
+	free(steps);
+
+	return path;
+}
+
+static void WriteSaxmanMatch(size_t position, const Step *step)
+{
+	// Copies are from a position in a $1000-byte ring buffer, where the
+	// decompressor turns ones that are further back than the start into zeroes
+	const size_t source = (step->distance == 0) ? position + 1 : position - step->distance;
+	const unsigned int index = (source - SAXMAN_DICTIONARY_OFFSET) & 0xFFF;
+
+	PutBit(false);
+	WriteByte(index & 0xFF);
+	WriteByte(((index >> 4) & 0xF0) | (step->length - SAXMAN_MIN_LENGTH));
+}
+
+static void WriteKosinskiMatch(const Step *step)
+{
+	if (step->length <= KOSINSKI_MAX_INLINE_LENGTH && step->distance <= KOSINSKI_MAX_INLINE_DISTANCE)
+	{
+		PutBit(false);
+		PutBit(false);
+		PutBit(((step->length - 2) >> 1) & 1);
+		PutBit((step->length - 2) & 1);
+		WriteByte(0x100 - step->distance);
+	}
+	else
+	{
+		// The distance is a negative 13-bit number
+		const unsigned int offset = KOSINSKI_MAX_DISTANCE - step->distance;
+
+		PutBit(false);
+		PutBit(true);
+		WriteByte(offset & 0xFF);
+
+		if (step->length <= KOSINSKI_MAX_SHORT_LENGTH)
+		{
+			WriteByte(((offset >> 5) & 0xF8) | (step->length - 2));
+		}
+		else
+		{
+			WriteByte((offset >> 5) & 0xF8);
+			WriteByte(step->length - 1);
+		}
+	}
+}
+
+bool Compress(Compression p_compression, const unsigned char *data, size_t size, MemoryStream *p_output_stream)
+{
+	compression = p_compression;
+	output_stream = p_output_stream;
+	has_descriptor = false;
+
+	if (compression == COMPRESSION_NONE)
+	{
+		MemoryStream_WriteBytes(output_stream, (unsigned char*)data, size);
+		return true;
+	}
+
+	const size_t start = MemoryStream_GetPosition(output_stream);
+
+	// Saxman's size goes in front
+	if (compression == COMPRESSION_SAXMAN)
+	{
+		WriteByte(0);
+		WriteByte(0);
+	}
+
+	size_t step_count;
+	Step *path = FindSteps(data, size, &step_count);
+	size_t position = 0;
+
+	for (size_t i = 0; i < step_count; ++i)
+	{
+		if (path[i].length == 1)
+		{
+			PutBit(true);
+			WriteByte(data[position]);
+		}
+		else if (compression == COMPRESSION_SAXMAN)
+		{
+			WriteSaxmanMatch(position, &path[i]);
+		}
+		else
+		{
+			WriteKosinskiMatch(&path[i]);
+		}
+
+		position += path[i].length;
+	}
+
+	free(path);
+
+	// Kosinski ends with a long copy whose length is 0
+	if (compression == COMPRESSION_KOSINSKI)
+	{
+		PutBit(false);
+		PutBit(true);
+		WriteByte(0x00);
+		WriteByte(0xF0);
+		WriteByte(0x00);
+	}
+
+	if (has_descriptor)
+		FinishDescriptor();
+
+	if (compression == COMPRESSION_SAXMAN)
+	{
+		const size_t compressed_size = MemoryStream_GetPosition(output_stream) - start - 2;
+
+		if (compressed_size > 0xFFFF)
+		{
+			PrintError("Error: $%zX bytes of Saxman-compressed data is too much for its 16-bit size\n", compressed_size);
+			return false;
+		}
+
+		MemoryStream_SetPosition(output_stream, start, MEMORYSTREAM_START);
+		WriteByte(compressed_size & 0xFF);
+		WriteByte(compressed_size >> 8);
+		MemoryStream_SetPosition(output_stream, 0, MEMORYSTREAM_END);
+	}
+
+	return true;
+}
+
+static bool ReadByte(unsigned int *value)
+{
+	if (input_position == input_size)
+	{
+		PrintError("Error: Compressed data ends in the middle of a step\n");
+		return false;
+	}
+
+	*value = input[input_position++];
+	return true;
+}
+
+static bool ReadDescriptor(void)
+{
+	descriptor = 0;
+	descriptor_bits = GetDescriptorSize();
+
+	for (unsigned int i = 0; i < GetDescriptorSize(); i += 8)
+	{
+		unsigned int value;
+
+		if (!ReadByte(&value))
+			return false;
+
+		descriptor |= value << i;
+	}
+
+	return true;
+}
+
+static bool ReadBit(bool *bit)
+{
+	if (descriptor_bits == 0 && !ReadDescriptor())
+		return false;
+
+	*bit = descriptor & 1;
+	descriptor >>= 1;
+
+	if (--descriptor_bits == 0 && compression == COMPRESSION_KOSINSKI && !ReadDescriptor())
+		return false;
+
+	return true;
+}
+
+// Copies from earlier in the output, which starts at 'start', byte by byte so
+// that copies can overlap themselves
+static bool Copy(size_t start, size_t distance, size_t length)
+{
+	const size_t position = MemoryStream_GetPosition(output_stream) - start;
+
+	if (distance > position)
+	{
+		if (compression != COMPRESSION_SAXMAN)
+		{
+			PrintError("Error: Compressed data copies from $%zX bytes before its start\n", distance - position);
+			return false;
+		}
+
+		for (size_t i = 0; i < length; ++i)
+			WriteByte(0);
+	}
+	else
+	{
+		for (size_t i = 0; i < length; ++i)
+			WriteByte(MemoryStream_GetBuffer(output_stream)[start + position - distance + i]);
+	}
+
+	return true;
+}
+
+static bool DecompressSaxman(size_t start)
+{
+	if (input_size < 2)
+	{
+		PrintError("Error: Saxman-compressed data is missing its size\n");
+		return false;
+	}
+
+	const size_t compressed_size = input[0] | (input[1] << 8);
+
+	if (compressed_size > input_size - 2)
+	{
+		PrintError("Error: Saxman-compressed data says it's $%zX bytes, but there are only $%zX\n", compressed_size, input_size - 2);
+		return false;
+	}
+
+	input_position = 2;
+	input_size = 2 + compressed_size;
+
+	while (input_position != input_size)
+	{
+		bool literal;
+		unsigned int first, second;
+
+		if (descriptor_bits == 0 && (!ReadDescriptor() || input_position == input_size))
+			break;
+
+		if (!ReadBit(&literal) || !ReadByte(&first))
+			return false;
+
+		if (literal)
+		{
+			WriteByte(first);
+		}
+		else
+		{
+			if (!ReadByte(&second))
+				return false;
+
+			const size_t position = MemoryStream_GetPosition(output_stream) - start;
+			const unsigned int index = ((first | ((second << 4) & 0xF00)) + SAXMAN_DICTIONARY_OFFSET) & 0xFFF;
+
+			if (!Copy(start, ((position - index - 1) & 0xFFF) + 1, (second & 0xF) + SAXMAN_MIN_LENGTH))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static bool DecompressKosinski(size_t start)
+{
+	if (!ReadDescriptor())
+		return false;
+
+	for (;;)
+	{
+		bool bit;
+		unsigned int first, second;
+
+		if (!ReadBit(&bit))
+			return false;
+
+		if (bit)
+		{
+			if (!ReadByte(&first))
+				return false;
+
+			WriteByte(first);
+			continue;
+		}
+
+		if (!ReadBit(&bit))
+			return false;
+
+		if (bit)
+		{
+			if (!ReadByte(&first) || !ReadByte(&second))
+				return false;
+
+			size_t length = (second & 7) + 2;
+
+			// A count of 0 means that the real one follows, where 0 ends the data and 1 does nothing
+			if ((second & 7) == 0)
+			{
+				unsigned int count;
+
+				if (!ReadByte(&count))
+					return false;
+
+				if (count == 0)
+					return true;
+				else if (count == 1)
+					continue;
+
+				length = count + 1;
+			}
+
+			if (!Copy(start, KOSINSKI_MAX_DISTANCE - (((second & 0xF8) << 5) | first), length))
+				return false;
+		}
+		else
+		{
+			bool high, low;
+
+			if (!ReadBit(&high) || !ReadBit(&low) || !ReadByte(&first))
+				return false;
+
+			if (!Copy(start, 0x100 - first, ((high << 1) | low) + 2))
+				return false;
+		}
+	}
+}
+
+bool Decompress(Compression p_compression, const unsigned char *data, size_t size, MemoryStream *p_output_stream)
+{
+	compression = p_compression;
+	output_stream = p_output_stream;
+	input = data;
+	input_size = size;
+	input_position = 0;
+	descriptor_bits = 0;
+	error = false;
+
+	switch (compression)
+	{
+		case COMPRESSION_SAXMAN:
+			return DecompressSaxman(MemoryStream_GetPosition(output_stream));
+
+		case COMPRESSION_KOSINSKI:
+			return DecompressKosinski(MemoryStream_GetPosition(output_stream));
+
+		default:
+			MemoryStream_WriteBytes(output_stream, (unsigned char*)data, size);
+			return true;
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "memory_stream.h"
+
+typedef enum Compression
+{
+	COMPRESSION_NONE,
+	COMPRESSION_SAXMAN,	// Sonic 2's music, with its size in front
+	COMPRESSION_KOSINSKI
+} Compression;
+
+Compression FindCompression(const char *name);
+bool Compress(Compression compression, const unsigned char *data, size_t size, MemoryStream *output_stream);
+bool Decompress(Compression compression, const unsigned char *data, size_t size, MemoryStream *output_stream);
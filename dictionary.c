@@ -8,26 +8,24 @@
 
 #include "error.h"
 
-DictionaryEntry *dictionary_head;
+#define DICTIONARY_BUCKETS 0x1000
+
+static DictionaryEntry *dictionary_buckets[DICTIONARY_BUCKETS];
 
 const char *undefined_symbol;
 
-void AddDictionaryEntry(const char *name, long value)
+unsigned long HashSymbol(const char *name)
 {
-	for (DictionaryEntry *entry = dictionary_head; entry != NULL; entry = entry->next)
-		if (strcmp(entry->name, name) == 0)
-			PrintError("Error: Symbol '%s' double-defined\n", name);
+	// FNV-1a
+	unsigned long hash = 0x811C9DC5;
 
-	DictionaryEntry *entry = malloc(sizeof(*entry));
-	entry->next = dictionary_head;
-	dictionary_head = entry;
+	for (; *name != '\0'; ++name)
+		hash = ((hash ^ (unsigned char)*name) * 0x01000193) & 0xFFFFFFFF;
 
-	entry->name = malloc(strlen(name) + 1);
-	strcpy(entry->name, name);
-	entry->value = value;
+	return hash;
 }
 
-long LookupDictionary(const char *name)
+bool ParseLiteral(const char *name, long *value)
 {
 	// Check if the symbol is actually a literal
 	if (name[0] == '-' || name[0] == '$' || (name[0] >= '0' && name[0] <= '9'))
@@ -37,43 +35,83 @@ long LookupDictionary(const char *name)
 		if (negative)
 			++name;
 
-		long value;
-
 		if (name[0] == '$')
 		{
 			// Hexadecimal literal
-			value = strtol(name + 1, NULL, 0x10);
+			*value = strtol(name + 1, NULL, 0x10);
 		}
 		else
 		{
 			// Decimal literal
-			value = strtol(name, NULL, 10);
+			*value = strtol(name, NULL, 10);
 		}
 
 		if (negative)
-			value = -value;
+			*value = -*value;
 
-		return value;
+		return true;
 	}
 
-	// Failing that, look up the symbol in the dictionary
-	for (DictionaryEntry *entry = dictionary_head; entry != NULL; entry = entry->next)
-		if (strcmp(entry->name, name) == 0)
+	return false;
+}
+
+void AddDictionaryEntryHashed(const char *name, unsigned long hash, long value)
+{
+	DictionaryEntry **bucket = &dictionary_buckets[hash % DICTIONARY_BUCKETS];
+
+	for (DictionaryEntry *entry = *bucket; entry != NULL; entry = entry->next)
+		if (entry->hash == hash && strcmp(entry->name, name) == 0)
+			PrintError("Error: Symbol '%s' double-defined\n", name);
+
+	DictionaryEntry *entry = malloc(sizeof(*entry));
+	entry->next = *bucket;
+	*bucket = entry;
+
+	entry->name = malloc(strlen(name) + 1);
+	strcpy(entry->name, name);
+	entry->hash = hash;
+	entry->value = value;
+}
+
+void AddDictionaryEntry(const char *name, long value)
+{
+	AddDictionaryEntryHashed(name, HashSymbol(name), value);
+}
+
+long LookupDictionaryHashed(const char *name, unsigned long hash)
+{
+	for (DictionaryEntry *entry = dictionary_buckets[hash % DICTIONARY_BUCKETS]; entry != NULL; entry = entry->next)
+		if (entry->hash == hash && strcmp(entry->name, name) == 0)
 			return entry->value;
 
 	undefined_symbol = name;
 	return 0;
 }
 
+long LookupDictionary(const char *name)
+{
+	long value;
+
+	if (ParseLiteral(name, &value))
+		return value;
+
+	// Failing that, look up the symbol in the dictionary
+	return LookupDictionaryHashed(name, HashSymbol(name));
+}
+
 void ClearDictionary(void)
 {
-	DictionaryEntry *entry = dictionary_head;
-	while (entry != NULL)
+	for (unsigned int i = 0; i < DICTIONARY_BUCKETS; ++i)
 	{
-		DictionaryEntry *next_entry = entry->next;
-		free(entry);
-		entry = next_entry;
-	}
+		DictionaryEntry *entry = dictionary_buckets[i];
+		while (entry != NULL)
+		{
+			DictionaryEntry *next_entry = entry->next;
+			free(entry->name);
+			free(entry);
+			entry = next_entry;
+		}
 
-	dictionary_head = NULL;
+		dictionary_buckets[i] = NULL;
+	}
 }
@@ -1,16 +1,22 @@
 #pragma once
 
+#include <stdbool.h>
+
 typedef struct DictionaryEntry
 {
 	struct DictionaryEntry *next;
 
 	char *name;
+	unsigned long hash;
 	long value;
 } DictionaryEntry;
 
-extern DictionaryEntry *dictionary_head;
 extern const char *undefined_symbol;
 
+unsigned long HashSymbol(const char *name);
+bool ParseLiteral(const char *name, long *value);
 void AddDictionaryEntry(const char *name, long value);
+void AddDictionaryEntryHashed(const char *name, unsigned long hash, long value);
 long LookupDictionary(const char *name);
+long LookupDictionaryHashed(const char *name, unsigned long hash);
 void ClearDictionary(void);
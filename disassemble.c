@@ -0,0 +1,748 @@
+#include "disassemble.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver.h"
+#include "error.h"
+#include "instruction.h"
+#include "ir.h"
+#include "song.h"
+#include "voice.h"
+
+#define MUSIC_HEADER_SIZE 6
+#define SFX_HEADER_SIZE 4
+#define SFX_CHANNEL_SIZE 6
+
+// What starts at each position of the song
+typedef enum Item
+{
+	ITEM_NONE,	// Byte that nothing reads, written as it is
+	ITEM_COMMAND,
+	ITEM_VOICE
+} Item;
+
+// The macro that writes each coordination flag, or NULL for flags that
+// only dc.b can write. Their arguments are their bytes, in order.
+static const char* const flag_macros[COORDINATION_FLAG_COUNT] = {
+	[COORDINATION_FLAG_PAN] = "smpsPan",
+	[COORDINATION_FLAG_DETUNE] = "smpsDetune",
+	[COORDINATION_FLAG_NOP] = "smpsNop",
+	[COORDINATION_FLAG_FADE] = "smpsFade",
+	[COORDINATION_FLAG_RETURN] = "smpsReturn",
+	[COORDINATION_FLAG_STOP_FM] = "smpsStopFM",
+	[COORDINATION_FLAG_FADE_IN] = "smpsFade",
+	[COORDINATION_FLAG_SET_VOL] = "smpsSetVol",
+	[COORDINATION_FLAG_CHAN_TEMPO_DIV] = "smpsChanTempoDiv",
+	[COORDINATION_FLAG_FM_ALTER_VOL] = "smpsFMAlterVol",
+	[COORDINATION_FLAG_ALTER_VOL] = "smpsAlterVol",
+	[COORDINATION_FLAG_NOTE_FILL] = "smpsNoteFill",
+	[COORDINATION_FLAG_CHANGE_TRANSPOSITION] = "smpsChangeTransposition",
+	[COORDINATION_FLAG_SPINDASH_REV] = "smpsSpindashRev",
+	[COORDINATION_FLAG_SET_TEMPO_MOD] = "smpsSetTempoMod",
+	[COORDINATION_FLAG_PLAY_DAC_SAMPLE] = "smpsPlayDACSample",
+	[COORDINATION_FLAG_SET_TEMPO_DIV] = "smpsSetTempoDiv",
+	[COORDINATION_FLAG_CONDITIONAL_JUMP] = "smpsConditionalJump",
+	[COORDINATION_FLAG_PSG_ALTER_VOL] = "smpsPSGAlterVol",
+	[COORDINATION_FLAG_CLEAR_PUSH] = "smpsClearPush",
+	[COORDINATION_FLAG_SET_NOTE] = "smpsSetNote",
+	[COORDINATION_FLAG_STOP_SPECIAL] = "smpsStopSpecial",
+	[COORDINATION_FLAG_FMI_COMMAND] = "smpsFMICommand",
+	[COORDINATION_FLAG_FM_VOICE] = "smpsFMvoice",
+	[COORDINATION_FLAG_MOD_SET] = "smpsModSet",
+	[COORDINATION_FLAG_MOD_ON] = "smpsModOn",
+	[COORDINATION_FLAG_MOD_CHANGE_2] = "smpsModChange2",
+	[COORDINATION_FLAG_STOP] = "smpsStop",
+	[COORDINATION_FLAG_PSG_FORM] = "smpsPSGform",
+	[COORDINATION_FLAG_MOD_OFF] = "smpsModOff",
+	[COORDINATION_FLAG_MOD_CHANGE] = "smpsModChange",
+	[COORDINATION_FLAG_PSG_VOICE] = "smpsPSGvoice",
+	[COORDINATION_FLAG_JUMP] = "smpsJump",
+	[COORDINATION_FLAG_LOOP] = "smpsLoop",
+	[COORDINATION_FLAG_CALL] = "smpsCall",
+	[COORDINATION_FLAG_MAX_REL_RATE] = "smpsMaxRelRate",
+	[COORDINATION_FLAG_CONTINUOUS_LOOP] = "smpsContinuousLoop",
+	[COORDINATION_FLAG_ALTERNATE_SMPS] = "smpsAlternateSMPS",
+	[COORDINATION_FLAG_FM3_SPECIAL_MODE] = "smpsFM3SpecialMode",
+	[COORDINATION_FLAG_PLAY_SOUND] = "smpsPlaySound",
+	[COORDINATION_FLAG_HALT_MUSIC] = "smpsHaltMusic",
+	[COORDINATION_FLAG_COPY_DATA] = "smpsCopyData",
+	[COORDINATION_FLAG_SSG_EG] = "smpsSSGEG",
+	[COORDINATION_FLAG_FM_VOL_ENV] = "smpsFMVolEnv",
+	[COORDINATION_FLAG_RESET_SPINDASH_REV] = "smpsResetSpindashRev",
+	[COORDINATION_FLAG_CHAN_FM_COMMAND] = "smpsChanFMCommand",
+	[COORDINATION_FLAG_PITCH_SLIDE] = "smpsPitchSlide",
+	[COORDINATION_FLAG_SET_LFO] = "smpsSetLFO",
+	[COORDINATION_FLAG_PLAY_MUSIC] = "smpsPlayMusic"
+};
+
+static const char* const pan_names[4] = {"panNone", "panRight", "panLeft", "panCentre"};
+
+static const unsigned char *data;
+static size_t size;
+static const Driver *driver;
+static size_t offset;
+static const char *name;
+static IR *ir;
+
+// A track that still needs decoding
+typedef struct Pending
+{
+	size_t position;
+	bool dac;
+} Pending;
+
+static unsigned char *items;
+static unsigned char *item_sizes;
+static bool *covered;
+static bool *dac;	// Set for commands in the DAC's track, whose notes are samples
+static char **labels;
+
+static Pending *pending;
+static size_t pending_count;
+
+static unsigned int ReadShort(size_t position)
+{
+	return driver->big_endian ? (data[position] << 8) | data[position + 1] : data[position] | (data[position + 1] << 8);
+}
+
+// Works out where a pointer goes, as a position within the song, which may
+// be outside of it
+static long GetPointerTarget(size_t site, SongPointer pointer)
+{
+	const unsigned int value = ReadShort(site);
+
+	switch (pointer)
+	{
+		case SONG_POINTER_SONG_RELATIVE:
+			return value;
+
+		case SONG_POINTER_TRACK_RELATIVE:
+			return (long)site + 1 + ((value & 0x8000) ? (long)value - 0x10000 : (long)value);
+
+		default:
+			return (long)value - (long)offset;
+	}
+}
+
+static bool IsInside(long position)
+{
+	return position >= 0 && (size_t)position <= size;
+}
+
+static void SetLabel(size_t position, const char *format, unsigned int number)
+{
+	if (labels[position] == NULL)
+	{
+		const size_t label_size = strlen(name) + strlen(format) + 16;
+
+		labels[position] = malloc(label_size);
+		snprintf(labels[position], label_size, "%s_", name);
+		snprintf(labels[position] + strlen(labels[position]), label_size - strlen(labels[position]), format, number);
+	}
+}
+
+static void AddNumber(unsigned long value)
+{
+	char argument[16];
+
+	snprintf(argument, sizeof(argument), (value > 0xFF) ? "$%04lX" : "$%02lX", value);
+	IR_AddArgument(ir, argument);
+}
+
+// Writes a pointer as the label of what it points to, or as an address if that's outside of the song
+static void AddPointer(size_t site, SongPointer pointer)
+{
+	const long target = GetPointerTarget(site, pointer);
+
+	if (IsInside(target))
+		IR_AddArgument(ir, labels[target]);
+	else
+		AddNumber((unsigned long)(target + (long)offset) & 0xFFFF);
+}
+
+// Writes a value as the driver's symbol for it if it has one, so that
+// assembling for another driver gives that driver's value instead
+static void AddSymbol(const char *symbol, unsigned long value)
+{
+	if (symbol != NULL)
+		IR_AddArgument(ir, symbol);
+	else
+		AddNumber(value);
+}
+
+// Finds every track's commands, following jumps, calls and loops
+static void DecodeTracks(void)
+{
+	const SongPointer pointer = driver->relative_pointers ? SONG_POINTER_TRACK_RELATIVE : SONG_POINTER_ABSOLUTE;
+
+	while (pending_count != 0 && !error)
+	{
+		// Code that several tracks share belongs to whichever gets to it first
+		const Pending track = pending[--pending_count];
+		size_t position = track.position;
+
+		while (items[position] != ITEM_COMMAND)
+		{
+			if (position >= size)
+			{
+				PrintError("Error: Track at $%zX runs off the end of the data\n", position);
+				break;
+			}
+
+			SongNode command;
+
+			if (!Song_DecodeCommand(driver, &data[position], size - position, &command))
+			{
+				PrintError("Error: Unknown coordination flag $%02X at $%zX\n", data[position], position);
+				break;
+			}
+
+			for (size_t i = 0; i < command.size; ++i)
+			{
+				if (covered[position + i])
+				{
+					PrintError("Error: Track data at $%zX overlaps something else\n", position + i);
+					return;
+				}
+
+				covered[position + i] = true;
+			}
+
+			items[position] = ITEM_COMMAND;
+			item_sizes[position] = command.size;
+			dac[position] = track.dac;
+
+			if (command.pointer != SONG_POINTER_NONE)
+			{
+				const long target = GetPointerTarget(position + command.pointer_offset, pointer);
+
+				if (IsInside(target))
+				{
+					SetLabel(target, "Loc%04X", (unsigned int)target);
+
+					if ((size_t)target < size)
+						pending[pending_count++] = (Pending){target, track.dac};
+				}
+			}
+
+			const FlagFlow flow = (command.kind == SONG_NODE_FLAG) ? coordination_flag_layouts[command.flag].flow : FLOW_NEXT;
+
+			if (flow == FLOW_STOP || flow == FLOW_RETURN || flow == FLOW_JUMP)
+				break;
+
+			position += command.size;
+		}
+	}
+}
+
+// Claims the voices from the header's pointer up to whatever comes after them
+static void FindVoices(long voices)
+{
+	if (voices < 0 || (size_t)voices >= size)
+		return;
+
+	for (size_t position = voices; position + VOICE_SIZE <= size; position += VOICE_SIZE)
+	{
+		for (size_t i = 0; i < VOICE_SIZE; ++i)
+			if (covered[position + i] || (i != 0 && labels[position + i] != NULL))
+				return;
+
+		memset(&covered[position], true, VOICE_SIZE);
+		items[position] = ITEM_VOICE;
+		item_sizes[position] = VOICE_SIZE;
+	}
+}
+
+// Which operators are carriers, and so have their TL bit 7 set in S3K-style voices
+static unsigned int GetCarrierMask(unsigned int algorithm, unsigned int operator)
+{
+	const unsigned int carrier_masks[4] = {
+		0x80,
+		(algorithm >= 5) << 7,
+		(algorithm >= 4) << 7,
+		(algorithm == 7) << 7
+	};
+
+	return carrier_masks[operator];
+}
+
+// SMPS2ASM version 0 voices have their carriers' TL bit 7 set for them. That
+// only suits songs whose every voice already has them set that way.
+static unsigned int GetSMPS2ASMVersion(void)
+{
+	if (driver->version < 3)
+		return 1;
+
+	for (size_t position = 0; position < size; ++position)
+	{
+		if (items[position] == ITEM_VOICE)
+		{
+			const unsigned char *voice = &data[position];
+
+			for (unsigned int i = 0; i < 4; ++i)
+			{
+				const unsigned int operator = driver->voice_operator_order[i];
+
+				if ((voice[21 + i] & 0x80) != GetCarrierMask(voice[0] & 7, operator))
+					return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+// Writes one of the smpsVc* macros, with one field from each operator
+static void AddVoiceOperators(const char *macro, const unsigned char *bytes, unsigned int shift, unsigned int mask, unsigned int algorithm, bool strip_carriers)
+{
+	unsigned int values[4];
+
+	// The bytes are in the driver's operator order, and the macro's arguments are not
+	for (unsigned int i = 0; i < 4; ++i)
+	{
+		const unsigned int operator = driver->voice_operator_order[i];
+
+		values[operator] = (bytes[i] >> shift) & mask;
+
+		if (strip_carriers)
+			values[operator] &= ~GetCarrierMask(algorithm, operator);
+	}
+
+	IR_AddLine(ir, NULL, macro);
+
+	for (unsigned int i = 0; i < 4; ++i)
+		AddNumber(values[i]);
+}
+
+static void AddVoice(size_t position, unsigned int smps2asm_version)
+{
+	const unsigned char *voice = &data[position];
+	const unsigned int algorithm = voice[0] & 7;
+
+	IR_AddLine(ir, labels[position], "smpsVcAlgorithm");
+	AddNumber(algorithm);
+	IR_AddLine(ir, NULL, "smpsVcFeedback");
+	AddNumber((voice[0] >> 3) & 7);
+
+	IR_AddLine(ir, NULL, "smpsVcUnusedBits");
+	AddNumber(voice[0] >> 6);
+
+	// Version 0's smpsVcAmpMod takes these bits as well
+	if (smps2asm_version != 0)
+	{
+		unsigned char unused_bits[4];
+
+		for (unsigned int i = 0; i < 4; ++i)
+			unused_bits[driver->voice_operator_order[i]] = voice[9 + i] & 0x60;
+
+		for (unsigned int i = 0; i < 4; ++i)
+			AddNumber(unused_bits[i]);
+	}
+
+	AddVoiceOperators("smpsVcDetune", &voice[1], 4, 0xF, algorithm, false);
+	AddVoiceOperators("smpsVcCoarseFreq", &voice[1], 0, 0xF, algorithm, false);
+	AddVoiceOperators("smpsVcRateScale", &voice[5], 6, 3, algorithm, false);
+	AddVoiceOperators("smpsVcAttackRate", &voice[5], 0, 0x3F, algorithm, false);
+
+	if (smps2asm_version == 0)
+		AddVoiceOperators("smpsVcAmpMod", &voice[9], 5, 7, algorithm, false);
+	else
+		AddVoiceOperators("smpsVcAmpMod", &voice[9], 7, 1, algorithm, false);
+
+	AddVoiceOperators("smpsVcDecayRate1", &voice[9], 0, 0x1F, algorithm, false);
+	AddVoiceOperators("smpsVcDecayRate2", &voice[13], 0, 0xFF, algorithm, false);
+	AddVoiceOperators("smpsVcDecayLevel", &voice[17], 4, 0xF, algorithm, false);
+	AddVoiceOperators("smpsVcReleaseRate", &voice[17], 0, 0xF, algorithm, false);
+	AddVoiceOperators("smpsVcTotalLevel", &voice[21], 0, 0xFF, algorithm, smps2asm_version == 0);
+}
+
+static void AddCommand(size_t position)
+{
+	SongNode command;
+
+	Song_DecodeCommand(driver, &data[position], item_sizes[position], &command);
+
+	const CoordinationFlag flag = command.flag;
+	const unsigned char *arguments = &command.bytes[driver->coordination_flags[flag].size];
+	const size_t argument_count = (command.pointer != SONG_POINTER_NONE ? command.pointer_offset : command.size) - driver->coordination_flags[flag].size;
+
+	switch (flag)
+	{
+		case COORDINATION_FLAG_PAN:
+			// Direction and AMS/FMS are added together
+			IR_AddLine(ir, labels[position], "smpsPan");
+			AddSymbol(pan_names[arguments[0] >> 6], arguments[0] & 0xC0);
+			AddNumber(arguments[0] & 0x3F);
+			return;
+
+		case COORDINATION_FLAG_FM_VOICE:
+			IR_AddLine(ir, labels[position], "smpsFMvoice");
+
+			if (argument_count == 2)
+			{
+				// A voice from another song
+				AddNumber(arguments[0] & 0x7F);
+				AddNumber((arguments[1] - 0x81) & 0xFF);
+			}
+			else
+			{
+				AddNumber(arguments[0]);
+			}
+
+			return;
+
+		case COORDINATION_FLAG_MOD_CHANGE:
+			// What smpsModOn means to Sonic 3's driver
+			if (arguments[0] == 0x80)
+			{
+				IR_AddLine(ir, labels[position], "smpsModOn");
+				return;
+			}
+
+			break;
+
+		case COORDINATION_FLAG_PLAY_DAC_SAMPLE:
+			IR_AddLine(ir, labels[position], "smpsPlayDACSample");
+			AddSymbol(GetDACSampleName(driver->version, arguments[0] | 0x80), arguments[0]);
+			return;
+
+		case COORDINATION_FLAG_PSG_VOICE:
+			IR_AddLine(ir, labels[position], "smpsPSGvoice");
+			AddSymbol(GetPSGEnvelopeName(driver->version, arguments[0]), arguments[0]);
+			return;
+
+		case COORDINATION_FLAG_COPY_DATA:
+			IR_AddLine(ir, labels[position], "smpsCopyData");
+			AddNumber(driver->big_endian ? (arguments[0] << 8) | arguments[1] : arguments[0] | (arguments[1] << 8));
+			AddNumber(arguments[2]);
+			return;
+
+		default:
+			break;
+	}
+
+	if (flag_macros[flag] == NULL)
+	{
+		IR_AddLine(ir, labels[position], "dc.b");
+
+		for (size_t i = 0; i < command.size; ++i)
+			AddNumber(command.bytes[i]);
+
+		return;
+	}
+
+	IR_AddLine(ir, labels[position], flag_macros[flag]);
+
+	for (size_t i = 0; i < argument_count; ++i)
+		AddNumber(arguments[i]);
+
+	if (command.pointer != SONG_POINTER_NONE)
+		AddPointer(position + command.pointer_offset, command.pointer);
+}
+
+// Notes, durations and smpsNoAttack are written with dc.b
+static bool IsInline(size_t position)
+{
+	SongNode command;
+
+	if (items[position] != ITEM_COMMAND)
+		return false;
+
+	Song_DecodeCommand(driver, &data[position], item_sizes[position], &command);
+
+	return command.kind != SONG_NODE_FLAG || command.flag == COORDINATION_FLAG_NO_ATTACK;
+}
+
+// Writes a run of notes and durations, or of bytes that nothing reads, as dc.b
+static size_t AddBytes(size_t position)
+{
+	const size_t start = position;
+	const bool inline_commands = items[start] == ITEM_COMMAND;
+
+	IR_AddLine(ir, labels[position], "dc.b");
+
+	do
+	{
+		// smpsNoAttack's value depends on the driver
+		if (inline_commands && data[position] >= 0xE0)
+			IR_AddArgument(ir, "smpsNoAttack");
+		else if (inline_commands && dac[position] && data[position] > 0x80)
+			AddSymbol(GetDACSampleName(driver->version, data[position]), data[position]);
+		else if (inline_commands)
+			AddSymbol(GetNoteName(data[position]), data[position]);
+		else
+			AddNumber(data[position]);
+
+		++position;
+	} while (position < size && position - start < 0x10 && labels[position] == NULL && (inline_commands ? IsInline(position) : items[position] == ITEM_NONE));
+
+	return position;
+}
+
+static const char* GetSFXChannelName(unsigned int id)
+{
+	switch (id)
+	{
+		case 0x02: return "FM3";
+		case 0x04: return "FM4";
+		case 0x05: return "FM5";
+		case 0x06: return "FM6";
+		case 0x80: return "PSG1";
+		case 0xA0: return "PSG2";
+		case 0xC0: return "PSG3";
+		case 0xE0: return "Noise";
+		default: return NULL;
+	}
+}
+
+static bool HasVoicePointer(void)
+{
+	const unsigned int value = ReadShort(0);
+
+	return value != 0 && (driver->universal_voice_bank == 0 || value != driver->universal_voice_bank);
+}
+
+// Labels the header's channels and voices, and returns the header's size
+static size_t FindHeader(bool sfx)
+{
+	const SongPointer pointer = driver->relative_pointers ? SONG_POINTER_SONG_RELATIVE : SONG_POINTER_ABSOLUTE;
+
+	if (size < (sfx ? SFX_HEADER_SIZE : MUSIC_HEADER_SIZE))
+	{
+		PrintError("Error: $%zX bytes is too small for a header\n", size);
+		return 0;
+	}
+
+	const size_t header_size = sfx ? SFX_HEADER_SIZE + data[3] * SFX_CHANNEL_SIZE : MUSIC_HEADER_SIZE + data[2] * 4 + data[3] * 6;
+
+	if (size < header_size)
+	{
+		PrintError("Error: The header lists more channels than there is room for\n");
+		return 0;
+	}
+
+	memset(covered, true, header_size);
+	SetLabel(0, "Header", 0);
+
+	if (HasVoicePointer())
+	{
+		const long voices = GetPointerTarget(0, pointer);
+
+		if (IsInside(voices))
+			SetLabel(voices, "Voices", 0);
+	}
+
+	for (unsigned int i = 0; i < (sfx ? data[3] : data[2] + data[3]); ++i)
+	{
+		const size_t site = sfx ? SFX_HEADER_SIZE + i * SFX_CHANNEL_SIZE + 2 : MUSIC_HEADER_SIZE + ((i < data[2]) ? i * 4 : data[2] * 4 + (i - data[2]) * 6);
+		const long target = GetPointerTarget(site, pointer);
+
+		if (!IsInside(target) || (size_t)target == size)
+		{
+			PrintError("Error: Channel pointer at $%zX points outside of the song\n", site);
+			return 0;
+		}
+
+		// Tracks are named after the first channel that plays them
+		if (sfx && GetSFXChannelName(data[site - 1]) != NULL)
+			SetLabel(target, GetSFXChannelName(data[site - 1]), 0);
+		else if (sfx)
+			SetLabel(target, "Chan%02X", data[site - 1]);
+		else if (i == 0)
+			SetLabel(target, "DAC", 0);
+		else if (i < data[2])
+			SetLabel(target, "FM%u", i);
+		else
+			SetLabel(target, "PSG%u", i - data[2] + 1);
+
+		pending[pending_count++] = (Pending){target, !sfx && i == 0};
+	}
+
+	return header_size;
+}
+
+static void AddHeader(bool sfx, unsigned int smps2asm_version)
+{
+	const SongPointer pointer = driver->relative_pointers ? SONG_POINTER_SONG_RELATIVE : SONG_POINTER_ABSOLUTE;
+
+	IR_AddLine(ir, labels[0], "smpsHeaderStartSong");
+	AddNumber(driver->version);
+	AddNumber(smps2asm_version);
+
+	if (HasVoicePointer())
+	{
+		IR_AddLine(ir, NULL, "smpsHeaderVoice");
+		AddPointer(0, pointer);
+	}
+	else
+	{
+		IR_AddLine(ir, NULL, (ReadShort(0) == 0) ? "smpsHeaderVoiceNull" : "smpsHeaderVoiceUVB");
+	}
+
+	if (sfx)
+	{
+		IR_AddLine(ir, NULL, "smpsHeaderTempoSFX");
+		AddNumber(data[2]);
+		IR_AddLine(ir, NULL, "smpsHeaderChanSFX");
+		AddNumber(data[3]);
+
+		for (unsigned int i = 0; i < data[3]; ++i)
+		{
+			const size_t site = SFX_HEADER_SIZE + i * SFX_CHANNEL_SIZE;
+			const char *channel_name = GetSFXChannelName(data[site + 1]);
+
+			// smpsHeaderSFXChannel always writes $80 here
+			if (data[site] != 0x80)
+				PrintWarning("Warning: Playback control byte at $%zX is $%02X rather than $80\n", site, data[site]);
+
+			IR_AddLine(ir, NULL, "smpsHeaderSFXChannel");
+
+			if (channel_name != NULL)
+			{
+				char symbol[8];
+
+				snprintf(symbol, sizeof(symbol), "c%s", channel_name);
+				IR_AddArgument(ir, symbol);
+			}
+			else
+			{
+				AddNumber(data[site + 1]);
+			}
+
+			AddPointer(site + 2, pointer);
+			AddNumber(data[site + 4]);
+			AddNumber(data[site + 5]);
+		}
+	}
+	else
+	{
+		IR_AddLine(ir, NULL, "smpsHeaderChan");
+		AddNumber(data[2]);
+		AddNumber(data[3]);
+		IR_AddLine(ir, NULL, "smpsHeaderTempo");
+		AddNumber(data[4]);
+		AddNumber(data[5]);
+
+		for (unsigned int i = 0; i < data[2]; ++i)
+		{
+			const size_t site = MUSIC_HEADER_SIZE + i * 4;
+
+			IR_AddLine(ir, NULL, (i == 0) ? "smpsHeaderDAC" : "smpsHeaderFM");
+			AddPointer(site, pointer);
+			AddNumber(data[site + 2]);
+			AddNumber(data[site + 3]);
+		}
+
+		for (unsigned int i = 0; i < data[3]; ++i)
+		{
+			const size_t site = MUSIC_HEADER_SIZE + data[2] * 4 + i * 6;
+
+			IR_AddLine(ir, NULL, "smpsHeaderPSG");
+			AddPointer(site, pointer);
+
+			for (unsigned int j = 2; j < 5; ++j)
+				AddNumber(data[site + j]);
+
+			AddSymbol(GetPSGEnvelopeName(driver->version, data[site + 5]), data[site + 5]);
+		}
+	}
+}
+
+static void Cleanup(void)
+{
+	if (labels != NULL)
+		for (size_t i = 0; i <= size; ++i)
+			free(labels[i]);
+
+	free(items);
+	free(item_sizes);
+	free(covered);
+	free(dac);
+	free(labels);
+	free(pending);
+	items = NULL;
+	item_sizes = NULL;
+	covered = NULL;
+	dac = NULL;
+	labels = NULL;
+	pending = NULL;
+	pending_count = 0;
+}
+
+// Turns a compiled song back into the macros that would assemble it, with
+// labels named after 'name'. 'offset' is where it was assembled to.
+IR* Disassemble(const unsigned char *p_data, size_t p_size, unsigned int driver_version, size_t p_offset, bool sfx, const char *p_name)
+{
+	error = false;
+
+	data = p_data;
+	size = p_size;
+	driver = GetDriver(driver_version);
+	offset = p_offset;
+	name = p_name;
+	ir = NULL;
+
+	if (driver == NULL)
+	{
+		PrintError("Error: Unsupported driver version %u\n", driver_version);
+		return NULL;
+	}
+
+	items = calloc(size + 1, 1);
+	item_sizes = calloc(size + 1, 1);
+	covered = calloc(size + 1, sizeof(*covered));
+	dac = calloc(size + 1, sizeof(*dac));
+	labels = calloc(size + 1, sizeof(*labels));
+	pending = malloc(sizeof(*pending) * (size + 1));
+
+	const size_t header_size = FindHeader(sfx);
+
+	if (!error)
+		DecodeTracks();
+
+	if (!error && HasVoicePointer())
+		FindVoices(GetPointerTarget(0, driver->relative_pointers ? SONG_POINTER_SONG_RELATIVE : SONG_POINTER_ABSOLUTE));
+
+	// Labels can only go where something starts
+	for (size_t position = 1; position < size && !error; ++position)
+		if (labels[position] != NULL && covered[position] && items[position] == ITEM_NONE)
+			PrintError("Error: Pointer to $%zX refers to the middle of a command\n", position);
+
+	if (!error)
+	{
+		const unsigned int smps2asm_version = GetSMPS2ASMVersion();
+
+		ir = IR_Create();
+		AddHeader(sfx, smps2asm_version);
+
+		for (size_t position = header_size; position < size; )
+		{
+			if (items[position] == ITEM_VOICE)
+			{
+				AddVoice(position, smps2asm_version);
+				position += VOICE_SIZE;
+			}
+			else if (items[position] == ITEM_COMMAND && !IsInline(position))
+			{
+				AddCommand(position);
+				position += item_sizes[position];
+			}
+			else
+			{
+				position = AddBytes(position);
+			}
+		}
+
+		// Pointers can go to the end of the song
+		if (labels[size] != NULL)
+			IR_AddLine(ir, labels[size], NULL);
+	}
+
+	Cleanup();
+
+	return ir;
+}
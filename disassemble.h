@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ir.h"
+
+IR* Disassemble(const unsigned char *data, size_t size, unsigned int driver_version, size_t offset, bool sfx, const char *name);
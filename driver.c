@@ -0,0 +1,67 @@
+#include "driver.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+const CoordinationFlagLayout coordination_flag_layouts[COORDINATION_FLAG_COUNT] = {
+#define X(name, arguments, flow, s1, s2, s3, sk, flamewing) {arguments, flow},
+	COORDINATION_FLAGS
+#undef X
+};
+
+static const Driver drivers[] = {
+	{
+		1, "Sonic 1",
+		true, true, false, 0, {3, 2, 1, 0}, 2, 4, 4, 8250,
+		{
+#define X(name, arguments, flow, s1, s2, s3, sk, flamewing) s1,
+			COORDINATION_FLAGS
+#undef X
+		}
+	},
+	{
+		2, "Sonic 2",
+		false, false, false, 0, {3, 1, 2, 0}, 3, 4, 2, 8250,
+		{
+#define X(name, arguments, flow, s1, s2, s3, sk, flamewing) s2,
+			COORDINATION_FLAGS
+#undef X
+		}
+	},
+	{
+		3, "Sonic 3",
+		false, false, true, 0x17D8, {3, 2, 1, 0}, 3, 4, 2, 16000,
+		{
+#define X(name, arguments, flow, s1, s2, s3, sk, flamewing) s3,
+			COORDINATION_FLAGS
+#undef X
+		}
+	},
+	{
+		4, "Sonic & Knuckles",
+		false, false, true, 0x17D8, {3, 2, 1, 0}, 3, 4, 2, 16000,
+		{
+#define X(name, arguments, flow, s1, s2, s3, sk, flamewing) sk,
+			COORDINATION_FLAGS
+#undef X
+		}
+	},
+	{
+		5, "Flamewing",
+		false, false, true, 0, {3, 2, 1, 0}, 3, 4, 2, 16000,
+		{
+#define X(name, arguments, flow, s1, s2, s3, sk, flamewing) flamewing,
+			COORDINATION_FLAGS
+#undef X
+		}
+	}
+};
+
+const Driver* GetDriver(unsigned int version)
+{
+	for (unsigned int i = 0; i < sizeof(drivers) / sizeof(drivers[0]); ++i)
+		if (drivers[i].version == version)
+			return &drivers[i];
+
+	return NULL;
+}
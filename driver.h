@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Every coordination flag that any driver has, and how each driver encodes it.
+// Each encoding is a list of bytes, which is empty when the driver lacks the
+// flag. Adding a driver variant is a matter of adding a column here, and an
+// entry to the table in driver.c.
+// 'Args' is how many bytes of arguments follow the flag, not counting the
+// pointer that flags which change the flow of the track end with.
+#define FLAG_NONE {0}
+#define FLAG1(a) {1, {a}}
+#define FLAG2(a, b) {2, {a, b}}
+
+#define COORDINATION_FLAGS \
+	/* Flag                 Args Flow          Sonic 1            Sonic 2            Sonic 3            Sonic & Knuckles   Flamewing */ \
+	X(PAN,                   1,  FLOW_NEXT,    FLAG1(0xE0),       FLAG1(0xE0),       FLAG1(0xE0),       FLAG1(0xE0),       FLAG1(0xE0)) \
+	X(DETUNE,                1,  FLOW_NEXT,    FLAG1(0xE1),       FLAG1(0xE1),       FLAG1(0xE1),       FLAG1(0xE1),       FLAG1(0xE1)) \
+	X(NOP,                   1,  FLOW_NEXT,    FLAG1(0xE2),       FLAG1(0xE2),       FLAG_NONE,         FLAG_NONE,         FLAG_NONE) \
+	X(FADE,                  1,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG1(0xE2),       FLAG1(0xE2),       FLAG1(0xE2)) \
+	X(RETURN,                0,  FLOW_RETURN,  FLAG1(0xE3),       FLAG1(0xE3),       FLAG1(0xF9),       FLAG1(0xF9),       FLAG1(0xF9)) \
+	X(STOP_FM,               0,  FLOW_STOP,    FLAG_NONE,         FLAG_NONE,         FLAG1(0xE3),       FLAG1(0xE3),       FLAG1(0xE3)) \
+	X(FADE_IN,               0,  FLOW_STOP,    FLAG1(0xE4),       FLAG1(0xE4),       FLAG_NONE,         FLAG_NONE,         FLAG_NONE) \
+	X(SET_VOL,               1,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG1(0xE4),       FLAG1(0xE4),       FLAG1(0xE4)) \
+	X(CHAN_TEMPO_DIV,        1,  FLOW_NEXT,    FLAG1(0xE5),       FLAG1(0xE5),       FLAG_NONE,         FLAG_NONE,         FLAG2(0xFF, 0x08)) \
+	X(FM_ALTER_VOL,          2,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG1(0xE5),       FLAG1(0xE5),       FLAG1(0xE5)) \
+	X(ALTER_VOL,             1,  FLOW_NEXT,    FLAG1(0xE6),       FLAG1(0xE6),       FLAG1(0xE6),       FLAG1(0xE6),       FLAG1(0xE6)) \
+	X(NO_ATTACK,             0,  FLOW_NEXT,    FLAG1(0xE7),       FLAG1(0xE7),       FLAG1(0xE7),       FLAG1(0xE7),       FLAG1(0xE7)) \
+	X(NOTE_FILL,             1,  FLOW_NEXT,    FLAG1(0xE8),       FLAG1(0xE8),       FLAG1(0xE8),       FLAG1(0xE8),       FLAG1(0xE8)) \
+	X(CHANGE_TRANSPOSITION,  1,  FLOW_NEXT,    FLAG1(0xE9),       FLAG1(0xE9),       FLAG1(0xFB),       FLAG1(0xFB),       FLAG1(0xFB)) \
+	X(SPINDASH_REV,          0,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG1(0xE9),       FLAG1(0xE9),       FLAG1(0xE9)) \
+	X(SET_TEMPO_MOD,         1,  FLOW_NEXT,    FLAG1(0xEA),       FLAG1(0xEA),       FLAG2(0xFF, 0x00), FLAG2(0xFF, 0x00), FLAG2(0xFF, 0x00)) \
+	X(PLAY_DAC_SAMPLE,       1,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG1(0xEA),       FLAG1(0xEA),       FLAG1(0xEA)) \
+	X(SET_TEMPO_DIV,         1,  FLOW_NEXT,    FLAG1(0xEB),       FLAG1(0xEB),       FLAG2(0xFF, 0x04), FLAG2(0xFF, 0x04), FLAG2(0xFF, 0x04)) \
+	X(CONDITIONAL_JUMP,      1,  FLOW_BRANCH,  FLAG_NONE,         FLAG_NONE,         FLAG1(0xEB),       FLAG1(0xEB),       FLAG1(0xEB)) \
+	X(PSG_ALTER_VOL,         1,  FLOW_NEXT,    FLAG1(0xEC),       FLAG1(0xEC),       FLAG1(0xEC),       FLAG1(0xEC),       FLAG1(0xEC)) \
+	X(CLEAR_PUSH,            0,  FLOW_NEXT,    FLAG1(0xED),       FLAG_NONE,         FLAG_NONE,         FLAG_NONE,         FLAG_NONE) \
+	X(SET_NOTE,              1,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG1(0xED),       FLAG1(0xED),       FLAG1(0xED)) \
+	X(STOP_SPECIAL,          0,  FLOW_NEXT,    FLAG1(0xEE),       FLAG_NONE,         FLAG_NONE,         FLAG_NONE,         FLAG_NONE) \
+	X(FMI_COMMAND,           2,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG1(0xEE),       FLAG1(0xEE),       FLAG1(0xEE)) \
+	X(FM_VOICE,              1,  FLOW_NEXT,    FLAG1(0xEF),       FLAG1(0xEF),       FLAG1(0xEF),       FLAG1(0xEF),       FLAG1(0xEF)) \
+	X(MOD_SET,               4,  FLOW_NEXT,    FLAG1(0xF0),       FLAG1(0xF0),       FLAG1(0xF0),       FLAG1(0xF0),       FLAG1(0xF0)) \
+	X(MOD_ON,                0,  FLOW_NEXT,    FLAG1(0xF1),       FLAG1(0xF1),       FLAG_NONE,         FLAG_NONE,         FLAG_NONE) \
+	X(MOD_CHANGE_2,          2,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG1(0xF1),       FLAG1(0xF1),       FLAG1(0xF1)) \
+	X(STOP,                  0,  FLOW_STOP,    FLAG1(0xF2),       FLAG1(0xF2),       FLAG1(0xF2),       FLAG1(0xF2),       FLAG1(0xF2)) \
+	X(PSG_FORM,              1,  FLOW_NEXT,    FLAG1(0xF3),       FLAG1(0xF3),       FLAG1(0xF3),       FLAG1(0xF3),       FLAG1(0xF3)) \
+	X(MOD_OFF,               0,  FLOW_NEXT,    FLAG1(0xF4),       FLAG1(0xF4),       FLAG1(0xFA),       FLAG1(0xFA),       FLAG1(0xFA)) \
+	X(MOD_CHANGE,            1,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG1(0xF4),       FLAG1(0xF4),       FLAG1(0xF4)) \
+	X(PSG_VOICE,             1,  FLOW_NEXT,    FLAG1(0xF5),       FLAG1(0xF5),       FLAG1(0xF5),       FLAG1(0xF5),       FLAG1(0xF5)) \
+	X(JUMP,                  0,  FLOW_JUMP,    FLAG1(0xF6),       FLAG1(0xF6),       FLAG1(0xF6),       FLAG1(0xF6),       FLAG1(0xF6)) \
+	X(LOOP,                  2,  FLOW_BRANCH,  FLAG1(0xF7),       FLAG1(0xF7),       FLAG1(0xF7),       FLAG1(0xF7),       FLAG1(0xF7)) \
+	X(CALL,                  0,  FLOW_CALL,    FLAG1(0xF8),       FLAG1(0xF8),       FLAG1(0xF8),       FLAG1(0xF8),       FLAG1(0xF8)) \
+	X(MAX_REL_RATE,          0,  FLOW_NEXT,    FLAG1(0xF9),       FLAG1(0xF9),       FLAG_NONE,         FLAG_NONE,         FLAG_NONE) \
+	X(CONTINUOUS_LOOP,       0,  FLOW_JUMP,    FLAG_NONE,         FLAG_NONE,         FLAG1(0xFC),       FLAG1(0xFC),       FLAG1(0xFC)) \
+	X(ALTERNATE_SMPS,        1,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG1(0xFD),       FLAG1(0xFD),       FLAG1(0xFD)) \
+	X(FM3_SPECIAL_MODE,      4,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG1(0xFE),       FLAG1(0xFE),       FLAG1(0xFE)) \
+	X(PLAY_SOUND,            1,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG2(0xFF, 0x01), FLAG2(0xFF, 0x01), FLAG2(0xFF, 0x01)) \
+	X(HALT_MUSIC,            1,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG2(0xFF, 0x02), FLAG2(0xFF, 0x02), FLAG2(0xFF, 0x02)) \
+	X(COPY_DATA,             3,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG2(0xFF, 0x03), FLAG2(0xFF, 0x03), FLAG2(0xFF, 0x03)) \
+	X(SSG_EG,                4,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG2(0xFF, 0x05), FLAG2(0xFF, 0x05), FLAG2(0xFF, 0x05)) \
+	X(FM_VOL_ENV,            2,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG2(0xFF, 0x06), FLAG2(0xFF, 0x06), FLAG2(0xFF, 0x06)) \
+	X(RESET_SPINDASH_REV,    0,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG2(0xFF, 0x07), FLAG2(0xFF, 0x07), FLAG2(0xFF, 0x07)) \
+	X(CHAN_FM_COMMAND,       2,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG_NONE,         FLAG_NONE,         FLAG2(0xFF, 0x09)) \
+	X(NOTE_FILL_TIMED,       1,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG_NONE,         FLAG_NONE,         FLAG2(0xFF, 0x0A)) \
+	X(PITCH_SLIDE,           1,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG_NONE,         FLAG_NONE,         FLAG2(0xFF, 0x0B)) \
+	X(SET_LFO,               2,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG_NONE,         FLAG_NONE,         FLAG2(0xFF, 0x0C)) \
+	X(PLAY_MUSIC,            1,  FLOW_NEXT,    FLAG_NONE,         FLAG_NONE,         FLAG_NONE,         FLAG_NONE,         FLAG2(0xFF, 0x0D))
+
+typedef enum CoordinationFlag
+{
+#define X(name, arguments, flow, s1, s2, s3, sk, flamewing) COORDINATION_FLAG_##name,
+	COORDINATION_FLAGS
+#undef X
+	COORDINATION_FLAG_COUNT
+} CoordinationFlag;
+
+// What a flag does to the order that a track is read in
+typedef enum FlagFlow
+{
+	FLOW_NEXT,	// Carries on with the next command
+	FLOW_STOP,	// Ends the track
+	FLOW_RETURN,	// Returns from smpsCall
+	FLOW_JUMP,	// Goes to its pointer
+	FLOW_CALL,	// Goes to its pointer, and comes back at smpsReturn
+	FLOW_BRANCH	// Either goes to its pointer or carries on
+} FlagFlow;
+
+typedef struct CoordinationFlagLayout
+{
+	unsigned char arguments;
+	FlagFlow flow;
+} CoordinationFlagLayout;
+
+extern const CoordinationFlagLayout coordination_flag_layouts[COORDINATION_FLAG_COUNT];
+
+typedef struct CoordinationFlagEncoding
+{
+	unsigned char size;
+	unsigned char bytes[2];
+} CoordinationFlagEncoding;
+
+typedef struct Driver
+{
+	unsigned int version;
+	const char *name;
+
+	bool big_endian;		// Sonic 1's driver runs on the 68k
+	bool relative_pointers;		// Sonic 1's songs are position-independent
+	bool external_voices;		// smpsFMvoice can pick voices from other songs
+	unsigned short universal_voice_bank;	// Address used by smpsHeaderVoiceUVB, or 0 if unsupported
+	unsigned char voice_operator_order[4];	// Order that voices' operators are stored in
+	unsigned char max_call_depth;		// How many smpsCalls can be nested before the track's stack overflows into its loop counters
+	unsigned char loop_counters;		// How many smpsLoop indices are safe alongside that many calls
+	unsigned char call_size;		// Bytes that each smpsCall pushes onto the track's stack, which grows down towards the loop counters
+	unsigned short dac_rate;	// Hz that DAC samples play back at, at the pitch that the drums usually use
+
+	CoordinationFlagEncoding coordination_flags[COORDINATION_FLAG_COUNT];
+} Driver;
+
+const Driver* GetDriver(unsigned int version);
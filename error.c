@@ -7,14 +7,34 @@
 
 bool error;
 
+void (*message_handler)(bool is_error, const char *message, va_list args);
+
+static void PrintMessage(bool is_error, const char *message, va_list args)
+{
+	if (message_handler != NULL)
+		message_handler(is_error, message, args);
+	else
+		vprintf(message, args);
+}
+
 void PrintError(char *message, ...)
 {
 	va_list args;
 	va_start(args, message);
 
-	vprintf(message, args);
+	PrintMessage(true, message, args);
 
 	va_end(args);
 
 	error = true;
 }
+
+void PrintWarning(char *message, ...)
+{
+	va_list args;
+	va_start(args, message);
+
+	PrintMessage(false, message, args);
+
+	va_end(args);
+}
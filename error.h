@@ -4,5 +4,7 @@
 #include <stdbool.h>
 
 extern bool error;
+extern void (*message_handler)(bool is_error, const char *message, va_list args);
 
 void PrintError(char *message, ...);
+void PrintWarning(char *message, ...);
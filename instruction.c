@@ -9,16 +9,34 @@
 
 #include "common.h"
 #include "dictionary.h"
+#include "driver.h"
 #include "error.h"
 #include "memory_stream.h"
+#include "tempo.h"
 
 #define SMPS2ASM_VERSION 1
 #define PSG_DELTA 12
 
 size_t file_offset;
-unsigned int target_driver;
+unsigned long symbol_arguments;
+void (*relocation_callback)(size_t output_position);
+void (*fixup_callback)(size_t output_position, unsigned int import, long addend);
+void (*label_callback)(const char *label, size_t output_position);
+void (*marker_callback)(Marker marker, size_t output_position);
 
+// How a song's source driver relates to the target, which decides how some macros are converted
+typedef enum Conversion
+{
+	CONVERSION_NONE,
+	CONVERSION_TO_S3K,	// Sonic 1/2 song going to a Sonic 3-era driver
+	CONVERSION_FROM_S3K	// Sonic 3-era song going to a Sonic 1/2 driver
+} Conversion;
+
+static const Driver *driver;
 static unsigned int source_driver;
+static Conversion conversion;
+static const TempoConversion *tempo_conversion;
+static long psg_pitch_delta;
 static unsigned int target_smps2asm_version;
 static size_t song_start_address;
 static unsigned int current_voice;
@@ -77,6 +95,12 @@ static const char *psg_envelopes_s3k[] = {
 	"sTone_25", "sTone_26", "sTone_27"
 };
 
+// Sonic 1 leaves gaps between its samples' IDs
+static const char *dac_samples_s1[] = {
+	"dKick", "dSnare", "dTimpani", NULL, NULL, NULL, NULL, "dHiTimpani", "dMidTimpani",
+	"dLowTimpani", "dVLowTimpani"
+};
+
 static const char *dac_samples_s2[] = {
 	"dKick", "dSnare", "dClap", "dScratch", "dTimpani", "dHiTom", "dVLowClap", "dHiTimpani", "dMidTimpani",
 	"dLowTimpani", "dVLowTimpani", "dMidTom", "dLowTom", "dFloorTom", "dHiClap",
@@ -113,239 +137,339 @@ static const char *dac_samples_s3[] = {
 	"dEchoedClapHit_S3", "dLowerEchoedClapHit_S3"
 };
 
-static const unsigned char smpsNoAttack = 0xE7;
-
 static void WriteByte(unsigned char value)
 {
 	MemoryStream_WriteByte(output_stream, value);
 }
 
-static void WriteShort(unsigned short value)
+static void WriteShortLE(unsigned short value)
+{
+	WriteByte(value & 0xFF);
+	WriteByte(value >> 8);
+}
+
+static void WriteShortBE(unsigned short value)
 {
-	if (target_driver >= 2)
+	WriteByte(value >> 8);
+	WriteByte(value & 0xFF);
+}
+
+static size_t GetLogicalAddress(void)
+{
+	return MemoryStream_GetPosition(output_stream) + file_offset;
+}
+
+// Absolute addresses have to be patched if the song is moved, or filled in
+// when it's linked if they belong to another song
+static void AddMarker(Marker marker)
+{
+	if (marker_callback != NULL && undefined_symbol == NULL)
+		marker_callback(marker, MemoryStream_GetPosition(output_stream));
+}
+
+static bool IsImport(unsigned int loc)
+{
+	return loc >= IMPORT_BASE && loc < IMPORT_BASE + MAX_IMPORTS * IMPORT_STRIDE;
+}
+
+static void AddRelocation(unsigned int loc)
+{
+	// Delayed instructions are run twice, so only count the run where every symbol was known
+	if (undefined_symbol != NULL)
+		return;
+
+	if (IsImport(loc))
 	{
-		WriteByte(value & 0xFF);
-		WriteByte(value >> 8);
+		const unsigned int import = (loc - IMPORT_BASE) / IMPORT_STRIDE;
+
+		if (fixup_callback != NULL)
+			fixup_callback(MemoryStream_GetPosition(output_stream), import, (long)loc - (long)GetImportPlaceholder(import));
 	}
-	else
+	else if (relocation_callback != NULL)
 	{
-		WriteByte(value >> 8);
-		WriteByte(value & 0xFF);
+		relocation_callback(MemoryStream_GetPosition(output_stream));
 	}
 }
 
-static size_t GetLogicalAddress(void)
+static void CheckNotImport(unsigned int loc)
 {
-	return MemoryStream_GetPosition(output_stream) + file_offset;
+	if (undefined_symbol == NULL && IsImport(loc))
+		PrintError("Error: Sonic 1 songs can't refer to labels in other songs, as their pointers are relative\n");
 }
 
-static unsigned int conv0To256(unsigned int n)
+// Pointers within track data (jumps, calls, loops)
+static void WritePointerAbsolute(unsigned int loc)
 {
-	return ((n == 0) << 8) | n;
+	AddRelocation(loc);
+	WriteShortLE(loc);
 }
 
-static unsigned int s2TempotoS1(unsigned int n)
+static void WritePointerRelative(unsigned int loc)
 {
-	return (((768 - n) >> 1) / (256 - n)) & 0xFF;
+	CheckNotImport(loc);
+	WriteShortBE(loc - GetLogicalAddress() - 1);
 }
 
-static unsigned int s2TempotoS3(unsigned int n)
+// Pointers from the song's header (voices)
+static void WriteSongPointerAbsolute(unsigned int loc)
 {
-	return (0x100 - ((n == 0) | n)) & 0xFF;
+	AddRelocation(loc);
+	WriteShortLE(loc);
 }
 
-static unsigned int s1TempotoS2(unsigned int n)
+static void WriteSongPointerRelative(unsigned int loc)
 {
-	return ((((conv0To256(n) - 1) << 8) + (conv0To256(n) >> 1)) / conv0To256(n)) & 0xFF;
+	CheckNotImport(loc);
+	WriteShortBE(loc - song_start_address);
 }
 
-static unsigned int s1TempotoS3(unsigned int n)
+// Pointers from the song's header to its tracks
+static void WriteChannelPointerAbsolute(unsigned int loc)
 {
-	return s2TempotoS3(s1TempotoS2(n));
+	AddRelocation(loc);
+	WriteShortLE(loc);
 }
 
-static unsigned int s3TempotoS1(unsigned int n)
+static void WriteChannelPointerRelative(unsigned int loc)
 {
-	return s2TempotoS1(s2TempotoS3(n));
+	CheckNotImport(loc);
+
+	// Forward references aren't known until the second pass, so don't judge them yet
+	if (undefined_symbol == NULL && loc < song_start_address)
+		PrintError("Error: Tracks for Sonic 1 songs must come after the start of the song\n");
+
+	WriteShortBE(loc - song_start_address);
 }
 
-static unsigned int s3TempotoS2(unsigned int n)
+// Picked by SetTargetDriver, so that the macros never have to check the driver themselves
+static void (*WriteShort)(unsigned short value);
+static void (*WritePointer)(unsigned int loc);
+static void (*WriteSongPointer)(unsigned int loc);
+static void (*WriteChannelPointer)(unsigned int loc);
+
+static bool HasCoordinationFlag(CoordinationFlag flag)
 {
-	return s2TempotoS3(n);
+	return driver->coordination_flags[flag].size != 0;
 }
 
-static unsigned int convertMainTempoMod(unsigned int mod)
+static void WriteCoordinationFlag(CoordinationFlag flag)
 {
-	unsigned int result;
+	const CoordinationFlagEncoding *encoding = &driver->coordination_flags[flag];
 
-	if ((source_driver >= 3 && target_driver >= 3) || source_driver == target_driver)
-	{
-		result = mod;
-	}
-	else if (source_driver == 1)
-	{
-		if (mod == 1)
-			PrintError("Error: Invalid main tempo of 1 in song from Sonic 1\n");
+	for (unsigned int i = 0; i < encoding->size; ++i)
+		WriteByte(encoding->bytes[i]);
+}
 
-		if (target_driver == 2)
-			result = s1TempotoS2(mod);
-		else //if (target_driver >= 3)
-			result = s1TempotoS3(mod);
-	}
-	else if (source_driver == 2)
-	{
-		if (mod == 0)
-			PrintError("Error: Invalid main tempo of 0 in song from Sonic 2\n");
+static unsigned int conv0To256(unsigned int n)
+{
+	return ((n == 0) << 8) | n;
+}
 
-		if (target_driver == 1)
-			result = s2TempotoS1(mod);
-		else //if (target_driver >= 3)
-			result = s2TempotoS3(mod);
-	}
-	else// if (source_driver >= 3)
+static unsigned int convertMainTempoMod(long mod)
+{
+	if (mod == tempo_conversion->problem_tempo)
 	{
-		if (mod == 0)
-			printf("Warning: Performing approximate conversion of Sonic 3 main tempo modifier of 0\n");
-
-		if (target_driver == 1)
-			result = s3TempotoS1(mod);
-		else //if (target_driver == 2)
-			result = s3TempotoS2(mod);
+		if (tempo_conversion->problem_is_error)
+			PrintError("%s", tempo_conversion->problem_message);
+		else
+			PrintWarning("%s", tempo_conversion->problem_message);
 	}
 
-	return result;
+	return tempo_conversion->table[mod & 0xFF];
+}
+
+static long PSGPitchConvert(long pitch)
+{
+	return (pitch + psg_pitch_delta) & 0xFF;
 }
 
-static void CheckedChannelPointer(unsigned int loc)
+static void SetSourceDriver(unsigned int version)
 {
-	if (target_driver >= 2)
+	source_driver = version;
+	tempo_conversion = Tempo_GetConversion(source_driver, driver->version);
+
+	if (driver->version >= 3 && source_driver < 3)
+	{
+		conversion = CONVERSION_TO_S3K;
+		psg_pitch_delta = PSG_DELTA;
+	}
+	else if (driver->version < 3 && source_driver >= 3)
 	{
-		WriteShort(loc);
+		conversion = CONVERSION_FROM_S3K;
+		psg_pitch_delta = -PSG_DELTA;
 	}
 	else
 	{
-		if (loc < song_start_address)
-			PrintError("Error: Tracks for Sonic 1 songs must come after the start of the song\n");
-
-		WriteShort(loc - song_start_address);
+		conversion = CONVERSION_NONE;
+		psg_pitch_delta = 0;
 	}
 }
 
-static long PSGPitchConvert(long pitch)
+bool SetTargetDriver(unsigned int version)
 {
-	long value;
+	driver = GetDriver(version);
 
-	if (target_driver >= 3 && source_driver < 3)
-		value = (pitch + PSG_DELTA) & 0xFF;
-	else if (target_driver < 3 && source_driver >= 3)
-		value = (pitch - PSG_DELTA) & 0xFF;
-	else
-		value = pitch;
+	if (driver == NULL)
+		return false;
+
+	WriteShort = driver->big_endian ? WriteShortBE : WriteShortLE;
+	WritePointer = driver->relative_pointers ? WritePointerRelative : WritePointerAbsolute;
+	WriteSongPointer = driver->relative_pointers ? WriteSongPointerRelative : WriteSongPointerAbsolute;
+	WriteChannelPointer = driver->relative_pointers ? WriteChannelPointerRelative : WriteChannelPointerAbsolute;
 
-	return value;
+	SetSourceDriver(0);
+
+	return true;
 }
 
-void FillDefaultDictionary(void)
+typedef struct NameTable
 {
-	for (unsigned int i = 0; i < sizeof(notes) / sizeof(notes[0]); ++i)
-		AddDictionaryEntry(notes[i], 0x80 + i);
+	const char **names;
+	size_t count;
+} NameTable;
 
-	for (unsigned int i = 0; i < sizeof(octave_pitches) / sizeof(octave_pitches[0]); ++i)
-		AddDictionaryEntry(octave_pitches[i].name, octave_pitches[i].value);
+#define NAME_TABLE(names) ((NameTable){names, sizeof(names) / sizeof(names[0])})
 
-	AddDictionaryEntry("smpsNoAttack", smpsNoAttack);
+// Fills 'tables' with the names of a driver's PSG envelopes, in order of ID, and returns how many tables there are
+static size_t GetPSGEnvelopeTables(unsigned int driver_version, NameTable tables[2])
+{
+	size_t count = 0;
 
-	if (target_driver > 2)
+	if (driver_version == 1)
 	{
-		AddDictionaryEntry("nMaxPSG", LookupDictionary("nBb6") - PSG_DELTA);
-		AddDictionaryEntry("nMaxPSG1", LookupDictionary("nBb6"));
-		AddDictionaryEntry("nMaxPSG2", LookupDictionary("nB6"));
+		tables[count++] = NAME_TABLE(psg_envelopes_s1);
+	}
+	else if (driver_version == 2)
+	{
+		tables[count++] = NAME_TABLE(psg_envelopes_s2);
 	}
 	else
 	{
-		AddDictionaryEntry("nMaxPSG", LookupDictionary("nA5"));
-		AddDictionaryEntry("nMaxPSG1", LookupDictionary("nA5") + PSG_DELTA);
-		AddDictionaryEntry("nMaxPSG2", LookupDictionary("nA5") + PSG_DELTA);
+		tables[count++] = NAME_TABLE(psg_envelopes_s3k);
+		tables[count++] = NAME_TABLE(psg_envelopes_s2);
 	}
 
-	if (target_driver == 1)
+	return count;
+}
+
+// Same as above, but for DAC samples
+static size_t GetDACSampleTables(unsigned int driver_version, NameTable tables[5])
+{
+	size_t count = 0;
+
+	if (driver_version == 1)
 	{
-		for (unsigned int i = 0; i < sizeof(psg_envelopes_s1) / sizeof(psg_envelopes_s1[0]); ++i)
-			AddDictionaryEntry(psg_envelopes_s1[i], 1 + i);
+		tables[count++] = NAME_TABLE(dac_samples_s1);
 	}
-	else if (target_driver == 2)
+	else if (driver_version == 2)
 	{
-		for (unsigned int i = 0; i < sizeof(psg_envelopes_s2) / sizeof(psg_envelopes_s2[0]); ++i)
-			AddDictionaryEntry(psg_envelopes_s2[i], 1 + i);
+		tables[count++] = NAME_TABLE(dac_samples_s2);
 	}
 	else
 	{
-		unsigned int current_id = 1;
-
-		for (unsigned int i = 0; i < sizeof(psg_envelopes_s3k) / sizeof(psg_envelopes_s3k[0]); ++i)
-			AddDictionaryEntry(psg_envelopes_s3k[i], current_id++);
+		tables[count++] = NAME_TABLE(dac_samples_s3_sk_s3d_common);
+		tables[count++] = NAME_TABLE(dac_samples_s3_sk_common);
 
-		for (unsigned int i = 0; i < sizeof(psg_envelopes_s2) / sizeof(psg_envelopes_s2[0]); ++i)
-			AddDictionaryEntry(psg_envelopes_s2[i], current_id++);
+		if (driver_version == 3)
+		{
+			tables[count++] = NAME_TABLE(dac_samples_s3);
+		}
+		else if (driver_version == 5)
+		{
+			tables[count++] = NAME_TABLE(dac_samples_s2);
+			tables[count++] = NAME_TABLE(dac_samples_s3d);
+			tables[count++] = NAME_TABLE(dac_samples_s3);
+		}
 	}
 
-	if (target_driver == 1)
-	{
-		AddDictionaryEntry("dKick", 0x81);
-		AddDictionaryEntry("dSnare", 0x82);
-		AddDictionaryEntry("dTimpani", 0x83);
-		AddDictionaryEntry("dHiTimpani", 0x88);
-		AddDictionaryEntry("dMidTimpani", 0x89);
-		AddDictionaryEntry("dLowTimpani", 0x8A);
-		AddDictionaryEntry("dVLowTimpani", 0x8B);
-	}
-	else if (target_driver == 2)
+	return count;
+}
+
+static void AddTableEntries(const NameTable *tables, size_t table_count, unsigned int first_id)
+{
+	unsigned int current_id = first_id;
+
+	for (size_t i = 0; i < table_count; ++i)
+		for (size_t j = 0; j < tables[i].count; ++j, ++current_id)
+			if (tables[i].names[j] != NULL)
+				AddDictionaryEntry(tables[i].names[j], current_id);
+}
+
+static const char* FindTableName(const NameTable *tables, size_t table_count, unsigned int first_id, unsigned int id)
+{
+	if (id < first_id)
+		return NULL;
+
+	size_t index = id - first_id;
+
+	for (size_t i = 0; i < table_count; ++i)
 	{
-		for (unsigned int i = 0; i < sizeof(dac_samples_s2) / sizeof(dac_samples_s2[0]); ++i)
-			AddDictionaryEntry(dac_samples_s2[i], 0x81 + i);
+		if (index < tables[i].count)
+			return tables[i].names[index];
+
+		index -= tables[i].count;
 	}
-	else if (target_driver == 3)
-	{
-		unsigned int current_id = 0x81;
 
-		for (unsigned int i = 0; i < sizeof(dac_samples_s3_sk_s3d_common) / sizeof(dac_samples_s3_sk_s3d_common[0]); ++i)
-			AddDictionaryEntry(dac_samples_s3_sk_s3d_common[i], current_id++);
+	return NULL;
+}
 
-		for (unsigned int i = 0; i < sizeof(dac_samples_s3_sk_common) / sizeof(dac_samples_s3_sk_common[0]); ++i)
-			AddDictionaryEntry(dac_samples_s3_sk_common[i], current_id++);
+const char* GetPSGEnvelopeName(unsigned int driver_version, unsigned int id)
+{
+	NameTable tables[2];
+	const size_t table_count = GetPSGEnvelopeTables(driver_version, tables);
 
-		for (unsigned int i = 0; i < sizeof(dac_samples_s3) / sizeof(dac_samples_s3[0]); ++i)
-			AddDictionaryEntry(dac_samples_s3[i], current_id++);
-	}
-	else if (target_driver == 4)
-	{
-		unsigned int current_id = 0x81;
+	return FindTableName(tables, table_count, 1, id);
+}
 
-		for (unsigned int i = 0; i < sizeof(dac_samples_s3_sk_s3d_common) / sizeof(dac_samples_s3_sk_s3d_common[0]); ++i)
-			AddDictionaryEntry(dac_samples_s3_sk_s3d_common[i], current_id++);
+const char* GetDACSampleName(unsigned int driver_version, unsigned int id)
+{
+	NameTable tables[5];
+	const size_t table_count = GetDACSampleTables(driver_version, tables);
 
-		for (unsigned int i = 0; i < sizeof(dac_samples_s3_sk_common) / sizeof(dac_samples_s3_sk_common[0]); ++i)
-			AddDictionaryEntry(dac_samples_s3_sk_common[i], current_id++);
-	}
-	else //if (target_driver == 5)
-	{
-		unsigned int current_id = 0x81;
+	return FindTableName(tables, table_count, 0x81, id);
+}
+
+const char* GetNoteName(unsigned int value)
+{
+	if (value < 0x80 || value - 0x80 >= sizeof(notes) / sizeof(notes[0]))
+		return NULL;
+
+	return notes[value - 0x80];
+}
 
-		for (unsigned int i = 0; i < sizeof(dac_samples_s3_sk_s3d_common) / sizeof(dac_samples_s3_sk_s3d_common[0]); ++i)
-			AddDictionaryEntry(dac_samples_s3_sk_s3d_common[i], current_id++);
+void FillDefaultDictionary(void)
+{
+	const unsigned int target_driver = driver->version;
 
-		for (unsigned int i = 0; i < sizeof(dac_samples_s3_sk_common) / sizeof(dac_samples_s3_sk_common[0]); ++i)
-			AddDictionaryEntry(dac_samples_s3_sk_common[i], current_id++);
+	for (unsigned int i = 0; i < sizeof(notes) / sizeof(notes[0]); ++i)
+		AddDictionaryEntry(notes[i], 0x80 + i);
 
-		for (unsigned int i = 0; i < sizeof(dac_samples_s2) / sizeof(dac_samples_s2[0]); ++i)
-			AddDictionaryEntry(dac_samples_s2[i], current_id++);
+	for (unsigned int i = 0; i < sizeof(octave_pitches) / sizeof(octave_pitches[0]); ++i)
+		AddDictionaryEntry(octave_pitches[i].name, octave_pitches[i].value);
 
-		for (unsigned int i = 0; i < sizeof(dac_samples_s3d) / sizeof(dac_samples_s3d[0]); ++i)
-			AddDictionaryEntry(dac_samples_s3d[i], current_id++);
+	AddDictionaryEntry("smpsNoAttack", driver->coordination_flags[COORDINATION_FLAG_NO_ATTACK].bytes[0]);
 
-		for (unsigned int i = 0; i < sizeof(dac_samples_s3) / sizeof(dac_samples_s3[0]); ++i)
-			AddDictionaryEntry(dac_samples_s3[i], current_id++);
+	if (target_driver > 2)
+	{
+		AddDictionaryEntry("nMaxPSG", LookupDictionary("nBb6") - PSG_DELTA);
+		AddDictionaryEntry("nMaxPSG1", LookupDictionary("nBb6"));
+		AddDictionaryEntry("nMaxPSG2", LookupDictionary("nB6"));
 	}
+	else
+	{
+		AddDictionaryEntry("nMaxPSG", LookupDictionary("nA5"));
+		AddDictionaryEntry("nMaxPSG1", LookupDictionary("nA5") + PSG_DELTA);
+		AddDictionaryEntry("nMaxPSG2", LookupDictionary("nA5") + PSG_DELTA);
+	}
+
+	NameTable tables[5];
+	size_t table_count;
+
+	table_count = GetPSGEnvelopeTables(target_driver, tables);
+	AddTableEntries(tables, table_count, 1);
+
+	table_count = GetDACSampleTables(target_driver, tables);
+	AddTableEntries(tables, table_count, 0x81);
 
 	AddDictionaryEntry("panNone", 0x00);
 	AddDictionaryEntry("panRight", 0x40);
@@ -363,9 +487,18 @@ void FillDefaultDictionary(void)
 	AddDictionaryEntry("cFM6", 0x06);
 }
 
-void HandleLabel(char *label)
+void HandleLabel(const char *label, unsigned long hash)
 {
-	AddDictionaryEntry(label, GetLogicalAddress());
+	AddDictionaryEntryHashed(label, hash, GetLogicalAddress());
+
+	if (label_callback != NULL)
+		label_callback(label, MemoryStream_GetPosition(output_stream));
+}
+
+unsigned long GetImportPlaceholder(unsigned int import)
+{
+	// Halfway through its range, so that offsets either side of the label still point to it
+	return IMPORT_BASE + import * IMPORT_STRIDE + IMPORT_STRIDE / 2;
 }
 
 static void Macro_smpsStop(unsigned int arg_count, long arg_array[]);
@@ -377,7 +510,9 @@ static void Macro_smpsHeaderStartSong(unsigned int arg_count, long arg_array[])
 	song_start_address = GetLogicalAddress();
 	current_voice = 0;
 
-	source_driver = arg_array[0];
+	AddMarker(MARKER_SONG);
+
+	SetSourceDriver(arg_array[0]);
 	target_smps2asm_version = (arg_count >= 2) ? arg_array[1] : 0;
 
 	if (target_smps2asm_version > SMPS2ASM_VERSION)
@@ -394,10 +529,8 @@ static void Macro_smpsHeaderVoice(unsigned int arg_count, long arg_array[])
 	if (song_start_address != GetLogicalAddress())
 		PrintError("Error: Missing smpsHeaderStartSong\n");
 
-	if (target_driver >= 2)
-		WriteShort(arg_array[0]);
-	else
-		WriteShort(arg_array[0] - song_start_address);
+	AddMarker(MARKER_VOICE_POINTER);
+	WriteSongPointer(arg_array[0]);
 }
 
 static void Macro_smpsHeaderVoiceNull(unsigned int arg_count, long arg_array[])
@@ -419,9 +552,9 @@ static void Macro_smpsHeaderVoiceUVB(unsigned int arg_count, long arg_array[])
 	if (song_start_address != GetLogicalAddress())
 		PrintError("Error: Missing smpsHeaderStartSong\n");
 
-	if (target_driver == 3 || target_driver == 4)
-		WriteShort(0x17D8);
-	else if (target_driver == 5)
+	if (driver->universal_voice_bank != 0)
+		WriteShort(driver->universal_voice_bank);
+	else if (driver->external_voices)
 		PrintError("Error: smpsHeaderVoiceUVB not supported in Flamewing's driver yet\n");
 	else
 		PrintError("Error: smpsHeaderVoiceUVB not supported in S1/S2's drivers\n");
@@ -447,7 +580,8 @@ static void Macro_smpsHeaderDAC(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	CheckedChannelPointer(arg_array[0]);		// Location
+	AddMarker(MARKER_CHANNEL_POINTER);
+	WriteChannelPointer(arg_array[0]);		// Location
 	WriteByte((arg_count >= 2) ? arg_array[1] : 0);	// Pitch
 	WriteByte((arg_count >= 3) ? arg_array[2] : 0);	// Volume
 }
@@ -456,7 +590,8 @@ static void Macro_smpsHeaderFM(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 3);
 
-	CheckedChannelPointer(arg_array[0]);	// Location
+	AddMarker(MARKER_CHANNEL_POINTER);
+	WriteChannelPointer(arg_array[0]);	// Location
 	WriteByte(arg_array[1]);		// Pitch
 	WriteByte(arg_array[2]);		// Volume
 }
@@ -465,7 +600,8 @@ static void Macro_smpsHeaderPSG(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 5);
 
-	CheckedChannelPointer(arg_array[0]);		// Location
+	AddMarker(MARKER_CHANNEL_POINTER);
+	WriteChannelPointer(arg_array[0]);		// Location
 	WriteByte(PSGPitchConvert(arg_array[1]));	// Pitch
 	WriteByte(arg_array[2]);			// Volume
 	WriteByte(arg_array[3]);			// Modulation
@@ -490,14 +626,15 @@ static void Macro_smpsHeaderSFXChannel(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	if (target_driver >= 3 && arg_array[0] == LookupDictionary("cNoise"))
+	if (driver->version >= 3 && arg_array[0] == LookupDictionary("cNoise"))
 		PrintError("Error: Using channel ID of cNoise ($E0) in Sonic 3 driver is dangerous. Fix the song so that it turns into a noise channel instead.\n");
-	else if (target_driver < 3 && arg_array[0] == LookupDictionary("cFM6"))
+	else if (driver->version < 3 && arg_array[0] == LookupDictionary("cFM6"))
 		PrintError("Error: Using channel ID of FM6 ($06) in Sonic 1 or Sonic 2 drivers is unsupported. Change it to another channel.\n");
 
 	WriteByte(0x80);			// Playback-control
 	WriteByte(arg_array[0]);		// Channel ID
-	CheckedChannelPointer(arg_array[1]);	// Location
+	AddMarker(MARKER_CHANNEL_POINTER);
+	WriteChannelPointer(arg_array[1]);	// Location
 	WriteByte((arg_array[0] & 0x80) ? PSGPitchConvert(arg_array[2]) : arg_array[2]);	// Pitch
 	WriteByte(arg_array[3]);		// Volume
 }
@@ -506,7 +643,7 @@ static void Macro_smpsPan(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 2);
 
-	WriteByte(0xE0);
+	WriteCoordinationFlag(COORDINATION_FLAG_PAN);
 	WriteByte(arg_array[0] + arg_array[1]);	// Direction + amsfms
 }
 
@@ -514,7 +651,7 @@ static void Macro_smpsDetune(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	WriteByte(0xE1);
+	WriteCoordinationFlag(COORDINATION_FLAG_DETUNE);
 	WriteByte(arg_array[0]);
 }
 
@@ -522,9 +659,9 @@ static void Macro_smpsNop(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver < 3)
+	if (HasCoordinationFlag(COORDINATION_FLAG_NOP))
 	{
-		WriteByte(0xE2);
+		WriteCoordinationFlag(COORDINATION_FLAG_NOP);
 		WriteByte(arg_array[0]);
 	}
 }
@@ -534,28 +671,28 @@ static void Macro_smpsReturn(unsigned int arg_count, long arg_array[])
 	(void)arg_count;
 	(void)arg_array;
 
-	WriteByte((target_driver >= 3) ? 0xF9 : 0xE3);
+	WriteCoordinationFlag(COORDINATION_FLAG_RETURN);
 }
 
 static void Macro_smpsFade(unsigned int arg_count, long arg_array[])
 {
-	if (target_driver >= 3)
+	if (HasCoordinationFlag(COORDINATION_FLAG_FADE))
 	{
-		WriteByte(0xE2);
+		WriteCoordinationFlag(COORDINATION_FLAG_FADE);
 
 		if (arg_count >= 1)
 			WriteByte(arg_array[0]);
 
-		if (source_driver < 3)
+		if (conversion == CONVERSION_TO_S3K)
 			Macro_smpsStop(arg_count, arg_array);
 	}
-	else if (source_driver >= 3 && arg_count >= 1 && arg_array[0] != 0xFF)
+	else if (conversion == CONVERSION_FROM_S3K && arg_count >= 1 && arg_array[0] != 0xFF)
 	{
 		// We should ignore these (they're actually smpsNop commands)
 	}
 	else
 	{
-		WriteByte(0xE4);
+		WriteCoordinationFlag(COORDINATION_FLAG_FADE_IN);
 	}
 }
 
@@ -563,20 +700,14 @@ static void Macro_smpsChanTempoDiv(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver >= 5)
+	if (HasCoordinationFlag(COORDINATION_FLAG_CHAN_TEMPO_DIV))
 	{
-		WriteByte(0xFF);
-		WriteByte(0x08);
+		WriteCoordinationFlag(COORDINATION_FLAG_CHAN_TEMPO_DIV);
 		WriteByte(arg_array[0]);
 	}
-	else if (target_driver >= 3)
-	{
-		PrintError("Error: Coord. Flag to set tempo divider of a single channel does not exist in S3 driver. Use Flamewing's modified S&K sound driver instead.\n");
-	}
 	else
 	{
-		WriteByte(0xE5);
-		WriteByte(arg_array[0]);
+		PrintError("Error: Coord. Flag to set tempo divider of a single channel does not exist in S3 driver. Use Flamewing's modified S&K sound driver instead.\n");
 	}
 }
 
@@ -584,7 +715,7 @@ static void Macro_smpsAlterVol(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	WriteByte(0xE6);
+	WriteCoordinationFlag(COORDINATION_FLAG_ALTER_VOL);
 	WriteByte(arg_array[0]);
 }
 
@@ -592,21 +723,20 @@ static void Macro_smpsNoteFill(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver >= 5 && source_driver < 3)
+	if (conversion == CONVERSION_TO_S3K && HasCoordinationFlag(COORDINATION_FLAG_NOTE_FILL_TIMED))
 	{
-		WriteByte(0xFF);
-		WriteByte(0x0A);
+		WriteCoordinationFlag(COORDINATION_FLAG_NOTE_FILL_TIMED);
 		WriteByte(arg_array[0]);
 	}
 	else
 	{
-		if (target_driver >= 3 && source_driver < 3)
+		if (conversion == CONVERSION_TO_S3K)
 			PrintError("Note fill will not work as intended unless you divide the fill value by the tempo divider or complain to Flamewing to add an appropriate coordination flag for it.\n");
-		else if (target_driver < 3 && source_driver >= 3)
+		else if (conversion == CONVERSION_FROM_S3K)
 			PrintError("Note fill will not work as intended unless you multiply the fill value by the tempo divider or complain to Flamewing to add an appropriate coordination flag for it.\n");
 	}
 
-	WriteByte(0xE8);
+	WriteCoordinationFlag(COORDINATION_FLAG_NOTE_FILL);
 	WriteByte(arg_array[0]);
 }
 
@@ -614,7 +744,7 @@ static void Macro_smpsChangeTransposition(unsigned int arg_count, long arg_array
 {
 	assert(arg_count >= 1);
 
-	WriteByte((target_driver >= 3) ? 0xFB : 0xE9);
+	WriteCoordinationFlag(COORDINATION_FLAG_CHANGE_TRANSPOSITION);
 	WriteByte(arg_array[0]);
 }
 
@@ -622,16 +752,7 @@ static void Macro_smpsSetTempoMod(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver >= 3)
-	{
-		WriteByte(0xFF);
-		WriteByte(0x00);
-	}
-	else
-	{
-		WriteByte(0xEA);
-	}
-
+	WriteCoordinationFlag(COORDINATION_FLAG_SET_TEMPO_MOD);
 	WriteByte(convertMainTempoMod(arg_array[0]));
 }
 
@@ -639,16 +760,7 @@ static void Macro_smpsSetTempoDiv(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver >= 3)
-	{
-		WriteByte(0xFF);
-		WriteByte(0x04);
-	}
-	else
-	{
-		WriteByte(0xEB);
-	}
-
+	WriteCoordinationFlag(COORDINATION_FLAG_SET_TEMPO_DIV);
 	WriteByte(arg_array[0]);
 }
 
@@ -656,9 +768,9 @@ static void Macro_smpsSetVol(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver >= 3)
+	if (HasCoordinationFlag(COORDINATION_FLAG_SET_VOL))
 	{
-		WriteByte(0xE4);
+		WriteCoordinationFlag(COORDINATION_FLAG_SET_VOL);
 		WriteByte(arg_array[0]);
 	}
 	else
@@ -671,7 +783,7 @@ static void Macro_smpsPSGAlterVol(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	WriteByte(0xEC);
+	WriteCoordinationFlag(COORDINATION_FLAG_PSG_ALTER_VOL);
 	WriteByte(arg_array[0]);
 }
 
@@ -680,8 +792,8 @@ static void Macro_smpsClearPush(unsigned int arg_count, long arg_array[])
 	(void)arg_count;
 	(void)arg_array;
 
-	if (target_driver == 1)
-		WriteByte(0xED);
+	if (HasCoordinationFlag(COORDINATION_FLAG_CLEAR_PUSH))
+		WriteCoordinationFlag(COORDINATION_FLAG_CLEAR_PUSH);
 	else
 		PrintError("Coord. Flag to clear S1 push block flag does not exist in S2 or S3 drivers. Complain to Flamewing to add it.\n");
 }
@@ -691,13 +803,13 @@ static void Macro_smpsStopSpecial(unsigned int arg_count, long arg_array[])
 	(void)arg_count;
 	(void)arg_array;
 
-	if (target_driver == 1)
+	if (HasCoordinationFlag(COORDINATION_FLAG_STOP_SPECIAL))
 	{
-		WriteByte(0xEE);
+		WriteCoordinationFlag(COORDINATION_FLAG_STOP_SPECIAL);
 	}
 	else
 	{
-		printf("Warning: Coord. Flag to stop special SFX does not exist in S2 or S3 drivers. Complain to Flamewing to add it. With adequate caution, smpsStop can do this job.\n");
+		PrintWarning("Warning: Coord. Flag to stop special SFX does not exist in S2 or S3 drivers. Complain to Flamewing to add it. With adequate caution, smpsStop can do this job.\n");
 		Macro_smpsStop(arg_count, arg_array);
 	}
 }
@@ -706,15 +818,17 @@ static void Macro_smpsFMvoice(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	WriteByte(0xEF);
+	WriteCoordinationFlag(COORDINATION_FLAG_FM_VOICE);
 
-	if (target_driver >= 3 && arg_count >= 2)
+	if (driver->external_voices && arg_count >= 2)
 	{
+		AddMarker(MARKER_EXTERNAL_VOICE_SELECT);
 		WriteByte(arg_array[0] | 0x80);	// Instrument
 		WriteByte(arg_array[1] + 0x81);	// ID of the song containing the instrument
 	}
 	else
 	{
+		AddMarker(MARKER_VOICE_SELECT);
 		WriteByte(arg_array[0]);	// Instrument
 	}
 }
@@ -723,16 +837,16 @@ static void Macro_smpsModSet(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	WriteByte(0xF0);
+	WriteCoordinationFlag(COORDINATION_FLAG_MOD_SET);
 
-	if (target_driver >= 3 && source_driver < 3)
+	if (conversion == CONVERSION_TO_S3K)
 	{
 		WriteByte(arg_array[0] + 1);	// Wait
 		WriteByte(arg_array[1]);	// Speed
 		WriteByte(arg_array[2]);	// Change
 		WriteByte(((arg_array[3] + 1) * arg_array[1]) & 0xFF);	// Step
 	}
-	else if (target_driver < 3 && source_driver >= 3)
+	else if (conversion == CONVERSION_FROM_S3K)
 	{
 		WriteByte(arg_array[0] - 1);	// Wait
 		WriteByte(arg_array[1]);	// Speed
@@ -750,9 +864,9 @@ static void Macro_smpsModSet(unsigned int arg_count, long arg_array[])
 
 static void Macro_smpsModOn(unsigned int arg_count, long arg_array[])
 {
-	if (target_driver >= 3)
+	if (HasCoordinationFlag(COORDINATION_FLAG_MOD_CHANGE))
 	{
-		WriteByte(0xF4);
+		WriteCoordinationFlag(COORDINATION_FLAG_MOD_CHANGE);
 
 		if (arg_count >= 1)
 			WriteByte(arg_array[0]);
@@ -762,9 +876,9 @@ static void Macro_smpsModOn(unsigned int arg_count, long arg_array[])
 	else
 	{
 		if (arg_count >= 1)
-			printf("Warning: Modulation envelopes are not supported in Sonic 1 or Sonic 2 drivers. smpsModOn flag won't work properly.\n");
+			PrintWarning("Warning: Modulation envelopes are not supported in Sonic 1 or Sonic 2 drivers. smpsModOn flag won't work properly.\n");
 		else
-			WriteByte(0xF1);
+			WriteCoordinationFlag(COORDINATION_FLAG_MOD_ON);
 	}
 }
 
@@ -773,14 +887,14 @@ static void Macro_smpsStop(unsigned int arg_count, long arg_array[])
 	(void)arg_count;
 	(void)arg_array;
 
-	WriteByte(0xF2);
+	WriteCoordinationFlag(COORDINATION_FLAG_STOP);
 }
 
 static void Macro_smpsPSGform(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	WriteByte(0xF3);
+	WriteCoordinationFlag(COORDINATION_FLAG_PSG_FORM);
 	WriteByte(arg_array[0]);
 }
 
@@ -789,14 +903,14 @@ static void Macro_smpsModOff(unsigned int arg_count, long arg_array[])
 	(void)arg_count;
 	(void)arg_array;
 
-	WriteByte((target_driver >= 3) ? 0xFA : 0xF4);
+	WriteCoordinationFlag(COORDINATION_FLAG_MOD_OFF);
 }
 
 static void Macro_smpsPSGvoice(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	WriteByte(0xF5);
+	WriteCoordinationFlag(COORDINATION_FLAG_PSG_VOICE);
 	WriteByte(arg_array[0]);
 }
 
@@ -804,38 +918,27 @@ static void Macro_smpsJump(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	WriteByte(0xF6);
-
-	if (target_driver >= 2)
-		WriteShort(arg_array[0]);
-	else
-		WriteShort(arg_array[0] - GetLogicalAddress() - 1);
+	WriteCoordinationFlag(COORDINATION_FLAG_JUMP);
+	WritePointer(arg_array[0]);
 }
 
 static void Macro_smpsLoop(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 3);
 
-	WriteByte(0xF7);
+	WriteCoordinationFlag(COORDINATION_FLAG_LOOP);
 	WriteByte(arg_array[0]);	// Index
 	WriteByte(arg_array[1]);	// Loops
 
-	if (target_driver >= 2)
-		WriteShort(arg_array[2]);	// Location
-	else
-		WriteShort(arg_array[2] - GetLogicalAddress() - 1);	// Location
+	WritePointer(arg_array[2]);	// Location
 }
 
 static void Macro_smpsCall(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	WriteByte(0xF8);
-
-	if (target_driver >= 2)
-		WriteShort(arg_array[0]);
-	else
-		WriteShort(arg_array[0] - GetLogicalAddress() - 1);
+	WriteCoordinationFlag(COORDINATION_FLAG_CALL);
+	WritePointer(arg_array[0]);
 }
 
 static void Macro_smpsFMAlterVol(unsigned int arg_count, long arg_array[])
@@ -844,21 +947,21 @@ static void Macro_smpsFMAlterVol(unsigned int arg_count, long arg_array[])
 
 	if (arg_count >= 2)
 	{
-		if (target_driver >= 3)
+		if (HasCoordinationFlag(COORDINATION_FLAG_FM_ALTER_VOL))
 		{
-			WriteByte(0xE5);
+			WriteCoordinationFlag(COORDINATION_FLAG_FM_ALTER_VOL);
 			WriteByte(arg_array[0]);	// PSG volume delta (ignored in S3/S&K/S3D's driver)
 			WriteByte(arg_array[1]);	// FM volume delta
 		}
 		else
 		{
-			WriteByte(0xE6);
+			WriteCoordinationFlag(COORDINATION_FLAG_ALTER_VOL);
 			WriteByte(arg_array[1]);	// FM volume delta
 		}
 	}
 	else
 	{
-		WriteByte(0xE6);
+		WriteCoordinationFlag(COORDINATION_FLAG_ALTER_VOL);
 		WriteByte(arg_array[0]);	// FM volume delta
 	}
 }
@@ -868,10 +971,10 @@ static void Macro_smpsStopFM(unsigned int arg_count, long arg_array[])
 	(void)arg_count;
 	(void)arg_array;
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_STOP_FM))
 		PrintError("Error: smpsStopFM is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xE3);
+	WriteCoordinationFlag(COORDINATION_FLAG_STOP_FM);
 }
 
 static void Macro_smpsSpindashRev(unsigned int arg_count, long arg_array[])
@@ -879,20 +982,20 @@ static void Macro_smpsSpindashRev(unsigned int arg_count, long arg_array[])
 	(void)arg_count;
 	(void)arg_array;
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_SPINDASH_REV))
 		PrintError("Error: smpsSpindashRev is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xE9);
+	WriteCoordinationFlag(COORDINATION_FLAG_SPINDASH_REV);
 }
 
 static void Macro_smpsPlayDACSample(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_PLAY_DAC_SAMPLE))
 		PrintError("Error: smpsPlayDACSample is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xEA);
+	WriteCoordinationFlag(COORDINATION_FLAG_PLAY_DAC_SAMPLE);
 	WriteByte(arg_array[0] & 0x7F);
 }
 
@@ -900,22 +1003,22 @@ static void Macro_smpsConditionalJump(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 2);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_CONDITIONAL_JUMP))
 		PrintError("Error: smpsConditionalJump is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xEB);
+	WriteCoordinationFlag(COORDINATION_FLAG_CONDITIONAL_JUMP);
 	WriteByte(arg_array[0]);
-	WriteShort(arg_array[1]);
+	WritePointer(arg_array[1]);
 }
 
 static void Macro_smpsSetNote(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_SET_NOTE))
 		PrintError("Error: smpsSetNote is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xED);
+	WriteCoordinationFlag(COORDINATION_FLAG_SET_NOTE);
 	WriteByte(arg_array[0]);
 }
 
@@ -923,10 +1026,10 @@ static void Macro_smpsFMICommand(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 2);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_FMI_COMMAND))
 		PrintError("Error: smpsFMICommand is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xEE);
+	WriteCoordinationFlag(COORDINATION_FLAG_FMI_COMMAND);
 	WriteByte(arg_array[0]);
 	WriteByte(arg_array[1]);
 }
@@ -935,10 +1038,10 @@ static void Macro_smpsModChange2(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 2);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_MOD_CHANGE_2))
 		PrintError("Error: smpsModChange2 is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xF1);
+	WriteCoordinationFlag(COORDINATION_FLAG_MOD_CHANGE_2);
 	WriteByte(arg_array[0]);
 	WriteByte(arg_array[1]);
 }
@@ -947,10 +1050,10 @@ static void Macro_smpsModChange(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_MOD_CHANGE))
 		PrintError("Error: smpsModChange is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xF4);
+	WriteCoordinationFlag(COORDINATION_FLAG_MOD_CHANGE);
 	WriteByte(arg_array[0]);
 }
 
@@ -958,21 +1061,21 @@ static void Macro_smpsContinuousLoop(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_CONTINUOUS_LOOP))
 		PrintError("Error: smpsContinuousLoop is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xFC);
-	WriteShort(arg_array[0]);
+	WriteCoordinationFlag(COORDINATION_FLAG_CONTINUOUS_LOOP);
+	WritePointer(arg_array[0]);
 }
 
 static void Macro_smpsAlternateSMPS(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_ALTERNATE_SMPS))
 		PrintError("Error: smpsAlternateSMPS is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xFD);
+	WriteCoordinationFlag(COORDINATION_FLAG_ALTERNATE_SMPS);
 	WriteByte(arg_array[0]);
 }
 
@@ -980,10 +1083,10 @@ static void Macro_smpsFM3SpecialMode(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_FM3_SPECIAL_MODE))
 		PrintError("Error: smpsFM3SpecialMode is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xFE);
+	WriteCoordinationFlag(COORDINATION_FLAG_FM3_SPECIAL_MODE);
 	WriteByte(arg_array[0]);
 	WriteByte(arg_array[1]);
 	WriteByte(arg_array[2]);
@@ -994,13 +1097,12 @@ static void Macro_smpsPlaySound(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_PLAY_SOUND))
 		PrintError("Error: smpsPlaySound is not supported in Sonic 1 or Sonic 2's driver\n");
-	else if (target_driver >= 5)
-		printf("smpsPlaySound only plays SFX in Flamedriver; use smpsPlayMusic to play music or fade effects.");
+	else if (HasCoordinationFlag(COORDINATION_FLAG_PLAY_MUSIC))
+		PrintWarning("Warning: smpsPlaySound only plays SFX in Flamedriver; use smpsPlayMusic to play music or fade effects.\n");
 
-	WriteByte(0xFF);
-	WriteByte(0x01);
+	WriteCoordinationFlag(COORDINATION_FLAG_PLAY_SOUND);
 	WriteByte(arg_array[0]);
 }
 
@@ -1008,11 +1110,10 @@ static void Macro_smpsHaltMusic(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_HALT_MUSIC))
 		PrintError("Error: smpsHaltMusic is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xFF);
-	WriteByte(0x02);
+	WriteCoordinationFlag(COORDINATION_FLAG_HALT_MUSIC);
 	WriteByte(arg_array[0]);
 }
 
@@ -1020,11 +1121,18 @@ static void Macro_smpsCopyData(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 2);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_COPY_DATA))
 		PrintError("Error: smpsCopyData is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xFF);
-	WriteByte(0x03);
+	WriteCoordinationFlag(COORDINATION_FLAG_COPY_DATA);
+
+	// A label moves with the song like any other pointer, but a plain
+	// address is somewhere outside of it, and stays where it is
+	if (driver->relative_pointers)
+		CheckNotImport(arg_array[0]);
+	else if (symbol_arguments & 1)
+		AddRelocation(arg_array[0]);
+
 	WriteShort(arg_array[0]);
 	WriteByte(arg_array[1]);
 }
@@ -1033,11 +1141,10 @@ static void Macro_smpsSSGEG(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_SSG_EG))
 		PrintError("Error: smpsSSGEG is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xFF);
-	WriteByte(0x05);
+	WriteCoordinationFlag(COORDINATION_FLAG_SSG_EG);
 	WriteByte(arg_array[0]);
 	WriteByte(arg_array[1]);
 	WriteByte(arg_array[2]);
@@ -1048,11 +1155,10 @@ static void Macro_smpsFMVolEnv(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 2);
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_FM_VOL_ENV))
 		PrintError("Error: smpsFMVolEnv is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xFF);
-	WriteByte(0x06);
+	WriteCoordinationFlag(COORDINATION_FLAG_FM_VOL_ENV);
 	WriteByte(arg_array[0]);
 	WriteByte(arg_array[1]);
 }
@@ -1062,22 +1168,20 @@ static void Macro_smpsResetSpindashRev(unsigned int arg_count, long arg_array[])
 	(void)arg_count;
 	(void)arg_array;
 
-	if (target_driver < 3)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_RESET_SPINDASH_REV))
 		PrintError("Error: smpsResetSpindashRev is not supported in Sonic 1 or Sonic 2's driver\n");
 
-	WriteByte(0xFF);
-	WriteByte(0x07);
+	WriteCoordinationFlag(COORDINATION_FLAG_RESET_SPINDASH_REV);
 }
 
 static void Macro_smpsChanFMCommand(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 2);
 
-	if (target_driver < 5)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_CHAN_FM_COMMAND))
 		PrintError("Error: smpsChanFMCommand is only supported in Flamewing's driver\n");
 
-	WriteByte(0xFF);
-	WriteByte(0x09);
+	WriteCoordinationFlag(COORDINATION_FLAG_CHAN_FM_COMMAND);
 	WriteByte(arg_array[0]);
 	WriteByte(arg_array[1]);
 }
@@ -1086,11 +1190,10 @@ static void Macro_smpsPitchSlide(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver < 5)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_PITCH_SLIDE))
 		PrintError("Error: smpsPitchSlide is only supported in Flamewing's driver\n");
 
-	WriteByte(0xFF);
-	WriteByte(0x0B);
+	WriteCoordinationFlag(COORDINATION_FLAG_PITCH_SLIDE);
 	WriteByte(arg_array[0]);
 }
 
@@ -1098,11 +1201,10 @@ static void Macro_smpsSetLFO(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 2);
 
-	if (target_driver < 5)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_SET_LFO))
 		PrintError("Error: smpsSetLFO is only supported in Flamewing's driver\n");
 
-	WriteByte(0xFF);
-	WriteByte(0x0C);
+	WriteCoordinationFlag(COORDINATION_FLAG_SET_LFO);
 	WriteByte(arg_array[0]);
 	WriteByte(arg_array[1]);
 }
@@ -1111,11 +1213,10 @@ static void Macro_smpsPlayMusic(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	if (target_driver < 5)
+	if (!HasCoordinationFlag(COORDINATION_FLAG_PLAY_MUSIC))
 		PrintError("Error: smpsPlayMusic is only supported in Flamewing's driver\n");
 
-	WriteByte(0xFF);
-	WriteByte(0x0D);
+	WriteCoordinationFlag(COORDINATION_FLAG_PLAY_MUSIC);
 	WriteByte(arg_array[0]);
 }
 
@@ -1124,14 +1225,14 @@ static void Macro_smpsMaxRelRate(unsigned int arg_count, long arg_array[])
 	(void)arg_count;
 	(void)arg_array;
 
-	if (target_driver >= 3)
+	if (HasCoordinationFlag(COORDINATION_FLAG_MAX_REL_RATE))
 	{
-		Macro_smpsFMICommand(2, (long[]){0x88, 0x0F});
-		Macro_smpsFMICommand(2, (long[]){0x8C, 0x0F});
+		WriteCoordinationFlag(COORDINATION_FLAG_MAX_REL_RATE);
 	}
 	else
 	{
-		WriteByte(0xF9);
+		Macro_smpsFMICommand(2, (long[]){0x88, 0x0F});
+		Macro_smpsFMICommand(2, (long[]){0x8C, 0x0F});
 	}
 }
 
@@ -1160,295 +1261,198 @@ static void Macro_smpsSetvoice(unsigned int arg_count, long arg_array[])
 	Macro_smpsFMvoice(arg_count, arg_array);
 }
 
-static unsigned int vcFeedback;
-static unsigned int vcAlgorithm;
-static unsigned int vcUnusedBits;
-static unsigned int vcD1R1Unk;
-static unsigned int vcD1R2Unk;
-static unsigned int vcD1R3Unk;
-static unsigned int vcD1R4Unk;
-static unsigned int vcDT1;
-static unsigned int vcDT2;
-static unsigned int vcDT3;
-static unsigned int vcDT4;
-static unsigned int vcCF1;
-static unsigned int vcCF2;
-static unsigned int vcCF3;
-static unsigned int vcCF4;
-static unsigned int vcRS1;
-static unsigned int vcRS2;
-static unsigned int vcRS3;
-static unsigned int vcRS4;
-static unsigned int vcAR1;
-static unsigned int vcAR2;
-static unsigned int vcAR3;
-static unsigned int vcAR4;
-static unsigned int vcAM1;
-static unsigned int vcAM2;
-static unsigned int vcAM3;
-static unsigned int vcAM4;
-static unsigned int vcD1R1;
-static unsigned int vcD1R2;
-static unsigned int vcD1R3;
-static unsigned int vcD1R4;
-static unsigned int vcD2R1;
-static unsigned int vcD2R2;
-static unsigned int vcD2R3;
-static unsigned int vcD2R4;
-static unsigned int vcDL1;
-static unsigned int vcDL2;
-static unsigned int vcDL3;
-static unsigned int vcDL4;
-static unsigned int vcRR1;
-static unsigned int vcRR2;
-static unsigned int vcRR3;
-static unsigned int vcRR4;
-static unsigned int vcTL1;
-static unsigned int vcTL2;
-static unsigned int vcTL3;
-static unsigned int vcTL4;
-static unsigned int vcTLMask1;
-static unsigned int vcTLMask2;
-static unsigned int vcTLMask3;
-static unsigned int vcTLMask4;
+// The voice being assembled by the smpsVc* macros, with one entry per operator
+static struct
+{
+	unsigned int feedback;
+	unsigned int algorithm;
+	unsigned int unused_bits;
+	unsigned int d1r_unknown[4];
+	unsigned int detune[4];
+	unsigned int coarse_freq[4];
+	unsigned int rate_scale[4];
+	unsigned int attack_rate[4];
+	unsigned int amp_mod[4];
+	unsigned int decay_rate_1[4];
+	unsigned int decay_rate_2[4];
+	unsigned int decay_level[4];
+	unsigned int release_rate[4];
+	unsigned int total_level[4];
+	unsigned int total_level_mask[4];
+} voice;
+
+static void SetVoiceOperators(unsigned int operators[4], long arg_array[], unsigned int shift)
+{
+	for (unsigned int i = 0; i < 4; ++i)
+		operators[i] = arg_array[i] << shift;
+}
 
 static void Macro_smpsVcFeedback(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	vcFeedback = arg_array[0];
+	voice.feedback = arg_array[0];
 }
 
 static void Macro_smpsVcAlgorithm(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	vcAlgorithm = arg_array[0];
+	voice.algorithm = arg_array[0];
 }
 
 static void Macro_smpsVcUnusedBits(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 1);
 
-	vcUnusedBits = arg_array[0];
+	voice.unused_bits = arg_array[0];
 
 	if (arg_count >= 5)
-	{
-		vcD1R1Unk = arg_array[1];
-		vcD1R2Unk = arg_array[2];
-		vcD1R3Unk = arg_array[3];
-		vcD1R4Unk = arg_array[4];
-	}
+		SetVoiceOperators(voice.d1r_unknown, &arg_array[1], 0);
 	else
-	{
-		vcD1R1Unk = 0;
-		vcD1R2Unk = 0;
-		vcD1R3Unk = 0;
-		vcD1R4Unk = 0;
-	}
+		SetVoiceOperators(voice.d1r_unknown, (long[]){0, 0, 0, 0}, 0);
 }
 
 static void Macro_smpsVcDetune(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	vcDT1 = arg_array[0];
-	vcDT2 = arg_array[1];
-	vcDT3 = arg_array[2];
-	vcDT4 = arg_array[3];
+	SetVoiceOperators(voice.detune, arg_array, 0);
 }
 
 static void Macro_smpsVcCoarseFreq(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	vcCF1 = arg_array[0];
-	vcCF2 = arg_array[1];
-	vcCF3 = arg_array[2];
-	vcCF4 = arg_array[3];
+	SetVoiceOperators(voice.coarse_freq, arg_array, 0);
 }
 
 static void Macro_smpsVcRateScale(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	vcRS1 = arg_array[0];
-	vcRS2 = arg_array[1];
-	vcRS3 = arg_array[2];
-	vcRS4 = arg_array[3];
+	SetVoiceOperators(voice.rate_scale, arg_array, 0);
 }
 
 static void Macro_smpsVcAttackRate(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	vcAR1 = arg_array[0];
-	vcAR2 = arg_array[1];
-	vcAR3 = arg_array[2];
-	vcAR4 = arg_array[3];
+	SetVoiceOperators(voice.attack_rate, arg_array, 0);
 }
 
 static void Macro_smpsVcAmpMod(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	if (target_smps2asm_version == 0)
-	{
-		vcAM1 = arg_array[0] << 5;
-		vcAM2 = arg_array[1] << 5;
-		vcAM3 = arg_array[2] << 5;
-		vcAM4 = arg_array[3] << 5;
-	}
-	else
-	{
-		vcAM1 = arg_array[0] << 7;
-		vcAM2 = arg_array[1] << 7;
-		vcAM3 = arg_array[2] << 7;
-		vcAM4 = arg_array[3] << 7;
-	}
+	SetVoiceOperators(voice.amp_mod, arg_array, (target_smps2asm_version == 0) ? 5 : 7);
 }
 
 static void Macro_smpsVcDecayRate1(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	vcD1R1 = arg_array[0];
-	vcD1R2 = arg_array[1];
-	vcD1R3 = arg_array[2];
-	vcD1R4 = arg_array[3];
+	SetVoiceOperators(voice.decay_rate_1, arg_array, 0);
 }
 
 static void Macro_smpsVcDecayRate2(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	vcD2R1 = arg_array[0];
-	vcD2R2 = arg_array[1];
-	vcD2R3 = arg_array[2];
-	vcD2R4 = arg_array[3];
+	SetVoiceOperators(voice.decay_rate_2, arg_array, 0);
 }
 
 static void Macro_smpsVcDecayLevel(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	vcDL1 = arg_array[0];
-	vcDL2 = arg_array[1];
-	vcDL3 = arg_array[2];
-	vcDL4 = arg_array[3];
+	SetVoiceOperators(voice.decay_level, arg_array, 0);
 }
 
 static void Macro_smpsVcReleaseRate(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	vcRR1 = arg_array[0];
-	vcRR2 = arg_array[1];
-	vcRR3 = arg_array[2];
-	vcRR4 = arg_array[3];
+	SetVoiceOperators(voice.release_rate, arg_array, 0);
 }
 
 static void Macro_smpsVcTotalLevel(unsigned int arg_count, long arg_array[])
 {
 	assert(arg_count >= 4);
 
-	vcTL1 = arg_array[0];
-	vcTL2 = arg_array[1];
-	vcTL3 = arg_array[2];
-	vcTL4 = arg_array[3];
+	SetVoiceOperators(voice.total_level, arg_array, 0);
 
-	WriteByte((vcUnusedBits << 6) + (vcFeedback << 3) + vcAlgorithm);
+	AddMarker(MARKER_VOICE);
+	WriteByte((voice.unused_bits << 6) + (voice.feedback << 3) + voice.algorithm);
 
-	if (target_smps2asm_version == 0)
-	{
-		vcTLMask4 = ((vcAlgorithm == 7) << 7);
-		vcTLMask3 = ((vcAlgorithm >= 4) << 7);
-		vcTLMask2 = ((vcAlgorithm >= 5) << 7);
-		vcTLMask1 = 0x80;
-	}
-	else
-	{
-		vcTLMask4 = 0;
-		vcTLMask3 = 0;
-		vcTLMask2 = 0;
-		vcTLMask1 = 0;
-	}
+	// Which operators are carriers, and so have their TL bit 7 set in S3K-style voices
+	const unsigned int carrier_masks[4] = {
+		0x80,
+		(voice.algorithm >= 5) << 7,
+		(voice.algorithm >= 4) << 7,
+		(voice.algorithm == 7) << 7
+	};
 
-	if (target_driver >= 3 && source_driver < 3)
-	{
-		vcTLMask4 = ((vcAlgorithm == 7) << 7);
-		vcTLMask3 = ((vcAlgorithm >= 4) << 7);
-		vcTLMask2 = ((vcAlgorithm >= 5) << 7);
-		vcTLMask1 = 0x80;
-
-		vcTL1 &= 0x7F;
-		vcTL2 &= 0x7F;
-		vcTL3 &= 0x7F;
-		vcTL4 &= 0x7F;
-	}
-	else if (target_driver < 3 && source_driver >= 3 && ((vcTL1 & 0x80) || (vcTL2 & 0x80 && vcAlgorithm >= 5) || (vcTL3 & 0x80 && vcAlgorithm >= 4) || (vcTL4 & 0x80 && vcAlgorithm == 7)))
-	{
-		printf("Warning: Voice 0x%X has TL bits that do not match its algorithm setting. This voice will not work in S1/S2 drivers.\n", current_voice);
-	}
+	for (unsigned int i = 0; i < 4; ++i)
+		voice.total_level_mask[i] = (target_smps2asm_version == 0) ? carrier_masks[i] : 0;
 
-	if (target_driver == 2)
+	if (conversion == CONVERSION_TO_S3K)
 	{
-		WriteByte((vcDT4<<4)+vcCF4);
-		WriteByte((vcDT2<<4)+vcCF2);
-		WriteByte((vcDT3<<4)+vcCF3);
-		WriteByte((vcDT1<<4)+vcCF1);
-		WriteByte((vcRS4<<6)+vcAR4);
-		WriteByte((vcRS2<<6)+vcAR2);
-		WriteByte((vcRS3<<6)+vcAR3);
-		WriteByte((vcRS1<<6)+vcAR1);
-		WriteByte(vcAM4|vcD1R4|vcD1R4Unk);
-		WriteByte(vcAM2|vcD1R2|vcD1R2Unk);
-		WriteByte(vcAM3|vcD1R3|vcD1R3Unk);
-		WriteByte(vcAM1|vcD1R1|vcD1R1Unk);
-		WriteByte(vcD2R4);
-		WriteByte(vcD2R2);
-		WriteByte(vcD2R3);
-		WriteByte(vcD2R1);
-		WriteByte((vcDL4<<4)+vcRR4);
-		WriteByte((vcDL2<<4)+vcRR2);
-		WriteByte((vcDL3<<4)+vcRR3);
-		WriteByte((vcDL1<<4)+vcRR1);
-		WriteByte(vcTL4|vcTLMask4);
-		WriteByte(vcTL2|vcTLMask2);
-		WriteByte(vcTL3|vcTLMask3);
-		WriteByte(vcTL1|vcTLMask1);
+		for (unsigned int i = 0; i < 4; ++i)
+		{
+			voice.total_level_mask[i] = carrier_masks[i];
+			voice.total_level[i] &= 0x7F;
+		}
 	}
-	else
+	else if (conversion == CONVERSION_FROM_S3K)
 	{
-		WriteByte((vcDT4<<4)+vcCF4);
-		WriteByte((vcDT3<<4)+vcCF3);
-		WriteByte((vcDT2<<4)+vcCF2);
-		WriteByte((vcDT1<<4)+vcCF1);
-		WriteByte((vcRS4<<6)+vcAR4);
-		WriteByte((vcRS3<<6)+vcAR3);
-		WriteByte((vcRS2<<6)+vcAR2);
-		WriteByte((vcRS1<<6)+vcAR1);
-		WriteByte(vcAM4|vcD1R4|vcD1R4Unk);
-		WriteByte(vcAM3|vcD1R3|vcD1R3Unk);
-		WriteByte(vcAM2|vcD1R2|vcD1R2Unk);
-		WriteByte(vcAM1|vcD1R1|vcD1R1Unk);
-		WriteByte(vcD2R4);
-		WriteByte(vcD2R3);
-		WriteByte(vcD2R2);
-		WriteByte(vcD2R1);
-		WriteByte((vcDL4<<4)+vcRR4);
-		WriteByte((vcDL3<<4)+vcRR3);
-		WriteByte((vcDL2<<4)+vcRR2);
-		WriteByte((vcDL1<<4)+vcRR1);
-		WriteByte(vcTL4|vcTLMask4);
-		WriteByte(vcTL3|vcTLMask3);
-		WriteByte(vcTL2|vcTLMask2);
-		WriteByte(vcTL1|vcTLMask1);
+		for (unsigned int i = 0; i < 4; ++i)
+		{
+			if ((voice.total_level[i] & carrier_masks[i]) != 0)
+			{
+				PrintWarning("Warning: Voice 0x%X has TL bits that do not match its algorithm setting. This voice will not work in S1/S2 drivers.\n", current_voice);
+				break;
+			}
+		}
 	}
 
+	const unsigned char *order = driver->voice_operator_order;
+
+	for (unsigned int i = 0; i < 4; ++i)
+		WriteByte((voice.detune[order[i]] << 4) + voice.coarse_freq[order[i]]);
+
+	for (unsigned int i = 0; i < 4; ++i)
+		WriteByte((voice.rate_scale[order[i]] << 6) + voice.attack_rate[order[i]]);
+
+	for (unsigned int i = 0; i < 4; ++i)
+		WriteByte(voice.amp_mod[order[i]] | voice.decay_rate_1[order[i]] | voice.d1r_unknown[order[i]]);
+
+	for (unsigned int i = 0; i < 4; ++i)
+		WriteByte(voice.decay_rate_2[order[i]]);
+
+	for (unsigned int i = 0; i < 4; ++i)
+		WriteByte((voice.decay_level[order[i]] << 4) + voice.release_rate[order[i]]);
+
+	for (unsigned int i = 0; i < 4; ++i)
+		WriteByte(voice.total_level[order[i]] | voice.total_level_mask[order[i]]);
+
 	++current_voice;
 }
 
+// The 68k's 'dc.b' instruction
+static void Directive_dcb(unsigned int arg_count, long arg_array[])
+{
+	for (unsigned int i = 0; i < arg_count; ++i)
+	{
+		const long value = arg_array[i];
+
+		if (value > 0xFF)
+			PrintError("Error: dc.b value must fit into a byte\n");
+
+		WriteByte(value);
+	}
+}
+
 // This array matches each SMPS2ASM macro name to a matching function
 static const struct
 {
@@ -1532,50 +1536,35 @@ static const struct
 	{"smpsVcDecayLevel",        Macro_smpsVcDecayLevel},
 	{"smpsVcReleaseRate",       Macro_smpsVcReleaseRate},
 	{"smpsVcTotalLevel",        Macro_smpsVcTotalLevel},
+	{"dc.b",                    Directive_dcb},
 };
 
-void HandleInstruction(char *opcode, unsigned int arg_count, char *arg_array[])
+int FindInstruction(const char *opcode)
 {
-	long *int_arg_array = malloc(sizeof(long) * arg_count);
-	if (int_arg_array == NULL)
-	{
-		PrintError("Error: malloc failed. Great.");
-		return;
-	}
-
-	// Convert arguments from symbols to numbers (*everything* resolves to a number eventually - code, labels, constants, etc.)
-	for (unsigned int i = 0; i < arg_count; ++i)
-		int_arg_array[i] = LookupDictionary(arg_array[i]);
-
-	// Execute the function that matches the instruction
 	for (unsigned int i = 0; i < sizeof(symbol_function_table) / sizeof(symbol_function_table[0]); ++i)
-	{
 		if (strcmp(opcode, symbol_function_table[i].symbol) == 0)
-		{
-			symbol_function_table[i].function(arg_count, int_arg_array);
-			free(int_arg_array);
-			return;
-		}
-	}
+			return i;
 
-	// If the instruction doesn't match any of the SMPS2ASM macros, check if it's the 68k's 'dc.b' instruction
-	if (strcmp(opcode, "dc.b") == 0)
-	{
-		for (unsigned int i = 0; i < arg_count; ++i)
-		{
-			const long value = int_arg_array[i];
+	return -1;
+}
 
-			if (value > 0xFF)
-				PrintError("Error: dc.b value must fit into a byte\n");
+unsigned int GetInstructionCount(void)
+{
+	return sizeof(symbol_function_table) / sizeof(symbol_function_table[0]);
+}
 
-			WriteByte(value);
-		}
-	}
-	else
-	{
-		// Oh no
-		PrintError("Error: Unhandled instruction: '%s'\n", opcode);
-	}
+// Changes whenever the table does, so that cached instruction indices can be invalidated
+unsigned long GetInstructionTableHash(void)
+{
+	unsigned long hash = 0;
+
+	for (unsigned int i = 0; i < sizeof(symbol_function_table) / sizeof(symbol_function_table[0]); ++i)
+		hash = (hash * 31 + HashSymbol(symbol_function_table[i].symbol)) & 0xFFFFFFFF;
 
-	free(int_arg_array);
+	return hash;
+}
+
+void ExecuteInstruction(int instruction, unsigned int arg_count, long arg_array[])
+{
+	symbol_function_table[instruction].function(arg_count, arg_array);
 }
@@ -1,12 +1,45 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 
 #include "memory_stream.h"
 
+// Labels from other songs stand in for their addresses with placeholders in this range
+#define IMPORT_BASE 0x10000000
+#define IMPORT_STRIDE 0x10000
+#define MAX_IMPORTS 0x1000
+
+// Places in the output that passes over assembled data need to find
+typedef enum Marker
+{
+	MARKER_SONG,			// Start of a song's header
+	MARKER_VOICE_POINTER,		// smpsHeaderVoice's pointer
+	MARKER_VOICE,			// Start of a voice
+	MARKER_VOICE_SELECT,		// smpsFMvoice's index into the song's own voices
+	MARKER_EXTERNAL_VOICE_SELECT,	// smpsFMvoice's index into another song's voices
+	MARKER_CHANNEL_POINTER		// Pointer to a track from the song's header
+} Marker;
+
 extern size_t file_offset;
-extern unsigned int target_driver;
+extern unsigned long symbol_arguments;		// Which arguments of the current instruction were symbols rather than numbers, one bit each
 
+// Set when assembling an object, to learn what needs patching when it's moved or linked
+extern void (*relocation_callback)(size_t output_position);
+extern void (*fixup_callback)(size_t output_position, unsigned int import, long addend);
+extern void (*label_callback)(const char *label, size_t output_position);
+extern void (*marker_callback)(Marker marker, size_t output_position);
+
+bool SetTargetDriver(unsigned int version);
 void FillDefaultDictionary(void);
-void HandleLabel(char *label);
-void HandleInstruction(char *opcode, unsigned int arg_count, char *arg_array[]);
+void HandleLabel(const char *label, unsigned long hash);
+unsigned long GetImportPlaceholder(unsigned int import);
+int FindInstruction(const char *opcode);
+unsigned int GetInstructionCount(void);
+unsigned long GetInstructionTableHash(void);
+void ExecuteInstruction(int instruction, unsigned int arg_count, long arg_array[]);
+
+// The symbols for notes, PSG envelopes and DAC samples, or NULL if there isn't one for that value
+const char* GetNoteName(unsigned int value);
+const char* GetPSGEnvelopeName(unsigned int driver_version, unsigned int id);
+const char* GetDACSampleName(unsigned int driver_version, unsigned int id);
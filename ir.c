@@ -0,0 +1,808 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define IR_USE_MMAP
+#endif
+
+#include "ir.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef IR_USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "dictionary.h"
+#include "instruction.h"
+#include "memory_stream.h"
+#include "thread.h"
+
+// Bump this whenever the cache's layout changes
+#define IR_CACHE_MAGIC "SMPSIR\0\1"
+
+// Files smaller than this aren't worth splitting up
+#define MINIMUM_CHUNK_SIZE 0x10000
+#define MAXIMUM_CHUNKS 0x40
+
+typedef struct Chunk
+{
+	char *strings;
+	size_t start;
+	size_t end;
+
+	IRLine *lines;
+	size_t line_count;
+	size_t line_capacity;
+
+	IRArgument *arguments;
+	size_t argument_count;
+	size_t argument_capacity;
+
+	unsigned long newline_count;
+} Chunk;
+
+static void AddArgument(Chunk *chunk, char *argument)
+{
+	if (chunk->argument_count == chunk->argument_capacity)
+	{
+		chunk->argument_capacity = (chunk->argument_capacity == 0) ? 0x100 : chunk->argument_capacity * 2;
+		chunk->arguments = realloc(chunk->arguments, sizeof(*chunk->arguments) * chunk->argument_capacity);
+	}
+
+	IRArgument *ir_argument = &chunk->arguments[chunk->argument_count++];
+
+	ir_argument->name = argument - chunk->strings;
+	ir_argument->is_literal = ParseLiteral(argument, &ir_argument->value);
+	ir_argument->hash = ir_argument->is_literal ? 0 : HashSymbol(argument);
+}
+
+static void LexLine(Chunk *chunk, char *line, unsigned long line_number)
+{
+	// Remove comments
+	char *comment_start = strchr(line, ';');
+	if (comment_start)
+		*comment_start = '\0';
+
+	IRLine ir_line;
+	ir_line.line = line_number;
+	ir_line.label = IR_NONE;
+	ir_line.label_hash = 0;
+	ir_line.instruction = IR_NONE;
+	ir_line.instruction_index = -1;
+	ir_line.first_argument = chunk->argument_count;
+	ir_line.argument_count = 0;
+
+	// Look for a label
+	const size_t size_of_label = strcspn(line, " \t:");
+	size_t size_of_whitespace = strspn(line + size_of_label, " \t:");
+
+	if (size_of_label != 0)
+	{
+		// We found a label!
+		line[size_of_label] = '\0';
+		ir_line.label = line - chunk->strings;
+		ir_line.label_hash = HashSymbol(line);
+	}
+
+	line += size_of_label + size_of_whitespace;
+
+	// Look for an instruction
+	const size_t size_of_instruction = strcspn(line, " \t");
+
+	if (size_of_instruction != 0)
+	{
+		size_t size_of_whitespace = strspn(line + size_of_instruction, " \t");
+
+		// We found an instruction!
+		line[size_of_instruction] = '\0';
+		ir_line.instruction = line - chunk->strings;
+		ir_line.instruction_index = FindInstruction(line);
+
+		// Look for the instruction's arguments
+		line += size_of_instruction + size_of_whitespace;
+
+		for (;;)
+		{
+			const size_t size_of_arg = strcspn(line, " \t,");
+			const size_t size_of_whitespace = strspn(line + size_of_arg, " \t,");
+			const bool is_last_arg = strchr(line, ',') == NULL;
+
+			if (size_of_arg != 0)
+			{
+				// We found an argument!
+				line[size_of_arg] = '\0';
+				AddArgument(chunk, line);
+				++ir_line.argument_count;
+
+				if (is_last_arg)
+					break;
+
+				line += size_of_arg + size_of_whitespace;
+			}
+			else
+				break;
+
+		}
+	}
+
+	if (ir_line.label == IR_NONE && ir_line.instruction == IR_NONE)
+		return;
+
+	if (chunk->line_count == chunk->line_capacity)
+	{
+		chunk->line_capacity = (chunk->line_capacity == 0) ? 0x100 : chunk->line_capacity * 2;
+		chunk->lines = realloc(chunk->lines, sizeof(*chunk->lines) * chunk->line_capacity);
+	}
+
+	chunk->lines[chunk->line_count++] = ir_line;
+}
+
+static void LexChunk(void *user_data, unsigned int index)
+{
+	Chunk *chunk = &((Chunk*)user_data)[index];
+
+	size_t position = chunk->start;
+
+	// Line numbers are relative to the start of the chunk until they're stitched together
+	unsigned long line_number = 0;
+
+	for (;;)
+	{
+		const size_t size_of_line = strcspn(chunk->strings + position, "\r\n");
+		const char line_ending = chunk->strings[position + size_of_line];
+
+		chunk->strings[position + size_of_line] = '\0';
+
+		LexLine(chunk, chunk->strings + position, line_number);
+
+		if (position + size_of_line >= chunk->end)
+			break;
+
+		position += size_of_line + 1;
+
+		// Treat "\r\n" as a single line ending
+		if (line_ending == '\r' && chunk->strings[position] == '\n')
+			++position;
+
+		++line_number;
+
+		// Chunks end with a line ending, and the line after it belongs to the next chunk
+		if (position >= chunk->end)
+			break;
+	}
+
+	chunk->newline_count = line_number;
+}
+
+IR* IR_Lex(char *buffer, size_t buffer_size)
+{
+	// Split the file into chunks at line boundaries, so that each one can be lexed independently
+	unsigned int chunk_count = Thread_GetCount();
+
+	if (chunk_count > buffer_size / MINIMUM_CHUNK_SIZE)
+		chunk_count = buffer_size / MINIMUM_CHUNK_SIZE;
+
+	if (chunk_count > MAXIMUM_CHUNKS)
+		chunk_count = MAXIMUM_CHUNKS;
+
+	if (chunk_count == 0)
+		chunk_count = 1;
+
+	Chunk *chunks = calloc(chunk_count, sizeof(*chunks));
+
+	size_t position = 0;
+
+	for (unsigned int i = 0; i < chunk_count; ++i)
+	{
+		chunks[i].strings = buffer;
+		chunks[i].start = position;
+
+		if (i == chunk_count - 1)
+		{
+			position = buffer_size;
+		}
+		else
+		{
+			// Aim for an even split, then move forward to the end of the line
+			size_t end = buffer_size * (i + 1) / chunk_count;
+
+			if (end < position)
+				end = position;
+
+			const char *newline = memchr(buffer + end, '\n', buffer_size - end);
+			position = (newline == NULL) ? buffer_size : (size_t)(newline - buffer) + 1;
+		}
+
+		chunks[i].end = position;
+	}
+
+	Thread_RunParallel(LexChunk, chunks, chunk_count);
+
+	// Stitch the chunks together
+	IR *ir = malloc(sizeof(*ir));
+
+	ir->strings = buffer;
+	ir->strings_size = buffer_size + 1;
+	ir->line_count = 0;
+	ir->argument_count = 0;
+
+	for (unsigned int i = 0; i < chunk_count; ++i)
+	{
+		ir->line_count += chunks[i].line_count;
+		ir->argument_count += chunks[i].argument_count;
+	}
+
+	ir->lines = malloc(sizeof(*ir->lines) * ir->line_count);
+	ir->arguments = malloc(sizeof(*ir->arguments) * ir->argument_count);
+	ir->storage = NULL;
+	ir->storage_size = 0;
+	ir->strings_capacity = ir->strings_size;
+	ir->line_capacity = ir->line_count;
+	ir->argument_capacity = ir->argument_count;
+
+	size_t line_index = 0;
+	size_t argument_index = 0;
+	unsigned long line_number = 1;
+
+	for (unsigned int i = 0; i < chunk_count; ++i)
+	{
+		for (size_t j = 0; j < chunks[i].line_count; ++j)
+		{
+			IRLine *ir_line = &ir->lines[line_index++];
+
+			*ir_line = chunks[i].lines[j];
+			ir_line->line += line_number;
+			ir_line->first_argument += argument_index;
+		}
+
+		if (chunks[i].argument_count != 0)
+			memcpy(&ir->arguments[argument_index], chunks[i].arguments, sizeof(*ir->arguments) * chunks[i].argument_count);
+
+		argument_index += chunks[i].argument_count;
+		line_number += chunks[i].newline_count;
+
+		free(chunks[i].lines);
+		free(chunks[i].arguments);
+	}
+
+	free(chunks);
+
+	return ir;
+}
+
+// Starts an empty IR, for sources that aren't text to be filled in line by line
+IR* IR_Create(void)
+{
+	IR *ir = calloc(1, sizeof(*ir));
+
+	return ir;
+}
+
+static uint32_t AddString(IR *ir, const char *string)
+{
+	const size_t length = strlen(string) + 1;
+
+	if (ir->strings_size + length > ir->strings_capacity)
+	{
+		ir->strings_capacity = (ir->strings_capacity == 0) ? 0x1000 : ir->strings_capacity * 2;
+
+		if (ir->strings_capacity < ir->strings_size + length)
+			ir->strings_capacity = ir->strings_size + length;
+
+		ir->strings = realloc(ir->strings, ir->strings_capacity);
+	}
+
+	const uint32_t offset = ir->strings_size;
+
+	memcpy(ir->strings + offset, string, length);
+	ir->strings_size += length;
+
+	return offset;
+}
+
+// Either 'label' or 'instruction' can be NULL, as in source files
+void IR_AddLine(IR *ir, const char *label, const char *instruction)
+{
+	if (ir->line_count == ir->line_capacity)
+	{
+		ir->line_capacity = (ir->line_capacity == 0) ? 0x100 : ir->line_capacity * 2;
+		ir->lines = realloc(ir->lines, sizeof(*ir->lines) * ir->line_capacity);
+	}
+
+	IRLine *line = &ir->lines[ir->line_count];
+
+	line->line = ir->line_count + 1;
+	line->label = (label != NULL) ? AddString(ir, label) : IR_NONE;
+	line->label_hash = (label != NULL) ? HashSymbol(label) : 0;
+	line->instruction = (instruction != NULL) ? AddString(ir, instruction) : IR_NONE;
+	line->instruction_index = (instruction != NULL) ? FindInstruction(instruction) : -1;
+	line->first_argument = ir->argument_count;
+	line->argument_count = 0;
+
+	++ir->line_count;
+}
+
+// Adds an argument to the last line, written as it would be in a source file
+void IR_AddArgument(IR *ir, const char *argument)
+{
+	if (ir->argument_count == ir->argument_capacity)
+	{
+		ir->argument_capacity = (ir->argument_capacity == 0) ? 0x100 : ir->argument_capacity * 2;
+		ir->arguments = realloc(ir->arguments, sizeof(*ir->arguments) * ir->argument_capacity);
+	}
+
+	IRArgument *ir_argument = &ir->arguments[ir->argument_count++];
+
+	ir_argument->name = AddString(ir, argument);
+	ir_argument->is_literal = ParseLiteral(argument, &ir_argument->value);
+	ir_argument->hash = ir_argument->is_literal ? 0 : HashSymbol(argument);
+
+	++ir->lines[ir->line_count - 1].argument_count;
+}
+
+// Counts lines the way that the lexer does, with "\r\n" as a single line ending
+static unsigned long CountLines(const char *text, size_t text_size)
+{
+	unsigned long line_count = 1;
+
+	for (size_t i = 0; i < text_size; ++i)
+		if (text[i] == '\n' || (text[i] == '\r' && (i + 1 == text_size || text[i + 1] != '\n')))
+			++line_count;
+
+	return line_count;
+}
+
+// Replaces whatever was lexed from source lines 'first_line' to
+// 'first_line' + 'line_count' - 1 (counting from 1) with what 'text' lexes to,
+// and renumbers the lines after them to match, so that an edit only needs the
+// lines that it touched to be lexed again. The replaced lines' strings are left
+// in the pool. The IR can't be one that was loaded from a cache.
+void IR_Splice(IR *ir, unsigned long first_line, unsigned long line_count, const char *text, size_t text_size)
+{
+	char *buffer = malloc(text_size + 1);
+	memcpy(buffer, text, text_size);
+	buffer[text_size] = '\0';
+
+	IR *new_ir = IR_Lex(buffer, text_size);
+
+	// The replaced lines are all together, and so are their arguments
+	size_t first = 0;
+
+	while (first < ir->line_count && ir->lines[first].line < first_line)
+		++first;
+
+	size_t last = first;
+
+	while (last < ir->line_count && ir->lines[last].line < first_line + line_count)
+		++last;
+
+	const size_t first_argument = (first < ir->line_count) ? ir->lines[first].first_argument : ir->argument_count;
+	const size_t last_argument = (last < ir->line_count) ? ir->lines[last].first_argument : ir->argument_count;
+
+	const size_t new_line_count = ir->line_count - (last - first) + new_ir->line_count;
+	const size_t new_argument_count = ir->argument_count - (last_argument - first_argument) + new_ir->argument_count;
+	const uint32_t string_base = ir->strings_size;
+
+	if (ir->strings_size + new_ir->strings_size > ir->strings_capacity)
+	{
+		ir->strings_capacity = ir->strings_capacity * 2;
+
+		if (ir->strings_capacity < ir->strings_size + new_ir->strings_size)
+			ir->strings_capacity = ir->strings_size + new_ir->strings_size;
+
+		ir->strings = realloc(ir->strings, ir->strings_capacity);
+	}
+
+	if (new_line_count > ir->line_capacity)
+	{
+		ir->line_capacity = new_line_count;
+		ir->lines = realloc(ir->lines, sizeof(*ir->lines) * ir->line_capacity);
+	}
+
+	if (new_argument_count > ir->argument_capacity)
+	{
+		ir->argument_capacity = new_argument_count;
+		ir->arguments = realloc(ir->arguments, sizeof(*ir->arguments) * ir->argument_capacity);
+	}
+
+	memcpy(ir->strings + string_base, new_ir->strings, new_ir->strings_size);
+	ir->strings_size += new_ir->strings_size;
+
+	// Make room, and move the lines after the edit to where they are now
+	const long line_shift = (long)CountLines(text, text_size) - (long)line_count;
+	const long argument_shift = (long)new_ir->argument_count - (long)(last_argument - first_argument);
+
+	if (last != ir->line_count)
+		memmove(&ir->lines[first + new_ir->line_count], &ir->lines[last], sizeof(*ir->lines) * (ir->line_count - last));
+
+	if (last_argument != ir->argument_count)
+		memmove(&ir->arguments[first_argument + new_ir->argument_count], &ir->arguments[last_argument], sizeof(*ir->arguments) * (ir->argument_count - last_argument));
+
+	for (size_t i = first + new_ir->line_count; i < new_line_count; ++i)
+	{
+		ir->lines[i].line += line_shift;
+		ir->lines[i].first_argument += argument_shift;
+	}
+
+	// Slot in the new lines, pointing into the pool and the arrays where they are now
+	for (size_t i = 0; i < new_ir->line_count; ++i)
+	{
+		IRLine *line = &ir->lines[first + i];
+
+		*line = new_ir->lines[i];
+		line->line += first_line - 1;
+		line->first_argument += first_argument;
+
+		if (line->label != IR_NONE)
+			line->label += string_base;
+
+		if (line->instruction != IR_NONE)
+			line->instruction += string_base;
+	}
+
+	for (size_t i = 0; i < new_ir->argument_count; ++i)
+	{
+		IRArgument *argument = &ir->arguments[first_argument + i];
+
+		*argument = new_ir->arguments[i];
+		argument->name += string_base;
+	}
+
+	ir->line_count = new_line_count;
+	ir->argument_count = new_argument_count;
+
+	IR_Destroy(new_ir);
+}
+
+static void WriteString(MemoryStream *stream, const char *string)
+{
+	MemoryStream_WriteBytes(stream, (unsigned char*)string, strlen(string));
+}
+
+// Writes the IR back out as source code, one label or instruction per line
+void IR_Write(const IR *ir, MemoryStream *stream)
+{
+	for (size_t i = 0; i < ir->line_count; ++i)
+	{
+		const IRLine *line = &ir->lines[i];
+
+		if (line->label != IR_NONE)
+		{
+			WriteString(stream, ir->strings + line->label);
+			WriteString(stream, ":\n");
+		}
+
+		if (line->instruction != IR_NONE)
+		{
+			WriteString(stream, "\t");
+			WriteString(stream, ir->strings + line->instruction);
+
+			for (uint32_t j = 0; j < line->argument_count; ++j)
+			{
+				WriteString(stream, (j == 0) ? "\t" : ", ");
+				WriteString(stream, ir->strings + ir->arguments[line->first_argument + j].name);
+			}
+
+			WriteString(stream, "\n");
+		}
+	}
+}
+
+void IR_Destroy(IR *ir)
+{
+	if (ir->storage != NULL)
+	{
+	#ifdef IR_USE_MMAP
+		munmap(ir->storage, ir->storage_size);
+	#else
+		free(ir->storage);
+	#endif
+	}
+	else
+	{
+		free(ir->strings);
+		free(ir->lines);
+		free(ir->arguments);
+	}
+
+	free(ir);
+}
+
+unsigned long long IR_HashSource(const char *buffer, size_t buffer_size)
+{
+	// FNV-1a
+	unsigned long long hash = 0xCBF29CE484222325;
+
+	for (size_t i = 0; i < buffer_size; ++i)
+		hash = (hash ^ (unsigned char)buffer[i]) * 0x100000001B3;
+
+	return hash;
+}
+
+// The cache is a straight dump of the IR's arrays, so that it can be used
+// without being parsed. This makes it specific to the machine and build that
+// made it, so the header records enough to reject anything else.
+typedef struct CacheHeader
+{
+	char magic[8];
+	unsigned long long layout;
+	unsigned long long instruction_table_hash;
+	unsigned long long source_hash;
+	unsigned long long source_size;
+	unsigned long long strings_size;
+	unsigned long long line_count;
+	unsigned long long argument_count;
+} CacheHeader;
+
+static size_t AlignCacheOffset(size_t offset)
+{
+	return (offset + 0xF) & ~(size_t)0xF;
+}
+
+static void FillCacheHeader(CacheHeader *header, unsigned long long source_hash, size_t source_size)
+{
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, IR_CACHE_MAGIC, sizeof(header->magic));
+	header->layout = sizeof(size_t) | (sizeof(long) << 8) | (sizeof(IRLine) << 16) | (sizeof(IRArgument) << 24);
+	header->instruction_table_hash = GetInstructionTableHash();
+	header->source_hash = source_hash;
+	header->source_size = source_size;
+}
+
+static bool IsStringValid(const IR *ir, uint32_t offset)
+{
+	return offset < ir->strings_size;
+}
+
+// The cache is used without being parsed, so a corrupt one could point
+// anywhere. Everything that the assembler follows is checked to stay inside
+// the arrays, including the instruction table's indices, and the string pool
+// has to end with a terminator so that no string runs off the end of it.
+static bool IsCacheValid(const IR *ir)
+{
+	const unsigned int instruction_count = GetInstructionCount();
+
+	if (ir->strings_size != 0 && ir->strings[ir->strings_size - 1] != '\0')
+		return false;
+
+	for (size_t i = 0; i < ir->line_count; ++i)
+	{
+		const IRLine *line = &ir->lines[i];
+
+		if (line->label != IR_NONE && !IsStringValid(ir, line->label))
+			return false;
+
+		if (line->instruction != IR_NONE && !IsStringValid(ir, line->instruction))
+			return false;
+
+		if (line->instruction_index < -1 || (line->instruction_index != -1 && (unsigned int)line->instruction_index >= instruction_count))
+			return false;
+
+		if (line->first_argument > ir->argument_count || line->argument_count > ir->argument_count - line->first_argument)
+			return false;
+	}
+
+	for (size_t i = 0; i < ir->argument_count; ++i)
+		if (!IsStringValid(ir, ir->arguments[i].name))
+			return false;
+
+	return true;
+}
+
+IR* IR_Load(const char *file_name, unsigned long long source_hash, size_t source_size)
+{
+	void *storage;
+	size_t storage_size;
+
+#ifdef IR_USE_MMAP
+	const int file = open(file_name, O_RDONLY);
+
+	if (file == -1)
+		return NULL;
+
+	struct stat file_status;
+
+	if (fstat(file, &file_status) != 0 || (size_t)file_status.st_size < sizeof(CacheHeader))
+	{
+		close(file);
+		return NULL;
+	}
+
+	storage_size = file_status.st_size;
+	storage = mmap(NULL, storage_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (storage == MAP_FAILED)
+		return NULL;
+#else
+	FILE *file = fopen(file_name, "rb");
+
+	if (file == NULL)
+		return NULL;
+
+	fseek(file, 0, SEEK_END);
+	storage_size = ftell(file);
+	rewind(file);
+
+	storage = malloc(storage_size);
+
+	if (storage_size < sizeof(CacheHeader) || fread(storage, 1, storage_size, file) != storage_size)
+	{
+		free(storage);
+		fclose(file);
+		return NULL;
+	}
+
+	fclose(file);
+#endif
+
+	const CacheHeader *header = (const CacheHeader*)storage;
+	CacheHeader expected_header;
+	FillCacheHeader(&expected_header, source_hash, source_size);
+
+	// The counts are checked against the file's size before anything is worked out from them,
+	// so that a corrupt header can't overflow the offsets into something that looks valid
+	const bool counts_fit = header->strings_size <= storage_size && header->line_count <= storage_size / sizeof(IRLine) && header->argument_count <= storage_size / sizeof(IRArgument);
+
+	const size_t strings_offset = AlignCacheOffset(sizeof(CacheHeader));
+	const size_t lines_offset = counts_fit ? AlignCacheOffset(strings_offset + header->strings_size) : 0;
+	const size_t arguments_offset = counts_fit ? AlignCacheOffset(lines_offset + header->line_count * sizeof(IRLine)) : 0;
+	const size_t end_offset = counts_fit ? arguments_offset + header->argument_count * sizeof(IRArgument) : 0;
+
+	if (memcmp(header, &expected_header, offsetof(CacheHeader, strings_size)) != 0 || !counts_fit || end_offset != storage_size)
+	{
+	#ifdef IR_USE_MMAP
+		munmap(storage, storage_size);
+	#else
+		free(storage);
+	#endif
+		return NULL;
+	}
+
+	IR *ir = malloc(sizeof(*ir));
+
+	ir->strings = (char*)storage + strings_offset;
+	ir->strings_size = header->strings_size;
+	ir->lines = (IRLine*)((char*)storage + lines_offset);
+	ir->line_count = header->line_count;
+	ir->arguments = (IRArgument*)((char*)storage + arguments_offset);
+	ir->argument_count = header->argument_count;
+	ir->storage = storage;
+	ir->storage_size = storage_size;
+	ir->strings_capacity = 0;
+	ir->line_capacity = 0;
+	ir->argument_capacity = 0;
+
+	if (!IsCacheValid(ir))
+	{
+		IR_Destroy(ir);
+		return NULL;
+	}
+
+	return ir;
+}
+
+static void WriteCachePadding(FILE *file, size_t *offset)
+{
+	static const char padding[0x10];
+	const size_t aligned_offset = AlignCacheOffset(*offset);
+
+	fwrite(padding, 1, aligned_offset - *offset, file);
+	*offset = aligned_offset;
+}
+
+// Lines and arguments are copied field by field into zeroed structs before
+// they're written, so that their padding doesn't make the cache differ
+// between runs
+static void WriteCacheLines(FILE *file, const IRLine *lines, size_t count)
+{
+	IRLine buffer[0x100];
+
+	for (size_t i = 0; i < count; i += sizeof(buffer) / sizeof(buffer[0]))
+	{
+		const size_t batch = (count - i < sizeof(buffer) / sizeof(buffer[0])) ? count - i : sizeof(buffer) / sizeof(buffer[0]);
+
+		memset(buffer, 0, sizeof(buffer));
+
+		for (size_t j = 0; j < batch; ++j)
+		{
+			buffer[j].line = lines[i + j].line;
+			buffer[j].label = lines[i + j].label;
+			buffer[j].label_hash = lines[i + j].label_hash;
+			buffer[j].instruction = lines[i + j].instruction;
+			buffer[j].instruction_index = lines[i + j].instruction_index;
+			buffer[j].first_argument = lines[i + j].first_argument;
+			buffer[j].argument_count = lines[i + j].argument_count;
+		}
+
+		fwrite(buffer, sizeof(buffer[0]), batch, file);
+	}
+}
+
+static void WriteCacheArguments(FILE *file, const IRArgument *arguments, size_t count)
+{
+	IRArgument buffer[0x100];
+
+	for (size_t i = 0; i < count; i += sizeof(buffer) / sizeof(buffer[0]))
+	{
+		const size_t batch = (count - i < sizeof(buffer) / sizeof(buffer[0])) ? count - i : sizeof(buffer) / sizeof(buffer[0]);
+
+		memset(buffer, 0, sizeof(buffer));
+
+		for (size_t j = 0; j < batch; ++j)
+		{
+			buffer[j].value = arguments[i + j].value;
+			buffer[j].name = arguments[i + j].name;
+			buffer[j].hash = arguments[i + j].hash;
+			buffer[j].is_literal = arguments[i + j].is_literal;
+		}
+
+		fwrite(buffer, sizeof(buffer[0]), batch, file);
+	}
+}
+
+bool IR_Save(const IR *ir, const char *file_name, unsigned long long source_hash, size_t source_size)
+{
+	// Write to a temporary file first, so that nothing ever sees a half-written cache
+	const size_t temporary_file_name_size = strlen(file_name) + 5;
+	char *temporary_file_name = malloc(temporary_file_name_size);
+	sprintf(temporary_file_name, "%s.tmp", file_name);
+
+	FILE *file = fopen(temporary_file_name, "wb");
+
+	if (file == NULL)
+	{
+		free(temporary_file_name);
+		return false;
+	}
+
+	CacheHeader header;
+	FillCacheHeader(&header, source_hash, source_size);
+	header.strings_size = ir->strings_size;
+	header.line_count = ir->line_count;
+	header.argument_count = ir->argument_count;
+
+	size_t offset = sizeof(header);
+	fwrite(&header, sizeof(header), 1, file);
+
+	WriteCachePadding(file, &offset);
+	fwrite(ir->strings, 1, ir->strings_size, file);
+	offset += ir->strings_size;
+
+	WriteCachePadding(file, &offset);
+	WriteCacheLines(file, ir->lines, ir->line_count);
+	offset += sizeof(*ir->lines) * ir->line_count;
+
+	WriteCachePadding(file, &offset);
+	WriteCacheArguments(file, ir->arguments, ir->argument_count);
+
+	const bool success = !ferror(file);
+
+	fclose(file);
+
+	bool renamed = success && rename(temporary_file_name, file_name) == 0;
+
+	// 'rename' won't replace an existing file on every platform
+	if (success && !renamed)
+	{
+		remove(file_name);
+		renamed = rename(temporary_file_name, file_name) == 0;
+	}
+
+	if (!renamed)
+	{
+		remove(temporary_file_name);
+		free(temporary_file_name);
+		return false;
+	}
+
+	free(temporary_file_name);
+
+	return true;
+}
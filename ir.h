@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memory_stream.h"
+
+// Marks a missing label or instruction
+#define IR_NONE 0xFFFFFFFF
+
+// Offsets are 32-bit to keep the IR (and its cache) compact
+typedef struct IRArgument
+{
+	long value;		// Only valid for literals
+	uint32_t name;		// Offset into the string pool
+	uint32_t hash;		// Hash of the name, for dictionary lookups
+	bool is_literal;
+} IRArgument;
+
+typedef struct IRLine
+{
+	uint32_t line;		// Line number in the source file
+	uint32_t label;		// Offset into the string pool
+	uint32_t label_hash;
+	uint32_t instruction;	// Offset into the string pool
+	int32_t instruction_index;	// From FindInstruction
+	uint32_t first_argument;
+	uint32_t argument_count;
+} IRLine;
+
+// A source file, lexed into a stream of labels and instructions
+typedef struct IR
+{
+	char *strings;
+	size_t strings_size;
+
+	IRLine *lines;
+	size_t line_count;
+
+	IRArgument *arguments;
+	size_t argument_count;
+
+	// When loaded from a cache, everything above lives in this one block
+	void *storage;
+	size_t storage_size;
+
+	// Room left in the arrays, for IR_AddLine and IR_AddArgument
+	size_t strings_capacity;
+	size_t line_capacity;
+	size_t argument_capacity;
+} IR;
+
+// 'buffer' must be allocated with malloc, be null-terminated, and will be owned by the IR
+IR* IR_Lex(char *buffer, size_t buffer_size);
+IR* IR_Create(void);
+void IR_AddLine(IR *ir, const char *label, const char *instruction);
+void IR_AddArgument(IR *ir, const char *argument);
+void IR_Splice(IR *ir, unsigned long first_line, unsigned long line_count, const char *text, size_t text_size);
+void IR_Write(const IR *ir, MemoryStream *stream);
+void IR_Destroy(IR *ir);
+unsigned long long IR_HashSource(const char *buffer, size_t buffer_size);
+IR* IR_Load(const char *file_name, unsigned long long source_hash, size_t source_size);
+bool IR_Save(const IR *ir, const char *file_name, unsigned long long source_hash, size_t source_size);
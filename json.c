@@ -0,0 +1,297 @@
+// Just enough JSON to speak JSON-RPC: values are located by walking the raw
+// text, rather than by building a tree
+
+#include "json.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory_stream.h"
+
+static const char* SkipWhitespace(const char *json)
+{
+	return json + strspn(json, " \t\r\n");
+}
+
+static const char* SkipString(const char *json)
+{
+	// Skip the opening quote
+	++json;
+
+	while (*json != '"')
+	{
+		if (*json == '\0')
+			return NULL;
+		else if (*json == '\\' && json[1] != '\0')
+			json += 2;
+		else
+			++json;
+	}
+
+	return json + 1;
+}
+
+const char* JSON_SkipValue(const char *json)
+{
+	json = SkipWhitespace(json);
+
+	switch (*json)
+	{
+		case '"':
+			return SkipString(json);
+
+		case '{':
+		case '[':
+		{
+			const char closer = (*json == '{') ? '}' : ']';
+
+			json = SkipWhitespace(json + 1);
+
+			if (*json == closer)
+				return json + 1;
+
+			for (;;)
+			{
+				if (closer == '}')
+				{
+					// Skip the key and its colon
+					if (*json != '"' || (json = SkipString(json)) == NULL)
+						return NULL;
+
+					json = SkipWhitespace(json);
+
+					if (*json++ != ':')
+						return NULL;
+				}
+
+				if ((json = JSON_SkipValue(json)) == NULL)
+					return NULL;
+
+				json = SkipWhitespace(json);
+
+				if (*json == closer)
+					return json + 1;
+				else if (*json != ',')
+					return NULL;
+
+				json = SkipWhitespace(json + 1);
+			}
+		}
+
+		case '\0':
+			return NULL;
+
+		default:
+			// Numbers, 'true', 'false', and 'null'
+			return json + strcspn(json, " \t\r\n,]}");
+	}
+}
+
+const char* JSON_Find(const char *json, const char *path)
+{
+	json = SkipWhitespace(json);
+
+	while (*path != '\0')
+	{
+		const size_t size_of_segment = strcspn(path, ".");
+
+		if (*json == '{')
+		{
+			json = SkipWhitespace(json + 1);
+
+			for (;;)
+			{
+				if (*json != '"')
+					return NULL;
+
+				const char *key = json + 1;
+				const char *key_end = SkipString(json);
+
+				if (key_end == NULL)
+					return NULL;
+
+				json = SkipWhitespace(key_end);
+
+				if (*json++ != ':')
+					return NULL;
+
+				json = SkipWhitespace(json);
+
+				if ((size_t)(key_end - 1 - key) == size_of_segment && memcmp(key, path, size_of_segment) == 0)
+					break;
+
+				if ((json = JSON_SkipValue(json)) == NULL)
+					return NULL;
+
+				json = SkipWhitespace(json);
+
+				if (*json != ',')
+					return NULL;
+
+				json = SkipWhitespace(json + 1);
+			}
+		}
+		else if (*json == '[')
+		{
+			unsigned long index = strtoul(path, NULL, 10);
+
+			json = SkipWhitespace(json + 1);
+
+			if (*json == ']')
+				return NULL;
+
+			while (index-- != 0)
+			{
+				if ((json = JSON_SkipValue(json)) == NULL)
+					return NULL;
+
+				json = SkipWhitespace(json);
+
+				if (*json != ',')
+					return NULL;
+
+				json = SkipWhitespace(json + 1);
+			}
+		}
+		else
+		{
+			return NULL;
+		}
+
+		path += size_of_segment;
+
+		if (*path == '.')
+			++path;
+	}
+
+	return json;
+}
+
+static void WriteUTF8(char **output, unsigned long code_point)
+{
+	if (code_point < 0x80)
+	{
+		*(*output)++ = (char)code_point;
+	}
+	else if (code_point < 0x800)
+	{
+		*(*output)++ = (char)(0xC0 | (code_point >> 6));
+		*(*output)++ = (char)(0x80 | (code_point & 0x3F));
+	}
+	else
+	{
+		*(*output)++ = (char)(0xE0 | (code_point >> 12));
+		*(*output)++ = (char)(0x80 | ((code_point >> 6) & 0x3F));
+		*(*output)++ = (char)(0x80 | (code_point & 0x3F));
+	}
+}
+
+char* JSON_GetString(const char *value)
+{
+	if (value == NULL || *value != '"')
+		return NULL;
+
+	const char *end = SkipString(value);
+
+	if (end == NULL)
+		return NULL;
+
+	// Escape sequences only ever shrink, so this is always big enough
+	char *string = malloc(end - value);
+	char *output = string;
+
+	for (const char *input = value + 1; input < end - 1; ++input)
+	{
+		if (*input != '\\')
+		{
+			*output++ = *input;
+			continue;
+		}
+
+		switch (*++input)
+		{
+			case 'b':
+				*output++ = '\b';
+				break;
+
+			case 'f':
+				*output++ = '\f';
+				break;
+
+			case 'n':
+				*output++ = '\n';
+				break;
+
+			case 'r':
+				*output++ = '\r';
+				break;
+
+			case 't':
+				*output++ = '\t';
+				break;
+
+			case 'u':
+			{
+				char hex[5] = {0};
+				strncpy(hex, input + 1, 4);
+				WriteUTF8(&output, strtoul(hex, NULL, 0x10));
+				input += strlen(hex);
+				break;
+			}
+
+			default:
+				// '"', '\\', and '/'
+				*output++ = *input;
+				break;
+		}
+	}
+
+	*output = '\0';
+
+	return string;
+}
+
+bool JSON_GetLong(const char *value, long *out)
+{
+	if (value == NULL || (*value != '-' && (*value < '0' || *value > '9')))
+		return false;
+
+	*out = strtol(value, NULL, 10);
+
+	return true;
+}
+
+void JSON_WriteString(MemoryStream *stream, const char *string)
+{
+	MemoryStream_WriteByte(stream, '"');
+
+	for (; *string != '\0'; ++string)
+	{
+		const unsigned char character = *string;
+
+		if (character == '"' || character == '\\')
+		{
+			MemoryStream_WriteByte(stream, '\\');
+			MemoryStream_WriteByte(stream, character);
+		}
+		else if (character == '\n')
+		{
+			MemoryStream_WriteBytes(stream, (unsigned char*)"\\n", 2);
+		}
+		else if (character < 0x20)
+		{
+			char escape[7];
+			sprintf(escape, "\\u%04X", character);
+			MemoryStream_WriteBytes(stream, (unsigned char*)escape, 6);
+		}
+		else
+		{
+			MemoryStream_WriteByte(stream, character);
+		}
+	}
+
+	MemoryStream_WriteByte(stream, '"');
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "memory_stream.h"
+
+const char* JSON_SkipValue(const char *json);
+const char* JSON_Find(const char *json, const char *path);
+char* JSON_GetString(const char *value);
+bool JSON_GetLong(const char *value, long *out);
+void JSON_WriteString(MemoryStream *stream, const char *string);
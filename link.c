@@ -0,0 +1,179 @@
+#include "link.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dictionary.h"
+#include "driver.h"
+#include "error.h"
+#include "object.h"
+
+// Labels exported by more than one object, which can't be imported
+static char **ambiguous_exports;
+static size_t ambiguous_export_count;
+
+static bool IsAmbiguous(const char *name)
+{
+	for (size_t i = 0; i < ambiguous_export_count; ++i)
+		if (strcmp(ambiguous_exports[i], name) == 0)
+			return true;
+
+	return false;
+}
+
+static void AddExport(Object *linked, const char *name, size_t position)
+{
+	undefined_symbol = NULL;
+	LookupDictionary(name);
+
+	if (undefined_symbol == NULL)
+	{
+		if (!IsAmbiguous(name))
+		{
+			ambiguous_exports = realloc(ambiguous_exports, sizeof(*ambiguous_exports) * (ambiguous_export_count + 1));
+			ambiguous_exports[ambiguous_export_count++] = (char*)name;
+		}
+	}
+	else
+	{
+		AddDictionaryEntry(name, linked->offset + position);
+	}
+
+	Object_AddExport(linked, name, position);
+}
+
+// Places the objects one after the other from 'offset', and fills in their
+// references to each other. References that none of them export are kept
+// as imports of the result, so that it can be linked again later.
+Object* Link(Object **objects, size_t object_count, size_t offset)
+{
+	error = false;
+
+	for (size_t i = 0; i < object_count; ++i)
+	{
+		const Driver *driver = GetDriver(objects[i]->driver);
+
+		if (objects[i]->driver != objects[0]->driver)
+			PrintError("Error: Object %u is for driver %u, but object 1 is for driver %u\n", (unsigned int)i + 1, objects[i]->driver, objects[0]->driver);
+		else if (driver == NULL)
+			PrintError("Error: Object %u is for unsupported driver %u\n", (unsigned int)i + 1, objects[i]->driver);
+		else if (driver->relative_pointers)
+			PrintError("Error: %s songs can't be linked, as their pointers are relative\n", driver->name);
+	}
+
+	if (error || object_count == 0)
+		return NULL;
+
+	Object *linked = Object_Create(objects[0]->driver, offset);
+
+	size_t total_size = 0;
+
+	for (size_t i = 0; i < object_count; ++i)
+		total_size += objects[i]->size;
+
+	unsigned char *data = malloc(total_size + 1);
+
+	// Lay the objects out, and gather everything that they export
+	size_t position = 0;
+
+	for (size_t i = 0; i < object_count; ++i)
+	{
+		Object *object = objects[i];
+
+		Object_Relocate(object, offset + position);
+
+		if (object->size != 0)
+			memcpy(data + position, object->data, object->size);
+
+		for (size_t j = 0; j < object->relocation_count; ++j)
+			Object_AddRelocation(linked, position + object->relocations[j]);
+
+		for (size_t j = 0; j < object->export_count; ++j)
+			AddExport(linked, object->exports[j].name, position + object->exports[j].position);
+
+		for (size_t j = 0; j < object->marker_count; ++j)
+			Object_AddMarker(linked, object->markers[j].kind, position + object->markers[j].position);
+
+		position += object->size;
+	}
+
+	// Fill in references between them
+	position = 0;
+
+	for (size_t i = 0; i < object_count; ++i)
+	{
+		const Object *object = objects[i];
+
+		// Where each of this object's imports ended up in the result
+		size_t *linked_imports = malloc(sizeof(*linked_imports) * (object->import_count + 1));
+
+		for (size_t j = 0; j < object->import_count; ++j)
+		{
+			const char *name = object->imports[j];
+
+			if (IsAmbiguous(name))
+				PrintError("Error: Symbol '%s' is exported by more than one object\n", name);
+
+			undefined_symbol = NULL;
+			LookupDictionary(name);
+
+			linked_imports[j] = (size_t)-1;
+
+			if (undefined_symbol != NULL)
+			{
+				for (size_t k = 0; k < linked->import_count; ++k)
+					if (strcmp(linked->imports[k], name) == 0)
+						linked_imports[j] = k;
+
+				if (linked_imports[j] == (size_t)-1)
+				{
+					linked_imports[j] = linked->import_count;
+					Object_AddImport(linked, name);
+				}
+			}
+		}
+
+		for (size_t j = 0; j < object->fixup_count; ++j)
+		{
+			const ObjectFixup *fixup = &object->fixups[j];
+			const size_t fixup_position = position + fixup->position;
+
+			if (linked_imports[fixup->import] != (size_t)-1)
+			{
+				Object_AddFixup(linked, fixup_position, linked_imports[fixup->import], fixup->addend);
+			}
+			else
+			{
+				const unsigned long address = LookupDictionary(object->imports[fixup->import]) + fixup->addend;
+
+				data[fixup_position + 0] = address & 0xFF;
+				data[fixup_position + 1] = (address >> 8) & 0xFF;
+
+				// It's an address within the result now, so it moves with it
+				Object_AddRelocation(linked, fixup_position);
+			}
+		}
+
+		free(linked_imports);
+
+		position += object->size;
+	}
+
+	Object_SetData(linked, data, total_size);
+	free(data);
+
+	ClearDictionary();
+	free(ambiguous_exports);
+	ambiguous_exports = NULL;
+	ambiguous_export_count = 0;
+
+	if (error)
+	{
+		Object_Destroy(linked);
+		return NULL;
+	}
+
+	return linked;
+}
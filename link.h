@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "object.h"
+
+Object* Link(Object **objects, size_t object_count, size_t offset);
@@ -0,0 +1,604 @@
+// Language server, speaking JSON-RPC over stdio
+
+#include "lsp.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "error.h"
+#include "ir.h"
+#include "json.h"
+#include "memory_stream.h"
+#include "smps2asm2bin.h"
+
+typedef struct Document
+{
+	struct Document *next;
+
+	char *uri;
+	char *text;
+	size_t text_length;
+
+	// Where each line starts in 'text'
+	size_t *line_starts;
+	unsigned long line_count;
+
+	// 'text', lexed, and kept up to date with each edit
+	IR *ir;
+
+	// What each line assembled to
+	MemoryStream *output;
+	size_t *line_output_positions;
+	size_t *line_output_sizes;
+} Document;
+
+static unsigned int target_driver;
+static size_t file_offset;
+
+static Document *document_list_head;
+
+static Document *compiling_document;
+static MemoryStream *diagnostics;
+static bool first_diagnostic;
+
+static void WriteFormat(MemoryStream *stream, const char *format, ...)
+{
+	char buffer[0x400];
+
+	va_list args;
+	va_start(args, format);
+	const int length = vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+
+	if (length > 0)
+		MemoryStream_WriteBytes(stream, (unsigned char*)buffer, ((size_t)length < sizeof(buffer)) ? (size_t)length : sizeof(buffer) - 1);
+}
+
+static void SendMessage(MemoryStream *body)
+{
+	const size_t body_size = MemoryStream_GetPosition(body);
+
+	printf("Content-Length: %lu\r\n\r\n", (unsigned long)body_size);
+	fwrite(MemoryStream_GetBuffer(body), 1, body_size, stdout);
+	fflush(stdout);
+}
+
+static MemoryStream* BeginResponse(const char *id, size_t id_length)
+{
+	MemoryStream *body = MemoryStream_Create(true);
+
+	WriteFormat(body, "{\"jsonrpc\":\"2.0\",\"id\":");
+	MemoryStream_WriteBytes(body, (unsigned char*)id, id_length);
+	WriteFormat(body, ",");
+
+	return body;
+}
+
+static void EndMessage(MemoryStream *body)
+{
+	WriteFormat(body, "}");
+	SendMessage(body);
+	MemoryStream_Destroy(body);
+}
+
+static size_t GetLineLength(Document *document, unsigned long line)
+{
+	const char *start = document->text + document->line_starts[line];
+
+	return strcspn(start, "\r\n");
+}
+
+static void IndexLines(Document *document)
+{
+	document->line_count = 1;
+
+	for (size_t i = 0; i < document->text_length; ++i)
+	{
+		if (document->text[i] == '\n' || (document->text[i] == '\r' && document->text[i + 1] != '\n'))
+			++document->line_count;
+	}
+
+	document->line_starts = realloc(document->line_starts, sizeof(*document->line_starts) * document->line_count);
+	document->line_output_positions = realloc(document->line_output_positions, sizeof(*document->line_output_positions) * document->line_count);
+	document->line_output_sizes = realloc(document->line_output_sizes, sizeof(*document->line_output_sizes) * document->line_count);
+
+	unsigned long line = 0;
+	document->line_starts[line++] = 0;
+
+	for (size_t i = 0; i < document->text_length; ++i)
+	{
+		if (document->text[i] == '\n' || (document->text[i] == '\r' && document->text[i + 1] != '\n'))
+			document->line_starts[line++] = i + 1;
+	}
+}
+
+// Finds which line 'offset' is on
+static unsigned long OffsetToLine(Document *document, size_t offset)
+{
+	unsigned long low = 0;
+	unsigned long high = document->line_count;
+
+	while (high - low > 1)
+	{
+		const unsigned long middle = low + (high - low) / 2;
+
+		if (document->line_starts[middle] <= offset)
+			low = middle;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+static void LexDocument(Document *document)
+{
+	// The lexer chops up its input, so give it a copy
+	char *buffer = malloc(document->text_length + 1);
+	memcpy(buffer, document->text, document->text_length + 1);
+
+	if (document->ir != NULL)
+		IR_Destroy(document->ir);
+
+	document->ir = IR_Lex(buffer, document->text_length);
+}
+
+static size_t PositionToOffset(Document *document, const char *position)
+{
+	long line = 0;
+	long character = 0;
+
+	JSON_GetLong(JSON_Find(position, "line"), &line);
+	JSON_GetLong(JSON_Find(position, "character"), &character);
+
+	if (line < 0)
+		return 0;
+	else if ((unsigned long)line >= document->line_count)
+		return document->text_length;
+
+	const size_t line_length = GetLineLength(document, line);
+
+	if (character < 0)
+		character = 0;
+	else if ((size_t)character > line_length)
+		character = line_length;
+
+	return document->line_starts[line] + character;
+}
+
+static void LineCallback(unsigned long line, size_t output_position, size_t size)
+{
+	// The assembler counts lines from 1
+	if (line - 1 < compiling_document->line_count)
+	{
+		compiling_document->line_output_positions[line - 1] = output_position;
+		compiling_document->line_output_sizes[line - 1] = size;
+	}
+}
+
+static void MessageHandler(bool is_error, const char *message, va_list args)
+{
+	char buffer[0x200];
+	vsnprintf(buffer, sizeof(buffer), message, args);
+	buffer[strcspn(buffer, "\n")] = '\0';
+
+	const unsigned long line = (current_line - 1 < compiling_document->line_count) ? current_line - 1 : 0;
+
+	if (!first_diagnostic)
+		WriteFormat(diagnostics, ",");
+
+	first_diagnostic = false;
+
+	WriteFormat(diagnostics, "{\"range\":{\"start\":{\"line\":%lu,\"character\":0},\"end\":{\"line\":%lu,\"character\":%lu}},\"severity\":%d,\"source\":\"smps2asm2bin\",\"message\":", line, line, (unsigned long)GetLineLength(compiling_document, line), is_error ? 1 : 2);
+	JSON_WriteString(diagnostics, buffer);
+	WriteFormat(diagnostics, "}");
+}
+
+static void PublishDiagnostics(Document *document, MemoryStream *diagnostic_array)
+{
+	MemoryStream *body = MemoryStream_Create(true);
+
+	WriteFormat(body, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+	JSON_WriteString(body, document->uri);
+	WriteFormat(body, ",\"diagnostics\":[");
+
+	if (diagnostic_array != NULL)
+		MemoryStream_WriteBytes(body, MemoryStream_GetBuffer(diagnostic_array), MemoryStream_GetPosition(diagnostic_array));
+
+	WriteFormat(body, "]}");
+
+	EndMessage(body);
+}
+
+static void CompileDocument(Document *document)
+{
+	memset(document->line_output_sizes, 0, sizeof(*document->line_output_sizes) * document->line_count);
+
+	if (document->output != NULL)
+		MemoryStream_Destroy(document->output);
+
+	document->output = MemoryStream_Create(true);
+
+	compiling_document = document;
+	diagnostics = MemoryStream_Create(true);
+	first_diagnostic = true;
+
+	line_callback = LineCallback;
+	message_handler = MessageHandler;
+
+	SMPS2ASM2BIN_IR(document->ir, document->output, target_driver, file_offset);
+
+	line_callback = NULL;
+	message_handler = NULL;
+
+	PublishDiagnostics(document, diagnostics);
+
+	MemoryStream_Destroy(diagnostics);
+	diagnostics = NULL;
+	compiling_document = NULL;
+}
+
+static Document* FindDocument(const char *params)
+{
+	char *uri = JSON_GetString(JSON_Find(params, "textDocument.uri"));
+
+	if (uri == NULL)
+		return NULL;
+
+	Document *document;
+
+	for (document = document_list_head; document != NULL; document = document->next)
+		if (strcmp(document->uri, uri) == 0)
+			break;
+
+	free(uri);
+
+	return document;
+}
+
+static void DestroyDocument(Document *document)
+{
+	if (document->output != NULL)
+		MemoryStream_Destroy(document->output);
+
+	if (document->ir != NULL)
+		IR_Destroy(document->ir);
+
+	free(document->line_output_sizes);
+	free(document->line_output_positions);
+	free(document->line_starts);
+	free(document->text);
+	free(document->uri);
+	free(document);
+}
+
+static void DidOpen(const char *params)
+{
+	char *uri = JSON_GetString(JSON_Find(params, "textDocument.uri"));
+	char *text = JSON_GetString(JSON_Find(params, "textDocument.text"));
+
+	if (uri == NULL || text == NULL)
+	{
+		free(uri);
+		free(text);
+		return;
+	}
+
+	Document *document = calloc(1, sizeof(*document));
+	document->next = document_list_head;
+	document_list_head = document;
+
+	document->uri = uri;
+	document->text = text;
+	document->text_length = strlen(text);
+
+	IndexLines(document);
+	LexDocument(document);
+	CompileDocument(document);
+}
+
+static void DidChange(const char *params)
+{
+	Document *document = FindDocument(params);
+
+	if (document == NULL)
+		return;
+
+	const char *changes = JSON_Find(params, "contentChanges");
+
+	for (unsigned long i = 0; changes != NULL; ++i)
+	{
+		char index[24];
+		sprintf(index, "%lu", i);
+
+		const char *change = JSON_Find(changes, index);
+
+		if (change == NULL)
+			break;
+
+		char *text = JSON_GetString(JSON_Find(change, "text"));
+
+		if (text == NULL)
+			continue;
+
+		const size_t text_length = strlen(text);
+		const char *range = JSON_Find(change, "range");
+
+		if (range == NULL)
+		{
+			// Full-document update
+			free(document->text);
+			document->text = text;
+			document->text_length = text_length;
+
+			IndexLines(document);
+			LexDocument(document);
+		}
+		else
+		{
+			// Splice the edit into the existing text
+			size_t start = PositionToOffset(document, JSON_Find(range, "start"));
+			size_t end = PositionToOffset(document, JSON_Find(range, "end"));
+
+			if (end < start)
+				end = start;
+
+			unsigned long first_line = OffsetToLine(document, start);
+
+			// Text after a lone '\r' can make it into a "\r\n", which changes the line before
+			if (first_line != 0 && start == document->line_starts[first_line] && document->text[start - 1] == '\r')
+				--first_line;
+
+			const unsigned long old_line_count = document->line_count;
+			const unsigned long old_edited_line_count = OffsetToLine(document, end) - first_line + 1;
+
+			const size_t new_length = document->text_length - (end - start) + text_length;
+
+			if (text_length > end - start)
+				document->text = realloc(document->text, new_length + 1);
+
+			memmove(document->text + start + text_length, document->text + end, document->text_length - end + 1);
+			memcpy(document->text + start, text, text_length);
+			document->text_length = new_length;
+
+			free(text);
+
+			// Later changes are relative to the result of earlier ones
+			IndexLines(document);
+
+			// Only the lines that the edit touched need lexing again
+			const unsigned long edited_line_count = old_edited_line_count + document->line_count - old_line_count;
+			const unsigned long last_line = first_line + edited_line_count - 1;
+			const size_t edit_start = document->line_starts[first_line];
+			const size_t edit_end = document->line_starts[last_line] + GetLineLength(document, last_line);
+
+			IR_Splice(document->ir, first_line + 1, old_edited_line_count, document->text + edit_start, edit_end - edit_start);
+		}
+	}
+
+	// Edits leave the strings of the lines that they replaced behind, so start
+	// afresh once those are most of what the IR holds
+	if (document->ir->strings_size > (document->text_length + 1) * 2)
+		LexDocument(document);
+
+	CompileDocument(document);
+}
+
+static void DidClose(const char *params)
+{
+	Document *document = FindDocument(params);
+
+	if (document == NULL)
+		return;
+
+	for (Document **link = &document_list_head; *link != NULL; link = &(*link)->next)
+	{
+		if (*link == document)
+		{
+			*link = document->next;
+			break;
+		}
+	}
+
+	PublishDiagnostics(document, NULL);
+	DestroyDocument(document);
+}
+
+static bool IsSymbolCharacter(char character)
+{
+	return isalnum((unsigned char)character) || character == '_' || character == '.' || character == '@';
+}
+
+static void Definition(const char *params, MemoryStream *body)
+{
+	Document *document = FindDocument(params);
+
+	if (document == NULL)
+	{
+		WriteFormat(body, "\"result\":null");
+		return;
+	}
+
+	// Find the symbol under the cursor
+	const size_t offset = PositionToOffset(document, JSON_Find(params, "position"));
+
+	size_t start = offset;
+	while (start != 0 && IsSymbolCharacter(document->text[start - 1]))
+		--start;
+
+	size_t end = offset;
+	while (IsSymbolCharacter(document->text[end]))
+		++end;
+
+	// Labels are whatever begins a line
+	if (end != start)
+	{
+		for (unsigned long line = 0; line < document->line_count; ++line)
+		{
+			const char *label = document->text + document->line_starts[line];
+			const size_t size_of_label = strcspn(label, " \t:;\r\n");
+
+			if (size_of_label == end - start && memcmp(label, document->text + start, size_of_label) == 0)
+			{
+				WriteFormat(body, "\"result\":{\"uri\":");
+				JSON_WriteString(body, document->uri);
+				WriteFormat(body, ",\"range\":{\"start\":{\"line\":%lu,\"character\":0},\"end\":{\"line\":%lu,\"character\":%lu}}}", line, line, (unsigned long)size_of_label);
+				return;
+			}
+		}
+	}
+
+	WriteFormat(body, "\"result\":null");
+}
+
+static void Hover(const char *params, MemoryStream *body)
+{
+	Document *document = FindDocument(params);
+	long line = -1;
+
+	if (document != NULL)
+		JSON_GetLong(JSON_Find(params, "position.line"), &line);
+
+	if (line < 0 || (unsigned long)line >= document->line_count || document->line_output_sizes[line] == 0)
+	{
+		WriteFormat(body, "\"result\":null");
+		return;
+	}
+
+	const size_t position = document->line_output_positions[line];
+	const size_t size = document->line_output_sizes[line];
+	const unsigned char *bytes = MemoryStream_GetBuffer(document->output) + position;
+
+	MemoryStream *contents = MemoryStream_Create(true);
+
+	WriteFormat(contents, "`$%04lX`: `", (unsigned long)(position + file_offset));
+
+	for (size_t i = 0; i < size && i < 0x40; ++i)
+		WriteFormat(contents, (i == 0) ? "%02X" : " %02X", bytes[i]);
+
+	WriteFormat(contents, (size > 0x40) ? " ...` (%lu bytes)" : "` (%lu bytes)", (unsigned long)size);
+	MemoryStream_WriteByte(contents, '\0');
+
+	WriteFormat(body, "\"result\":{\"contents\":{\"kind\":\"markdown\",\"value\":");
+	JSON_WriteString(body, (char*)MemoryStream_GetBuffer(contents));
+	WriteFormat(body, "}}");
+
+	MemoryStream_Destroy(contents);
+}
+
+static char* ReadMessage(void)
+{
+	char header[0x100];
+	unsigned long content_length = 0;
+
+	// Headers are terminated by an empty line
+	for (;;)
+	{
+		if (fgets(header, sizeof(header), stdin) == NULL)
+			return NULL;
+
+		if (header[0] == '\r' || header[0] == '\n')
+			break;
+
+		if (strncmp(header, "Content-Length:", 15) == 0)
+			content_length = strtoul(header + 15, NULL, 10);
+	}
+
+	char *message = malloc(content_length + 1);
+
+	if (fread(message, 1, content_length, stdin) != content_length)
+	{
+		free(message);
+		return NULL;
+	}
+
+	message[content_length] = '\0';
+
+	return message;
+}
+
+int LSP_Run(unsigned int p_target_driver, size_t p_file_offset)
+{
+	target_driver = p_target_driver;
+	file_offset = p_file_offset;
+
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+	bool shutdown = false;
+	char *message;
+
+	while ((message = ReadMessage()) != NULL)
+	{
+		char *method = JSON_GetString(JSON_Find(message, "method"));
+		const char *params = JSON_Find(message, "params");
+		const char *id = JSON_Find(message, "id");
+
+		if (method == NULL)
+		{
+			// Responses to requests that we never make
+		}
+		else if (strcmp(method, "exit") == 0)
+		{
+			free(method);
+			free(message);
+			break;
+		}
+		else if (strcmp(method, "textDocument/didOpen") == 0)
+		{
+			DidOpen(params);
+		}
+		else if (strcmp(method, "textDocument/didChange") == 0)
+		{
+			DidChange(params);
+		}
+		else if (strcmp(method, "textDocument/didClose") == 0)
+		{
+			DidClose(params);
+		}
+		else if (id != NULL)
+		{
+			MemoryStream *body = BeginResponse(id, JSON_SkipValue(id) - id);
+
+			if (strcmp(method, "initialize") == 0)
+				WriteFormat(body, "\"result\":{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},\"definitionProvider\":true,\"hoverProvider\":true},\"serverInfo\":{\"name\":\"smps2asm2bin\"}}");
+			else if (strcmp(method, "shutdown") == 0)
+			{
+				WriteFormat(body, "\"result\":null");
+				shutdown = true;
+			}
+			else if (strcmp(method, "textDocument/definition") == 0)
+				Definition(params, body);
+			else if (strcmp(method, "textDocument/hover") == 0)
+				Hover(params, body);
+			else
+				WriteFormat(body, "\"error\":{\"code\":-32601,\"message\":\"Method not found\"}");
+
+			EndMessage(body);
+		}
+
+		free(method);
+		free(message);
+	}
+
+	while (document_list_head != NULL)
+	{
+		Document *next_document = document_list_head->next;
+		DestroyDocument(document_list_head);
+		document_list_head = next_document;
+	}
+
+	return shutdown ? 0 : 1;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include <stddef.h>
+
+int LSP_Run(unsigned int p_target_driver, size_t p_file_offset);
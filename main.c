@@ -1,51 +1,479 @@
 #include <stdio.h>
 
+#include "analyze.h"
+#include "build.h"
+#include "compress.h"
+#include "disassemble.h"
+#include "driver.h"
+#include "instruction.h"
+#include "link.h"
+#include "lsp.h"
 #include "memory_stream.h"
+#include "object.h"
+#include "optimize.h"
+#include "pack.h"
+#include "patch.h"
+#include "render.h"
+#include "rom.h"
+#include "sample.h"
+#include "share.h"
+#include "simulate.h"
 #include "smps2asm2bin.h"
+#include "tempo.h"
+#include "thread.h"
+#include "voice.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+#define MAX_TARGET_DRIVERS 8
+#define SIMULATED_FRAMES (3 * 60 * 60)	/* Three minutes at 60 frames per second */
+#define BUSIEST_FRAMES 8
+#define FIRST_DAC_SAMPLE 0x81
+#define MAX_DAC_SAMPLES 0x5F		/* IDs $81 to $DF, as $E0 and up are coordination flags */
+#define MAX_VOICES 0x100		/* smpsFMvoice takes a byte */
+#define MAX_EXTERNAL_VOICES 0x80	/* Drivers that take $80 and up to mean another song's voices */
+
+/* Formats that output can be written in */
+typedef enum OutputFormat {
+	OUTPUT_FORMAT_BINARY,
+	OUTPUT_FORMAT_OBJECT,
+	OUTPUT_FORMAT_IPS,
+	OUTPUT_FORMAT_BPS
+} OutputFormat;
+
+/* Options shared by the default mode and the commands */
+typedef struct Options {
+	unsigned int target_drivers[MAX_TARGET_DRIVERS];
+	unsigned int target_driver_count;
+	size_t file_offset;
+	const char * cache_directory;
+	OutputFormat output_format;
+	bool share_voices;
+	const char * universal_voice_bank_path;
+	unsigned int optimizations;
+	size_t bank_size;
+	const char * map_path;
+	char * inject_path;
+	size_t inject_offset;
+	size_t inject_size;
+	bool has_table_entry;
+	size_t table_entry;
+	unsigned int source_driver;
+	bool has_source_offset;
+	size_t source_offset;
+	bool sfx;
+	Compression compression;
+	size_t frame_count;
+	unsigned int write_limit;
+	unsigned long sample_rate;
+	SampleEncoding sample_encoding;
+} Options;
+
+/* Songs that 'render' has played, for its threads to synthesize */
+typedef struct RenderJobs {
+	char ** out_file_paths;
+	RegisterLog ** logs;					// NULL for songs that couldn't be played
+	bool * succeeded;
+	size_t count;
+	unsigned int thread_count;
+} RenderJobs;
+
+/* A command, and the function that carries it out */
+typedef struct Command {
+	const char * name;
+	int (*run)(int argc, char *argv[], Options * options);
+} Command;
+
+/* Object being assembled, when outputting one */
+static Object * current_object;
+
+/* Options that apply to every song that 'build' assembles */
+static const char * build_cache_directory;
+static unsigned int build_optimizations;
+
+/* Format that 'pack' writes each bank in */
+static OutputFormat pack_output_format;
+
 /* Program usage */
 const char * usageMessageStr = 
 	"USAGE:\n"
-	"	%s [-v driver_version] [-o hex_offset] in_file_path [out_file_path]\n"	// "%s" should substitute for argv[0]
+	"	%s [options] in_file_path [out_file_path]\n"	// "%s" should substitute for argv[0]
 	"\n"
 	"OPTIONS:\n"
-	"	-v driver_version\n"
+	"	-v driver_version[,driver_version...]\n"
 	"		Specifies the target driver version:\n"
 	"			1 = Sonic 1 (default)\n"
 	"			2 = Sonic 2\n"
 	"			3 = Sonic 3 & Knuckles\n"
+	"		When given several (for example, '-v 1,2,3'), the source is parsed\n"
+	"		once and one output is written per driver, with '.vN' inserted\n"
+	"		before the output file's extension.\n"
 	"\n"
 	"	-o hex_offset\n"
 	"		Base offset for the binary file (hexadecimal).\n"
+	"\n"
+	"	-c cache_directory\n"
+	"		Caches the parsed form of each source file in this directory,\n"
+	"		keyed by the file's contents, so that recompiling an unchanged file\n"
+	"		for another driver or offset skips parsing.\n"
+	"\n"
+	"	-f bin|obj|ips|bps\n"
+	"		Output format. 'bin' (default) is plain binary data; 'obj' is the\n"
+	"		same data plus a list of where it holds absolute addresses, so\n"
+	"		that 'relocate' can move it to another offset. 'ips' and 'bps'\n"
+	"		are patches that make the changes that '-i' would to the ROM,\n"
+	"		which is left alone.\n"
+	"\n"
+	"	-i rom_path@hex_offset[:hex_size]\n"
+	"		Writes the song straight into an existing ROM at the given offset,\n"
+	"		instead of to 'out_file_path', and corrects the ROM's checksum.\n"
+	"		With '-f ips' or '-f bps', the ROM is left alone and a patch that\n"
+	"		makes the same changes is written to 'out_file_path' instead.\n"
+	"		Nothing is written if the song doesn't fit in the ROM, in\n"
+	"		'hex_size' bytes if given, or (for Z80 drivers) in one bank.\n"
+	"\n"
+	"	-t hex_table_entry_offset\n"
+	"		With '-i', points the ROM's pointer table entry at this offset\n"
+	"		at the song: a longword ROM address for Sonic 1, or the song's\n"
+	"		Z80 address ('-o') for the others.\n"
+	"\n"
+	"	-O pass[,pass...]\n"
+	"		Optimizes the tracks after assembling them. Passes:\n"
+	"			dce = remove track data that no channel can reach\n"
+	"			loops = turn back-to-back repeats into smpsLoops\n"
+	"			peephole = drop commands that change nothing, and merge volume changes\n"
+	"			subroutines = move repeated runs of commands into smpsCalls\n"
+	"\n"
+	"	-z saxman|kosinski\n"
+	"		Compresses the output, after any optimizing and before it's\n"
+	"		written or put into a ROM. Saxman output starts with its size,\n"
+	"		as Sonic 2's music does. Not available for objects.\n"
 	"\n";
 
+/* One per command, as a single string would be longer than C99 guarantees support for */
+const char * const commandUsageStrs[] = {
+	"COMMANDS:\n"
+	"	lsp [-v driver_version] [-o hex_offset]\n"
+	"		Run as a language server, speaking JSON-RPC over stdio.\n"
+	"\n",
+
+	"	relocate [-o hex_offset] [-f bin|obj] in_object_path [out_file_path]\n"
+	"		Move an object made with '-f obj' to a new offset, without\n"
+	"		assembling it again.\n"
+	"\n",
+
+	"	link [-o hex_offset] [-f bin|obj] [-s voices] [-u uvb_path] out_file_path in_object_path...\n"
+	"		Place objects one after another from the given offset, and fill\n"
+	"		in the labels that they use from each other. '-s voices' keeps one\n"
+	"		copy of each FM voice in a table that all of the songs share;\n"
+	"		'-u' writes that table to its own file as Sonic 3 & Knuckles'\n"
+	"		universal voice bank instead.\n"
+	"\n",
+
+	"	pack [-o hex_offset] [-b hex_bank_size] [-f bin|obj] [-m map_path] out_file_path in_object_path...\n"
+	"		Share objects out between as few Z80 banks as possible, so that\n"
+	"		none of them crosses from one bank into the next, and link each\n"
+	"		bank at the offset of the Z80's window into it. Banks are written\n"
+	"		with '.bankN' inserted before the output file's extension, and\n"
+	"		where each object went is written to 'map_path', or printed.\n"
+	"		Banks are $8000 bytes at $8000 unless '-b' and '-o' say\n"
+	"		otherwise.\n"
+	"\n",
+
+	"	build [-c cache_directory] [-O pass[,pass...]] manifest_path\n"
+	"		Assemble every song and sound effect that a JSON manifest lists,\n"
+	"		each at its own offset and bank or straight after the one before\n"
+	"		it, and write the music and sound effect pointer tables.\n"
+	"\n",
+
+	"	transcode [-d driver_version[@hex_offset]] [-k music|sfx] [options] in_file_path [out_file_path]\n"
+	"		Convert a compiled song from the driver given to '-d' (Sonic 1\n"
+	"		by default) to the ones given to '-v', as though its source had\n"
+	"		been assembled for them. '@hex_offset' is where the input was\n"
+	"		assembled to, if not the same as '-o'. '-k sfx' reads a sound\n"
+	"		effect's header instead of a song's. Every option of the default\n"
+	"		mode applies to the output.\n"
+	"\n",
+
+	"	disasm [-d driver_version[@hex_offset]] [-k music|sfx] in_file_path [out_file_path]\n"
+	"		Turn a compiled song back into SMPS2ASM source code, with labels\n"
+	"		named after the input file. '-d' and '-k' are as for 'transcode'.\n"
+	"\n",
+
+	"	decompress -z saxman|kosinski in_file_path [out_file_path]\n"
+	"		Undo '-z', or unpack a song from a game to disassemble it.\n"
+	"\n",
+
+	"	verify [-v driver_version[,driver_version...]] [-o hex_offset] [-c cache_directory] in_file_path...\n"
+	"		Assemble each source for each driver, disassemble the result, and\n"
+	"		check that assembling the disassembly gives the same bytes. This\n"
+	"		all happens in memory.\n"
+	"\n",
+
+	"	analyze [-v driver_version[,driver_version...]] [-o hex_offset] [-c cache_directory] [-O pass[,pass...]] in_file_path...\n"
+	"		Assemble each source for each driver and print how deeply each\n"
+	"		channel's smpsCalls nest and which smpsLoop indices it uses.\n"
+	"		Warns about, and fails on, calls that overflow the driver's\n"
+	"		stack, loop counters that the stack grows onto, loops nested in\n"
+	"		loops with the same index, and smpsReturns outside of calls.\n"
+	"\n",
+
+	"	simulate [-d driver_version[@hex_offset]] [-k music|sfx] [-z saxman|kosinski] [-l frames] [-w max_writes] in_file_path [csv_path]\n"
+	"		Play a compiled song as its driver would, for up to '-l' frames\n"
+	"		(three minutes by default), and report how many tracks update,\n"
+	"		how many bytes they read and how many YM2612 and PSG register\n"
+	"		writes they make each frame, with the busiest frames. With '-w',\n"
+	"		fails if any frame makes more register writes than that.\n"
+	"		'csv_path' gets every frame's figures.\n"
+	"\n",
+
+	"	render [-d driver_version[@hex_offset]] [-k music|sfx] [-z saxman|kosinski] [-l frames] in_file_path...\n"
+	"		Play each compiled song through models of the YM2612 and PSG,\n"
+	"		for up to '-l' frames, and write what it sounds like to\n"
+	"		'in_file_path' with '.wav' added. Songs are synthesized in\n"
+	"		parallel.\n"
+	"\n",
+
+	"	dac [-v driver_version[,driver_version...]] [-o hex_offset] [-b hex_bank_size] [-r rate] [-p dpcm|pcm] [-m ids_path] out_file_path in_wav_path...\n"
+	"		Resample WAV files to the rate that the driver's DAC plays at, or\n"
+	"		'-r', and encode them as the 4-bit DPCM that every driver\n"
+	"		decodes, or as unsigned 8-bit PCM with '-p pcm' for drivers that\n"
+	"		have been changed to play it. They're written as one bank,\n"
+	"		starting with a table of each one's Z80 pointer and length, and\n"
+	"		fail if it goes over '-b'. The IDs that songs play them by, from\n"
+	"		$81, are written to 'ids_path' as equates, or printed.\n"
+	"\n",
+
+	"	voices [-v driver_version[,driver_version...]] [-m ids_path] out_file_path in_voice_path...\n"
+	"		Pack TFI, DefleMask DMP and VGI instruments into a bank of FM\n"
+	"		voices in each driver's operator order, as smpsVcTotalLevel\n"
+	"		would, with one copy of each different voice. The index that\n"
+	"		songs pick each file's voice by is written to 'ids_path' as\n"
+	"		equates, or printed.\n"
+	"\n",
+
+	"	verify-tempo\n"
+	"		Check the tempo conversion tables against their formulas, for\n"
+	"		every tempo and every pair of drivers.\n"
+	"\n"
+};
+
 /*
- * Helper function to parse arguments
+ * Helper function to parse options
  */
-int parseArgs(
-	int argc, 
-	char *argv[], 
-	const char ** in_file_path_ptr, 		// memory address for "in_file_path" argument
-	const char ** out_file_path_ptr, 		// memory address for "out_file_path" argument
-	unsigned int * target_driver_ptr,		// memory address for "target_driver_ptr" argument
-	size_t * file_offset_ptr				// memory address for "file_offset_ptr"argument
+int parseOptions(
+	int argc,
+	char *argv[],
+	int * arg_index_ptr,					// memory address for index of the first option, updated to the first non-option
+	Options * options_ptr					// memory address for parsed options
 ) {
 
-	int arg_index = 1;		// Tracks index of currently processed argument
+	int arg_index = *arg_index_ptr;
 
-	/* Process options (if available) */
 	for (; arg_index < argc && argv[arg_index][0] == '-'; arg_index += 2) {
 		const char * option_name = argv[arg_index];
 		const char * option_raw_value = argv[arg_index+1];
 
+		if (option_raw_value == NULL) {
+			fprintf(stderr, "ERROR: Expected a value after option \"%s\"\n", option_name);
+			return -1;
+		}
+
 		if (strcmp(option_name, "-v") == 0) {
-			*target_driver_ptr = (unsigned int)strtol(option_raw_value, NULL, 10);
+			/* Comma-separated list of drivers */
+			options_ptr->target_driver_count = 0;
+
+			for (const char * value = option_raw_value; ; ++value) {
+				char * value_end;
+
+				if (options_ptr->target_driver_count == MAX_TARGET_DRIVERS) {
+					fprintf(stderr, "ERROR: Too many driver versions given to \"-v\"\n");
+					return -1;
+				}
+
+				options_ptr->target_drivers[options_ptr->target_driver_count] = (unsigned int)strtol(value, &value_end, 10);
+
+				if (GetDriver(options_ptr->target_drivers[options_ptr->target_driver_count]) == NULL) {
+					fprintf(stderr, "ERROR: Unsupported driver version \"%.*s\"\n", (int)(value_end - value), value);
+					return -1;
+				}
+
+				++options_ptr->target_driver_count;
+				value = value_end;
+
+				if (*value != ',') {
+					break;
+				}
+			}
 		}
 		else if (strcmp(option_name, "-o") == 0) {
-			*file_offset_ptr = (size_t)strtol(option_raw_value, NULL, 0x10);
+			options_ptr->file_offset = (size_t)strtol(option_raw_value, NULL, 0x10);
+		}
+		else if (strcmp(option_name, "-c") == 0) {
+			options_ptr->cache_directory = option_raw_value;
+		}
+		else if (strcmp(option_name, "-f") == 0) {
+			if (strcmp(option_raw_value, "bin") == 0) {
+				options_ptr->output_format = OUTPUT_FORMAT_BINARY;
+			}
+			else if (strcmp(option_raw_value, "obj") == 0) {
+				options_ptr->output_format = OUTPUT_FORMAT_OBJECT;
+			}
+			else if (strcmp(option_raw_value, "ips") == 0) {
+				options_ptr->output_format = OUTPUT_FORMAT_IPS;
+			}
+			else if (strcmp(option_raw_value, "bps") == 0) {
+				options_ptr->output_format = OUTPUT_FORMAT_BPS;
+			}
+			else {
+				fprintf(stderr, "ERROR: Unrecognized output format \"%s\"\n", option_raw_value);
+				return -1;
+			}
+		}
+		else if (strcmp(option_name, "-O") == 0) {
+			/* Comma-separated list of passes */
+			for (const char * value = option_raw_value; ; ++value) {
+				const size_t length = strcspn(value, ",");
+				char name[0x20];
+
+				snprintf(name, sizeof(name), "%.*s", (int)length, value);
+
+				const unsigned int optimization = FindOptimization(name);
+
+				if (optimization == 0) {
+					fprintf(stderr, "ERROR: Unrecognized optimization \"%s\"\n", name);
+					return -1;
+				}
+
+				options_ptr->optimizations |= optimization;
+				value += length;
+
+				if (*value != ',') {
+					break;
+				}
+			}
+		}
+		else if (strcmp(option_name, "-s") == 0) {
+			if (strcmp(option_raw_value, "voices") == 0) {
+				options_ptr->share_voices = true;
+			}
+			else {
+				fprintf(stderr, "ERROR: Unrecognized data to share \"%s\"\n", option_raw_value);
+				return -1;
+			}
+		}
+		else if (strcmp(option_name, "-u") == 0) {
+			options_ptr->share_voices = true;
+			options_ptr->universal_voice_bank_path = option_raw_value;
+		}
+		else if (strcmp(option_name, "-b") == 0) {
+			options_ptr->bank_size = (size_t)strtol(option_raw_value, NULL, 0x10);
+
+			if (options_ptr->bank_size == 0) {
+				fprintf(stderr, "ERROR: Invalid bank size \"%s\"\n", option_raw_value);
+				return -1;
+			}
+		}
+		else if (strcmp(option_name, "-m") == 0) {
+			options_ptr->map_path = option_raw_value;
+		}
+		else if (strcmp(option_name, "-i") == 0) {
+			/* Path, then where in the ROM, then optionally how much room there is */
+			const char * separator = strrchr(option_raw_value, '@');
+			char * value_end;
+
+			if (separator == NULL || separator == option_raw_value) {
+				fprintf(stderr, "ERROR: Expected \"rom_path@hex_offset\" after \"-i\", not \"%s\"\n", option_raw_value);
+				return -1;
+			}
+
+			free(options_ptr->inject_path);
+			options_ptr->inject_path = malloc(separator - option_raw_value + 1);
+			snprintf(options_ptr->inject_path, separator - option_raw_value + 1, "%s", option_raw_value);
+
+			options_ptr->inject_offset = (size_t)strtol(separator + 1, &value_end, 0x10);
+			options_ptr->inject_size = 0;
+
+			if (*value_end == ':') {
+				options_ptr->inject_size = (size_t)strtol(value_end + 1, &value_end, 0x10);
+			}
+
+			if (value_end == separator + 1 || *value_end != '\0') {
+				fprintf(stderr, "ERROR: Expected \"rom_path@hex_offset\" after \"-i\", not \"%s\"\n", option_raw_value);
+				return -1;
+			}
+		}
+		else if (strcmp(option_name, "-d") == 0) {
+			/* Driver, then optionally the offset that the input was assembled at */
+			char * value_end;
+
+			options_ptr->source_driver = (unsigned int)strtol(option_raw_value, &value_end, 10);
+			options_ptr->has_source_offset = *value_end == '@';
+
+			if (options_ptr->has_source_offset) {
+				options_ptr->source_offset = (size_t)strtol(value_end + 1, &value_end, 0x10);
+			}
+
+			if (*value_end != '\0') {
+				fprintf(stderr, "ERROR: Expected \"driver_version[@hex_offset]\" after \"-d\", not \"%s\"\n", option_raw_value);
+				return -1;
+			}
+		}
+		else if (strcmp(option_name, "-k") == 0) {
+			if (strcmp(option_raw_value, "music") == 0) {
+				options_ptr->sfx = false;
+			}
+			else if (strcmp(option_raw_value, "sfx") == 0) {
+				options_ptr->sfx = true;
+			}
+			else {
+				fprintf(stderr, "ERROR: Unrecognized kind of song \"%s\"\n", option_raw_value);
+				return -1;
+			}
+		}
+		else if (strcmp(option_name, "-z") == 0) {
+			options_ptr->compression = FindCompression(option_raw_value);
+
+			if (options_ptr->compression == COMPRESSION_NONE) {
+				fprintf(stderr, "ERROR: Unrecognized compression \"%s\"\n", option_raw_value);
+				return -1;
+			}
+		}
+		else if (strcmp(option_name, "-l") == 0) {
+			options_ptr->frame_count = (size_t)strtol(option_raw_value, NULL, 10);
+
+			if (options_ptr->frame_count == 0) {
+				fprintf(stderr, "ERROR: Invalid number of frames \"%s\"\n", option_raw_value);
+				return -1;
+			}
+		}
+		else if (strcmp(option_name, "-w") == 0) {
+			options_ptr->write_limit = (unsigned int)strtol(option_raw_value, NULL, 10);
+		}
+		else if (strcmp(option_name, "-r") == 0) {
+			options_ptr->sample_rate = (unsigned long)strtol(option_raw_value, NULL, 10);
+
+			if (options_ptr->sample_rate == 0) {
+				fprintf(stderr, "ERROR: Invalid sample rate \"%s\"\n", option_raw_value);
+				return -1;
+			}
+		}
+		else if (strcmp(option_name, "-p") == 0) {
+			if (strcmp(option_raw_value, "dpcm") == 0) {
+				options_ptr->sample_encoding = SAMPLE_ENCODING_DPCM;
+			}
+			else if (strcmp(option_raw_value, "pcm") == 0) {
+				options_ptr->sample_encoding = SAMPLE_ENCODING_PCM;
+			}
+			else {
+				fprintf(stderr, "ERROR: Unrecognized sample encoding \"%s\"\n", option_raw_value);
+				return -1;
+			}
+		}
+		else if (strcmp(option_name, "-t") == 0) {
+			options_ptr->has_table_entry = true;
+			options_ptr->table_entry = (size_t)strtol(option_raw_value, NULL, 0x10);
 		}
 		else {
 			fprintf(stderr, "ERROR: Unrecognized option \"%s\"\n", option_name);
@@ -53,6 +481,28 @@ int parseArgs(
 		}
 	}
 
+	*arg_index_ptr = arg_index;
+
+	return 0;
+}
+
+/*
+ * Helper function to parse arguments
+ */
+int parseArgs(
+	int argc, 
+	char *argv[], 
+	int arg_index,							// index of the first argument after the program or command name
+	const char ** in_file_path_ptr, 		// memory address for "in_file_path" argument
+	const char ** out_file_path_ptr, 		// memory address for "out_file_path" argument
+	Options * options_ptr					// memory address for parsed options
+) {
+
+	/* Process options (if available) */
+	if (parseOptions(argc, argv, &arg_index, options_ptr) != 0) {
+		return -1;
+	}
+
 	/* Process "in_file_path" argument */
 	if (arg_index >= argc) {
 		fprintf(stderr, "ERROR: Expected \"in_file_path\" after options\n");
@@ -63,7 +513,8 @@ int parseArgs(
 
 	/* Process "out_file_path" argument */
 	if (arg_index >= argc) {
-		const char * extension = ".bin";
+		static const char * const extensions[] = {".bin", ".obj", ".ips", ".bps"};
+		const char * extension = extensions[options_ptr->output_format];
 		const size_t buffer_length = strlen(*in_file_path_ptr) + strlen(extension) + 1;
 		char * buffer = malloc(buffer_length);
 
@@ -78,45 +529,1578 @@ int parseArgs(
 	return 0;
 }
 
-int main(int argc, char *argv[])
-{
-	/* When called without arguments, print usage */
-	if (argc < 2) {
-		fprintf(stderr, usageMessageStr, argv[0]);
-		return 1;
+/*
+ * Helper function to build the output path for one of several drivers or banks
+ */
+char * getNumberedOutputPath(const char * out_file_path, const char * tag, unsigned int number) {
+	/* Insert ".vN" or the like before the extension, if there is one */
+	const char * file_name = out_file_path;
+
+	for (const char * character = out_file_path; *character != '\0'; ++character) {
+		if (*character == '/' || *character == '\\') {
+			file_name = character + 1;
+		}
 	}
 
-	MemoryStream *output_stream = MemoryStream_Create(true);
+	const char * extension = strrchr(file_name, '.');
 
-	/* Parse input arguments */
-	const char * in_file_path = NULL;
-	const char * out_file_path = NULL;
-	unsigned int target_driver = 1;
-	size_t file_offset = 0;
+	if (extension == NULL || extension == file_name) {
+		extension = file_name + strlen(file_name);
+	}
 
-	int parseResult = parseArgs(argc, argv, &in_file_path, &out_file_path, &target_driver, &file_offset);
+	const size_t buffer_length = strlen(out_file_path) + strlen(tag) + 16;
+	char * buffer = malloc(buffer_length);
 
-	if (parseResult != 0) {
-		fprintf(stderr, "Error during arguments parsing, unable to continue.\n");
-		return parseResult;
+	snprintf(buffer, buffer_length, "%.*s.%s%u%s", (int)(extension - out_file_path), out_file_path, tag, number, extension);
+
+	return buffer;
+}
+
+/*
+ * Relocation callback, used when writing objects
+ */
+void addRelocation(size_t output_position) {
+	Object_AddRelocation(current_object, output_position);
+}
+
+void addFixup(size_t output_position, unsigned int import, long addend) {
+	Object_AddFixup(current_object, output_position, import, addend);
+}
+
+void addExport(const char * label, size_t output_position) {
+	Object_AddExport(current_object, label, output_position);
+}
+
+void addImport(const char * symbol) {
+	Object_AddImport(current_object, symbol);
+}
+
+void addMarker(Marker marker, size_t output_position) {
+	Object_AddMarker(current_object, marker, output_position);
+}
+
+/*
+ * Optimization callback, to report what each pass did
+ */
+void reportOptimization(const char * pass, size_t bytes_saved) {
+	printf("%s: saved %zu bytes\n", pass, bytes_saved);
+}
+
+/*
+ * Build callback, which assembles each song that a manifest lists
+ */
+Object * buildSong(const char * in_file_path, unsigned int target_driver, size_t file_offset) {
+	IR *ir = SMPS2ASM2BIN_LexFile(in_file_path, build_cache_directory);
+
+	if (ir == NULL) {
+		fprintf(stderr, "Processing of \"%s\" file halted due to an error.\n", in_file_path);
+		return NULL;
 	}
 
-	/* Read file and process it */
-	if (!SMPS2ASM2BIN(in_file_path, output_stream, target_driver, file_offset))
-	{
-		MemoryStream_Destroy(output_stream);
+	MemoryStream *output_stream = MemoryStream_Create(true);
+
+	current_object = Object_Create(target_driver, file_offset);
+
+	if (!SMPS2ASM2BIN_IR(ir, output_stream, target_driver, file_offset)) {
 		fprintf(stderr, "Processing of \"%s\" file halted due to an error.\n", in_file_path);
-		return 1;
+		Object_Destroy(current_object);
+		current_object = NULL;
 	}
+	else {
+		MemoryStream_SetPosition(output_stream, 0, MEMORYSTREAM_END);
+		Object_SetData(current_object, MemoryStream_GetBuffer(output_stream), MemoryStream_GetPosition(output_stream));
 
-	/* Write down the output */
-	FILE *out_file = fopen(out_file_path, "wb");
+		if (build_optimizations != 0 && !Optimize(current_object, build_optimizations)) {
+			fprintf(stderr, "Optimization of \"%s\" halted due to an error.\n", in_file_path);
+			Object_Destroy(current_object);
+			current_object = NULL;
+		}
+	}
 
-	MemoryStream_SetPosition(output_stream, 0, MEMORYSTREAM_END);
-	fwrite(MemoryStream_GetBuffer(output_stream), 1, MemoryStream_GetPosition(output_stream), out_file);
-	fclose(out_file);
+	Object * object = current_object;
 
+	current_object = NULL;
 	MemoryStream_Destroy(output_stream);
+	IR_Destroy(ir);
+
+	return object;
+}
+
+/*
+ * Helper function to write an object, either as it is or as plain binary
+ */
+int writeObject(const char * out_file_path, const Object * object, OutputFormat output_format) {
+	if (output_format == OUTPUT_FORMAT_IPS || output_format == OUTPUT_FORMAT_BPS) {
+		fprintf(stderr, "ERROR: Patches can only be made of songs written into a ROM with \"-i\"\n");
+		return 1;
+	}
+	else if (output_format == OUTPUT_FORMAT_OBJECT) {
+		if (!Object_Save(object, out_file_path)) {
+			fprintf(stderr, "ERROR: Couldn't write \"%s\"\n", out_file_path);
+			return 1;
+		}
+	}
+	else {
+		/* Plain binary can't leave anything for later */
+		if (object->import_count != 0) {
+			for (size_t i = 0; i < object->import_count; ++i) {
+				fprintf(stderr, "ERROR: Symbol '%s' undefined\n", object->imports[i]);
+			}
+
+			return 1;
+		}
+
+		FILE *out_file = fopen(out_file_path, "wb");
+
+		if (out_file == NULL) {
+			fprintf(stderr, "ERROR: Couldn't open \"%s\" for writing\n", out_file_path);
+			return 1;
+		}
+
+		fwrite(object->data, 1, object->size, out_file);
+		fclose(out_file);
+	}
 
 	return 0;
 }
+
+/*
+ * Helper function to replace an object's data with a compressed copy of it
+ */
+int compressObject(Object * object, Compression compression) {
+	MemoryStream *output_stream = MemoryStream_Create(true);
+	int result = 1;
+
+	if (Compress(compression, object->data, object->size, output_stream)) {
+		MemoryStream_SetPosition(output_stream, 0, MEMORYSTREAM_END);
+		Object_SetData(object, MemoryStream_GetBuffer(output_stream), MemoryStream_GetPosition(output_stream));
+		result = 0;
+	}
+
+	MemoryStream_Destroy(output_stream);
+
+	return result;
+}
+
+/*
+ * Helper function to write an object into place in an existing ROM, or a patch that does so
+ */
+int injectObject(const Options * options, const Object * object, const char * out_file_path) {
+	if (object->import_count != 0) {
+		for (size_t i = 0; i < object->import_count; ++i) {
+			fprintf(stderr, "ERROR: Symbol '%s' undefined\n", object->imports[i]);
+		}
+
+		return 1;
+	}
+
+	/* Patches are made by comparing an edited copy of the ROM with the original */
+	const bool patch = options->output_format == OUTPUT_FORMAT_IPS || options->output_format == OUTPUT_FORMAT_BPS;
+	Rom *rom = Rom_Open(options->inject_path, !patch);
+	Rom *original_rom = NULL;
+
+	if (rom == NULL) {
+		return 1;
+	}
+
+	if (patch && (original_rom = Rom_Open(options->inject_path, false)) == NULL) {
+		Rom_Close(rom);
+		return 1;
+	}
+
+	const Driver *driver = GetDriver(object->driver);
+	const size_t rom_size = Rom_GetSize(rom);
+	const size_t start = options->inject_offset;
+	const size_t end = start + object->size;
+	const size_t entry_size = driver->big_endian ? 4 : 2;
+
+	/* Refuse to write anything unless all of it fits */
+	if (start > rom_size || object->size > rom_size - start) {
+		fprintf(stderr, "ERROR: The song is $%zX bytes, which doesn't fit between $%zX and the end of the ROM at $%zX\n", object->size, start, rom_size);
+	}
+	else if (options->inject_size != 0 && object->size > options->inject_size) {
+		fprintf(stderr, "ERROR: The song is $%zX bytes, which is more than the $%zX bytes that there is room for\n", object->size, options->inject_size);
+	}
+	/* The Z80 can only see one bank at a time */
+	else if (!driver->big_endian && object->size != 0 && start / options->bank_size != (end - 1) / options->bank_size) {
+		fprintf(stderr, "ERROR: The song would cross from one bank into the next between $%zX and $%zX\n", start, end);
+	}
+	else if (options->has_table_entry && (options->table_entry > rom_size || entry_size > rom_size - options->table_entry)) {
+		fprintf(stderr, "ERROR: The pointer table entry at $%zX is past the end of the ROM\n", options->table_entry);
+	}
+	else if (options->has_table_entry && options->table_entry < end && options->table_entry + entry_size > start) {
+		fprintf(stderr, "ERROR: The pointer table entry at $%zX would be overwritten by the song\n", options->table_entry);
+	}
+	else {
+		Rom_Write(rom, start, object->data, object->size);
+
+		if (options->has_table_entry) {
+			unsigned char entry[4];
+
+			/* Sonic 1's table holds ROM addresses; the Z80 drivers' hold addresses in the bank window */
+			if (driver->big_endian) {
+				entry[0] = (start >> 24) & 0xFF;
+				entry[1] = (start >> 16) & 0xFF;
+				entry[2] = (start >> 8) & 0xFF;
+				entry[3] = start & 0xFF;
+			}
+			else {
+				entry[0] = options->file_offset & 0xFF;
+				entry[1] = (options->file_offset >> 8) & 0xFF;
+			}
+
+			Rom_Write(rom, options->table_entry, entry, entry_size);
+		}
+
+		int result = 0;
+
+		if (patch) {
+			if (!Patch_Write(out_file_path, (options->output_format == OUTPUT_FORMAT_IPS) ? PATCH_FORMAT_IPS : PATCH_FORMAT_BPS, Rom_GetData(original_rom), Rom_GetData(rom), rom_size)) {
+				result = 1;
+			}
+
+			Rom_Close(original_rom);
+		}
+
+		if (!Rom_Close(rom)) {
+			fprintf(stderr, "ERROR: Couldn't write \"%s\"\n", options->inject_path);
+			result = 1;
+		}
+
+		return result;
+	}
+
+	if (original_rom != NULL) {
+		Rom_Close(original_rom);
+	}
+
+	Rom_Close(rom);
+
+	return 1;
+}
+
+/*
+ * Helper function to read a compiled song back into the form that assembly starts from
+ */
+IR * disassembleFile(const char * in_file_path, const Options * options, const char * name) {
+	FILE *in_file = fopen(in_file_path, "rb");
+
+	if (in_file == NULL) {
+		fprintf(stderr, "ERROR: Couldn't open \"%s\"\n", in_file_path);
+		return NULL;
+	}
+
+	fseek(in_file, 0, SEEK_END);
+	const size_t in_file_size = ftell(in_file);
+	rewind(in_file);
+
+	unsigned char * data = malloc(in_file_size + 1);
+	IR * ir = NULL;
+
+	if (fread(data, 1, in_file_size, in_file) != in_file_size) {
+		fprintf(stderr, "ERROR: Couldn't read \"%s\"\n", in_file_path);
+	}
+	else {
+		ir = Disassemble(data, in_file_size, options->source_driver, options->has_source_offset ? options->source_offset : options->file_offset, options->sfx, name);
+	}
+
+	fclose(in_file);
+	free(data);
+
+	return ir;
+}
+
+/*
+ * Helper function to name a disassembly's labels after its file, minus any directories and extension
+ */
+char * getLabelPrefix(const char * file_path) {
+	const char * file_name = file_path;
+
+	for (const char * character = file_path; *character != '\0'; ++character) {
+		if (*character == '/' || *character == '\\') {
+			file_name = character + 1;
+		}
+	}
+
+	const size_t length = (strchr(file_name, '.') != NULL) ? (size_t)(strchr(file_name, '.') - file_name) : strlen(file_name);
+	char * prefix = malloc(length + 2);
+	size_t prefix_length = 0;
+
+	/* Labels can't start with a digit, or they'd be mistaken for numbers */
+	if (length == 0 || (file_name[0] >= '0' && file_name[0] <= '9')) {
+		prefix[prefix_length++] = '_';
+	}
+
+	for (size_t i = 0; i < length; ++i) {
+		const char character = file_name[i];
+		const bool is_valid = (character >= 'a' && character <= 'z') || (character >= 'A' && character <= 'Z') || (character >= '0' && character <= '9') || character == '_';
+
+		prefix[prefix_length++] = is_valid ? character : '_';
+	}
+
+	prefix[prefix_length] = '\0';
+
+	return prefix;
+}
+
+/*
+ * Helper function to tell sound effects from music by their header
+ */
+bool isSoundEffect(const IR * ir) {
+	for (size_t i = 0; i < ir->line_count; ++i) {
+		if (ir->lines[i].instruction != IR_NONE && strcmp(ir->strings + ir->lines[i].instruction, "smpsHeaderChanSFX") == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Helper function to assemble a song, disassemble the result to source code, and check that assembling that
+ * gives the same bytes again, without touching the disk
+ */
+int verifySong(const char * in_file_path, const IR * ir, unsigned int target_driver, size_t file_offset) {
+	MemoryStream *original_stream = MemoryStream_Create(true);
+	MemoryStream *text_stream = MemoryStream_Create(false);
+	MemoryStream *output_stream = MemoryStream_Create(true);
+	IR *disassembly = NULL;
+	IR *reparsed = NULL;
+	int result = 1;
+
+	if (!SMPS2ASM2BIN_IR(ir, original_stream, target_driver, file_offset)) {
+		fprintf(stderr, "Processing of \"%s\" file for driver version %u halted due to an error.\n", in_file_path, target_driver);
+		MemoryStream_Destroy(text_stream);
+	}
+	else {
+		MemoryStream_SetPosition(original_stream, 0, MEMORYSTREAM_END);
+
+		const unsigned char * original = MemoryStream_GetBuffer(original_stream);
+		const size_t original_size = MemoryStream_GetPosition(original_stream);
+
+		disassembly = Disassemble(original, original_size, target_driver, file_offset, isSoundEffect(ir), "Song");
+
+		if (disassembly == NULL) {
+			fprintf(stderr, "ERROR: \"%s\" for driver version %u couldn't be disassembled\n", in_file_path, target_driver);
+			MemoryStream_Destroy(text_stream);
+		}
+		else {
+			/* The lexer takes ownership of the text, which needs a terminator */
+			IR_Write(disassembly, text_stream);
+			MemoryStream_WriteByte(text_stream, '\0');
+			MemoryStream_SetPosition(text_stream, 0, MEMORYSTREAM_END);
+
+			const size_t text_size = MemoryStream_GetPosition(text_stream) - 1;
+
+			reparsed = IR_Lex((char*)MemoryStream_GetBuffer(text_stream), text_size);
+			MemoryStream_Destroy(text_stream);
+
+			if (reparsed == NULL || !SMPS2ASM2BIN_IR(reparsed, output_stream, target_driver, file_offset)) {
+				fprintf(stderr, "ERROR: The disassembly of \"%s\" for driver version %u couldn't be assembled\n", in_file_path, target_driver);
+			}
+			else {
+				MemoryStream_SetPosition(output_stream, 0, MEMORYSTREAM_END);
+
+				const unsigned char * output = MemoryStream_GetBuffer(output_stream);
+				const size_t output_size = MemoryStream_GetPosition(output_stream);
+				size_t position = 0;
+
+				while (position < original_size && position < output_size && original[position] == output[position]) {
+					++position;
+				}
+
+				if (position != original_size || position != output_size) {
+					fprintf(stderr, "ERROR: The disassembly of \"%s\" for driver version %u assembles differently, from $%zX\n", in_file_path, target_driver, position);
+				}
+				else {
+					result = 0;
+				}
+			}
+		}
+	}
+
+	if (reparsed != NULL) {
+		IR_Destroy(reparsed);
+	}
+
+	if (disassembly != NULL) {
+		IR_Destroy(disassembly);
+	}
+
+	MemoryStream_Destroy(original_stream);
+	MemoryStream_Destroy(output_stream);
+
+	return result;
+}
+
+/*
+ * Helper function to print one frame of a simulation, and when it happens at 60 frames per second
+ */
+void printSimulatedFrame(size_t index, const SimulatedFrame * frame, unsigned int write_limit) {
+	const bool over_limit = write_limit != 0 && frame->ym2612_writes + frame->psg_writes > write_limit;
+
+	printf("	frame %zu (%zu:%05.2f): %u tracks updated, %u bytes read, %u YM2612 writes, %u PSG writes%s\n",
+		index, index / (60 * 60), (double)(index % (60 * 60)) / 60, frame->tracks, frame->bytes, frame->ym2612_writes, frame->psg_writes, over_limit ? " (over the limit)" : "");
+}
+
+/*
+ * Helper function to print what one channel uses of its track's RAM
+ */
+void reportChannelUsage(const ChannelUsage * usage) {
+	printf("	channel %u at $%04zX: ", usage->channel, usage->position);
+
+	if (usage->recursive) {
+		printf("smpsCalls nest without end");
+	}
+	else {
+		printf("smpsCalls nest %u deep", usage->call_depth);
+	}
+
+	bool any_loops = false;
+
+	for (unsigned int i = 0; i < sizeof(usage->loop_indices) / sizeof(usage->loop_indices[0]); ++i) {
+		if (usage->loop_indices[i]) {
+			printf("%s%u", any_loops ? ", " : ", loop indices ", i);
+			any_loops = true;
+		}
+	}
+
+	printf("%s\n", any_loops ? "" : ", no loops");
+}
+
+/*
+ * Helper function to read a whole input file, decompressing it first if '-z' was given
+ */
+unsigned char * readInputFile(const char * in_file_path, const Options * options, size_t * size) {
+	FILE *in_file = fopen(in_file_path, "rb");
+
+	if (in_file == NULL) {
+		fprintf(stderr, "ERROR: Couldn't open \"%s\"\n", in_file_path);
+		return NULL;
+	}
+
+	fseek(in_file, 0, SEEK_END);
+	const size_t in_file_size = ftell(in_file);
+	rewind(in_file);
+
+	unsigned char * data = malloc(in_file_size + 1);
+
+	if (fread(data, 1, in_file_size, in_file) != in_file_size) {
+		fprintf(stderr, "ERROR: Couldn't read \"%s\"\n", in_file_path);
+		free(data);
+		data = NULL;
+	}
+	else if (options->compression != COMPRESSION_NONE) {
+		/* The stream's buffer outlives it, and takes the place of the file's contents */
+		MemoryStream *decompressed_stream = MemoryStream_Create(false);
+		const bool decompressed = Decompress(options->compression, data, in_file_size, decompressed_stream);
+
+		free(data);
+		MemoryStream_SetPosition(decompressed_stream, 0, MEMORYSTREAM_END);
+		data = MemoryStream_GetBuffer(decompressed_stream);
+		*size = MemoryStream_GetPosition(decompressed_stream);
+		MemoryStream_Destroy(decompressed_stream);
+
+		if (!decompressed) {
+			fprintf(stderr, "Decompression of \"%s\" halted due to an error.\n", in_file_path);
+			free(data);
+			data = NULL;
+		}
+	}
+	else {
+		*size = in_file_size;
+	}
+
+	fclose(in_file);
+
+	return data;
+}
+
+/*
+ * Helper function to play a compiled song the way its driver would, and report what each frame costs
+ */
+int simulateFile(const char * in_file_path, const char * out_file_path, const Options * options) {
+	size_t song_size;
+	unsigned char * song = readInputFile(in_file_path, options, &song_size);
+	SimulatedFrame * frames = malloc(sizeof(*frames) * options->frame_count);
+	size_t frame_count = 0;
+	int result = 1;
+
+	if (song != NULL) {
+		frame_count = Simulate(song, song_size, options->source_driver, options->has_source_offset ? options->source_offset : options->file_offset, options->sfx, frames, options->frame_count);
+
+		if (frame_count == 0) {
+			fprintf(stderr, "Simulation of \"%s\" halted due to an error.\n", in_file_path);
+		}
+		else {
+			result = 0;
+		}
+	}
+
+	if (result == 0) {
+		static const char * const metric_names[4] = {"Tracks updated", "Bytes read", "YM2612 writes", "PSG writes"};
+		unsigned long totals[4] = {0};
+		unsigned int worst[4] = {0};
+		size_t worst_frames[4] = {0};
+		size_t busiest[BUSIEST_FRAMES];
+		size_t busiest_count = 0;
+		size_t over_limit = 0;
+
+		for (size_t i = 0; i < frame_count; ++i) {
+			const unsigned int metrics[4] = {frames[i].tracks, frames[i].bytes, frames[i].ym2612_writes, frames[i].psg_writes};
+			const unsigned int writes = frames[i].ym2612_writes + frames[i].psg_writes;
+
+			for (unsigned int j = 0; j < 4; ++j) {
+				totals[j] += metrics[j];
+
+				if (metrics[j] > worst[j]) {
+					worst[j] = metrics[j];
+					worst_frames[j] = i;
+				}
+			}
+
+			if (options->write_limit != 0 && writes > options->write_limit) {
+				++over_limit;
+			}
+
+			/* Keep the frames with the most register writes, earliest first among equals */
+			size_t slot = busiest_count;
+
+			while (slot != 0 && frames[busiest[slot - 1]].ym2612_writes + frames[busiest[slot - 1]].psg_writes < writes) {
+				--slot;
+			}
+
+			if (slot < BUSIEST_FRAMES && writes != 0) {
+				if (busiest_count < BUSIEST_FRAMES) {
+					++busiest_count;
+				}
+
+				memmove(&busiest[slot + 1], &busiest[slot], sizeof(*busiest) * (busiest_count - 1 - slot));
+				busiest[slot] = i;
+			}
+		}
+
+		printf("%s: played %zu frames, %s\n", in_file_path, frame_count, (frame_count < options->frame_count) ? "until every track stopped" : "and is still playing");
+		printf("	%-16s %8s %8s %8s\n", "", "average", "worst", "at frame");
+
+		for (unsigned int i = 0; i < 4; ++i) {
+			printf("	%-16s %8.2f %8u %8zu\n", metric_names[i], (double)totals[i] / frame_count, worst[i], worst_frames[i]);
+		}
+
+		if (busiest_count != 0) {
+			printf("Frames with the most register writes:\n");
+
+			for (size_t i = 0; i < busiest_count; ++i) {
+				printSimulatedFrame(busiest[i], &frames[busiest[i]], options->write_limit);
+			}
+		}
+
+		if (options->write_limit != 0) {
+			printf("%zu frames make more than %u register writes\n", over_limit, options->write_limit);
+
+			if (over_limit != 0) {
+				result = 1;
+			}
+		}
+
+		/* Every frame, for graphing */
+		if (out_file_path != NULL) {
+			FILE *out_file = fopen(out_file_path, "w");
+
+			if (out_file == NULL) {
+				fprintf(stderr, "ERROR: Couldn't open \"%s\" for writing\n", out_file_path);
+				result = 1;
+			}
+			else {
+				fprintf(out_file, "frame,tracks,bytes,ym2612_writes,psg_writes\n");
+
+				for (size_t i = 0; i < frame_count; ++i) {
+					fprintf(out_file, "%zu,%u,%u,%u,%u\n", i, frames[i].tracks, frames[i].bytes, frames[i].ym2612_writes, frames[i].psg_writes);
+				}
+
+				fclose(out_file);
+			}
+		}
+	}
+
+	free(song);
+	free(frames);
+
+	return result;
+}
+
+/*
+ * Helper function to synthesize each song that falls to one thread, and write it to its WAV file
+ */
+void renderSongs(void * user_data, unsigned int thread_index) {
+	RenderJobs * jobs = user_data;
+
+	for (size_t i = thread_index; i < jobs->count; i += jobs->thread_count) {
+		if (jobs->logs[i] == NULL) {
+			continue;
+		}
+
+		MemoryStream * wav = MemoryStream_Create(true);
+		FILE * out_file = fopen(jobs->out_file_paths[i], "wb");
+
+		Render_Synthesize(jobs->logs[i], wav);
+
+		if (out_file != NULL) {
+			jobs->succeeded[i] = fwrite(MemoryStream_GetBuffer(wav), 1, MemoryStream_GetPosition(wav), out_file) == MemoryStream_GetPosition(wav);
+			fclose(out_file);
+		}
+
+		MemoryStream_Destroy(wav);
+	}
+}
+
+/*
+ * Helper function to read a WAV file, for 'dac'
+ */
+bool readSample(const char * in_file_path, const Options * options, Sample * sample) {
+	size_t size;
+	unsigned char * data = readInputFile(in_file_path, options, &size);
+
+	if (data == NULL) {
+		return false;
+	}
+
+	const bool read = Sample_ReadWAV(data, size, sample);
+
+	if (!read) {
+		fprintf(stderr, "Reading of \"%s\" halted due to an error.\n", in_file_path);
+	}
+
+	free(data);
+
+	return read;
+}
+
+/*
+ * Helper function to encode samples for one driver, and write them after a table of each one's Z80 pointer and length
+ */
+int writeSampleBank(const char * out_file_path, const Sample * samples, size_t sample_count, unsigned int driver_version, const Options * options) {
+	const Driver * driver = GetDriver(driver_version);
+	const unsigned long rate = (options->sample_rate != 0) ? options->sample_rate : driver->dac_rate;
+	const size_t table_size = sample_count * 4;
+	MemoryStream * table = MemoryStream_Create(true);
+	MemoryStream * sample_data = MemoryStream_Create(true);
+	int result = 0;
+
+	for (size_t i = 0; i < sample_count; ++i) {
+		const size_t start = MemoryStream_GetPosition(sample_data);
+		const size_t pointer = options->file_offset + table_size + start;
+		Sample resampled;
+
+		Sample_Resample(&samples[i], rate, &resampled);
+		Sample_Encode(&resampled, options->sample_encoding, sample_data);
+		Sample_Destroy(&resampled);
+
+		const size_t length = MemoryStream_GetPosition(sample_data) - start;
+
+		/* The drivers' pointers and lengths are both 16-bit, and little-endian as the Z80 reads them */
+		MemoryStream_WriteByte(table, pointer & 0xFF);
+		MemoryStream_WriteByte(table, (pointer >> 8) & 0xFF);
+		MemoryStream_WriteByte(table, length & 0xFF);
+		MemoryStream_WriteByte(table, (length >> 8) & 0xFF);
+	}
+
+	const size_t total_size = table_size + MemoryStream_GetPosition(sample_data);
+
+	if (total_size > options->bank_size) {
+		fprintf(stderr, "ERROR: \"%s\" would be $%zX bytes, which doesn't fit in a $%zX-byte bank\n", out_file_path, total_size, options->bank_size);
+		result = 1;
+	}
+	else {
+		FILE * out_file = fopen(out_file_path, "wb");
+
+		if (out_file == NULL) {
+			fprintf(stderr, "ERROR: Couldn't open \"%s\" for writing\n", out_file_path);
+			result = 1;
+		}
+		else {
+			fwrite(MemoryStream_GetBuffer(table), 1, table_size, out_file);
+			fwrite(MemoryStream_GetBuffer(sample_data), 1, MemoryStream_GetPosition(sample_data), out_file);
+			fclose(out_file);
+
+			printf("%s: %zu samples at %luHz, $%zX bytes\n", out_file_path, sample_count, rate, total_size);
+		}
+	}
+
+	MemoryStream_Destroy(table);
+	MemoryStream_Destroy(sample_data);
+
+	return result;
+}
+
+/*
+ * Helper function to write the equates that songs pick each sample or voice by, named after its file
+ */
+int writeIDs(const char * ids_path, char prefix, const char ** in_file_paths, const size_t * ids, size_t first_id, size_t count) {
+	FILE * ids_file = (ids_path != NULL) ? fopen(ids_path, "w") : stdout;
+
+	if (ids_file == NULL) {
+		fprintf(stderr, "ERROR: Couldn't open \"%s\" for writing\n", ids_path);
+		return 1;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		char * name = getLabelPrefix(in_file_paths[i]);
+
+		/* 'kick.wav' becomes 'dKick', after the disassemblies' own names */
+		if (name[0] >= 'a' && name[0] <= 'z') {
+			name[0] -= 'a' - 'A';
+		}
+
+		fprintf(ids_file, "%c%s\tequ $%02zX\n", prefix, name, first_id + ((ids != NULL) ? ids[i] : i));
+		free(name);
+	}
+
+	if (ids_file != stdout) {
+		fclose(ids_file);
+	}
+
+	return 0;
+}
+
+/*
+ * Helper function to read a TFI, DMP or VGI voice, for 'voices'
+ */
+bool readVoice(const char * in_file_path, const Options * options, Voice * voice) {
+	const VoiceFormat format = FindVoiceFormat(in_file_path);
+
+	if (format == VOICE_FORMAT_NONE) {
+		fprintf(stderr, "ERROR: \"%s\" isn't a .tfi, .dmp or .vgi file\n", in_file_path);
+		return false;
+	}
+
+	size_t size;
+	unsigned char * data = readInputFile(in_file_path, options, &size);
+
+	if (data == NULL) {
+		return false;
+	}
+
+	const bool read = Voice_Read(format, data, size, voice);
+
+	if (!read) {
+		fprintf(stderr, "Reading of \"%s\" halted due to an error.\n", in_file_path);
+	}
+	else if (Voice_HasExtras(voice)) {
+		fprintf(stderr, "WARNING: \"%s\" uses SSG-EG or the LFO, which were left out\n", in_file_path);
+	}
+
+	free(data);
+
+	return read;
+}
+
+/*
+ * Helper function to pack voices for one driver, with one copy of each, and write them
+ */
+int writeVoiceBank(const char * out_file_path, const Voice * voices, size_t voice_count, unsigned int driver_version, size_t * ids) {
+	const Driver * driver = GetDriver(driver_version);
+	const size_t max_voices = driver->external_voices ? MAX_EXTERNAL_VOICES : MAX_VOICES;
+	MemoryStream * bank = MemoryStream_Create(true);
+	const size_t packed_count = Voice_PackBank(voices, voice_count, driver, bank, ids);
+	FILE * out_file = NULL;
+	int result = 0;
+
+	if (packed_count > max_voices) {
+		fprintf(stderr, "ERROR: %s's songs can only pick from $%zX voices, but there are $%zX different ones\n", driver->name, max_voices, packed_count);
+		result = 1;
+	}
+	else if ((out_file = fopen(out_file_path, "wb")) == NULL) {
+		fprintf(stderr, "ERROR: Couldn't open \"%s\" for writing\n", out_file_path);
+		result = 1;
+	}
+	else {
+		fwrite(MemoryStream_GetBuffer(bank), 1, MemoryStream_GetPosition(bank), out_file);
+		fclose(out_file);
+
+		printf("%s: %zu voices, %zu once duplicates are removed, $%zX bytes\n", out_file_path, voice_count, packed_count, MemoryStream_GetPosition(bank));
+	}
+
+	MemoryStream_Destroy(bank);
+
+	return result;
+}
+
+/*
+ * Helper function to parse a command's options, and check that 'argument_count' or more arguments follow them
+ */
+int parseCommandOptions(int argc, char *argv[], int * arg_index_ptr, Options * options, int argument_count, const char * arguments) {
+	if (parseOptions(argc, argv, arg_index_ptr, options) != 0 || *arg_index_ptr + argument_count > argc) {
+		if (*arg_index_ptr + argument_count > argc) {
+			fprintf(stderr, "ERROR: Expected %s after options\n", arguments);
+		}
+
+		fprintf(stderr, "Error during arguments parsing, unable to continue.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Bank callback, which writes each bank that 'pack' links
+ */
+bool writeBank(const char * out_file_path, const Object * object) {
+	return writeObject(out_file_path, object, pack_output_format) == 0;
+}
+
+/*
+ * Run as a language server
+ */
+int lspCommand(int argc, char *argv[], Options * options) {
+	int arg_index = 2;
+
+	if (parseCommandOptions(argc, argv, &arg_index, options, 0, NULL) != 0) {
+		return -1;
+	}
+
+	return LSP_Run(options->target_drivers[0], options->file_offset);
+}
+
+/*
+ * Move an object to another offset
+ */
+int relocateCommand(int argc, char *argv[], Options * options) {
+	const char * in_file_path = NULL;
+	const char * out_file_path = NULL;
+
+	if (parseArgs(argc, argv, 2, &in_file_path, &out_file_path, options) != 0) {
+		fprintf(stderr, "Error during arguments parsing, unable to continue.\n");
+		return -1;
+	}
+
+	Object *object = Object_Load(in_file_path);
+
+	if (object == NULL) {
+		fprintf(stderr, "ERROR: \"%s\" is not a valid object file\n", in_file_path);
+		return 1;
+	}
+
+	Object_Relocate(object, options->file_offset);
+
+	const int result = writeObject(out_file_path, object, options->output_format);
+
+	Object_Destroy(object);
+
+	return result;
+}
+
+/*
+ * Helper function to free objects that loadObjects loaded
+ */
+void destroyObjects(Object ** objects, size_t object_count) {
+	for (size_t i = 0; i < object_count; ++i) {
+		Object_Destroy(objects[i]);
+	}
+
+	free(objects);
+}
+
+/*
+ * Helper function to load every object that a command was given
+ */
+Object ** loadObjects(const char ** in_object_paths, size_t object_count) {
+	Object **objects = malloc(sizeof(*objects) * object_count);
+	bool loaded = true;
+
+	for (size_t i = 0; i < object_count; ++i) {
+		objects[i] = Object_Load(in_object_paths[i]);
+
+		if (objects[i] == NULL) {
+			fprintf(stderr, "ERROR: \"%s\" is not a valid object file\n", in_object_paths[i]);
+			loaded = false;
+		}
+	}
+
+	if (!loaded) {
+		destroyObjects(objects, object_count);
+		return NULL;
+	}
+
+	return objects;
+}
+
+/*
+ * Combine several objects
+ */
+int linkCommand(int argc, char *argv[], Options * options) {
+	int arg_index = 2;
+
+	if (parseCommandOptions(argc, argv, &arg_index, options, 2, "\"out_file_path\" and at least one \"in_object_path\"") != 0) {
+		return -1;
+	}
+
+	const char * out_file_path = argv[arg_index++];
+	const size_t object_count = argc - arg_index;
+	Object **objects = loadObjects((const char **)&argv[arg_index], object_count);
+
+	if (objects == NULL) {
+		return 1;
+	}
+
+	Object *linked = Link(objects, object_count, options->file_offset);
+	int result = 1;
+
+	if (linked != NULL && options->share_voices) {
+		MemoryStream *universal_voice_bank = (options->universal_voice_bank_path != NULL) ? MemoryStream_Create(true) : NULL;
+
+		if (!ShareVoices(linked, universal_voice_bank)) {
+			Object_Destroy(linked);
+			linked = NULL;
+		}
+		else if (universal_voice_bank != NULL) {
+			FILE *uvb_file = fopen(options->universal_voice_bank_path, "wb");
+
+			if (uvb_file == NULL) {
+				fprintf(stderr, "ERROR: Couldn't open \"%s\" for writing\n", options->universal_voice_bank_path);
+				Object_Destroy(linked);
+				linked = NULL;
+			}
+			else {
+				fwrite(MemoryStream_GetBuffer(universal_voice_bank), 1, MemoryStream_GetPosition(universal_voice_bank), uvb_file);
+				fclose(uvb_file);
+			}
+		}
+
+		if (universal_voice_bank != NULL) {
+			MemoryStream_Destroy(universal_voice_bank);
+		}
+	}
+
+	if (linked != NULL) {
+		result = writeObject(out_file_path, linked, options->output_format);
+	}
+	else {
+		fprintf(stderr, "Linking halted due to an error.\n");
+	}
+
+	Object_Destroy(linked);
+	destroyObjects(objects, object_count);
+
+	return result;
+}
+
+/*
+ * Share objects out between Z80 banks
+ */
+int packCommand(int argc, char *argv[], Options * options) {
+	int arg_index = 2;
+
+	/* Banks are only any use where the Z80 sees them, unless told otherwise */
+	options->file_offset = Z80_BANK_WINDOW;
+
+	if (parseCommandOptions(argc, argv, &arg_index, options, 2, "\"out_file_path\" and at least one \"in_object_path\"") != 0) {
+		return -1;
+	}
+
+	const char * out_file_path = argv[arg_index++];
+	const char ** object_paths = (const char **)&argv[arg_index];
+	const size_t object_count = argc - arg_index;
+	Object **objects = loadObjects(object_paths, object_count);
+
+	if (objects == NULL) {
+		return 1;
+	}
+
+	int result = 0;
+
+	pack_output_format = options->output_format;
+	pack_callback = writeBank;
+
+	if (!PackBanks(objects, object_paths, object_count, options->bank_size, options->file_offset, out_file_path, options->map_path)) {
+		fprintf(stderr, "Packing halted due to an error.\n");
+		result = 1;
+	}
+
+	destroyObjects(objects, object_count);
+
+	return result;
+}
+
+/*
+ * Assemble everything that a manifest lists
+ */
+int buildCommand(int argc, char *argv[], Options * options) {
+	int arg_index = 2;
+
+	if (parseCommandOptions(argc, argv, &arg_index, options, 1, "\"manifest_path\"") != 0) {
+		return -1;
+	}
+
+	build_cache_directory = options->cache_directory;
+	build_optimizations = options->optimizations;
+	build_callback = buildSong;
+
+	if (options->optimizations != 0) {
+		relocation_callback = addRelocation;
+		fixup_callback = addFixup;
+		marker_callback = addMarker;
+		optimization_callback = reportOptimization;
+	}
+
+	if (!Build(argv[arg_index])) {
+		fprintf(stderr, "Building of \"%s\" halted due to an error.\n", argv[arg_index]);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Turn a compiled song back into source code
+ */
+int disasmCommand(int argc, char *argv[], Options * options) {
+	int arg_index = 2;
+
+	if (parseCommandOptions(argc, argv, &arg_index, options, 1, "\"in_file_path\"") != 0) {
+		return -1;
+	}
+
+	const char * in_file_path = argv[arg_index++];
+	char * out_file_path;
+
+	if (arg_index < argc) {
+		out_file_path = malloc(strlen(argv[arg_index]) + 1);
+		strcpy(out_file_path, argv[arg_index]);
+	}
+	else {
+		out_file_path = malloc(strlen(in_file_path) + sizeof(".asm"));
+		sprintf(out_file_path, "%s.asm", in_file_path);
+	}
+
+	char * name = getLabelPrefix(in_file_path);
+	IR * ir = disassembleFile(in_file_path, options, name);
+	int result = 0;
+
+	if (ir == NULL) {
+		fprintf(stderr, "Disassembly of \"%s\" halted due to an error.\n", in_file_path);
+		result = 1;
+	}
+	else {
+		MemoryStream *text_stream = MemoryStream_Create(true);
+		FILE *out_file = fopen(out_file_path, "wb");
+
+		IR_Write(ir, text_stream);
+		MemoryStream_SetPosition(text_stream, 0, MEMORYSTREAM_END);
+
+		if (out_file == NULL) {
+			fprintf(stderr, "ERROR: Couldn't open \"%s\"\n", out_file_path);
+			result = 1;
+		}
+		else {
+			if (fwrite(MemoryStream_GetBuffer(text_stream), 1, MemoryStream_GetPosition(text_stream), out_file) != MemoryStream_GetPosition(text_stream)) {
+				fprintf(stderr, "ERROR: Couldn't write \"%s\"\n", out_file_path);
+				result = 1;
+			}
+
+			fclose(out_file);
+		}
+
+		MemoryStream_Destroy(text_stream);
+		IR_Destroy(ir);
+	}
+
+	free(name);
+	free(out_file_path);
+
+	return result;
+}
+
+/*
+ * Undo '-z', or unpack a game's own songs
+ */
+int decompressCommand(int argc, char *argv[], Options * options) {
+	const char * in_file_path = NULL;
+	const char * out_file_path = NULL;
+
+	if (parseArgs(argc, argv, 2, &in_file_path, &out_file_path, options) != 0) {
+		fprintf(stderr, "Error during arguments parsing, unable to continue.\n");
+		return -1;
+	}
+
+	if (options->compression == COMPRESSION_NONE) {
+		fprintf(stderr, "ERROR: Expected \"-z saxman|kosinski\" to say how \"%s\" is compressed\n", in_file_path);
+		return -1;
+	}
+
+	FILE *in_file = fopen(in_file_path, "rb");
+
+	if (in_file == NULL) {
+		fprintf(stderr, "ERROR: Couldn't open \"%s\"\n", in_file_path);
+		return 1;
+	}
+
+	fseek(in_file, 0, SEEK_END);
+	const size_t in_file_size = ftell(in_file);
+	rewind(in_file);
+
+	unsigned char * data = malloc(in_file_size + 1);
+	MemoryStream *output_stream = MemoryStream_Create(true);
+	int result = 1;
+
+	if (fread(data, 1, in_file_size, in_file) != in_file_size) {
+		fprintf(stderr, "ERROR: Couldn't read \"%s\"\n", in_file_path);
+	}
+	else if (!Decompress(options->compression, data, in_file_size, output_stream)) {
+		fprintf(stderr, "Decompression of \"%s\" halted due to an error.\n", in_file_path);
+	}
+	else {
+		FILE *out_file = fopen(out_file_path, "wb");
+
+		MemoryStream_SetPosition(output_stream, 0, MEMORYSTREAM_END);
+
+		if (out_file == NULL) {
+			fprintf(stderr, "ERROR: Couldn't open \"%s\" for writing\n", out_file_path);
+		}
+		else {
+			fwrite(MemoryStream_GetBuffer(output_stream), 1, MemoryStream_GetPosition(output_stream), out_file);
+			fclose(out_file);
+			result = 0;
+		}
+	}
+
+	fclose(in_file);
+	free(data);
+	MemoryStream_Destroy(output_stream);
+
+	return result;
+}
+
+/*
+ * Check that every song survives being disassembled and assembled again
+ */
+int verifyCommand(int argc, char *argv[], Options * options) {
+	int arg_index = 2;
+
+	if (parseCommandOptions(argc, argv, &arg_index, options, 1, "\"in_file_path\"") != 0) {
+		return -1;
+	}
+
+	unsigned int checked = 0;
+	unsigned int failed = 0;
+
+	for (; arg_index < argc; ++arg_index) {
+		IR *ir = SMPS2ASM2BIN_LexFile(argv[arg_index], options->cache_directory);
+
+		if (ir == NULL) {
+			fprintf(stderr, "Processing of \"%s\" file halted due to an error.\n", argv[arg_index]);
+			checked += options->target_driver_count;
+			failed += options->target_driver_count;
+			continue;
+		}
+
+		for (unsigned int i = 0; i < options->target_driver_count; ++i) {
+			++checked;
+
+			if (verifySong(argv[arg_index], ir, options->target_drivers[i], options->file_offset) != 0) {
+				++failed;
+			}
+		}
+
+		IR_Destroy(ir);
+	}
+
+	printf("%u of %u songs came back the same\n", checked - failed, checked);
+
+	return (failed != 0) ? 1 : 0;
+}
+
+/*
+ * Play a compiled song and report what it costs the driver each frame
+ */
+int simulateCommand(int argc, char *argv[], Options * options) {
+	int arg_index = 2;
+
+	if (parseCommandOptions(argc, argv, &arg_index, options, 1, "\"in_file_path\"") != 0) {
+		return -1;
+	}
+
+	return simulateFile(argv[arg_index], (arg_index + 1 < argc) ? argv[arg_index + 1] : NULL, options);
+}
+
+/*
+ * Play compiled songs through models of the sound chips, and write what they sound like
+ */
+int renderCommand(int argc, char *argv[], Options * options) {
+	int arg_index = 2;
+
+	if (parseCommandOptions(argc, argv, &arg_index, options, 1, "\"in_file_path\"") != 0) {
+		return -1;
+	}
+
+	RenderJobs jobs;
+
+	jobs.count = argc - arg_index;
+	jobs.out_file_paths = malloc(sizeof(*jobs.out_file_paths) * jobs.count);
+	jobs.logs = malloc(sizeof(*jobs.logs) * jobs.count);
+	jobs.succeeded = calloc(jobs.count, sizeof(*jobs.succeeded));
+
+	/* Playing the songs reports errors as it goes, so it happens one song at a time */
+	for (size_t i = 0; i < jobs.count; ++i) {
+		const char * in_file_path = argv[arg_index + i];
+		size_t song_size;
+		unsigned char * song = readInputFile(in_file_path, options, &song_size);
+
+		jobs.out_file_paths[i] = malloc(strlen(in_file_path) + sizeof(".wav"));
+		sprintf(jobs.out_file_paths[i], "%s.wav", in_file_path);
+		jobs.logs[i] = NULL;
+
+		if (song != NULL) {
+			jobs.logs[i] = Render_Sequence(song, song_size, options->source_driver, options->has_source_offset ? options->source_offset : options->file_offset, options->sfx, options->frame_count);
+
+			if (jobs.logs[i] == NULL) {
+				fprintf(stderr, "Rendering of \"%s\" halted due to an error.\n", in_file_path);
+			}
+		}
+
+		free(song);
+	}
+
+	/* Synthesizing them is where the time goes, and each one is independent of the others */
+	jobs.thread_count = Thread_GetCount();
+
+	if (jobs.thread_count > jobs.count) {
+		jobs.thread_count = (unsigned int)jobs.count;
+	}
+
+	Thread_RunParallel(renderSongs, &jobs, jobs.thread_count);
+
+	size_t rendered = 0;
+
+	for (size_t i = 0; i < jobs.count; ++i) {
+		if (jobs.succeeded[i]) {
+			printf("%s: %zu frames\n", jobs.out_file_paths[i], jobs.logs[i]->frame_count);
+			++rendered;
+		}
+		else if (jobs.logs[i] != NULL) {
+			fprintf(stderr, "ERROR: Couldn't write \"%s\"\n", jobs.out_file_paths[i]);
+		}
+
+		if (jobs.logs[i] != NULL) {
+			Render_DestroyLog(jobs.logs[i]);
+		}
+
+		free(jobs.out_file_paths[i]);
+	}
+
+	printf("%zu of %zu songs rendered\n", rendered, jobs.count);
+
+	free(jobs.out_file_paths);
+	free(jobs.logs);
+	free(jobs.succeeded);
+
+	return (rendered != jobs.count) ? 1 : 0;
+}
+
+/*
+ * Encode WAV files as a bank of DAC samples
+ */
+int dacCommand(int argc, char *argv[], Options * options) {
+	int arg_index = 2;
+
+	if (parseCommandOptions(argc, argv, &arg_index, options, 2, "\"out_file_path\" and at least one \"in_wav_path\"") != 0) {
+		return -1;
+	}
+
+	const char * out_file_path = argv[arg_index++];
+	const char ** in_wav_paths = (const char **)&argv[arg_index];
+	const size_t sample_count = argc - arg_index;
+
+	if (sample_count > MAX_DAC_SAMPLES) {
+		fprintf(stderr, "ERROR: Songs can only play $%X samples, not $%zX\n", MAX_DAC_SAMPLES, sample_count);
+		return 1;
+	}
+
+	Sample * samples = calloc(sample_count, sizeof(*samples));
+	int result = 0;
+
+	for (size_t i = 0; i < sample_count; ++i) {
+		if (!readSample(in_wav_paths[i], options, &samples[i])) {
+			result = 1;
+		}
+	}
+
+	for (unsigned int i = 0; i < options->target_driver_count && result == 0; ++i) {
+		char * driver_out_file_path = (options->target_driver_count > 1) ? getNumberedOutputPath(out_file_path, "v", options->target_drivers[i]) : NULL;
+
+		result = writeSampleBank((driver_out_file_path != NULL) ? driver_out_file_path : out_file_path, samples, sample_count, options->target_drivers[i], options);
+		free(driver_out_file_path);
+	}
+
+	/* The IDs are the same whichever driver the samples are for */
+	if (result == 0) {
+		result = writeIDs(options->map_path, 'd', in_wav_paths, NULL, FIRST_DAC_SAMPLE, sample_count);
+	}
+
+	for (size_t i = 0; i < sample_count; ++i) {
+		Sample_Destroy(&samples[i]);
+	}
+
+	free(samples);
+
+	return result;
+}
+
+/*
+ * Pack binary instrument files into a bank of FM voices
+ */
+int voicesCommand(int argc, char *argv[], Options * options) {
+	int arg_index = 2;
+
+	if (parseCommandOptions(argc, argv, &arg_index, options, 2, "\"out_file_path\" and at least one \"in_voice_path\"") != 0) {
+		return -1;
+	}
+
+	const char * out_file_path = argv[arg_index++];
+	const char ** in_voice_paths = (const char **)&argv[arg_index];
+	const size_t voice_count = argc - arg_index;
+	Voice * voices = malloc(sizeof(*voices) * voice_count);
+	size_t * ids = malloc(sizeof(*ids) * voice_count);
+	int result = 0;
+
+	for (size_t i = 0; i < voice_count; ++i) {
+		if (!readVoice(in_voice_paths[i], options, &voices[i])) {
+			result = 1;
+		}
+	}
+
+	for (unsigned int i = 0; i < options->target_driver_count && result == 0; ++i) {
+		char * driver_out_file_path = (options->target_driver_count > 1) ? getNumberedOutputPath(out_file_path, "v", options->target_drivers[i]) : NULL;
+
+		result = writeVoiceBank((driver_out_file_path != NULL) ? driver_out_file_path : out_file_path, voices, voice_count, options->target_drivers[i], ids);
+		free(driver_out_file_path);
+	}
+
+	/* Duplicates are the same whichever order the driver stores operators in, and so are the IDs */
+	if (result == 0) {
+		result = writeIDs(options->map_path, 'v', in_voice_paths, ids, 0, voice_count);
+	}
+
+	free(voices);
+	free(ids);
+
+	return result;
+}
+
+/*
+ * Check that every channel's calls and loops fit in its track's RAM
+ */
+int analyzeCommand(int argc, char *argv[], Options * options) {
+	int arg_index = 2;
+
+	if (parseCommandOptions(argc, argv, &arg_index, options, 1, "\"in_file_path\"") != 0) {
+		return -1;
+	}
+
+	/* Following the tracks needs to know what's where, as optimizing does */
+	build_cache_directory = options->cache_directory;
+	build_optimizations = options->optimizations;
+	relocation_callback = addRelocation;
+	fixup_callback = addFixup;
+	marker_callback = addMarker;
+	optimization_callback = reportOptimization;
+	analysis_callback = reportChannelUsage;
+
+	int result = 0;
+
+	for (; arg_index < argc; ++arg_index) {
+		for (unsigned int i = 0; i < options->target_driver_count; ++i) {
+			const Driver * driver = GetDriver(options->target_drivers[i]);
+			Object * object = buildSong(argv[arg_index], options->target_drivers[i], options->file_offset);
+			size_t problem_count;
+
+			if (object == NULL) {
+				result = 1;
+				continue;
+			}
+
+			printf("%s for %s (room for %u nested smpsCalls and %u loop indices):\n", argv[arg_index], driver->name, driver->max_call_depth, driver->loop_counters);
+
+			if (!Analyze(object, &problem_count)) {
+				fprintf(stderr, "Analysis of \"%s\" halted due to an error.\n", argv[arg_index]);
+				result = 1;
+			}
+			else if (problem_count != 0) {
+				result = 1;
+			}
+
+			Object_Destroy(object);
+		}
+	}
+
+	return result;
+}
+
+/*
+ * Self-check of the tempo tables
+ */
+int verifyTempoCommand(int argc, char *argv[], Options * options) {
+	(void)argc;
+	(void)argv;
+	(void)options;
+
+	return Tempo_Verify();
+}
+
+/*
+ * Assemble a song, or transcode a compiled one, for every target driver
+ */
+int assembleSong(int argc, char *argv[], int arg_index, bool transcode, Options * options) {
+	/* Parse input arguments */
+	const char * in_file_path = NULL;
+	const char * out_file_path = NULL;
+
+	int parseResult = parseArgs(argc, argv, arg_index, &in_file_path, &out_file_path, options);
+
+	if (parseResult != 0) {
+		fprintf(stderr, "Error during arguments parsing, unable to continue.\n");
+		return parseResult;
+	}
+
+	if (options->inject_path != NULL && (options->target_driver_count > 1 || options->output_format == OUTPUT_FORMAT_OBJECT)) {
+		fprintf(stderr, "ERROR: \"-i\" can only write plain binary or a patch, for one driver\n");
+		return -1;
+	}
+
+	if (options->compression != COMPRESSION_NONE && options->output_format == OUTPUT_FORMAT_OBJECT) {
+		fprintf(stderr, "ERROR: Objects can't be compressed, as their addresses still need patching\n");
+		return -1;
+	}
+
+	if (options->inject_path == NULL && (options->output_format == OUTPUT_FORMAT_IPS || options->output_format == OUTPUT_FORMAT_BPS)) {
+		fprintf(stderr, "ERROR: Patches need \"-i\" to say which ROM they're for, and where the song goes in it\n");
+		return -1;
+	}
+
+	/* Read file and lex it (or disassemble it), once for every driver */
+	IR *ir = transcode ? disassembleFile(in_file_path, options, "Song") : SMPS2ASM2BIN_LexFile(in_file_path, options->cache_directory);
+
+	if (ir == NULL) {
+		fprintf(stderr, "Processing of \"%s\" file halted due to an error.\n", in_file_path);
+		return 1;
+	}
+
+	int result = 0;
+
+	/* Optimizing needs to know what's where just as much as objects do */
+	if (options->output_format == OUTPUT_FORMAT_OBJECT || options->optimizations != 0) {
+		relocation_callback = addRelocation;
+		fixup_callback = addFixup;
+		marker_callback = addMarker;
+		optimization_callback = reportOptimization;
+	}
+
+	/* Labels only matter to whatever links against an object, and ones that no-one defines can only be left for 'link' to fill in */
+	if (options->output_format == OUTPUT_FORMAT_OBJECT) {
+		label_callback = addExport;
+		import_callback = addImport;
+	}
+
+	for (unsigned int i = 0; i < options->target_driver_count; ++i) {
+		const unsigned int target_driver = options->target_drivers[i];
+		MemoryStream *output_stream = MemoryStream_Create(true);
+
+		current_object = Object_Create(target_driver, options->file_offset);
+
+		/* Process it */
+		if (!SMPS2ASM2BIN_IR(ir, output_stream, target_driver, options->file_offset))
+		{
+			Object_Destroy(current_object);
+			MemoryStream_Destroy(output_stream);
+
+			if (options->target_driver_count > 1)
+				fprintf(stderr, "Processing of \"%s\" file for driver version %u halted due to an error.\n", in_file_path, target_driver);
+			else
+				fprintf(stderr, "Processing of \"%s\" file halted due to an error.\n", in_file_path);
+
+			result = 1;
+			continue;
+		}
+
+		/* Write down the output */
+		char * driver_out_file_path = (options->target_driver_count > 1) ? getNumberedOutputPath(out_file_path, "v", target_driver) : NULL;
+
+		MemoryStream_SetPosition(output_stream, 0, MEMORYSTREAM_END);
+		Object_SetData(current_object, MemoryStream_GetBuffer(output_stream), MemoryStream_GetPosition(output_stream));
+
+		if (options->optimizations != 0 && !Optimize(current_object, options->optimizations)) {
+			fprintf(stderr, "Optimization of \"%s\" halted due to an error.\n", in_file_path);
+			result = 1;
+		}
+		else if (options->compression != COMPRESSION_NONE && compressObject(current_object, options->compression) != 0) {
+			fprintf(stderr, "Compression of \"%s\" halted due to an error.\n", in_file_path);
+			result = 1;
+		}
+		else if (options->inject_path != NULL) {
+			if (injectObject(options, current_object, out_file_path) != 0) {
+				result = 1;
+			}
+		}
+		else if (writeObject((driver_out_file_path != NULL) ? driver_out_file_path : out_file_path, current_object, options->output_format) != 0) {
+			result = 1;
+		}
+
+		Object_Destroy(current_object);
+		free(driver_out_file_path);
+		MemoryStream_Destroy(output_stream);
+	}
+
+	IR_Destroy(ir);
+
+	return result;
+}
+
+/*
+ * Converting a compiled song to another driver is the same as assembling it, once it's disassembled
+ */
+int transcodeCommand(int argc, char *argv[], Options * options) {
+	return assembleSong(argc, argv, 2, true, options);
+}
+
+/* Commands that can be given in place of "in_file_path" */
+static const Command commands[] = {
+	{"lsp", lspCommand},
+	{"relocate", relocateCommand},
+	{"link", linkCommand},
+	{"pack", packCommand},
+	{"build", buildCommand},
+	{"disasm", disasmCommand},
+	{"decompress", decompressCommand},
+	{"verify", verifyCommand},
+	{"simulate", simulateCommand},
+	{"render", renderCommand},
+	{"dac", dacCommand},
+	{"voices", voicesCommand},
+	{"analyze", analyzeCommand},
+	{"verify-tempo", verifyTempoCommand},
+	{"transcode", transcodeCommand}
+};
+
+int main(int argc, char *argv[])
+{
+	/* When called without arguments, print usage */
+	if (argc < 2) {
+		fprintf(stderr, usageMessageStr, argv[0], argv[0]);
+
+		for (size_t i = 0; i < sizeof(commandUsageStrs) / sizeof(commandUsageStrs[0]); ++i)
+			fputs(commandUsageStrs[i], stderr);
+
+		return 1;
+	}
+
+	Options options = {{1}, 1, 0, NULL, OUTPUT_FORMAT_BINARY, false, NULL, 0, Z80_BANK_SIZE, NULL, NULL, 0, 0, false, 0, 1, false, 0, false, COMPRESSION_NONE, SIMULATED_FRAMES, 0, 0, SAMPLE_ENCODING_DPCM};
+
+	for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i) {
+		if (strcmp(argv[1], commands[i].name) == 0) {
+			return commands[i].run(argc, argv, &options);
+		}
+	}
+
+	/* Without a command, the first argument is already the song to assemble */
+	return assembleSong(argc, argv, 1, false, &options);
+}
@@ -0,0 +1,353 @@
+#include "object.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bump the last byte whenever the format changes
+#define OBJECT_MAGIC "SMPSOBJ\3"
+
+// Grows one of the object's lists to fit another entry
+static void* Reserve(void *list, size_t element_size, size_t count, size_t *capacity)
+{
+	if (count == *capacity)
+	{
+		*capacity = (*capacity == 0) ? 0x40 : *capacity * 2;
+		list = realloc(list, element_size * *capacity);
+	}
+
+	return list;
+}
+
+static char* DuplicateString(const char *string)
+{
+	char *copy = malloc(strlen(string) + 1);
+	strcpy(copy, string);
+	return copy;
+}
+
+// Everything in the file is little-endian, so that objects can be shared between machines
+static void WriteLong(FILE *file, unsigned long value)
+{
+	fputc(value & 0xFF, file);
+	fputc((value >> 8) & 0xFF, file);
+	fputc((value >> 16) & 0xFF, file);
+	fputc((value >> 24) & 0xFF, file);
+}
+
+static void WriteString(FILE *file, const char *string)
+{
+	const size_t length = strlen(string);
+
+	WriteLong(file, length);
+	fwrite(string, 1, length, file);
+}
+
+static bool ReadLong(FILE *file, unsigned long *value)
+{
+	unsigned char bytes[4];
+
+	if (fread(bytes, 1, 4, file) != 4)
+		return false;
+
+	*value = (unsigned long)bytes[0] | ((unsigned long)bytes[1] << 8) | ((unsigned long)bytes[2] << 16) | ((unsigned long)bytes[3] << 24);
+
+	return true;
+}
+
+static char* ReadString(FILE *file)
+{
+	unsigned long length;
+
+	if (!ReadLong(file, &length) || length > 0x10000)
+		return NULL;
+
+	char *string = malloc(length + 1);
+
+	if (fread(string, 1, length, file) != length)
+	{
+		free(string);
+		return NULL;
+	}
+
+	string[length] = '\0';
+
+	return string;
+}
+
+static int CompareRelocations(const void *a, const void *b)
+{
+	const size_t relocation_a = *(const size_t*)a;
+	const size_t relocation_b = *(const size_t*)b;
+
+	return (relocation_a > relocation_b) - (relocation_a < relocation_b);
+}
+
+static int CompareFixups(const void *a, const void *b)
+{
+	const ObjectFixup *fixup_a = a;
+	const ObjectFixup *fixup_b = b;
+
+	return (fixup_a->position > fixup_b->position) - (fixup_a->position < fixup_b->position);
+}
+
+static int CompareMarkers(const void *a, const void *b)
+{
+	const ObjectMarker *marker_a = a;
+	const ObjectMarker *marker_b = b;
+
+	if (marker_a->position != marker_b->position)
+		return (marker_a->position > marker_b->position) - (marker_a->position < marker_b->position);
+
+	return (marker_a->kind > marker_b->kind) - (marker_a->kind < marker_b->kind);
+}
+
+Object* Object_Create(unsigned int driver, size_t offset)
+{
+	Object *object = calloc(1, sizeof(*object));
+
+	object->driver = driver;
+	object->offset = offset;
+
+	return object;
+}
+
+void Object_Destroy(Object *object)
+{
+	if (object != NULL)
+	{
+		for (size_t i = 0; i < object->export_count; ++i)
+			free(object->exports[i].name);
+
+		for (size_t i = 0; i < object->import_count; ++i)
+			free(object->imports[i]);
+
+		free(object->data);
+		free(object->relocations);
+		free(object->exports);
+		free(object->imports);
+		free(object->fixups);
+		free(object->markers);
+		free(object);
+	}
+}
+
+void Object_SetData(Object *object, const unsigned char *data, size_t size)
+{
+	free(object->data);
+	object->data = malloc(size + 1);
+	object->size = size;
+
+	if (size != 0)
+		memcpy(object->data, data, size);
+
+	// Delayed instructions report their addresses out of order
+	if (object->relocation_count != 0)
+		qsort(object->relocations, object->relocation_count, sizeof(*object->relocations), CompareRelocations);
+
+	if (object->fixup_count != 0)
+		qsort(object->fixups, object->fixup_count, sizeof(*object->fixups), CompareFixups);
+
+	if (object->marker_count != 0)
+		qsort(object->markers, object->marker_count, sizeof(*object->markers), CompareMarkers);
+}
+
+void Object_AddRelocation(Object *object, size_t position)
+{
+	object->relocations = Reserve(object->relocations, sizeof(*object->relocations), object->relocation_count, &object->relocation_capacity);
+
+	object->relocations[object->relocation_count++] = position;
+}
+
+void Object_AddExport(Object *object, const char *name, size_t position)
+{
+	object->exports = Reserve(object->exports, sizeof(*object->exports), object->export_count, &object->export_capacity);
+
+	object->exports[object->export_count].name = DuplicateString(name);
+	object->exports[object->export_count].position = position;
+	++object->export_count;
+}
+
+void Object_AddImport(Object *object, const char *name)
+{
+	object->imports = Reserve(object->imports, sizeof(*object->imports), object->import_count, &object->import_capacity);
+
+	object->imports[object->import_count++] = DuplicateString(name);
+}
+
+void Object_AddFixup(Object *object, size_t position, size_t import, long addend)
+{
+	object->fixups = Reserve(object->fixups, sizeof(*object->fixups), object->fixup_count, &object->fixup_capacity);
+
+	object->fixups[object->fixup_count].position = position;
+	object->fixups[object->fixup_count].import = import;
+	object->fixups[object->fixup_count].addend = addend;
+	++object->fixup_count;
+}
+
+void Object_AddMarker(Object *object, unsigned int kind, size_t position)
+{
+	object->markers = Reserve(object->markers, sizeof(*object->markers), object->marker_count, &object->marker_capacity);
+
+	object->markers[object->marker_count].kind = kind;
+	object->markers[object->marker_count].position = position;
+	++object->marker_count;
+}
+
+Object* Object_Load(const char *file_name)
+{
+	FILE *file = fopen(file_name, "rb");
+
+	if (file == NULL)
+		return NULL;
+
+	Object *object = NULL;
+
+	char magic[8];
+	unsigned long driver, offset, size, relocation_count, export_count, import_count, fixup_count, marker_count;
+
+	if (fread(magic, 1, 8, file) == 8 && memcmp(magic, OBJECT_MAGIC, 8) == 0
+	 && ReadLong(file, &driver) && ReadLong(file, &offset) && ReadLong(file, &size)
+	 && ReadLong(file, &relocation_count) && ReadLong(file, &export_count) && ReadLong(file, &import_count) && ReadLong(file, &fixup_count) && ReadLong(file, &marker_count))
+	{
+		object = Object_Create(driver, offset);
+		object->data = malloc(size + 1);
+		object->size = size;
+
+		bool valid = fread(object->data, 1, size, file) == size;
+
+		for (unsigned long i = 0; valid && i < relocation_count; ++i)
+		{
+			unsigned long position;
+
+			valid = ReadLong(file, &position) && position + 2 <= size;
+
+			if (valid)
+				Object_AddRelocation(object, position);
+		}
+
+		for (unsigned long i = 0; valid && i < export_count; ++i)
+		{
+			unsigned long position;
+			char *name = ReadString(file);
+
+			valid = name != NULL && ReadLong(file, &position) && position <= size;
+
+			if (valid)
+				Object_AddExport(object, name, position);
+
+			free(name);
+		}
+
+		for (unsigned long i = 0; valid && i < import_count; ++i)
+		{
+			char *name = ReadString(file);
+
+			valid = name != NULL;
+
+			if (valid)
+				Object_AddImport(object, name);
+
+			free(name);
+		}
+
+		for (unsigned long i = 0; valid && i < fixup_count; ++i)
+		{
+			unsigned long position, import, addend;
+
+			valid = ReadLong(file, &position) && ReadLong(file, &import) && ReadLong(file, &addend) && position + 2 <= size && import < import_count;
+
+			// The addend is stored as two's complement
+			if (valid)
+				Object_AddFixup(object, position, import, (addend & 0x80000000) ? -(long)(0xFFFFFFFF - addend) - 1 : (long)addend);
+		}
+
+		for (unsigned long i = 0; valid && i < marker_count; ++i)
+		{
+			unsigned long kind, position;
+
+			valid = ReadLong(file, &kind) && ReadLong(file, &position) && position <= size;
+
+			if (valid)
+				Object_AddMarker(object, kind, position);
+		}
+
+		if (!valid)
+		{
+			Object_Destroy(object);
+			object = NULL;
+		}
+	}
+
+	fclose(file);
+
+	return object;
+}
+
+bool Object_Save(const Object *object, const char *file_name)
+{
+	FILE *file = fopen(file_name, "wb");
+
+	if (file == NULL)
+		return false;
+
+	fwrite(OBJECT_MAGIC, 1, 8, file);
+	WriteLong(file, object->driver);
+	WriteLong(file, object->offset);
+	WriteLong(file, object->size);
+	WriteLong(file, object->relocation_count);
+	WriteLong(file, object->export_count);
+	WriteLong(file, object->import_count);
+	WriteLong(file, object->fixup_count);
+	WriteLong(file, object->marker_count);
+	fwrite(object->data, 1, object->size, file);
+
+	for (size_t i = 0; i < object->relocation_count; ++i)
+		WriteLong(file, object->relocations[i]);
+
+	for (size_t i = 0; i < object->export_count; ++i)
+	{
+		WriteString(file, object->exports[i].name);
+		WriteLong(file, object->exports[i].position);
+	}
+
+	for (size_t i = 0; i < object->import_count; ++i)
+		WriteString(file, object->imports[i]);
+
+	for (size_t i = 0; i < object->fixup_count; ++i)
+	{
+		WriteLong(file, object->fixups[i].position);
+		WriteLong(file, object->fixups[i].import);
+		WriteLong(file, (unsigned long)object->fixups[i].addend & 0xFFFFFFFF);
+	}
+
+	for (size_t i = 0; i < object->marker_count; ++i)
+	{
+		WriteLong(file, object->markers[i].kind);
+		WriteLong(file, object->markers[i].position);
+	}
+
+	const bool success = !ferror(file);
+
+	fclose(file);
+
+	return success;
+}
+
+void Object_Relocate(Object *object, size_t offset)
+{
+	const size_t delta = offset - object->offset;
+
+	for (size_t i = 0; i < object->relocation_count; ++i)
+	{
+		unsigned char *site = &object->data[object->relocations[i]];
+		const size_t address = (site[0] | (site[1] << 8)) + delta;
+
+		site[0] = address & 0xFF;
+		site[1] = (address >> 8) & 0xFF;
+	}
+
+	object->offset = offset;
+}
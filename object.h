@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A label that other objects can refer to
+typedef struct ObjectExport
+{
+	char *name;
+	size_t position;	// Within the data
+} ObjectExport;
+
+// A 16-bit little-endian address that refers to another object's label
+typedef struct ObjectFixup
+{
+	size_t position;	// Within the data
+	size_t import;		// Index into the imports
+	long addend;
+} ObjectFixup;
+
+// A place in the data that passes over it need to find
+typedef struct ObjectMarker
+{
+	unsigned int kind;	// A Marker from instruction.h
+	size_t position;	// Within the data
+} ObjectMarker;
+
+// Assembled song data, along with where it refers to addresses, so that it
+// can be moved to another offset or linked with other songs without
+// assembling it again
+typedef struct Object
+{
+	unsigned int driver;
+	size_t offset;		// Address that the data currently targets
+	unsigned char *data;
+	size_t size;
+
+	size_t *relocations;	// Positions of 16-bit little-endian addresses within the data
+	size_t relocation_count;
+	size_t relocation_capacity;
+
+	ObjectExport *exports;
+	size_t export_count;
+	size_t export_capacity;
+
+	char **imports;		// Names of labels in other objects
+	size_t import_count;
+	size_t import_capacity;
+
+	ObjectFixup *fixups;
+	size_t fixup_count;
+	size_t fixup_capacity;
+
+	ObjectMarker *markers;
+	size_t marker_count;
+	size_t marker_capacity;
+} Object;
+
+Object* Object_Create(unsigned int driver, size_t offset);
+void Object_Destroy(Object *object);
+void Object_SetData(Object *object, const unsigned char *data, size_t size);
+void Object_AddRelocation(Object *object, size_t position);
+void Object_AddExport(Object *object, const char *name, size_t position);
+void Object_AddImport(Object *object, const char *name);
+void Object_AddFixup(Object *object, size_t position, size_t import, long addend);
+void Object_AddMarker(Object *object, unsigned int kind, size_t position);
+Object* Object_Load(const char *file_name);
+bool Object_Save(const Object *object, const char *file_name);
+void Object_Relocate(Object *object, size_t offset);
@@ -0,0 +1,1058 @@
+#include "optimize.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver.h"
+#include "error.h"
+#include "object.h"
+#include "song.h"
+
+#define UNREACHED UINT_MAX
+
+// Deep enough for any driver's stack, but stops recursive calls from going on forever
+#define MAX_DEPTH 16
+
+// Longest run of commands that is considered for a subroutine or loop
+#define MAX_RUN_LENGTH 64
+
+void (*optimization_callback)(const char *pass, size_t bytes_saved);
+
+typedef struct Work
+{
+	size_t node;
+	unsigned int depth;
+} Work;
+
+static FlagFlow GetFlow(const SongNode *node)
+{
+	return (node->kind == SONG_NODE_FLAG) ? coordination_flag_layouts[node->flag].flow : FLOW_NEXT;
+}
+
+static SongNode* CreateFlag(const Song *song, CoordinationFlag flag, SongNode *node)
+{
+	const CoordinationFlagEncoding *encoding = &song->driver->coordination_flags[flag];
+	unsigned char bytes[8] = {0};
+
+	memcpy(bytes, encoding->bytes, encoding->size);
+	Song_DecodeCommand(song->driver, bytes, sizeof(bytes), node);
+
+	return node;
+}
+
+// Finds the first command of each channel, from the header's pointers
+static size_t* FindChannels(const Song *song, size_t *channel_count)
+{
+	size_t *channels = malloc(sizeof(*channels) * (song->node_count + 1));
+
+	*channel_count = 0;
+
+	for (size_t i = song->first; i != SONG_NONE; i = song->nodes[i].next)
+	{
+		const SongNode *node = &song->nodes[i];
+
+		if (node->kind == SONG_NODE_POINTER && node->pointer != SONG_POINTER_EXTERNAL)
+		{
+			const size_t target = Song_Resolve(song, node->target);
+
+			if (target != SONG_NONE && Song_IsCommand(&song->nodes[target]))
+				channels[(*channel_count)++] = target;
+		}
+	}
+
+	return channels;
+}
+
+// Finds how deeply nested in smpsCalls each command runs, or UNREACHED if
+// no channel reaches it. With 'channel' set, only that channel is followed.
+static unsigned int* ComputeDepths(const Song *song, size_t channel)
+{
+	unsigned int *depths = malloc(sizeof(*depths) * song->node_count);
+	Work *pending = malloc(sizeof(*pending) * (song->node_count + 1));
+	size_t pending_count = 0;
+	size_t pending_capacity = song->node_count + 1;
+
+	for (size_t i = 0; i < song->node_count; ++i)
+		depths[i] = UNREACHED;
+
+	if (channel != SONG_NONE)
+	{
+		pending[pending_count++] = (Work){channel, 0};
+	}
+	else
+	{
+		size_t channel_count;
+		size_t *channels = FindChannels(song, &channel_count);
+
+		for (size_t i = 0; i < channel_count; ++i)
+			pending[pending_count++] = (Work){channels[i], 0};
+
+		free(channels);
+	}
+
+	while (pending_count != 0)
+	{
+		const Work work = pending[--pending_count];
+
+		for (size_t i = work.node; i != SONG_NONE && Song_IsCommand(&song->nodes[i]); i = song->nodes[i].next)
+		{
+			const SongNode *node = &song->nodes[i];
+
+			if (depths[i] != UNREACHED && depths[i] >= work.depth)
+				break;
+
+			depths[i] = work.depth;
+
+			const FlagFlow flow = GetFlow(node);
+
+			// smpsCopyData points at data rather than somewhere to go
+			if (node->pointer != SONG_POINTER_NONE && node->pointer != SONG_POINTER_EXTERNAL && flow != FLOW_NEXT)
+			{
+				const unsigned int depth = (flow == FLOW_CALL) ? work.depth + 1 : work.depth;
+
+				if (depth <= MAX_DEPTH)
+				{
+					if (pending_count == pending_capacity)
+					{
+						pending_capacity *= 2;
+						pending = realloc(pending, sizeof(*pending) * pending_capacity);
+					}
+
+					pending[pending_count++] = (Work){Song_Resolve(song, node->target), depth};
+				}
+			}
+
+			if (flow == FLOW_STOP || flow == FLOW_RETURN || flow == FLOW_JUMP)
+				break;
+		}
+	}
+
+	free(pending);
+
+	return depths;
+}
+
+// Finds the commands that pointers or labels lead to, which have to stay
+// at the start of anything that's moved
+static bool* FindTargets(const Song *song)
+{
+	bool *targeted = calloc(song->node_count, sizeof(*targeted));
+
+	for (size_t i = song->first; i != SONG_NONE; i = song->nodes[i].next)
+	{
+		const SongNode *node = &song->nodes[i];
+
+		if (node->pointer != SONG_POINTER_NONE && node->pointer != SONG_POINTER_EXTERNAL)
+		{
+			const size_t target = Song_Resolve(song, node->target);
+
+			if (target != SONG_NONE)
+				targeted[target] = true;
+		}
+	}
+
+	for (size_t i = 0; i < song->object->export_count; ++i)
+	{
+		const size_t target = Song_Resolve(song, song->position_nodes[song->object->exports[i].position]);
+
+		if (target != SONG_NONE)
+			targeted[target] = true;
+	}
+
+	return targeted;
+}
+
+// Counts the pointers and labels that lead to each command
+static unsigned int* CountIncoming(const Song *song)
+{
+	unsigned int *incoming = calloc(song->node_count, sizeof(*incoming));
+	bool *targeted = FindTargets(song);
+
+	for (size_t i = song->first; i != SONG_NONE; i = song->nodes[i].next)
+	{
+		const SongNode *node = &song->nodes[i];
+
+		if (node->pointer != SONG_POINTER_NONE && node->pointer != SONG_POINTER_EXTERNAL)
+			++incoming[Song_Resolve(song, node->target)];
+	}
+
+	// Labels count as coming from outside of anything
+	for (size_t i = 0; i < song->node_count; ++i)
+		if (targeted[i] && incoming[i] == 0)
+			incoming[i] = 1;
+
+	free(targeted);
+
+	return incoming;
+}
+
+static unsigned long HashNode(const SongNode *node)
+{
+	unsigned long hash = 2166136261UL;
+
+	for (unsigned int i = 0; i < node->size; ++i)
+		hash = ((hash ^ node->bytes[i]) * 16777619UL) & 0xFFFFFFFFUL;
+
+	return hash;
+}
+
+static bool NodesEqual(const SongNode *a, const SongNode *b)
+{
+	return a->size == b->size && memcmp(a->bytes, b->bytes, a->size) == 0;
+}
+
+////////////////////
+// Subroutines
+////////////////////
+
+// A place where a run of commands could be replaced with a call
+typedef struct Occurrence
+{
+	unsigned long hash;
+	size_t start;		// Index into the command list
+	size_t segment;		// Commands in different segments can't be in the same run
+} Occurrence;
+
+static int CompareOccurrences(const void *a, const void *b)
+{
+	const Occurrence *occurrence_a = a;
+	const Occurrence *occurrence_b = b;
+
+	if (occurrence_a->hash != occurrence_b->hash)
+		return (occurrence_a->hash < occurrence_b->hash) ? -1 : 1;
+
+	return (occurrence_a->start > occurrence_b->start) - (occurrence_a->start < occurrence_b->start);
+}
+
+// A note followed by a duration is one event, so the two can't be split by
+// a call or return
+static bool CanSplitBefore(const Song *song, size_t node)
+{
+	const size_t previous = song->nodes[node].previous;
+
+	return !(song->nodes[node].kind == SONG_NODE_DURATION && previous != SONG_NONE && song->nodes[previous].kind == SONG_NODE_NOTE);
+}
+
+static bool CanSplitAfter(const Song *song, size_t node)
+{
+	const size_t next = song->nodes[node].next;
+
+	return !(song->nodes[node].kind == SONG_NODE_NOTE && next != SONG_NONE && song->nodes[next].kind == SONG_NODE_DURATION);
+}
+
+// Makes one subroutine out of the run of commands that saves the most by
+// being called from everywhere that it appears, returning how much it saved
+static size_t ExtractSubroutine(Song *song)
+{
+	const Driver *driver = song->driver;
+	const size_t call_size = driver->coordination_flags[COORDINATION_FLAG_CALL].size + 2;
+	const size_t return_size = driver->coordination_flags[COORDINATION_FLAG_RETURN].size;
+
+	unsigned int *depths = ComputeDepths(song, SONG_NONE);
+	bool *targeted = FindTargets(song);
+
+	// List the commands that could be moved into a subroutine, split into
+	// segments wherever something else has to stay put
+	size_t *commands = malloc(sizeof(*commands) * song->node_count);
+	size_t *segments = malloc(sizeof(*segments) * song->node_count);
+	size_t command_count = 0;
+	size_t segment = 0;
+
+	for (size_t i = song->first; i != SONG_NONE; i = song->nodes[i].next)
+	{
+		const SongNode *node = &song->nodes[i];
+		const bool movable = Song_IsCommand(node) && node->pointer == SONG_POINTER_NONE && GetFlow(node) == FLOW_NEXT && depths[i] != UNREACHED && depths[i] < driver->max_call_depth;
+
+		if (!movable || targeted[i])
+			++segment;
+
+		if (movable)
+		{
+			commands[command_count] = i;
+			segments[command_count] = segment;
+			++command_count;
+		}
+	}
+
+	unsigned long *hashes = malloc(sizeof(*hashes) * (command_count + 1));
+	Occurrence *occurrences = malloc(sizeof(*occurrences) * (command_count + 1));
+
+	for (size_t i = 0; i < command_count; ++i)
+		hashes[i] = HashNode(&song->nodes[commands[i]]);
+
+	size_t best_saving = 0, best_start = 0, best_length = 0;
+
+	for (size_t length = 2; length <= MAX_RUN_LENGTH && length <= command_count; ++length)
+	{
+		size_t occurrence_count = 0;
+
+		for (size_t start = 0; start + length <= command_count; ++start)
+		{
+			if (segments[start] != segments[start + length - 1])
+				continue;
+
+			if (!CanSplitBefore(song, commands[start]) || !CanSplitAfter(song, commands[start + length - 1]))
+				continue;
+
+			unsigned long hash = 0;
+
+			for (size_t i = 0; i < length; ++i)
+				hash = ((hash * 31) + hashes[start + i]) & 0xFFFFFFFFUL;
+
+			occurrences[occurrence_count].hash = hash;
+			occurrences[occurrence_count].start = start;
+			occurrences[occurrence_count].segment = segments[start];
+			++occurrence_count;
+		}
+
+		qsort(occurrences, occurrence_count, sizeof(*occurrences), CompareOccurrences);
+
+		for (size_t group = 0; group < occurrence_count; )
+		{
+			size_t group_end = group + 1;
+
+			while (group_end < occurrence_count && occurrences[group_end].hash == occurrences[group].hash)
+				++group_end;
+
+			if (group_end - group >= 2)
+			{
+				const size_t first = occurrences[group].start;
+				size_t bytes = 0;
+				size_t count = 0;
+				size_t previous_end = 0;
+
+				for (size_t i = 0; i < length; ++i)
+					bytes += song->nodes[commands[first + i]].size;
+
+				for (size_t j = group; j < group_end; ++j)
+				{
+					const size_t start = occurrences[j].start;
+					bool equal = true;
+
+					if (count != 0 && start < previous_end)
+						continue;
+
+					for (size_t i = 0; i < length && equal; ++i)
+						equal = NodesEqual(&song->nodes[commands[first + i]], &song->nodes[commands[start + i]]);
+
+					if (equal)
+					{
+						++count;
+						previous_end = start + length;
+					}
+				}
+
+				const size_t cost = count * call_size + bytes + return_size;
+
+				if (count >= 2 && count * bytes > cost && count * bytes - cost > best_saving)
+				{
+					best_saving = count * bytes - cost;
+					best_start = first;
+					best_length = length;
+				}
+			}
+
+			group = group_end;
+		}
+	}
+
+	if (best_saving != 0)
+	{
+		// Write the subroutine at the end of the data
+		size_t *body = malloc(sizeof(*body) * best_length);
+		SongNode node;
+
+		for (size_t i = 0; i < best_length; ++i)
+		{
+			node = song->nodes[commands[best_start + i]];
+			node.position = SONG_NONE;
+			body[i] = Song_AddNode(song, &node);
+			Song_Insert(song, body[i], song->last);
+		}
+
+		Song_Insert(song, Song_AddNode(song, CreateFlag(song, COORDINATION_FLAG_RETURN, &node)), song->last);
+
+		// Call it from everywhere that it appears, in the order that they were found
+		size_t previous_end = 0;
+
+		for (size_t start = 0; start + best_length <= command_count; ++start)
+		{
+			if (start != best_start && start < previous_end)
+				continue;
+
+			if (segments[start] != segments[start + best_length - 1] || !CanSplitBefore(song, commands[start]) || !CanSplitAfter(song, commands[start + best_length - 1]))
+				continue;
+
+			bool equal = true;
+
+			for (size_t i = 0; i < best_length && equal; ++i)
+				equal = NodesEqual(&song->nodes[body[i]], &song->nodes[commands[start + i]]);
+
+			if (!equal)
+				continue;
+
+			CreateFlag(song, COORDINATION_FLAG_CALL, &node);
+			node.target = body[0];
+
+			const size_t call = Song_AddNode(song, &node);
+
+			Song_Insert(song, call, commands[start]);
+
+			for (size_t i = 0; i < best_length; ++i)
+				Song_Remove(song, commands[start + i], call, body[i]);
+
+			previous_end = start + best_length;
+		}
+
+		free(body);
+	}
+
+	free(depths);
+	free(targeted);
+	free(commands);
+	free(segments);
+	free(hashes);
+	free(occurrences);
+
+	return best_saving;
+}
+
+static size_t ExtractSubroutines(Song *song)
+{
+	size_t saved = 0;
+	size_t saving;
+
+	while ((saving = ExtractSubroutine(song)) != 0)
+		saved += saving;
+
+	return saved;
+}
+
+////////////////////
+// Dead code
+////////////////////
+
+// Finds the track data that no channel reaches: commands that nothing leads
+// to, and the bytes after a track's end that were never decoded because
+// nothing points to them. Those bytes run up to the next reachable command,
+// or to anything that has to stay, such as a header, a voice, a label,
+// whatever a pointer outside of the dead data refers to, or the bytes that an
+// smpsCopyData reads.
+static bool* FindDeadCode(const Song *song, const unsigned int *depths)
+{
+	const Object *object = song->object;
+	bool *dead = calloc(song->node_count, sizeof(*dead));
+	bool *kept = calloc(object->size + 1, sizeof(*kept));
+
+	for (size_t i = 0; i < object->marker_count; ++i)
+		kept[object->markers[i].position] = true;
+
+	for (size_t i = 0; i < object->export_count; ++i)
+		kept[object->exports[i].position] = true;
+
+	kept[object->size] = true;
+
+	// Keeping something can keep more through its pointers, so go until nothing changes
+	bool changed = true;
+
+	while (changed)
+	{
+		bool after_end = false;
+
+		for (size_t i = song->first; i != SONG_NONE; i = song->nodes[i].next)
+		{
+			const SongNode *node = &song->nodes[i];
+
+			if (Song_IsCommand(node))
+			{
+				dead[i] = depths[i] == UNREACHED;
+
+				if (dead[i])
+				{
+					after_end = true;
+				}
+				else
+				{
+					const FlagFlow flow = GetFlow(node);
+
+					after_end = flow == FLOW_STOP || flow == FLOW_RETURN || flow == FLOW_JUMP;
+				}
+			}
+			else
+			{
+				dead[i] = after_end && !kept[node->position];
+				after_end = dead[i];
+			}
+		}
+
+		changed = false;
+
+		for (size_t i = song->first; i != SONG_NONE; i = song->nodes[i].next)
+		{
+			const SongNode *node = &song->nodes[i];
+
+			if (!dead[i] && node->pointer != SONG_POINTER_NONE && node->pointer != SONG_POINTER_EXTERNAL)
+			{
+				const size_t target = Song_Resolve(song, node->target);
+
+				if (target == SONG_NONE || song->nodes[target].position == SONG_NONE)
+					continue;
+
+				const size_t position = song->nodes[target].position;
+
+				// smpsCopyData reads as many bytes as it says, rather than just the first
+				const size_t length = (node->kind == SONG_NODE_FLAG && node->flag == COORDINATION_FLAG_COPY_DATA) ? node->bytes[node->pointer_offset + 2] : 1;
+
+				for (size_t j = position; j < position + length && j < object->size; ++j)
+				{
+					if (!kept[j])
+					{
+						kept[j] = true;
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+
+	free(kept);
+
+	return dead;
+}
+
+// Removes track data that no channel can reach
+static size_t RemoveDeadCode(Song *song)
+{
+	unsigned int *depths = ComputeDepths(song, SONG_NONE);
+	bool *dead = FindDeadCode(song, depths);
+	size_t removed = 0;
+
+	for (size_t i = song->first; i != SONG_NONE; )
+	{
+		if (!dead[i])
+		{
+			i = song->nodes[i].next;
+			continue;
+		}
+
+		// Whatever still refers to the dead data goes to what follows it instead
+		size_t end = i;
+
+		while (dead[end])
+			end = song->nodes[end].next;
+
+		while (i != end)
+		{
+			const size_t next = song->nodes[i].next;
+
+			removed += song->nodes[i].size;
+			Song_Remove(song, i, end, SONG_NONE);
+			i = next;
+		}
+	}
+
+	free(depths);
+	free(dead);
+
+	return removed;
+}
+
+////////////////////
+// Peephole
+////////////////////
+
+// What a channel is known to have set, going by the commands just before
+typedef struct ChannelState
+{
+	bool voice_known;
+	SongNode voice;
+	bool pan_known;
+	unsigned char pan;
+	bool duration_known;
+	unsigned char duration;
+} ChannelState;
+
+// Whether a flag leaves the voice, panning and note duration as they were.
+// Anything that writes to the FM chip directly, or that isn't listed, is
+// assumed not to.
+static bool KeepsState(CoordinationFlag flag)
+{
+	switch (flag)
+	{
+		case COORDINATION_FLAG_PAN:
+		case COORDINATION_FLAG_DETUNE:
+		case COORDINATION_FLAG_NOP:
+		case COORDINATION_FLAG_SET_VOL:
+		case COORDINATION_FLAG_CHAN_TEMPO_DIV:
+		case COORDINATION_FLAG_FM_ALTER_VOL:
+		case COORDINATION_FLAG_ALTER_VOL:
+		case COORDINATION_FLAG_NO_ATTACK:
+		case COORDINATION_FLAG_NOTE_FILL:
+		case COORDINATION_FLAG_NOTE_FILL_TIMED:
+		case COORDINATION_FLAG_CHANGE_TRANSPOSITION:
+		case COORDINATION_FLAG_SET_TEMPO_MOD:
+		case COORDINATION_FLAG_SET_TEMPO_DIV:
+		case COORDINATION_FLAG_PSG_ALTER_VOL:
+		case COORDINATION_FLAG_FM_VOICE:
+		case COORDINATION_FLAG_MOD_SET:
+		case COORDINATION_FLAG_MOD_ON:
+		case COORDINATION_FLAG_MOD_OFF:
+		case COORDINATION_FLAG_MOD_CHANGE:
+		case COORDINATION_FLAG_MOD_CHANGE_2:
+		case COORDINATION_FLAG_PSG_FORM:
+		case COORDINATION_FLAG_PSG_VOICE:
+		case COORDINATION_FLAG_LOOP:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+// Adds two volume changes together, returning false if they cancel out
+static bool MergeVolumeChanges(const Song *song, SongNode *into, const SongNode *from)
+{
+	const unsigned int start = song->driver->coordination_flags[into->flag].size;
+	bool changes = false;
+
+	for (unsigned int i = start; i < into->size; ++i)
+	{
+		into->bytes[i] = (into->bytes[i] + from->bytes[i]) & 0xFF;
+		changes |= into->bytes[i] != 0;
+	}
+
+	return changes;
+}
+
+// Taking a command out from between a note and a duration would make the
+// note take the duration as its own
+static bool CanRemove(const Song *song, size_t node)
+{
+	const size_t previous = song->nodes[node].previous;
+	const size_t next = song->nodes[node].next;
+
+	return previous == SONG_NONE || next == SONG_NONE || song->nodes[previous].kind != SONG_NODE_NOTE || song->nodes[next].kind != SONG_NODE_DURATION;
+}
+
+// Drops commands that don't change anything, going by what the channel has
+// already set, and merges volume changes that follow each other
+static size_t Peephole(Song *song)
+{
+	bool *targeted = FindTargets(song);
+	unsigned int *depths = ComputeDepths(song, SONG_NONE);
+	ChannelState state = {0};
+	size_t saved = 0;
+
+	for (size_t i = song->first; i != SONG_NONE; )
+	{
+		SongNode *node = &song->nodes[i];
+		const size_t next = node->next;
+		const size_t previous = node->previous;
+
+		// Only carry what's known on if nothing else leads here
+		if (targeted[i] || previous == SONG_NONE || !Song_IsCommand(&song->nodes[previous]) || depths[i] == UNREACHED)
+		{
+			memset(&state, 0, sizeof(state));
+		}
+		else
+		{
+			const FlagFlow flow = GetFlow(&song->nodes[previous]);
+
+			if (flow != FLOW_NEXT && flow != FLOW_BRANCH)
+				memset(&state, 0, sizeof(state));
+		}
+
+		if (depths[i] == UNREACHED || !Song_IsCommand(node))
+		{
+			i = next;
+			continue;
+		}
+
+		bool redundant = false;
+
+		if (node->kind == SONG_NODE_DURATION)
+		{
+			// A duration straight after a note sets how long the note is; one that's the same as the last can go
+			if (song->nodes[previous].kind == SONG_NODE_NOTE && state.duration_known && state.duration == node->bytes[0] && !targeted[i])
+				redundant = true;
+
+			state.duration_known = true;
+			state.duration = node->bytes[0];
+		}
+		else if (node->kind == SONG_NODE_FLAG)
+		{
+			const unsigned int start = song->driver->coordination_flags[node->flag].size;
+
+			switch (node->flag)
+			{
+				case COORDINATION_FLAG_FM_VOICE:
+					redundant = state.voice_known && NodesEqual(&state.voice, node);
+					state.voice_known = true;
+					state.voice = *node;
+					break;
+
+				case COORDINATION_FLAG_PAN:
+					redundant = state.pan_known && state.pan == node->bytes[start];
+					state.pan_known = true;
+					state.pan = node->bytes[start];
+					break;
+
+				case COORDINATION_FLAG_ALTER_VOL:
+				case COORDINATION_FLAG_FM_ALTER_VOL:
+				case COORDINATION_FLAG_PSG_ALTER_VOL:
+				{
+					SongNode *previous_node = &song->nodes[previous];
+
+					// Volume changes just add up
+					if (!targeted[i] && previous_node->kind == SONG_NODE_FLAG && previous_node->flag == node->flag)
+					{
+						const size_t merged = previous;
+
+						Song_Remove(song, i, merged, merged);
+						saved += node->size;
+
+						if (!MergeVolumeChanges(song, previous_node, node) && CanRemove(song, merged))
+						{
+							Song_Remove(song, merged, next, SONG_NONE);
+							targeted[next] |= targeted[merged];
+							saved += previous_node->size;
+						}
+
+						i = next;
+						continue;
+					}
+
+					break;
+				}
+
+				case COORDINATION_FLAG_SET_TEMPO_DIV:
+				case COORDINATION_FLAG_CHAN_TEMPO_DIV:
+					// Durations are scaled by the tempo divider as they're read
+					state.duration_known = false;
+					break;
+
+				default:
+					break;
+			}
+
+			if (!KeepsState(node->flag))
+				memset(&state, 0, sizeof(state));
+		}
+
+		if (redundant && CanRemove(song, i))
+		{
+			// Whatever led here now leads to the next command instead
+			Song_Remove(song, i, next, SONG_NONE);
+			targeted[next] |= targeted[i];
+			saved += node->size;
+		}
+
+		i = next;
+	}
+
+	free(targeted);
+	free(depths);
+
+	return saved;
+}
+
+////////////////////
+// Loops
+////////////////////
+
+// Whether two runs of commands do the same thing. Pointers have to either
+// lead to the same place within their own run, or call the same subroutine
+// or copy the same data.
+static bool RunsEqual(const Song *song, const size_t *commands, const size_t *command_indices, size_t a, size_t b, size_t length)
+{
+	for (size_t i = 0; i < length; ++i)
+	{
+		const SongNode *node_a = &song->nodes[commands[a + i]];
+		const SongNode *node_b = &song->nodes[commands[b + i]];
+
+		if (node_a->pointer == SONG_POINTER_NONE)
+		{
+			if (!NodesEqual(node_a, node_b))
+				return false;
+
+			continue;
+		}
+
+		if (node_a->size != node_b->size || memcmp(node_a->bytes, node_b->bytes, node_a->pointer_offset) != 0)
+			return false;
+
+		const size_t target_a = Song_Resolve(song, node_a->target);
+		const size_t target_b = Song_Resolve(song, node_b->target);
+		const size_t index_a = command_indices[target_a];
+		const size_t index_b = command_indices[target_b];
+
+		if (index_a != SONG_NONE && index_a >= a && index_a < a + length)
+		{
+			if (index_b != index_a - a + b)
+				return false;
+		}
+		else if ((GetFlow(node_a) != FLOW_CALL && GetFlow(node_a) != FLOW_NEXT) || target_a != target_b)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Finds the lowest loop index that none of the channels that reach a command use
+static unsigned int FindFreeLoopIndex(const Song *song, const bool *reached, size_t channel_count, size_t node)
+{
+	const CoordinationFlagEncoding *loop = &song->driver->coordination_flags[COORDINATION_FLAG_LOOP];
+	unsigned int used = 0;
+
+	for (size_t channel = 0; channel < channel_count; ++channel)
+	{
+		const bool *channel_reached = &reached[channel * song->node_count];
+
+		if (!channel_reached[node])
+			continue;
+
+		for (size_t i = song->first; i != SONG_NONE; i = song->nodes[i].next)
+			if (channel_reached[i] && song->nodes[i].kind == SONG_NODE_FLAG && song->nodes[i].flag == COORDINATION_FLAG_LOOP && song->nodes[i].bytes[loop->size] < sizeof(used) * CHAR_BIT)
+				used |= 1u << song->nodes[i].bytes[loop->size];
+	}
+
+	for (unsigned int index = 0; index < song->driver->loop_counters; ++index)
+		if ((used & (1u << index)) == 0)
+			return index;
+
+	return UINT_MAX;
+}
+
+// Turns the run of commands that repeats back-to-back to the greatest
+// effect into a single copy and an smpsLoop, returning how much it saved
+static size_t RollLoop(Song *song)
+{
+	const CoordinationFlagEncoding *loop = &song->driver->coordination_flags[COORDINATION_FLAG_LOOP];
+	const size_t loop_size = loop->size + coordination_flag_layouts[COORDINATION_FLAG_LOOP].arguments + 2;
+
+	// Note which channels reach each command, to keep their loop indices apart
+	size_t channel_count;
+	size_t *channels = FindChannels(song, &channel_count);
+	bool *reached = malloc(sizeof(*reached) * song->node_count * (channel_count + 1));
+
+	for (size_t channel = 0; channel < channel_count; ++channel)
+	{
+		unsigned int *depths = ComputeDepths(song, channels[channel]);
+
+		for (size_t i = 0; i < song->node_count; ++i)
+			reached[channel * song->node_count + i] = depths[i] != UNREACHED;
+
+		free(depths);
+	}
+
+	unsigned int *incoming = CountIncoming(song);
+
+	// List the commands that could be repeated by a loop. Anything that
+	// leaves the track, or goes somewhere other than a subroutine or an
+	// earlier part of the same run, can't be.
+	size_t *commands = malloc(sizeof(*commands) * song->node_count);
+	size_t *segments = malloc(sizeof(*segments) * song->node_count);
+	size_t *command_indices = malloc(sizeof(*command_indices) * song->node_count);
+	size_t command_count = 0;
+	size_t segment = 0;
+
+	for (size_t i = 0; i < song->node_count; ++i)
+		command_indices[i] = SONG_NONE;
+
+	for (size_t i = song->first; i != SONG_NONE; i = song->nodes[i].next)
+	{
+		const SongNode *node = &song->nodes[i];
+		const FlagFlow flow = GetFlow(node);
+		bool reached_by_any = false;
+
+		for (size_t channel = 0; channel < channel_count; ++channel)
+			reached_by_any |= reached[channel * song->node_count + i];
+
+		if (!reached_by_any || !Song_IsCommand(node) || node->pointer == SONG_POINTER_EXTERNAL || (flow != FLOW_NEXT && flow != FLOW_CALL && flow != FLOW_BRANCH))
+		{
+			++segment;
+			continue;
+		}
+
+		command_indices[i] = command_count;
+		commands[command_count] = i;
+		segments[command_count] = segment;
+		++command_count;
+	}
+
+	size_t best_saving = 0, best_start = 0, best_length = 0, best_count = 0;
+	unsigned int best_index = 0;
+
+	for (size_t start = 0; start < command_count; ++start)
+	{
+		if (!CanSplitBefore(song, commands[start]))
+			continue;
+
+		for (size_t length = 1; length <= MAX_RUN_LENGTH && start + length * 2 <= command_count; ++length)
+		{
+			if (segments[start + length * 2 - 1] != segments[start])
+				break;
+
+			size_t count = 1;
+
+			while (count < 0xFF && start + length * (count + 1) <= command_count && segments[start + length * (count + 1) - 1] == segments[start] && RunsEqual(song, commands, command_indices, start, start + length * count, length))
+				++count;
+
+			if (count < 2 || !CanSplitAfter(song, commands[start + length - 1]))
+				continue;
+
+			// The loop has to be able to take the place of every repeat
+			while (count >= 2 && !CanSplitAfter(song, commands[start + length * count - 1]))
+				--count;
+
+			size_t bytes = 0;
+
+			for (size_t i = 0; i < length; ++i)
+				bytes += song->nodes[commands[start + i]].size;
+
+			if (count < 2 || (count - 1) * bytes <= loop_size || (count - 1) * bytes - loop_size <= best_saving)
+				continue;
+
+			// Nothing outside of the run may lead into the middle of it, or out of it
+			const size_t end = start + length * count;
+			bool self_contained = true;
+
+			for (size_t i = start + 1; i < end && self_contained; ++i)
+			{
+				unsigned int internal = 0;
+
+				for (size_t j = start; j < end; ++j)
+					if (song->nodes[commands[j]].pointer != SONG_POINTER_NONE && Song_Resolve(song, song->nodes[commands[j]].target) == commands[i])
+						++internal;
+
+				self_contained = incoming[commands[i]] == internal;
+			}
+
+			for (size_t i = start; i < end && self_contained; ++i)
+			{
+				const SongNode *node = &song->nodes[commands[i]];
+
+				if (GetFlow(node) == FLOW_BRANCH)
+				{
+					const size_t index = command_indices[Song_Resolve(song, node->target)];
+
+					self_contained = index != SONG_NONE && index >= start && index < end;
+				}
+			}
+
+			if (!self_contained)
+				continue;
+
+			const unsigned int index = FindFreeLoopIndex(song, reached, channel_count, commands[start]);
+
+			if (index == UINT_MAX)
+				continue;
+
+			best_saving = (count - 1) * bytes - loop_size;
+			best_start = start;
+			best_length = length;
+			best_count = count;
+			best_index = index;
+		}
+	}
+
+	if (best_saving != 0)
+	{
+		const size_t last = commands[best_start + best_length * best_count - 1];
+		SongNode node;
+
+		CreateFlag(song, COORDINATION_FLAG_LOOP, &node);
+		node.bytes[loop->size + 0] = best_index;
+		node.bytes[loop->size + 1] = best_count;
+		node.target = commands[best_start];
+
+		const size_t loop_node = Song_AddNode(song, &node);
+
+		Song_Insert(song, loop_node, song->nodes[last].next);
+
+		for (size_t i = best_start + best_length; i < best_start + best_length * best_count; ++i)
+			Song_Remove(song, commands[i], loop_node, commands[best_start + (i - best_start) % best_length]);
+	}
+
+	free(channels);
+	free(reached);
+	free(incoming);
+	free(commands);
+	free(segments);
+	free(command_indices);
+
+	return best_saving;
+}
+
+static size_t RollLoops(Song *song)
+{
+	size_t saved = 0;
+	size_t saving;
+
+	while ((saving = RollLoop(song)) != 0)
+		saved += saving;
+
+	return saved;
+}
+
+////////////////////
+// Passes
+////////////////////
+
+static const struct
+{
+	const char *name;
+	Optimization optimization;
+	size_t (*Run)(Song *song);
+} passes[] = {
+	{"dce", OPTIMIZATION_DEAD_CODE, RemoveDeadCode},
+	{"peephole", OPTIMIZATION_PEEPHOLE, Peephole},
+	{"loops", OPTIMIZATION_LOOPS, RollLoops},
+	{"subroutines", OPTIMIZATION_SUBROUTINES, ExtractSubroutines}
+};
+
+unsigned int FindOptimization(const char *name)
+{
+	for (size_t i = 0; i < sizeof(passes) / sizeof(passes[0]); ++i)
+		if (strcmp(passes[i].name, name) == 0)
+			return passes[i].optimization;
+
+	return 0;
+}
+
+// Runs the chosen passes over every track in the object
+bool Optimize(Object *object, unsigned int optimizations)
+{
+	Song *song = Song_Decode(object);
+
+	if (song == NULL)
+		return false;
+
+	for (size_t i = 0; i < sizeof(passes) / sizeof(passes[0]); ++i)
+	{
+		if (optimizations & passes[i].optimization)
+		{
+			const size_t saved = passes[i].Run(song);
+
+			if (optimization_callback != NULL)
+				optimization_callback(passes[i].name, saved);
+		}
+	}
+
+	Object *optimized = Song_Encode(song);
+
+	Song_Destroy(song);
+
+	// Swap the optimized object into place
+	const Object original = *object;
+	*object = *optimized;
+	*optimized = original;
+	Object_Destroy(optimized);
+
+	return true;
+}
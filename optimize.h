@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "object.h"
+
+typedef enum Optimization
+{
+	OPTIMIZATION_SUBROUTINES = 1 << 0,
+	OPTIMIZATION_LOOPS = 1 << 1,
+	OPTIMIZATION_PEEPHOLE = 1 << 2,
+	OPTIMIZATION_DEAD_CODE = 1 << 3
+} Optimization;
+
+// Told how much each pass saved
+extern void (*optimization_callback)(const char *pass, size_t bytes_saved);
+
+unsigned int FindOptimization(const char *name);
+bool Optimize(Object *object, unsigned int optimizations);
@@ -0,0 +1,164 @@
+#include "pack.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "link.h"
+#include "object.h"
+
+// Called with each bank once it's linked, to write it to 'file_name'
+bool (*pack_callback)(const char *file_name, const Object *object);
+
+static Object **sorted_objects;
+
+static int CompareSizes(const void *a, const void *b)
+{
+	const size_t size_a = sorted_objects[*(const size_t*)a]->size;
+	const size_t size_b = sorted_objects[*(const size_t*)b]->size;
+
+	// Largest first, with ties left in the order that they were given
+	if (size_a != size_b)
+		return (size_a < size_b) ? 1 : -1;
+
+	return (*(const size_t*)a < *(const size_t*)b) ? -1 : 1;
+}
+
+// Shares the objects out between as few banks as it can, so that none of
+// them crosses from one bank into the next. Each object goes into the
+// first bank that it fits, biggest first, which rarely needs more than one
+// bank more than the best arrangement would. Returns which bank each object
+// goes into, or NULL if one is too big for any bank.
+size_t* Pack(Object **objects, size_t object_count, size_t bank_size, size_t *bank_count)
+{
+	error = false;
+
+	for (size_t i = 0; i < object_count; ++i)
+		if (objects[i]->size > bank_size)
+			PrintError("Error: Object %u is $%zX bytes, which is more than a bank can hold ($%zX bytes)\n", (unsigned int)i + 1, objects[i]->size, bank_size);
+
+	if (error)
+		return NULL;
+
+	size_t *order = malloc(sizeof(*order) * (object_count + 1));
+
+	for (size_t i = 0; i < object_count; ++i)
+		order[i] = i;
+
+	sorted_objects = objects;
+	qsort(order, object_count, sizeof(*order), CompareSizes);
+
+	size_t *banks = malloc(sizeof(*banks) * (object_count + 1));
+	size_t *bank_used = malloc(sizeof(*bank_used) * (object_count + 1));
+
+	*bank_count = 0;
+
+	for (size_t i = 0; i < object_count; ++i)
+	{
+		const size_t object = order[i];
+		size_t bank = 0;
+
+		while (bank < *bank_count && bank_used[bank] + objects[object]->size > bank_size)
+			++bank;
+
+		if (bank == *bank_count)
+			bank_used[(*bank_count)++] = 0;
+
+		banks[object] = bank;
+		bank_used[bank] += objects[object]->size;
+	}
+
+	free(order);
+	free(bank_used);
+
+	return banks;
+}
+
+// Inserts ".bankN" before the file name's extension, if it has one
+static char* GetBankFileName(const char *file_name, size_t bank)
+{
+	const char *name = file_name;
+
+	for (const char *character = file_name; *character != '\0'; ++character)
+		if (*character == '/' || *character == '\\')
+			name = character + 1;
+
+	const char *extension = strrchr(name, '.');
+
+	if (extension == NULL || extension == name)
+		extension = name + strlen(name);
+
+	char *bank_file_name = malloc(strlen(file_name) + sizeof(".bank") + 20);
+	sprintf(bank_file_name, "%.*s.bank%zu%s", (int)(extension - file_name), file_name, bank, extension);
+
+	return bank_file_name;
+}
+
+// Packs the objects into banks, and links each bank's objects together for
+// pack_callback to write to 'file_name' with ".bankN" before its extension.
+// Every bank is linked at 'offset', as the Z80 sees them all through the same
+// window. Where each object went is listed in 'map_file_name', or printed if
+// that's NULL, under its name from 'object_names'.
+bool PackBanks(Object **objects, const char **object_names, size_t object_count, size_t bank_size, size_t offset, const char *file_name, const char *map_file_name)
+{
+	size_t bank_count;
+	size_t *banks = Pack(objects, object_count, bank_size, &bank_count);
+
+	if (banks == NULL)
+		return false;
+
+	FILE *map_file = (map_file_name == NULL) ? stdout : fopen(map_file_name, "w");
+
+	if (map_file == NULL)
+	{
+		PrintError("Error: Couldn't open '%s' for writing\n", map_file_name);
+		free(banks);
+		return false;
+	}
+
+	fprintf(map_file, "Bank\tAddress\tSize\tObject\n");
+
+	Object **bank_objects = malloc(sizeof(*bank_objects) * object_count);
+	bool success = true;
+
+	for (size_t bank = 0; bank < bank_count && success; ++bank)
+	{
+		size_t bank_object_count = 0;
+
+		for (size_t i = 0; i < object_count; ++i)
+			if (banks[i] == bank)
+				bank_objects[bank_object_count++] = objects[i];
+
+		Object *linked = Link(bank_objects, bank_object_count, offset);
+
+		if (linked == NULL)
+		{
+			PrintError("Error: Linking of bank %zu halted due to an error\n", bank);
+			success = false;
+			break;
+		}
+
+		char *bank_file_name = GetBankFileName(file_name, bank);
+
+		success = pack_callback(bank_file_name, linked);
+
+		// Linking placed each object where it is in its bank
+		for (size_t i = 0; i < object_count; ++i)
+			if (banks[i] == bank)
+				fprintf(map_file, "%zu\t$%04zX\t$%04zX\t%s\n", bank, objects[i]->offset, objects[i]->size, object_names[i]);
+
+		free(bank_file_name);
+		Object_Destroy(linked);
+	}
+
+	if (map_file != stdout)
+		fclose(map_file);
+
+	free(bank_objects);
+	free(banks);
+
+	return success;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "object.h"
+
+// Size of the Z80's window into the 68k's address space
+#define Z80_BANK_SIZE 0x8000
+// Where the Z80 sees that window
+#define Z80_BANK_WINDOW 0x8000
+
+extern bool (*pack_callback)(const char *file_name, const Object *object);
+
+size_t* Pack(Object **objects, size_t object_count, size_t bank_size, size_t *bank_count);
+bool PackBanks(Object **objects, const char **object_names, size_t object_count, size_t bank_size, size_t offset, const char *file_name, const char *map_file_name);
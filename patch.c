@@ -0,0 +1,228 @@
+#include "patch.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "error.h"
+#include "memory_stream.h"
+
+// Unchanged bytes are skipped this many at a time
+#define BLOCK_SIZE 0x40
+
+// IPS records start with a 24-bit offset and a 16-bit size
+#define IPS_RECORD_HEADER_SIZE 5
+#define IPS_MAX_RECORD_SIZE 0xFFFF
+#define IPS_MAX_OFFSET 0xFFFFFF
+#define IPS_EOF_OFFSET 0x454F46	// "EOF", which would be read as the end of the patch
+
+// Roughly what a BPS SourceRead and the TargetRead after it cost
+#define BPS_ACTION_SIZE 2
+
+// Finds the next byte that the target changes, from 'position' on
+static size_t FindChange(const unsigned char *source, const unsigned char *target, size_t position, size_t size)
+{
+	// memcmp is usually vectorised, so let it rule out whole blocks first
+	while (position + BLOCK_SIZE <= size && memcmp(&source[position], &target[position], BLOCK_SIZE) == 0)
+		position += BLOCK_SIZE;
+
+	while (position < size && source[position] == target[position])
+		++position;
+
+	return position;
+}
+
+// Finds the next run of changed bytes, taking in any unchanged bytes between
+// changes that would cost less to repeat than to start a new run for
+static bool FindRun(const unsigned char *source, const unsigned char *target, size_t size, size_t position, size_t max_gap, size_t max_length, size_t *start, size_t *end)
+{
+	*start = FindChange(source, target, position, size);
+
+	if (*start == size)
+		return false;
+
+	*end = *start;
+
+	for (;;)
+	{
+		size_t run_end = *end;
+
+		while (run_end < size && source[run_end] != target[run_end])
+			++run_end;
+
+		*end = run_end;
+
+		const size_t next = FindChange(source, target, run_end, size);
+
+		if (next == size || next - run_end > max_gap || next - *start >= max_length)
+			break;
+
+		*end = next;
+	}
+
+	if (*end - *start > max_length)
+		*end = *start + max_length;
+
+	return true;
+}
+
+static void WriteBigEndian(MemoryStream *stream, unsigned long value, unsigned int bytes)
+{
+	while (bytes-- != 0)
+		MemoryStream_WriteByte(stream, (value >> (bytes * 8)) & 0xFF);
+}
+
+static bool WriteIPS(MemoryStream *stream, const unsigned char *source, const unsigned char *target, size_t size)
+{
+	size_t start, end;
+
+	MemoryStream_WriteBytes(stream, (unsigned char*)"PATCH", 5);
+
+	for (size_t position = 0; FindRun(source, target, size, position, IPS_RECORD_HEADER_SIZE, IPS_MAX_RECORD_SIZE, &start, &end); position = end)
+	{
+		// Back up a byte rather than start a record at "EOF"
+		if (start == IPS_EOF_OFFSET)
+		{
+			--start;
+
+			if (end - start > IPS_MAX_RECORD_SIZE)
+				--end;
+		}
+
+		if (end - 1 > IPS_MAX_OFFSET)
+		{
+			PrintError("Error: IPS patches can't change anything past $%X, but this one changes $%zX\n", IPS_MAX_OFFSET, end - 1);
+			return false;
+		}
+
+		WriteBigEndian(stream, start, 3);
+		WriteBigEndian(stream, end - start, 2);
+		MemoryStream_WriteBytes(stream, (unsigned char*)&target[start], end - start);
+	}
+
+	MemoryStream_WriteBytes(stream, (unsigned char*)"EOF", 3);
+
+	return true;
+}
+
+static void WriteBPSNumber(MemoryStream *stream, size_t value)
+{
+	for (;;)
+	{
+		const unsigned char bits = value & 0x7F;
+
+		value >>= 7;
+
+		if (value == 0)
+		{
+			MemoryStream_WriteByte(stream, 0x80 | bits);
+			break;
+		}
+
+		MemoryStream_WriteByte(stream, bits);
+		--value;
+	}
+}
+
+static unsigned long CRC32(const unsigned char *data, size_t size)
+{
+	static unsigned long table[0x100];
+
+	if (table[1] == 0)
+	{
+		for (unsigned int i = 0; i < 0x100; ++i)
+		{
+			unsigned long crc = i;
+
+			for (unsigned int bit = 0; bit < 8; ++bit)
+				crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+
+			table[i] = crc;
+		}
+	}
+
+	unsigned long crc = 0xFFFFFFFF;
+
+	for (size_t i = 0; i < size; ++i)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+	return crc ^ 0xFFFFFFFF;
+}
+
+static void WriteLittleEndian32(MemoryStream *stream, unsigned long value)
+{
+	for (unsigned int i = 0; i < 4; ++i)
+		MemoryStream_WriteByte(stream, (value >> (i * 8)) & 0xFF);
+}
+
+static void WriteBPS(MemoryStream *stream, const unsigned char *source, const unsigned char *target, size_t size)
+{
+	// SourceRead copies what's at the same place in the source, and TargetRead takes bytes from the patch
+	enum {SOURCE_READ, TARGET_READ};
+
+	size_t start, end, position = 0;
+
+	MemoryStream_WriteBytes(stream, (unsigned char*)"BPS1", 4);
+	WriteBPSNumber(stream, size);
+	WriteBPSNumber(stream, size);
+	WriteBPSNumber(stream, 0);	// No metadata
+
+	while (FindRun(source, target, size, position, BPS_ACTION_SIZE, (size_t)-1, &start, &end))
+	{
+		if (start != position)
+			WriteBPSNumber(stream, (start - position - 1) << 2 | SOURCE_READ);
+
+		WriteBPSNumber(stream, (end - start - 1) << 2 | TARGET_READ);
+		MemoryStream_WriteBytes(stream, (unsigned char*)&target[start], end - start);
+
+		position = end;
+	}
+
+	if (position != size)
+		WriteBPSNumber(stream, (size - position - 1) << 2 | SOURCE_READ);
+
+	WriteLittleEndian32(stream, CRC32(source, size));
+	WriteLittleEndian32(stream, CRC32(target, size));
+	WriteLittleEndian32(stream, CRC32(MemoryStream_GetBuffer(stream), MemoryStream_GetPosition(stream)));
+}
+
+// Writes a patch that turns 'source' into 'target', which are the same size
+bool Patch_Write(const char *file_name, PatchFormat format, const unsigned char *source, const unsigned char *target, size_t size)
+{
+	error = false;
+
+	MemoryStream *stream = MemoryStream_Create(true);
+
+	switch (format)
+	{
+		case PATCH_FORMAT_IPS:
+			WriteIPS(stream, source, target, size);
+			break;
+
+		case PATCH_FORMAT_BPS:
+			WriteBPS(stream, source, target, size);
+			break;
+	}
+
+	if (!error)
+	{
+		FILE *file = fopen(file_name, "wb");
+
+		if (file == NULL)
+		{
+			PrintError("Error: Couldn't open '%s' for writing\n", file_name);
+		}
+		else
+		{
+			if (fwrite(MemoryStream_GetBuffer(stream), 1, MemoryStream_GetPosition(stream), file) != MemoryStream_GetPosition(stream))
+				PrintError("Error: Couldn't write '%s'\n", file_name);
+
+			fclose(file);
+		}
+	}
+
+	MemoryStream_Destroy(stream);
+
+	return !error;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum PatchFormat
+{
+	PATCH_FORMAT_IPS,
+	PATCH_FORMAT_BPS
+} PatchFormat;
+
+bool Patch_Write(const char *file_name, PatchFormat format, const unsigned char *source, const unsigned char *target, size_t size);
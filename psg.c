@@ -0,0 +1,134 @@
+#include "psg.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+static unsigned int GetNoisePeriod(const PSG *psg)
+{
+	static const unsigned int noise_periods[3] = {0x10, 0x20, 0x40};
+
+	return ((psg->noise_mode & 3) == 3) ? psg->periods[2] : noise_periods[psg->noise_mode & 3];
+}
+
+// Sega's PSG clocks its 16-bit shift register with taps at bits 0 and 3
+static void ClockNoise(PSG *psg)
+{
+	const unsigned int feedback = (psg->noise_mode & 4) ? (psg->shift_register ^ (psg->shift_register >> 3)) & 1 : psg->shift_register & 1;
+
+	psg->shift_register = (psg->shift_register >> 1) | (feedback << 15);
+}
+
+static void Tick(PSG *psg)
+{
+	for (unsigned int channel = 0; channel < 4; ++channel)
+	{
+		const unsigned int period = (channel == 3) ? GetNoisePeriod(psg) : psg->periods[channel];
+
+		// Periods of 0 and 1 hold the output high, which is how the drivers play samples
+		if (period <= 1)
+		{
+			psg->outputs[channel] = true;
+			continue;
+		}
+
+		if (--psg->counters[channel] != 0 && psg->counters[channel] <= period)
+			continue;
+
+		psg->counters[channel] = period;
+		psg->outputs[channel] = !psg->outputs[channel];
+
+		// The noise channel shifts once for each of its square wave's cycles
+		if (channel == 3 && psg->outputs[channel])
+			ClockNoise(psg);
+	}
+}
+
+static float GetOutput(const PSG *psg)
+{
+	float output = 0.0f;
+
+	for (unsigned int channel = 0; channel < 3; ++channel)
+		output += psg->outputs[channel] ? psg->volume_table[psg->attenuations[channel]] : -psg->volume_table[psg->attenuations[channel]];
+
+	output += (psg->shift_register & 1) ? psg->volume_table[psg->attenuations[3]] : -psg->volume_table[psg->attenuations[3]];
+
+	return output;
+}
+
+void PSG_Init(PSG *psg)
+{
+	memset(psg, 0, sizeof(*psg));
+
+	for (unsigned int channel = 0; channel < 4; ++channel)
+	{
+		psg->attenuations[channel] = 15;
+		psg->counters[channel] = 1;
+	}
+
+	psg->shift_register = 0x8000;
+
+	// Each step is 2dB quieter than the last
+	float volume = 1.0f;
+
+	for (unsigned int i = 0; i < 15; ++i)
+	{
+		psg->volume_table[i] = volume;
+		volume *= 0.79432823f;
+	}
+
+	psg->volume_table[15] = 0.0f;
+}
+
+void PSG_Write(PSG *psg, unsigned int value)
+{
+	// Latch bytes choose a register and fill in its low four bits, and data bytes fill in the rest
+	const bool latch = (value & 0x80) != 0;
+
+	if (latch)
+		psg->latched = (value >> 4) & 7;
+
+	const unsigned int channel = psg->latched >> 1;
+
+	if (psg->latched & 1)
+	{
+		psg->attenuations[channel] = value & 0xF;
+	}
+	else if (channel == 3)
+	{
+		psg->noise_mode = value & 7;
+		psg->shift_register = 0x8000;
+	}
+	else if (latch)
+	{
+		psg->periods[channel] = (psg->periods[channel] & 0x3F0) | (value & 0xF);
+	}
+	else
+	{
+		psg->periods[channel] = (psg->periods[channel] & 0xF) | ((value & 0x3F) << 4);
+	}
+}
+
+// Adds the chip's output to 'output', averaged over the ticks in each sample
+void PSG_Render(PSG *psg, float *output, size_t sample_count, unsigned long sample_rate)
+{
+	const float ticks_per_sample = (float)PSG_CLOCK / 16.0f / (float)sample_rate;
+
+	for (size_t sample = 0; sample < sample_count; ++sample)
+	{
+		psg->ticks += ticks_per_sample;
+
+		const unsigned int ticks = (unsigned int)psg->ticks;
+		float sum = 0.0f;
+
+		psg->ticks -= (float)ticks;
+
+		for (unsigned int tick = 0; tick < ticks; ++tick)
+		{
+			Tick(psg);
+			sum += GetOutput(psg);
+		}
+
+		output[sample] += (ticks == 0) ? GetOutput(psg) : sum / (float)ticks;
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PSG_CLOCK 3579545	// An NTSC Mega Drive's Z80 clock, which the PSG shares
+
+typedef struct PSG
+{
+	unsigned int periods[3];	// Of the tone channels, in ticks of the clock divided by 16
+	unsigned int counters[4];
+	bool outputs[4];
+	unsigned int attenuations[4];	// In steps of 2dB, where 15 is silent
+	unsigned int noise_mode;	// Bit 2 chooses white noise, and bits 0 and 1 the rate
+	unsigned int shift_register;
+	unsigned int latched;		// The channel and register that data bytes go to
+	float ticks;			// Carried over from one sample to the next
+	float volume_table[16];
+} PSG;
+
+void PSG_Init(PSG *psg);
+void PSG_Write(PSG *psg, unsigned int value);
+void PSG_Render(PSG *psg, float *output, size_t sample_count, unsigned long sample_rate);
@@ -0,0 +1,358 @@
+#include "render.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver.h"
+#include "error.h"
+#include "memory_stream.h"
+#include "psg.h"
+#include "sequencer.h"
+#include "ym2612.h"
+
+#define FRAME_RATE 60
+#define TAIL_FRAMES 60			// Left for the last notes to ring out once every track stops
+#define MAX_FRAME_SAMPLES (YM2612_SAMPLE_RATE / FRAME_RATE + 1)
+
+// Where each operator's registers are, from operator 1 to 4
+static const unsigned char operator_offsets[4] = {0, 8, 4, 0xC};
+
+static const Driver *driver;
+static RegisterLog *register_log;
+static unsigned int current_frame;
+
+static int Clamp(int value, int minimum, int maximum)
+{
+	return (value < minimum) ? minimum : (value > maximum) ? maximum : value;
+}
+
+static void AddWrite(RenderChip chip, unsigned int address, unsigned int value)
+{
+	if (register_log->write_count == register_log->write_capacity)
+	{
+		register_log->write_capacity *= 2;
+		register_log->writes = realloc(register_log->writes, sizeof(*register_log->writes) * register_log->write_capacity);
+	}
+
+	register_log->writes[register_log->write_count++] = (RegisterWrite){current_frame, chip, address & 0xFF, value & 0xFF};
+}
+
+static void WriteFM(const SequencerTrack *track, unsigned int address, unsigned int value)
+{
+	if (track->channel == SEQUENCER_CHANNEL_FM)
+		AddWrite((track->id & 4) ? RENDER_CHIP_FM_PORT_1 : RENDER_CHIP_FM_PORT_0, address + (track->id & 3), value);
+}
+
+static void WriteKey(const SequencerTrack *track, bool on)
+{
+	if (track->channel == SEQUENCER_CHANNEL_FM)
+		AddWrite(RENDER_CHIP_FM_PORT_0, 0x28, (on ? 0xF0 : 0) | track->id);
+}
+
+static void WritePSGVolume(const SequencerTrack *track, unsigned int attenuation)
+{
+	if (track->channel == SEQUENCER_CHANNEL_PSG)
+		AddWrite(RENDER_CHIP_PSG, 0, (track->noise ? 0xE0 : track->id) | 0x10 | attenuation);
+}
+
+static bool IsCarrier(unsigned int algorithm, unsigned int operator)
+{
+	const bool carriers[4] = {algorithm == 7, algorithm >= 4, algorithm >= 5, true};
+
+	return carriers[operator];
+}
+
+// Stored operator 'i' is operator 4 - voice_operator_order[i]
+static unsigned int GetOperator(unsigned int i)
+{
+	return 3 - driver->voice_operator_order[i];
+}
+
+static void WriteTotalLevels(const SequencerTrack *track)
+{
+	if (!track->has_voice)
+		return;
+
+	for (unsigned int i = 0; i < 4; ++i)
+	{
+		const unsigned int operator = GetOperator(i);
+		int total_level = track->voice[21 + i] & 0x7F;
+
+		if (IsCarrier(track->voice[0] & 7, operator))
+			total_level = Clamp(total_level + track->volume, 0, 0x7F);
+
+		WriteFM(track, 0x40 + operator_offsets[operator], total_level);
+	}
+}
+
+static void WriteVolume(const SequencerTrack *track)
+{
+	if (track->channel == SEQUENCER_CHANNEL_FM)
+		WriteTotalLevels(track);
+	else if (!track->resting)
+		WritePSGVolume(track, Clamp(track->volume, 0, 0xF));
+}
+
+static void WriteFrequency(const SequencerTrack *track)
+{
+	const int frequency = (int)track->frequency + track->detune + track->modulation;
+
+	if (track->resting)
+		return;
+
+	if (track->channel == SEQUENCER_CHANNEL_FM)
+	{
+		WriteFM(track, 0xA4, (frequency >> 8) & 0x3F);
+		WriteFM(track, 0xA0, frequency & 0xFF);
+	}
+	else if (track->channel == SEQUENCER_CHANNEL_PSG)
+	{
+		const int period = Clamp(frequency, 0, 0x3FF);
+
+		AddWrite(RENDER_CHIP_PSG, 0, track->id | (period & 0xF));
+		AddWrite(RENDER_CHIP_PSG, 0, (period >> 4) & 0x3F);
+	}
+}
+
+static void WriteVoice(const SequencerTrack *track)
+{
+	static const unsigned char registers[5] = {0x30, 0x50, 0x60, 0x70, 0x80};
+
+	// Voices in other songs or the universal voice bank aren't here to load
+	if (!track->has_voice)
+		return;
+
+	WriteFM(track, 0xB0, track->voice[0]);
+
+	for (unsigned int i = 0; i < 5; ++i)
+		for (unsigned int j = 0; j < 4; ++j)
+			WriteFM(track, registers[i] + operator_offsets[GetOperator(j)], track->voice[1 + i * 4 + j]);
+
+	WriteTotalLevels(track);
+	WriteFM(track, 0xB4, track->pan);
+}
+
+static void Silence(const SequencerTrack *track)
+{
+	WriteKey(track, false);
+	WritePSGVolume(track, 0xF);
+}
+
+static void WriteFlag(const SequencerTrack *track, CoordinationFlag flag, const unsigned char *arguments)
+{
+	switch (flag)
+	{
+		case COORDINATION_FLAG_PAN:
+			WriteFM(track, 0xB4, track->pan);
+			break;
+
+		case COORDINATION_FLAG_FM_VOICE:
+			WriteVoice(track);
+			break;
+
+		case COORDINATION_FLAG_ALTER_VOL:
+		case COORDINATION_FLAG_FM_ALTER_VOL:
+		case COORDINATION_FLAG_SET_VOL:
+			WriteVolume(track);
+			break;
+
+		case COORDINATION_FLAG_PSG_ALTER_VOL:
+			if (track->channel == SEQUENCER_CHANNEL_PSG)
+				WriteVolume(track);
+
+			break;
+
+		case COORDINATION_FLAG_PSG_FORM:
+			// PSG 3's tone drives the noise, so it's silenced
+			if (track->channel == SEQUENCER_CHANNEL_PSG)
+			{
+				AddWrite(RENDER_CHIP_PSG, 0, arguments[0]);
+				AddWrite(RENDER_CHIP_PSG, 0, 0xDF);
+			}
+
+			break;
+
+		default:
+			break;
+	}
+}
+
+// Makes the register writes that the driver would for each thing that it does
+static void WriteEvent(const SequencerEvent *event)
+{
+	const SequencerTrack *track = event->track;
+
+	switch (event->kind)
+	{
+		case SEQUENCER_EVENT_FLAG:
+			WriteFlag(track, event->flag, event->arguments);
+			break;
+
+		case SEQUENCER_EVENT_NOTE:
+			if (!track->no_attack)
+				WriteKey(track, false);
+
+			if (track->resting)
+			{
+				Silence(track);
+			}
+			else
+			{
+				WriteFrequency(track);
+				WriteVolume(track);
+
+				if (!track->no_attack)
+					WriteKey(track, true);
+			}
+
+			break;
+
+		case SEQUENCER_EVENT_SILENCE:
+			Silence(track);
+			break;
+
+		case SEQUENCER_EVENT_MODULATE:
+			WriteFrequency(track);
+			break;
+
+		// PSG volume envelopes aren't modelled
+		case SEQUENCER_EVENT_UPDATE:
+		case SEQUENCER_EVENT_READ:
+		case SEQUENCER_EVENT_ENVELOPE:
+			break;
+	}
+}
+
+// Plays a compiled song the way its driver would, and logs the register writes
+// that it makes, until every track stops or 'frame_count' frames have gone by.
+// 'offset' is where it was assembled to. Returns NULL if the song can't be played.
+RegisterLog* Render_Sequence(const unsigned char *data, size_t size, unsigned int driver_version, size_t offset, bool sfx, size_t frame_count)
+{
+	error = false;
+
+	driver = GetDriver(driver_version);
+	current_frame = 0;
+
+	register_log = malloc(sizeof(*register_log));
+	register_log->write_capacity = 0x100;
+	register_log->write_count = 0;
+	register_log->writes = malloc(sizeof(*register_log->writes) * register_log->write_capacity);
+	register_log->frame_count = 0;
+
+	if (Sequencer_Start(data, size, driver_version, offset, sfx, WriteEvent))
+	{
+		size_t end = frame_count;
+
+		// With a DAC channel and five FM channels, FM 6 plays samples, which
+		// aren't part of the song and so play as silence
+		if (!sfx && data[2] != 0 && data[2] < 7)
+			AddWrite(RENDER_CHIP_FM_PORT_0, 0x2B, 0x80);
+
+		for (; current_frame < end && !error; ++current_frame)
+		{
+			const bool playing = Sequencer_PlayFrame();
+
+			if (!playing && end == frame_count && current_frame + TAIL_FRAMES < frame_count)
+				end = current_frame + 1 + TAIL_FRAMES;
+		}
+	}
+
+	register_log->frame_count = current_frame;
+	Sequencer_Stop();
+
+	if (error)
+	{
+		Render_DestroyLog(register_log);
+		return NULL;
+	}
+
+	return register_log;
+}
+
+void Render_DestroyLog(RegisterLog *p_log)
+{
+	free(p_log->writes);
+	free(p_log);
+}
+
+static void WriteLittleEndian(MemoryStream *stream, unsigned long value, unsigned int bytes)
+{
+	for (unsigned int i = 0; i < bytes; ++i)
+		MemoryStream_WriteByte(stream, (value >> (i * 8)) & 0xFF);
+}
+
+static void WriteWAVHeader(MemoryStream *wav, size_t sample_count)
+{
+	const unsigned long data_size = (unsigned long)sample_count * 4;
+
+	MemoryStream_WriteBytes(wav, (unsigned char*)"RIFF", 4);
+	WriteLittleEndian(wav, 36 + data_size, 4);
+	MemoryStream_WriteBytes(wav, (unsigned char*)"WAVEfmt ", 8);
+	WriteLittleEndian(wav, 16, 4);
+	WriteLittleEndian(wav, 1, 2);			// Uncompressed
+	WriteLittleEndian(wav, 2, 2);			// Stereo
+	WriteLittleEndian(wav, YM2612_SAMPLE_RATE, 4);
+	WriteLittleEndian(wav, YM2612_SAMPLE_RATE * 4, 4);
+	WriteLittleEndian(wav, 4, 2);
+	WriteLittleEndian(wav, 16, 2);
+	MemoryStream_WriteBytes(wav, (unsigned char*)"data", 4);
+	WriteLittleEndian(wav, data_size, 4);
+}
+
+static void WriteSample(MemoryStream *wav, float sample)
+{
+	sample = (sample > 1.0f) ? 1.0f : (sample < -1.0f) ? -1.0f : sample;
+
+	WriteLittleEndian(wav, (unsigned long)(long)(sample * 32767.0f) & 0xFFFF, 2);
+}
+
+// Plays a log through models of the YM2612 and PSG, and writes what they
+// output as a 16-bit stereo WAV file at the YM2612's own sample rate. This
+// touches nothing but its arguments, so songs can be synthesized in parallel.
+void Render_Synthesize(const RegisterLog *p_log, MemoryStream *wav)
+{
+	YM2612 *ym2612 = malloc(sizeof(*ym2612));
+	PSG psg;
+	float left[MAX_FRAME_SAMPLES];
+	float right[MAX_FRAME_SAMPLES];
+	float psg_output[MAX_FRAME_SAMPLES];
+	size_t write = 0;
+
+	YM2612_Init(ym2612);
+	PSG_Init(&psg);
+	WriteWAVHeader(wav, p_log->frame_count * YM2612_SAMPLE_RATE / FRAME_RATE);
+
+	for (size_t frame = 0; frame < p_log->frame_count; ++frame)
+	{
+		const size_t sample_count = (frame + 1) * YM2612_SAMPLE_RATE / FRAME_RATE - frame * YM2612_SAMPLE_RATE / FRAME_RATE;
+
+		// The driver makes all of a frame's writes at the start of it
+		for (; write < p_log->write_count && p_log->writes[write].frame == frame; ++write)
+		{
+			const RegisterWrite *register_write = &p_log->writes[write];
+
+			if (register_write->chip == RENDER_CHIP_PSG)
+				PSG_Write(&psg, register_write->value);
+			else
+				YM2612_Write(ym2612, register_write->chip == RENDER_CHIP_FM_PORT_1, register_write->address, register_write->value);
+		}
+
+		memset(left, 0, sizeof(left));
+		memset(right, 0, sizeof(right));
+		memset(psg_output, 0, sizeof(psg_output));
+
+		YM2612_Render(ym2612, left, right, sample_count);
+		PSG_Render(&psg, psg_output, sample_count, YM2612_SAMPLE_RATE);
+
+		// Leave room for all six FM channels and all four PSG channels at full volume
+		for (size_t i = 0; i < sample_count; ++i)
+		{
+			WriteSample(wav, left[i] / 8.0f + psg_output[i] / 16.0f);
+			WriteSample(wav, right[i] / 8.0f + psg_output[i] / 16.0f);
+		}
+	}
+
+	free(ym2612);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "memory_stream.h"
+
+typedef enum RenderChip
+{
+	RENDER_CHIP_FM_PORT_0,
+	RENDER_CHIP_FM_PORT_1,
+	RENDER_CHIP_PSG
+} RenderChip;
+
+// A register write that the driver makes, and the frame that it makes it in
+typedef struct RegisterWrite
+{
+	unsigned int frame;
+	unsigned char chip;		// A RenderChip
+	unsigned char address;		// Unused by the PSG
+	unsigned char value;
+} RegisterWrite;
+
+typedef struct RegisterLog
+{
+	RegisterWrite *writes;
+	size_t write_count;
+	size_t write_capacity;
+	size_t frame_count;
+} RegisterLog;
+
+RegisterLog* Render_Sequence(const unsigned char *data, size_t size, unsigned int driver_version, size_t offset, bool sfx, size_t frame_count);
+void Render_DestroyLog(RegisterLog *log);
+void Render_Synthesize(const RegisterLog *log, MemoryStream *wav);
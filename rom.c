@@ -0,0 +1,198 @@
+// Edits ROMs in place. Where the platform can map files into memory, only
+// the pages that change are written back; elsewhere, the ROM is read in
+// whole and only the range that changed is written back. ROMs that aren't
+// written back are edited in a private copy.
+
+#if !defined(_WIN32) && (defined(__unix__) || defined(__APPLE__))
+#define _POSIX_C_SOURCE 200809L
+#define ROM_MMAP
+#endif
+
+#include "rom.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ROM_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "error.h"
+
+struct Rom
+{
+	unsigned char *data;
+	size_t size;
+	bool write_back;
+
+#ifdef ROM_MMAP
+	int file;
+#else
+	FILE *file;
+	size_t changed_start;	// Range that has to be written back
+	size_t changed_end;
+#endif
+};
+
+Rom* Rom_Open(const char *file_name, bool write_back)
+{
+	Rom *rom = calloc(1, sizeof(*rom));
+
+	rom->write_back = write_back;
+
+#ifdef ROM_MMAP
+	struct stat status;
+
+	rom->file = open(file_name, write_back ? O_RDWR : O_RDONLY);
+
+	if (rom->file == -1 || fstat(rom->file, &status) != 0 || status.st_size == 0)
+	{
+		PrintError("Error: Couldn't open ROM '%s'\n", file_name);
+
+		if (rom->file != -1)
+			close(rom->file);
+
+		free(rom);
+		return NULL;
+	}
+
+	rom->size = (size_t)status.st_size;
+	rom->data = mmap(NULL, rom->size, PROT_READ | PROT_WRITE, write_back ? MAP_SHARED : MAP_PRIVATE, rom->file, 0);
+
+	if (rom->data == MAP_FAILED)
+	{
+		PrintError("Error: Couldn't map ROM '%s' into memory\n", file_name);
+		close(rom->file);
+		free(rom);
+		return NULL;
+	}
+#else
+	rom->file = fopen(file_name, write_back ? "r+b" : "rb");
+
+	if (rom->file == NULL)
+	{
+		PrintError("Error: Couldn't open ROM '%s'\n", file_name);
+		free(rom);
+		return NULL;
+	}
+
+	fseek(rom->file, 0, SEEK_END);
+	rom->size = ftell(rom->file);
+	rewind(rom->file);
+
+	rom->data = malloc(rom->size + 1);
+	rom->changed_start = rom->size;
+	rom->changed_end = 0;
+
+	if (rom->size == 0 || fread(rom->data, 1, rom->size, rom->file) != rom->size)
+	{
+		PrintError("Error: Couldn't read ROM '%s'\n", file_name);
+		fclose(rom->file);
+		free(rom->data);
+		free(rom);
+		return NULL;
+	}
+#endif
+
+	return rom;
+}
+
+// Writes back whatever changed, and returns whether that worked
+bool Rom_Close(Rom *rom)
+{
+	bool success = true;
+
+#ifdef ROM_MMAP
+	if (rom->write_back)
+		success = msync(rom->data, rom->size, MS_SYNC) == 0;
+
+	munmap(rom->data, rom->size);
+	close(rom->file);
+#else
+	if (rom->write_back && rom->changed_start < rom->changed_end)
+	{
+		fseek(rom->file, (long)rom->changed_start, SEEK_SET);
+		success = fwrite(&rom->data[rom->changed_start], 1, rom->changed_end - rom->changed_start, rom->file) == rom->changed_end - rom->changed_start;
+	}
+
+	success &= fclose(rom->file) == 0;
+	free(rom->data);
+#endif
+
+	free(rom);
+
+	return success;
+}
+
+size_t Rom_GetSize(const Rom *rom)
+{
+	return rom->size;
+}
+
+const unsigned char* Rom_GetData(const Rom *rom)
+{
+	return rom->data;
+}
+
+// Adds up the big-endian words that the checksum covers, between two even positions
+static unsigned int SumWords(const Rom *rom, size_t start, size_t end)
+{
+	unsigned int sum = 0;
+
+	for (size_t i = start; i < end; i += 2)
+		sum += (rom->data[i] << 8) | rom->data[i + 1];
+
+	return sum;
+}
+
+// Copies data into the ROM, and adjusts the header's checksum by the
+// difference that it made, rather than adding up the whole ROM again.
+// Bytes that already match are left alone, so that their pages aren't
+// written to.
+void Rom_Write(Rom *rom, size_t position, const unsigned char *data, size_t size)
+{
+	// The checksum covers whole words, up to the last whole one
+	const size_t checksum_end = rom->size & ~(size_t)1;
+	size_t sum_start = position & ~(size_t)1;
+	size_t sum_end = (position + size + 1) & ~(size_t)1;
+
+	if (sum_start < ROM_CHECKSUM_START)
+		sum_start = ROM_CHECKSUM_START;
+
+	if (sum_end > checksum_end)
+		sum_end = checksum_end;
+
+	const bool checksummed = rom->size >= ROM_CHECKSUM_START && sum_start < sum_end;
+	const unsigned int old_sum = checksummed ? SumWords(rom, sum_start, sum_end) : 0;
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		if (rom->data[position + i] != data[i])
+		{
+			rom->data[position + i] = data[i];
+
+#ifndef ROM_MMAP
+			if (position + i < rom->changed_start)
+				rom->changed_start = position + i;
+			if (position + i + 1 > rom->changed_end)
+				rom->changed_end = position + i + 1;
+#endif
+		}
+	}
+
+	if (checksummed)
+	{
+		const unsigned int checksum = (rom->data[ROM_CHECKSUM_POSITION] << 8) | rom->data[ROM_CHECKSUM_POSITION + 1];
+		const unsigned int new_checksum = (checksum - old_sum + SumWords(rom, sum_start, sum_end)) & 0xFFFF;
+		const unsigned char bytes[2] = {new_checksum >> 8, new_checksum & 0xFF};
+
+		if (new_checksum != checksum)
+			Rom_Write(rom, ROM_CHECKSUM_POSITION, bytes, sizeof(bytes));
+	}
+}
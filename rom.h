@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Where the Mega Drive's header keeps the checksum of everything after it
+#define ROM_CHECKSUM_POSITION 0x18E
+#define ROM_CHECKSUM_START 0x200
+
+typedef struct Rom Rom;
+
+Rom* Rom_Open(const char *file_name, bool write_back);
+bool Rom_Close(Rom *rom);
+size_t Rom_GetSize(const Rom *rom);
+const unsigned char* Rom_GetData(const Rom *rom);
+void Rom_Write(Rom *rom, size_t position, const unsigned char *data, size_t size);
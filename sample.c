@@ -0,0 +1,323 @@
+#include "sample.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "memory_stream.h"
+
+#define PI 3.14159265f
+#define FILTER_ZERO_CROSSINGS 8		// On each side of the filter's centre, which is plenty for drums
+#define MAX_FILTER_HALF_WIDTH 0x400
+#define FILTER_CUTOFF 0.45f		// Of the new rate, leaving room for the filter to roll off below half of it
+#define BLOCK_SIZE 8			// Samples that the kernels work on at once, which the compiler turns into vector instructions
+
+// What each DPCM nibble adds to the last sample. Every driver's zDACDecodeTbl
+// holds the same deltas.
+static const unsigned char dpcm_deltas[16] = {0, 1, 2, 4, 8, 0x10, 0x20, 0x40, 0x80, 0xFF, 0xFE, 0xFC, 0xF8, 0xF0, 0xE0, 0xC0};
+
+static unsigned long ReadLittleEndian(const unsigned char *bytes, unsigned int count)
+{
+	unsigned long value = 0;
+
+	for (unsigned int i = 0; i < count; ++i)
+		value |= (unsigned long)bytes[i] << (i * 8);
+
+	return value;
+}
+
+// The build doesn't link the maths library, so this brings the angle into
+// -pi to pi and takes the Taylor series far enough for a float
+static float Cosine(float angle)
+{
+	const float turns = angle / (2.0f * PI);
+
+	angle -= 2.0f * PI * (float)(long)(turns + ((turns < 0.0f) ? -0.5f : 0.5f));
+
+	float term = 1.0f;
+	float sum = 1.0f;
+
+	for (unsigned int i = 1; i <= 8; ++i)
+	{
+		term *= -angle * angle / (float)((2 * i - 1) * (2 * i));
+		sum += term;
+	}
+
+	return sum;
+}
+
+static float Sine(float angle)
+{
+	return Cosine(angle - PI / 2.0f);
+}
+
+// Turns one channel of one sample frame into a float from -1 to 1
+static float DecodeWAVSample(const unsigned char *bytes, unsigned int format, unsigned int bits)
+{
+	const unsigned long value = ReadLittleEndian(bytes, bits / 8);
+
+	if (format == 3)
+	{
+		float result;
+		const unsigned char float_bytes[4] = {value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, (value >> 24) & 0xFF};
+
+		// Assumes that the host's floats are IEEE 754 singles
+		memcpy(&result, float_bytes, sizeof(result));
+		return result;
+	}
+
+	// 8-bit samples are unsigned, and the rest are signed
+	if (bits == 8)
+		return ((float)value - 128.0f) / 128.0f;
+
+	const unsigned long sign = 1UL << (bits - 1);
+
+	return (value & sign) ? -(float)((sign << 1) - value) / (float)sign : (float)value / (float)sign;
+}
+
+// Reads an uncompressed or floating-point WAV file, of any rate and number of channels
+bool Sample_ReadWAV(const unsigned char *data, size_t size, Sample *sample)
+{
+	size_t format_position = 0;
+	size_t format_size = 0;
+	size_t data_position = 0;
+	size_t data_size = 0;
+
+	if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0)
+	{
+		PrintError("Error: Not a WAV file\n");
+		return false;
+	}
+
+	for (size_t position = 12; position + 8 <= size; )
+	{
+		const size_t body = position + 8;
+		size_t chunk_size = ReadLittleEndian(&data[position + 4], 4);
+
+		// Files that were cut short are common, so the last chunk may be shorter than it says
+		if (chunk_size > size - body)
+			chunk_size = size - body;
+
+		if (memcmp(&data[position], "fmt ", 4) == 0 && chunk_size >= 16)
+		{
+			format_position = body;
+			format_size = chunk_size;
+		}
+		else if (memcmp(&data[position], "data", 4) == 0)
+		{
+			data_position = body;
+			data_size = chunk_size;
+		}
+
+		position = body + chunk_size + (chunk_size & 1);
+	}
+
+	if (format_position == 0 || data_position == 0)
+	{
+		PrintError("Error: WAV file has no 'fmt ' or 'data' chunk\n");
+		return false;
+	}
+
+	unsigned int format = ReadLittleEndian(&data[format_position], 2);
+	const unsigned int channels = ReadLittleEndian(&data[format_position + 2], 2);
+	const unsigned long rate = ReadLittleEndian(&data[format_position + 4], 4);
+	const unsigned int bits = ReadLittleEndian(&data[format_position + 14], 2);
+
+	// Extensible files keep the real format at the start of their subformat's GUID
+	if (format == 0xFFFE && format_size >= 26)
+		format = ReadLittleEndian(&data[format_position + 24], 2);
+
+	if (!(format == 1 && (bits == 8 || bits == 16 || bits == 24 || bits == 32)) && !(format == 3 && bits == 32))
+	{
+		PrintError("Error: Only 8, 16, 24 and 32-bit uncompressed and 32-bit floating-point WAV files are supported\n");
+		return false;
+	}
+
+	if (channels == 0 || rate == 0)
+	{
+		PrintError("Error: WAV file has no channels, or a rate of 0Hz\n");
+		return false;
+	}
+
+	const size_t frame_size = channels * (bits / 8);
+
+	sample->count = data_size / frame_size;
+	sample->rate = rate;
+	sample->samples = malloc(sizeof(*sample->samples) * (sample->count + 1));
+
+	// Stereo is mixed down to mono
+	for (size_t i = 0; i < sample->count; ++i)
+	{
+		float sum = 0.0f;
+
+		for (unsigned int channel = 0; channel < channels; ++channel)
+			sum += DecodeWAVSample(&data[data_position + i * frame_size + channel * (bits / 8)], format, bits);
+
+		sample->samples[i] = sum / (float)channels;
+	}
+
+	return true;
+}
+
+void Sample_Destroy(Sample *sample)
+{
+	free(sample->samples);
+	sample->samples = NULL;
+	sample->count = 0;
+}
+
+// One tap of the filter, applied to the whole sound at once. It goes a block
+// at a time, since the compiler only vectorizes loops of a known length.
+static void MultiplyAdd(float *restrict output, const float *restrict input, float weight, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + BLOCK_SIZE <= count; i += BLOCK_SIZE)
+		for (size_t j = 0; j < BLOCK_SIZE; ++j)
+			output[i + j] += weight * input[i + j];
+
+	for (; i < count; ++i)
+		output[i] += weight * input[i];
+}
+
+// A windowed sinc filter that removes everything above 'cutoff', in cycles per sample
+static float* LowPass(const Sample *input, float cutoff)
+{
+	size_t half_width = (size_t)(FILTER_ZERO_CROSSINGS / (2.0f * cutoff)) + 1;
+
+	if (half_width > MAX_FILTER_HALF_WIDTH)
+		half_width = MAX_FILTER_HALF_WIDTH;
+
+	const size_t tap_count = half_width * 2 + 1;
+	float *taps = malloc(sizeof(*taps) * tap_count);
+	float total = 0.0f;
+
+	for (size_t i = 0; i < tap_count; ++i)
+	{
+		const float distance = (float)i - (float)half_width;
+		const float phase = 2.0f * PI * (float)i / (float)(tap_count - 1);
+		const float blackman = 0.42f - 0.5f * Cosine(phase) + 0.08f * Cosine(2.0f * phase);
+
+		taps[i] = blackman * ((i == half_width) ? 2.0f * cutoff : Sine(2.0f * PI * cutoff * distance) / (PI * distance));
+		total += taps[i];
+	}
+
+	// The sound is padded with silence on either side for the filter to run into
+	float *padded = calloc(input->count + tap_count, sizeof(*padded));
+	float *output = calloc(input->count + 1, sizeof(*output));
+
+	memcpy(padded + half_width, input->samples, sizeof(*padded) * input->count);
+
+	for (size_t i = 0; i < tap_count; ++i)
+		MultiplyAdd(output, padded + i, taps[i] / total, input->count);
+
+	free(taps);
+	free(padded);
+
+	return output;
+}
+
+// Changes a sound's rate, filtering out anything too high for the new rate first
+void Sample_Resample(const Sample *input, unsigned long rate, Sample *output)
+{
+	const double step = (double)input->rate / (double)rate;
+	float *filtered = (rate < input->rate) ? LowPass(input, FILTER_CUTOFF * (float)rate / (float)input->rate) : NULL;
+	const float *source = (filtered != NULL) ? filtered : input->samples;
+
+	output->rate = rate;
+	output->count = (size_t)((double)input->count / step);
+	output->samples = malloc(sizeof(*output->samples) * (output->count + 1));
+
+	for (size_t i = 0; i < output->count; ++i)
+	{
+		const double position = (double)i * step;
+		size_t index = (size_t)position;
+
+		if (index >= input->count)
+			index = input->count - 1;
+
+		const float fraction = (float)(position - (double)index);
+		const float next = (index + 1 < input->count) ? source[index + 1] : source[index];
+
+		output->samples[i] = source[index] + (next - source[index]) * fraction;
+	}
+
+	free(filtered);
+}
+
+static unsigned char QuantizeOne(float sample)
+{
+	float level = sample * 127.5f + 128.0f;
+
+	level = (level < 0.0f) ? 0.0f : level;
+	level = (level > 255.0f) ? 255.0f : level;
+
+	return (unsigned char)(int)level;
+}
+
+// Turns floats into unsigned 8-bit levels, a block at a time like 'MultiplyAdd'
+static void Quantize(const float *restrict samples, unsigned char *restrict levels, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + BLOCK_SIZE <= count; i += BLOCK_SIZE)
+		for (size_t j = 0; j < BLOCK_SIZE; ++j)
+			levels[i + j] = QuantizeOne(samples[i + j]);
+
+	for (; i < count; ++i)
+		levels[i] = QuantizeOne(samples[i]);
+}
+
+// Each nibble, high one first, picks the delta that lands closest to the
+// next level. The decoder starts from $80.
+static void EncodeDPCM(const unsigned char *levels, size_t count, MemoryStream *output)
+{
+	unsigned int last = 0x80;
+	unsigned int byte = 0;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		unsigned int best = 0;
+		unsigned int best_distance = 0x100;
+
+		for (unsigned int nibble = 0; nibble < 16; ++nibble)
+		{
+			const unsigned int candidate = (last + dpcm_deltas[nibble]) & 0xFF;
+			const unsigned int distance = (candidate > levels[i]) ? candidate - levels[i] : levels[i] - candidate;
+
+			if (distance < best_distance)
+			{
+				best = nibble;
+				best_distance = distance;
+			}
+		}
+
+		last = (last + dpcm_deltas[best]) & 0xFF;
+
+		if (i % 2 == 0)
+			byte = best << 4;
+		else
+			MemoryStream_WriteByte(output, byte | best);
+	}
+
+	if (count % 2 != 0)
+		MemoryStream_WriteByte(output, byte);
+}
+
+// Writes a sound in the form that the driver's DAC code plays. The sound
+// should already be at the driver's rate.
+void Sample_Encode(const Sample *sample, SampleEncoding encoding, MemoryStream *output)
+{
+	unsigned char *levels = malloc(sample->count + 1);
+
+	Quantize(sample->samples, levels, sample->count);
+
+	if (encoding == SAMPLE_ENCODING_DPCM)
+		EncodeDPCM(levels, sample->count, output);
+	else
+		MemoryStream_WriteBytes(output, levels, sample->count);
+
+	free(levels);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "memory_stream.h"
+
+typedef enum SampleEncoding
+{
+	SAMPLE_ENCODING_DPCM,	// 4-bit deltas, which is what every driver's DAC code plays
+	SAMPLE_ENCODING_PCM	// Unsigned 8-bit, for drivers that have been changed to play samples as they are
+} SampleEncoding;
+
+// A sound, mixed down to one channel, from -1 to 1
+typedef struct Sample
+{
+	float *samples;
+	size_t count;
+	unsigned long rate;
+} Sample;
+
+bool Sample_ReadWAV(const unsigned char *data, size_t size, Sample *sample);
+void Sample_Destroy(Sample *sample);
+void Sample_Resample(const Sample *input, unsigned long rate, Sample *output);
+void Sample_Encode(const Sample *sample, SampleEncoding encoding, MemoryStream *output);
@@ -0,0 +1,607 @@
+#include "sequencer.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver.h"
+#include "error.h"
+#include "song.h"
+#include "voice.h"
+
+#define MUSIC_HEADER_SIZE 6
+#define SFX_HEADER_SIZE 4
+#define SFX_CHANNEL_SIZE 6
+#define MAX_COMMANDS_PER_NOTE 0x10000	// Any more, and the track is going round in circles without a note
+
+// The first octave of each chip's notes. Higher octaves use the next FM block,
+// and halve the PSG's period.
+static const unsigned short fm_frequencies[12] = {0x25E, 0x284, 0x2AB, 0x2D3, 0x2FE, 0x32D, 0x35C, 0x38F, 0x3C5, 0x3FF, 0x43C, 0x47C};
+static const unsigned short psg_periods[12] = {0x356, 0x326, 0x2F9, 0x2CE, 0x2A5, 0x280, 0x25C, 0x23A, 0x21A, 0x1FB, 0x1DF, 0x1C4};
+
+static const unsigned char *data;
+static size_t size;
+static const Driver *driver;
+static size_t offset;
+static bool sfx;
+static void (*callback)(const SequencerEvent *event);
+
+static SequencerTrack *tracks;
+static unsigned int track_count;
+static unsigned int tempo_modifier;
+static unsigned int tempo_counter;	// Sonic 1's timeout, or the other drivers' accumulator
+
+static unsigned int ReadShort(size_t position)
+{
+	return driver->big_endian ? (data[position] << 8) | data[position + 1] : data[position] | (data[position + 1] << 8);
+}
+
+static int ReadSigned(size_t position)
+{
+	return (data[position] & 0x80) ? (int)data[position] - 0x100 : (int)data[position];
+}
+
+// Counters that the drivers decrement before checking treat 0 as 256
+static unsigned int Conv0To256(unsigned int value)
+{
+	return (value == 0) ? 0x100 : value;
+}
+
+// Works out where a pointer goes, as a position within the song, which may
+// be outside of it
+static long GetPointerTarget(size_t site, SongPointer pointer)
+{
+	const unsigned int value = ReadShort(site);
+
+	switch (pointer)
+	{
+		case SONG_POINTER_SONG_RELATIVE:
+			return value;
+
+		case SONG_POINTER_TRACK_RELATIVE:
+			return (long)site + 1 + ((value & 0x8000) ? (long)value - 0x10000 : (long)value);
+
+		default:
+			return (long)value - (long)offset;
+	}
+}
+
+static void Report(SequencerEventKind kind, const SequencerTrack *track)
+{
+	const SequencerEvent event = {kind, track, 0, COORDINATION_FLAG_COUNT, NULL};
+
+	callback(&event);
+}
+
+static void ReportRead(const SequencerTrack *track, size_t bytes)
+{
+	const SequencerEvent event = {SEQUENCER_EVENT_READ, track, bytes, COORDINATION_FLAG_COUNT, NULL};
+
+	callback(&event);
+}
+
+static void LoadVoice(SequencerTrack *track, unsigned int voice)
+{
+	const unsigned int pointer = ReadShort(0);
+
+	track->has_voice = false;
+
+	// Voices in other songs or the universal voice bank aren't here to load
+	if (pointer == 0 || (driver->universal_voice_bank != 0 && pointer == driver->universal_voice_bank) || ((voice & 0x80) != 0 && driver->external_voices))
+		return;
+
+	const long position = GetPointerTarget(0, driver->relative_pointers ? SONG_POINTER_SONG_RELATIVE : SONG_POINTER_ABSOLUTE) + (long)voice * VOICE_SIZE;
+
+	if (position < 0 || (size_t)position + VOICE_SIZE > size)
+		return;
+
+	memcpy(track->voice, &data[position], VOICE_SIZE);
+	track->has_voice = true;
+}
+
+static void SetNote(SequencerTrack *track, unsigned int note)
+{
+	int index = (int)note - 0x81 + track->transposition;
+
+	if (track->channel == SEQUENCER_CHANNEL_FM)
+	{
+		index = ((index % 96) + 96) % 96;
+		track->frequency = ((index / 12) << 11) | fm_frequencies[index % 12];
+	}
+	else
+	{
+		// Sonic 3 & Knuckles' PSG notes start an octave lower, which is
+		// why converting to it raises the PSG channels' transposition
+		if (driver->version >= 3)
+			index -= 12;
+
+		const int octave = (index >= 0) ? index / 12 : -((11 - index) / 12);
+		const unsigned int period = psg_periods[index - octave * 12];
+
+		// Below the first octave is below what the PSG can play
+		track->frequency = (octave >= 0) ? period >> (octave > 9 ? 9 : octave) : 0x3FF;
+	}
+}
+
+static void SetAllTempoDividers(unsigned int divider)
+{
+	for (unsigned int i = 0; i < track_count; ++i)
+		tracks[i].tempo_divider = divider;
+}
+
+static void StopTrack(SequencerTrack *track)
+{
+	track->playing = false;
+	Report(SEQUENCER_EVENT_SILENCE, track);
+}
+
+// Carries out one coordination flag, and returns false if the track stops
+static bool DoFlag(SequencerTrack *track, const SongNode *command)
+{
+	const size_t arguments = track->position + driver->coordination_flags[command->flag].size;
+	const size_t next = track->position + command->size;
+
+	long target = -1;
+
+	if (command->pointer != SONG_POINTER_NONE)
+	{
+		target = GetPointerTarget(track->position + command->pointer_offset, command->pointer);
+
+		if (target < 0 || (size_t)target >= size)
+		{
+			PrintError("Error: Pointer at $%zX points outside of the song\n", track->position + command->pointer_offset);
+			return false;
+		}
+	}
+
+	track->position = next;
+
+	switch (command->flag)
+	{
+		case COORDINATION_FLAG_PAN:
+			track->pan = (track->pan & 0x37) | data[arguments];
+			break;
+
+		case COORDINATION_FLAG_DETUNE:
+			track->detune = ReadSigned(arguments);
+			break;
+
+		case COORDINATION_FLAG_CHANGE_TRANSPOSITION:
+			track->transposition += ReadSigned(arguments);
+			break;
+
+		case COORDINATION_FLAG_FM_VOICE:
+			if (track->channel == SEQUENCER_CHANNEL_FM)
+				LoadVoice(track, data[arguments]);
+
+			break;
+
+		case COORDINATION_FLAG_ALTER_VOL:
+			track->volume += ReadSigned(arguments);
+			break;
+
+		case COORDINATION_FLAG_FM_ALTER_VOL:
+			track->volume += ReadSigned(arguments + (track->channel == SEQUENCER_CHANNEL_PSG ? 1 : 0));
+			break;
+
+		case COORDINATION_FLAG_PSG_ALTER_VOL:
+			if (track->channel == SEQUENCER_CHANNEL_PSG)
+				track->volume += ReadSigned(arguments);
+
+			break;
+
+		case COORDINATION_FLAG_SET_VOL:
+			track->volume = data[arguments];
+			break;
+
+		case COORDINATION_FLAG_PSG_FORM:
+			// PSG 3's tone drives the noise, so its volume goes to the noise channel
+			if (track->channel == SEQUENCER_CHANNEL_PSG)
+				track->noise = true;
+
+			break;
+
+		case COORDINATION_FLAG_PSG_VOICE:
+			track->envelope = data[arguments] != 0;
+			break;
+
+		case COORDINATION_FLAG_NO_ATTACK:
+			track->no_attack = true;
+			break;
+
+		case COORDINATION_FLAG_NOTE_FILL:
+		case COORDINATION_FLAG_NOTE_FILL_TIMED:
+			track->note_fill = data[arguments];
+			break;
+
+		case COORDINATION_FLAG_SET_TEMPO_MOD:
+			tempo_modifier = data[arguments];
+
+			if (driver->version == 1)
+				tempo_counter = Conv0To256(tempo_modifier);
+
+			break;
+
+		case COORDINATION_FLAG_SET_TEMPO_DIV:
+			SetAllTempoDividers(data[arguments]);
+			break;
+
+		case COORDINATION_FLAG_CHAN_TEMPO_DIV:
+			track->tempo_divider = data[arguments];
+			break;
+
+		case COORDINATION_FLAG_MOD_SET:
+			track->modulating = true;
+			track->modulation_wait = data[arguments];
+			track->modulation_speed = data[arguments + 1];
+			track->modulation_delta = ReadSigned(arguments + 2);
+			track->modulation_steps = data[arguments + 3];
+			break;
+
+		case COORDINATION_FLAG_MOD_ON:
+			track->modulating = true;
+			break;
+
+		case COORDINATION_FLAG_MOD_OFF:
+			track->modulating = false;
+			break;
+
+		case COORDINATION_FLAG_MOD_CHANGE:
+		case COORDINATION_FLAG_MOD_CHANGE_2:
+			track->modulating = data[arguments] != 0;
+			break;
+
+		case COORDINATION_FLAG_RETURN:
+			if (track->stack_depth == 0)
+			{
+				PrintError("Error: smpsReturn at $%zX has nothing to return to\n", next - command->size);
+				return false;
+			}
+
+			track->position = track->stack[--track->stack_depth];
+			break;
+
+		case COORDINATION_FLAG_JUMP:
+		case COORDINATION_FLAG_CONTINUOUS_LOOP:
+			track->position = target;
+			break;
+
+		case COORDINATION_FLAG_CALL:
+			if (track->stack_depth == SEQUENCER_MAX_CALL_DEPTH)
+			{
+				PrintError("Error: smpsCall at $%zX is nested more than %u deep\n", next - command->size, SEQUENCER_MAX_CALL_DEPTH);
+				return false;
+			}
+
+			track->stack[track->stack_depth++] = next;
+			track->position = target;
+			break;
+
+		case COORDINATION_FLAG_LOOP:
+		{
+			unsigned char *counter = &track->loop_counters[data[arguments]];
+
+			if (*counter == 0)
+				*counter = data[arguments + 1];
+
+			if (--*counter != 0)
+				track->position = target;
+
+			break;
+		}
+
+		// Whatever it depends on is outside of the song, so it's assumed not to happen
+		case COORDINATION_FLAG_CONDITIONAL_JUMP:
+			break;
+
+		default:
+			if (coordination_flag_layouts[command->flag].flow == FLOW_STOP)
+			{
+				StopTrack(track);
+				return false;
+			}
+
+			break;
+	}
+
+	const SequencerEvent event = {SEQUENCER_EVENT_FLAG, track, 0, command->flag, &data[arguments]};
+
+	callback(&event);
+
+	return true;
+}
+
+// Reads commands up to the next note, the way the driver does when a note runs out, and starts it
+static void ReadNote(SequencerTrack *track)
+{
+	Report(SEQUENCER_EVENT_UPDATE, track);
+
+	for (unsigned long commands = 0; ; ++commands)
+	{
+		SongNode command;
+
+		if (commands == MAX_COMMANDS_PER_NOTE)
+		{
+			PrintError("Error: Track at $%zX never reaches a note, which would hang the driver\n", track->position);
+			track->playing = false;
+			return;
+		}
+
+		if (track->position >= size)
+		{
+			PrintError("Error: Track at $%zX runs off the end of the data\n", track->position);
+			track->playing = false;
+			return;
+		}
+
+		if (!Song_DecodeCommand(driver, &data[track->position], size - track->position, &command))
+		{
+			PrintError("Error: Unknown coordination flag $%02X at $%zX\n", data[track->position], track->position);
+			track->playing = false;
+			return;
+		}
+
+		ReportRead(track, command.size);
+
+		if (command.kind == SONG_NODE_FLAG)
+		{
+			if (!DoFlag(track, &command))
+			{
+				track->playing = false;
+				return;
+			}
+		}
+		else
+		{
+			if (command.kind == SONG_NODE_NOTE)
+			{
+				const unsigned int note = data[track->position++];
+
+				track->resting = note == 0x80;
+
+				if (!track->resting && track->channel != SEQUENCER_CHANNEL_DAC)
+					SetNote(track, note);
+
+				// Notes can be followed by their duration
+				if (track->position < size && data[track->position] < 0x80)
+				{
+					ReportRead(track, 1);
+					track->duration = data[track->position++];
+				}
+			}
+			else
+			{
+				track->duration = data[track->position++];
+			}
+
+			break;
+		}
+	}
+
+	track->timeout = Conv0To256((track->duration * track->tempo_divider) & 0xFF);
+	track->fill_timeout = track->note_fill;
+
+	if (!track->no_attack)
+	{
+		track->wait_timeout = track->modulation_wait;
+		track->speed_timeout = Conv0To256(track->modulation_speed);
+		track->steps_timeout = Conv0To256(track->modulation_steps / 2);
+		track->delta = track->modulation_delta;
+		track->modulation = 0;
+	}
+
+	Report(SEQUENCER_EVENT_NOTE, track);
+
+	track->no_attack = false;
+}
+
+// What happens every frame that a note plays, even when the tempo holds the
+// tracks back. Modulation moves the note's frequency up and down by 'delta'
+// every 'speed' frames, turning round every 'steps' of them.
+static void UpdateEffects(SequencerTrack *track)
+{
+	if (track->resting)
+		return;
+
+	if (track->envelope)
+		Report(SEQUENCER_EVENT_ENVELOPE, track);
+
+	if (!track->modulating)
+		return;
+
+	if (track->wait_timeout != 0)
+	{
+		--track->wait_timeout;
+		return;
+	}
+
+	if (--track->speed_timeout != 0)
+		return;
+
+	track->speed_timeout = Conv0To256(track->modulation_speed);
+	track->modulation += track->delta;
+
+	if (--track->steps_timeout == 0)
+	{
+		track->steps_timeout = Conv0To256(track->modulation_steps);
+		track->delta = -track->delta;
+	}
+
+	Report(SEQUENCER_EVENT_MODULATE, track);
+}
+
+// Whether the tracks' notes count down this frame. Sonic 1 holds them back
+// for a frame each time its tempo timeout runs out, Sonic 2 lets them count
+// down each time its accumulator overflows, and Sonic 3 & Knuckles holds
+// them back each time instead, which is why the conversions between them
+// invert the tempo.
+static bool AdvanceTempo(void)
+{
+	if (sfx)
+		return true;
+
+	if (driver->version == 1)
+	{
+		if (--tempo_counter != 0)
+			return true;
+
+		tempo_counter = Conv0To256(tempo_modifier);
+		return false;
+	}
+
+	tempo_counter += tempo_modifier;
+
+	const bool overflowed = tempo_counter > 0xFF;
+
+	tempo_counter &= 0xFF;
+
+	return (driver->version == 2) ? overflowed : !overflowed;
+}
+
+static bool FindTracks(void)
+{
+	// Music's FM channels go in this order, after the DAC
+	static const unsigned char fm_ids[6] = {0, 1, 2, 4, 5, 6};
+
+	const SongPointer pointer = driver->relative_pointers ? SONG_POINTER_SONG_RELATIVE : SONG_POINTER_ABSOLUTE;
+
+	if (size < (sfx ? SFX_HEADER_SIZE : MUSIC_HEADER_SIZE))
+	{
+		PrintError("Error: $%zX bytes is too small for a header\n", size);
+		return false;
+	}
+
+	track_count = sfx ? data[3] : data[2] + data[3];
+
+	if (size < (sfx ? SFX_HEADER_SIZE + (size_t)track_count * SFX_CHANNEL_SIZE : MUSIC_HEADER_SIZE + (size_t)data[2] * 4 + (size_t)data[3] * 6))
+	{
+		PrintError("Error: The header lists more channels than there is room for\n");
+		return false;
+	}
+
+	if (!sfx && (data[2] > 7 || data[3] > 3))
+	{
+		PrintError("Error: The header lists more channels than the sound chips have\n");
+		return false;
+	}
+
+	tracks = calloc(track_count, sizeof(*tracks));
+
+	for (unsigned int i = 0; i < track_count; ++i)
+	{
+		// Each channel's entry has its transposition and volume after its pointer
+		const size_t site = sfx ? SFX_HEADER_SIZE + i * SFX_CHANNEL_SIZE + 2 : MUSIC_HEADER_SIZE + ((i < data[2]) ? i * 4 : data[2] * 4 + (i - data[2]) * 6);
+		const long target = GetPointerTarget(site, pointer);
+		SequencerTrack *track = &tracks[i];
+
+		if (target < 0 || (size_t)target >= size)
+		{
+			PrintError("Error: Channel pointer at $%zX points outside of the song\n", site);
+			return false;
+		}
+
+		if (sfx)
+		{
+			track->channel = (data[site - 1] & 0x80) ? SEQUENCER_CHANNEL_PSG : SEQUENCER_CHANNEL_FM;
+			track->id = (track->channel == SEQUENCER_CHANNEL_PSG) ? data[site - 1] & 0xE0 : data[site - 1] & 7;
+		}
+		else if (i == 0)
+		{
+			track->channel = SEQUENCER_CHANNEL_DAC;
+		}
+		else if (i < data[2])
+		{
+			track->channel = SEQUENCER_CHANNEL_FM;
+			track->id = fm_ids[i - 1];
+		}
+		else
+		{
+			track->channel = SEQUENCER_CHANNEL_PSG;
+			track->id = 0x80 + (i - data[2]) * 0x20;
+		}
+
+		track->playing = true;
+		track->position = target;
+		track->timeout = 1;
+		track->tempo_divider = data[sfx ? 2 : 4];
+		track->resting = true;
+		track->transposition = ReadSigned(site + 2);
+		track->volume = ReadSigned(site + 3);
+		track->pan = 0xC0;
+		track->envelope = !sfx && track->channel == SEQUENCER_CHANNEL_PSG && data[site + 5] != 0;
+	}
+
+	if (!sfx)
+	{
+		tempo_modifier = data[5];
+		tempo_counter = (driver->version == 1) ? Conv0To256(tempo_modifier) : 0;
+	}
+
+	return true;
+}
+
+// Gets ready to play a compiled song the way its driver would, reporting
+// everything that the driver does to 'callback'. 'offset' is where it was
+// assembled to. Returns false if the song can't be played.
+bool Sequencer_Start(const unsigned char *p_data, size_t p_size, unsigned int driver_version, size_t p_offset, bool p_sfx, void (*p_callback)(const SequencerEvent *event))
+{
+	data = p_data;
+	size = p_size;
+	driver = GetDriver(driver_version);
+	offset = p_offset;
+	sfx = p_sfx;
+	callback = p_callback;
+	tracks = NULL;
+	track_count = 0;
+
+	if (driver == NULL)
+	{
+		PrintError("Error: Unsupported driver version %u\n", driver_version);
+		return false;
+	}
+
+	return FindTracks();
+}
+
+// Plays one frame, and returns whether any track is still playing
+bool Sequencer_PlayFrame(void)
+{
+	const bool advance = AdvanceTempo();
+	bool playing = false;
+
+	for (unsigned int i = 0; i < track_count; ++i)
+	{
+		SequencerTrack *track = &tracks[i];
+
+		if (!track->playing)
+			continue;
+
+		if (advance)
+		{
+			if (--track->timeout == 0)
+				ReadNote(track);
+			else if (track->fill_timeout != 0 && --track->fill_timeout == 0 && !track->resting)
+			{
+				// Note fill cuts the note off early, as though it were a rest
+				Report(SEQUENCER_EVENT_SILENCE, track);
+				track->resting = true;
+			}
+		}
+
+		if (track->playing)
+		{
+			UpdateEffects(track);
+			playing = true;
+		}
+	}
+
+	return playing;
+}
+
+void Sequencer_Stop(void)
+{
+	free(tracks);
+	tracks = NULL;
+	track_count = 0;
+}
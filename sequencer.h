@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "driver.h"
+#include "voice.h"
+
+#define SEQUENCER_MAX_CALL_DEPTH 0x10
+
+typedef enum SequencerChannel
+{
+	SEQUENCER_CHANNEL_DAC,
+	SEQUENCER_CHANNEL_FM,
+	SEQUENCER_CHANNEL_PSG
+} SequencerChannel;
+
+// One track, as the driver keeps it in RAM
+typedef struct SequencerTrack
+{
+	SequencerChannel channel;
+	unsigned int id;		// What the driver calls the channel: 0-2 and 4-6 for FM, and $80, $A0 and $C0 for PSG
+	bool playing;
+	size_t position;
+	unsigned int timeout;		// Ticks until the note runs out
+	unsigned int duration;		// Of the last note, for notes that don't give their own
+	unsigned int tempo_divider;
+	bool resting;
+	bool no_attack;
+	unsigned int note_fill;
+	unsigned int fill_timeout;
+	int transposition;
+	int volume;			// Added to the carriers' total levels, or to the PSG's attenuation
+	int detune;
+	unsigned int frequency;		// Block and F-number, or PSG period, before detune and modulation
+	unsigned int pan;		// AMS, FMS and panning, as written to $B4
+	unsigned char voice[VOICE_SIZE];
+	bool has_voice;			// Whether 'voice' holds the current voice, which may be outside of the song
+	bool noise;			// PSG 3 is driving the noise channel, and its volume goes there instead
+	bool envelope;			// PSG volume envelope, which is written every frame
+	bool modulating;
+	unsigned int modulation_wait;
+	unsigned int modulation_speed;
+	int modulation_delta;
+	unsigned int modulation_steps;
+	unsigned int wait_timeout;
+	unsigned int speed_timeout;
+	unsigned int steps_timeout;
+	int delta;
+	int modulation;
+
+	size_t stack[SEQUENCER_MAX_CALL_DEPTH];
+	unsigned int stack_depth;
+	unsigned char loop_counters[0x100];
+} SequencerTrack;
+
+typedef enum SequencerEventKind
+{
+	SEQUENCER_EVENT_UPDATE,		// The track's note ran out, so it's reading commands up to the next one
+	SEQUENCER_EVENT_READ,		// It read 'bytes' bytes of track data
+	SEQUENCER_EVENT_FLAG,		// It carried out 'flag', after updating itself to match
+	SEQUENCER_EVENT_NOTE,		// A note or rest starts, and 'no_attack' says whether it's tied
+	SEQUENCER_EVENT_SILENCE,	// Note fill cut the note off, or the track stopped
+	SEQUENCER_EVENT_ENVELOPE,	// The PSG volume envelope moves on, which it does every frame
+	SEQUENCER_EVENT_MODULATE	// Modulation moved the note's frequency
+} SequencerEventKind;
+
+typedef struct SequencerEvent
+{
+	SequencerEventKind kind;
+	const SequencerTrack *track;
+	size_t bytes;			// For SEQUENCER_EVENT_READ
+	CoordinationFlag flag;		// For SEQUENCER_EVENT_FLAG
+	const unsigned char *arguments;	// For SEQUENCER_EVENT_FLAG
+} SequencerEvent;
+
+bool Sequencer_Start(const unsigned char *data, size_t size, unsigned int driver_version, size_t offset, bool sfx, void (*callback)(const SequencerEvent *event));
+bool Sequencer_PlayFrame(void);
+void Sequencer_Stop(void);
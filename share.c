@@ -0,0 +1,393 @@
+#include "share.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver.h"
+#include "error.h"
+#include "instruction.h"
+#include "memory_stream.h"
+#include "object.h"
+#include "voice.h"
+
+// smpsFMvoice indices with bit 7 set mean something else in Sonic 3's driver
+#define MAX_SHARED_VOICES 0x80
+
+typedef struct Song
+{
+	size_t start;
+	size_t voice_pointer;	// Position of smpsHeaderVoice's pointer
+	size_t voices;		// Position of the first voice that it points to
+	bool has_voices;
+	bool shareable;		// Whether all of its smpsFMvoice flags can be redirected to the shared voices
+} Song;
+
+// A block of voices that follow each other, as written by smpsVcTotalLevel
+typedef struct VoiceRun
+{
+	size_t start;
+	size_t end;
+	bool referenced;	// By a song that is being redirected
+	bool removable;
+} VoiceRun;
+
+static Song *songs;
+static size_t song_count;
+
+static VoiceRun *runs;
+static size_t run_count;
+
+static size_t *voices;
+static size_t voice_count;
+
+static unsigned int ReadAddress(const Object *object, size_t position)
+{
+	return object->data[position] | (object->data[position + 1] << 8);
+}
+
+static void WriteAddress(unsigned char *data, size_t position, unsigned int address)
+{
+	data[position + 0] = address & 0xFF;
+	data[position + 1] = (address >> 8) & 0xFF;
+}
+
+static bool IsVoice(size_t position)
+{
+	size_t low = 0, high = voice_count;
+
+	while (low < high)
+	{
+		const size_t middle = low + (high - low) / 2;
+
+		if (voices[middle] < position)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low < voice_count && voices[low] == position;
+}
+
+static VoiceRun* FindRun(size_t position)
+{
+	for (size_t i = 0; i < run_count; ++i)
+		if (position >= runs[i].start && position < runs[i].end)
+			return &runs[i];
+
+	return NULL;
+}
+
+static Song* FindSong(size_t position)
+{
+	Song *song = NULL;
+
+	for (size_t i = 0; i < song_count && songs[i].start <= position; ++i)
+		song = &songs[i];
+
+	return song;
+}
+
+static bool IsRemoved(size_t position)
+{
+	const VoiceRun *run = FindRun(position);
+
+	return run != NULL && run->removable;
+}
+
+// Where a position ends up once the removable runs are gone
+static size_t MapPosition(size_t position)
+{
+	size_t mapped = position;
+
+	for (size_t i = 0; i < run_count && runs[i].start < position; ++i)
+		if (runs[i].removable)
+			mapped -= ((position < runs[i].end) ? position : runs[i].end) - runs[i].start;
+
+	return mapped;
+}
+
+static bool IsVoicePointer(size_t position)
+{
+	for (size_t i = 0; i < song_count; ++i)
+		if (songs[i].has_voices && songs[i].voice_pointer == position)
+			return true;
+
+	return false;
+}
+
+static void Cleanup(void)
+{
+	free(songs);
+	free(runs);
+	free(voices);
+	songs = NULL;
+	runs = NULL;
+	voices = NULL;
+	song_count = run_count = voice_count = 0;
+}
+
+// Stores every distinct voice that the object's songs use once, points the
+// songs' headers at that table, and renumbers their smpsFMvoice flags to
+// match. The songs' own copies are removed when nothing else refers to
+// them. The table is appended to the object, or written to
+// 'universal_voice_bank' for the driver to provide instead.
+bool ShareVoices(Object *object, MemoryStream *universal_voice_bank)
+{
+	error = false;
+
+	const Driver *driver = GetDriver(object->driver);
+
+	if (universal_voice_bank != NULL && (driver == NULL || driver->universal_voice_bank == 0))
+	{
+		PrintError("Error: Driver %u has no universal voice bank\n", object->driver);
+		return false;
+	}
+
+	// Sort out the markers
+	size_t select_count = 0;
+
+	songs = malloc(sizeof(*songs) * (object->marker_count + 1));
+	voices = malloc(sizeof(*voices) * (object->marker_count + 1));
+
+	for (size_t i = 0; i < object->marker_count; ++i)
+	{
+		const ObjectMarker *marker = &object->markers[i];
+
+		switch (marker->kind)
+		{
+			case MARKER_SONG:
+				songs[song_count].start = marker->position;
+				songs[song_count].has_voices = false;
+				songs[song_count].shareable = false;
+				++song_count;
+				break;
+
+			case MARKER_VOICE:
+				voices[voice_count++] = marker->position;
+				break;
+
+			case MARKER_VOICE_SELECT:
+				++select_count;
+				break;
+
+			case MARKER_EXTERNAL_VOICE_SELECT:
+				PrintError("Error: Voices can't be shared while songs use each other's voices through smpsFMvoice\n");
+				break;
+
+			case MARKER_VOICE_POINTER:
+			case MARKER_CHANNEL_POINTER:
+				break;
+		}
+	}
+
+	if (error)
+	{
+		Cleanup();
+		return false;
+	}
+
+	// Group the voices into runs
+	runs = malloc(sizeof(*runs) * (voice_count + 1));
+
+	for (size_t i = 0; i < voice_count; ++i)
+	{
+		if (run_count != 0 && runs[run_count - 1].end == voices[i])
+		{
+			runs[run_count - 1].end += VOICE_SIZE;
+		}
+		else
+		{
+			runs[run_count].start = voices[i];
+			runs[run_count].end = voices[i] + VOICE_SIZE;
+			runs[run_count].referenced = false;
+			runs[run_count].removable = true;
+			++run_count;
+		}
+	}
+
+	// Find each song's voices
+	for (size_t i = 0; i < object->marker_count; ++i)
+	{
+		const ObjectMarker *marker = &object->markers[i];
+		Song *song = FindSong(marker->position);
+
+		if (marker->kind == MARKER_VOICE_POINTER && song != NULL)
+		{
+			const size_t voices_position = ReadAddress(object, marker->position) - object->offset;
+
+			song->voice_pointer = marker->position;
+			song->voices = voices_position;
+			song->has_voices = true;
+			song->shareable = IsVoice(voices_position);
+		}
+	}
+
+	// Songs can only be redirected if every voice that they use is known
+	for (size_t i = 0; i < object->marker_count; ++i)
+	{
+		const ObjectMarker *marker = &object->markers[i];
+		Song *song = FindSong(marker->position);
+
+		if (marker->kind == MARKER_VOICE_SELECT && song != NULL && song->shareable)
+			song->shareable = IsVoice(song->voices + object->data[marker->position] * VOICE_SIZE);
+	}
+
+	// Voices can only be removed if nothing but redirected songs refer to them
+	for (size_t i = 0; i < song_count; ++i)
+	{
+		if (songs[i].has_voices)
+		{
+			VoiceRun *run = FindRun(songs[i].voices);
+
+			if (run != NULL)
+			{
+				if (songs[i].shareable)
+					run->referenced = true;
+				else
+					run->removable = false;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < object->relocation_count; ++i)
+	{
+		if (!IsVoicePointer(object->relocations[i]))
+		{
+			VoiceRun *run = FindRun(ReadAddress(object, object->relocations[i]) - object->offset);
+
+			if (run != NULL)
+				run->removable = false;
+		}
+	}
+
+	for (size_t i = 0; i < run_count; ++i)
+		if (!runs[i].referenced)
+			runs[i].removable = false;
+
+	// Gather the distinct voices, and renumber the smpsFMvoice flags
+	unsigned char *shared_voices = malloc(MAX_SHARED_VOICES * VOICE_SIZE);
+	size_t shared_voice_count = 0;
+
+	size_t *selects = malloc(sizeof(*selects) * (select_count + 1));
+	unsigned char *shared_indices = malloc(select_count + 1);
+	select_count = 0;
+
+	for (size_t i = 0; i < object->marker_count && !error; ++i)
+	{
+		const ObjectMarker *marker = &object->markers[i];
+		const Song *song = FindSong(marker->position);
+
+		if (marker->kind == MARKER_VOICE_SELECT && song != NULL && song->shareable)
+		{
+			const unsigned char *voice = &object->data[song->voices + object->data[marker->position] * VOICE_SIZE];
+			size_t shared_index = 0;
+
+			while (shared_index < shared_voice_count && memcmp(&shared_voices[shared_index * VOICE_SIZE], voice, VOICE_SIZE) != 0)
+				++shared_index;
+
+			if (shared_index == shared_voice_count)
+			{
+				if (shared_voice_count == MAX_SHARED_VOICES)
+				{
+					PrintError("Error: The songs use more than %u different voices, which is too many to share\n", MAX_SHARED_VOICES);
+					break;
+				}
+
+				memcpy(&shared_voices[shared_voice_count++ * VOICE_SIZE], voice, VOICE_SIZE);
+			}
+
+			selects[select_count] = marker->position;
+			shared_indices[select_count] = shared_index;
+			++select_count;
+		}
+	}
+
+	if (!error)
+	{
+		// Rebuild the object without the removed voices
+		Object *shared = Object_Create(object->driver, object->offset);
+
+		const size_t kept_size = MapPosition(object->size);
+		const size_t table_position = kept_size;
+		const unsigned int table_address = (universal_voice_bank != NULL) ? driver->universal_voice_bank : object->offset + table_position;
+		const size_t shared_size = kept_size + ((universal_voice_bank != NULL) ? 0 : shared_voice_count * VOICE_SIZE);
+
+		unsigned char *data = malloc(shared_size + 1);
+
+		for (size_t i = 0; i < object->size; ++i)
+			if (!IsRemoved(i))
+				data[MapPosition(i)] = object->data[i];
+
+		for (size_t i = 0; i < select_count; ++i)
+			data[MapPosition(selects[i])] = shared_indices[i];
+
+		for (size_t i = 0; i < object->relocation_count; ++i)
+		{
+			const size_t position = object->relocations[i];
+			const Song *song = FindSong(position);
+
+			if (song != NULL && song->shareable && song->voice_pointer == position)
+			{
+				WriteAddress(data, MapPosition(position), table_address);
+
+				// The universal voice bank stays put
+				if (universal_voice_bank == NULL)
+					Object_AddRelocation(shared, MapPosition(position));
+			}
+			else
+			{
+				const size_t target = ReadAddress(object, position) - object->offset;
+
+				if (target <= object->size)
+					WriteAddress(data, MapPosition(position), object->offset + MapPosition(target));
+
+				Object_AddRelocation(shared, MapPosition(position));
+			}
+		}
+
+		for (size_t i = 0; i < object->export_count; ++i)
+			if (!IsRemoved(object->exports[i].position))
+				Object_AddExport(shared, object->exports[i].name, MapPosition(object->exports[i].position));
+
+		for (size_t i = 0; i < object->import_count; ++i)
+			Object_AddImport(shared, object->imports[i]);
+
+		for (size_t i = 0; i < object->fixup_count; ++i)
+			Object_AddFixup(shared, MapPosition(object->fixups[i].position), object->fixups[i].import, object->fixups[i].addend);
+
+		for (size_t i = 0; i < object->marker_count; ++i)
+			if (!IsRemoved(object->markers[i].position))
+				Object_AddMarker(shared, object->markers[i].kind, MapPosition(object->markers[i].position));
+
+		// Put the shared voices in place
+		if (universal_voice_bank != NULL)
+		{
+			MemoryStream_WriteBytes(universal_voice_bank, shared_voices, shared_voice_count * VOICE_SIZE);
+		}
+		else
+		{
+			memcpy(&data[table_position], shared_voices, shared_voice_count * VOICE_SIZE);
+
+			for (size_t i = 0; i < shared_voice_count; ++i)
+				Object_AddMarker(shared, MARKER_VOICE, table_position + i * VOICE_SIZE);
+		}
+
+		Object_SetData(shared, data, shared_size);
+		free(data);
+
+		// Swap the rebuilt object into place
+		const Object original = *object;
+		*object = *shared;
+		*shared = original;
+		Object_Destroy(shared);
+	}
+
+	free(shared_voices);
+	free(selects);
+	free(shared_indices);
+	Cleanup();
+
+	return !error;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "memory_stream.h"
+#include "object.h"
+
+bool ShareVoices(Object *object, MemoryStream *universal_voice_bank);
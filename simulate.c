@@ -0,0 +1,148 @@
+#include "simulate.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "driver.h"
+#include "error.h"
+#include "sequencer.h"
+
+// Registers that each event writes. Voices are written in full: feedback and
+// algorithm, five registers for each of the four operators, and then the
+// total levels and panning. Volume changes only rewrite the carriers' total
+// levels.
+#define FM_VOICE_WRITES 26
+#define FM_FREQUENCY_WRITES 2
+#define FM_KEY_WRITES 1
+#define PSG_TONE_WRITES 2
+#define PSG_VOLUME_WRITES 1
+
+static SimulatedFrame *frame;
+
+// How many operators of the track's voice output sound, which are the ones
+// that volume changes rewrite. Voices that aren't in the song could be anything.
+static unsigned int GetCarrierCount(const SequencerTrack *track)
+{
+	static const unsigned char carrier_counts[8] = {1, 1, 1, 1, 2, 3, 3, 4};
+
+	return track->has_voice ? carrier_counts[track->voice[0] & 7] : 4;
+}
+
+static void AddWrites(const SequencerTrack *track, unsigned int ym2612_writes, unsigned int psg_writes)
+{
+	if (track->channel == SEQUENCER_CHANNEL_FM)
+		frame->ym2612_writes += ym2612_writes;
+	else if (track->channel == SEQUENCER_CHANNEL_PSG)
+		frame->psg_writes += psg_writes;
+}
+
+static void CountFlag(const SequencerTrack *track, CoordinationFlag flag)
+{
+	switch (flag)
+	{
+		case COORDINATION_FLAG_PAN:
+		case COORDINATION_FLAG_FMI_COMMAND:
+		case COORDINATION_FLAG_CHAN_FM_COMMAND:
+		case COORDINATION_FLAG_FM3_SPECIAL_MODE:
+			AddWrites(track, 1, 0);
+			break;
+
+		case COORDINATION_FLAG_SET_LFO:
+			AddWrites(track, 2, 0);
+			break;
+
+		case COORDINATION_FLAG_SSG_EG:
+			AddWrites(track, 4, 0);
+			break;
+
+		case COORDINATION_FLAG_FM_VOICE:
+			AddWrites(track, FM_VOICE_WRITES, 0);
+			break;
+
+		case COORDINATION_FLAG_ALTER_VOL:
+		case COORDINATION_FLAG_FM_ALTER_VOL:
+		case COORDINATION_FLAG_SET_VOL:
+			AddWrites(track, GetCarrierCount(track), 0);
+			break;
+
+		case COORDINATION_FLAG_PSG_FORM:
+			AddWrites(track, 0, PSG_VOLUME_WRITES + 1);
+			break;
+
+		default:
+			break;
+	}
+}
+
+// Counts what each thing that the driver does costs
+static void CountEvent(const SequencerEvent *event)
+{
+	const SequencerTrack *track = event->track;
+
+	switch (event->kind)
+	{
+		case SEQUENCER_EVENT_UPDATE:
+			++frame->tracks;
+			break;
+
+		case SEQUENCER_EVENT_READ:
+			frame->bytes += event->bytes;
+			break;
+
+		case SEQUENCER_EVENT_FLAG:
+			CountFlag(track, event->flag);
+			break;
+
+		case SEQUENCER_EVENT_NOTE:
+			if (!track->no_attack)
+				AddWrites(track, FM_KEY_WRITES, 0);
+
+			if (track->resting)
+				AddWrites(track, 0, PSG_VOLUME_WRITES);
+			else
+				AddWrites(track, FM_FREQUENCY_WRITES + (track->no_attack ? 0 : FM_KEY_WRITES), PSG_TONE_WRITES + PSG_VOLUME_WRITES);
+
+			break;
+
+		case SEQUENCER_EVENT_SILENCE:
+			if (!track->resting)
+				AddWrites(track, FM_KEY_WRITES, PSG_VOLUME_WRITES);
+
+			break;
+
+		case SEQUENCER_EVENT_ENVELOPE:
+			AddWrites(track, 0, PSG_VOLUME_WRITES);
+			break;
+
+		case SEQUENCER_EVENT_MODULATE:
+			AddWrites(track, FM_FREQUENCY_WRITES, PSG_TONE_WRITES);
+			break;
+	}
+}
+
+// Plays a compiled song the way its driver would, and fills in what each
+// frame costs, until every track stops or 'frame_count' frames have gone by.
+// 'offset' is where it was assembled to. Returns how many frames were played.
+size_t Simulate(const unsigned char *data, size_t size, unsigned int driver_version, size_t offset, bool sfx, SimulatedFrame *frames, size_t frame_count)
+{
+	error = false;
+
+	size_t frame_index = 0;
+
+	if (Sequencer_Start(data, size, driver_version, offset, sfx, CountEvent))
+	{
+		bool playing = true;
+
+		for (; frame_index < frame_count && playing && !error; ++frame_index)
+		{
+			frame = &frames[frame_index];
+			memset(frame, 0, sizeof(*frame));
+			playing = Sequencer_PlayFrame();
+		}
+	}
+
+	Sequencer_Stop();
+
+	return error ? 0 : frame_index;
+}
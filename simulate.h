@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// What the driver did during one frame of a song
+typedef struct SimulatedFrame
+{
+	unsigned int tracks;		// Tracks whose note ran out, and so read more commands
+	unsigned int bytes;		// Bytes of track data read
+	unsigned int ym2612_writes;
+	unsigned int psg_writes;
+} SimulatedFrame;
+
+size_t Simulate(const unsigned char *data, size_t size, unsigned int driver_version, size_t offset, bool sfx, SimulatedFrame *frames, size_t frame_count);
@@ -10,114 +10,172 @@
 #include "dictionary.h"
 #include "error.h"
 #include "instruction.h"
+#include "ir.h"
 #include "memory_stream.h"
 
 typedef struct DelayedInstruction
 {
 	struct DelayedInstruction *next;
 
-	char *instruction;
-	unsigned int arg_count;
-	char **arg_array;
+	const IRLine *line;
 	size_t output_position;
 } DelayedInstruction;
 
 static DelayedInstruction *delayed_instruction_list_head;
 
-static void ParseLine(char *line)
+unsigned long current_line;
+void (*line_callback)(unsigned long line, size_t output_position, size_t size);
+void (*import_callback)(const char *symbol);
+
+static void AssembleInstruction(const IR *ir, const IRLine *line)
 {
-	// Remove comments
-	char *comment_start = strchr(line, ';');
-	if (comment_start)
-		*comment_start = '\0';
+	long *int_arg_array = malloc(sizeof(long) * (line->argument_count + 1));
 
-	// Look for a label
-	const size_t size_of_label = strcspn(line, " \t:");
-	size_t size_of_whitespace = strspn(line + size_of_label, " \t:");
+	symbol_arguments = 0;
 
-	if (size_of_label != 0)
+	// Convert arguments from symbols to numbers (*everything* resolves to a number eventually - code, labels, constants, etc.)
+	for (unsigned int i = 0; i < line->argument_count; ++i)
 	{
-		// We found a label!
-		line[size_of_label] = '\0';
-		HandleLabel(line);
+		const IRArgument *argument = &ir->arguments[line->first_argument + i];
+
+		if (argument->is_literal)
+			int_arg_array[i] = argument->value;
+		else
+		{
+			int_arg_array[i] = LookupDictionaryHashed(ir->strings + argument->name, argument->hash);
+
+			if (i < sizeof(symbol_arguments) * 8)
+				symbol_arguments |= 1UL << i;
+		}
 	}
 
-	line += size_of_label + size_of_whitespace;
+	if (line->instruction_index != -1)
+		ExecuteInstruction(line->instruction_index, line->argument_count, int_arg_array);
+	else
+		PrintError("Error: Unhandled instruction: '%s'\n", ir->strings + line->instruction);	// Oh no
+
+	free(int_arg_array);
+}
+
+bool SMPS2ASM2BIN_IR(const IR *ir, MemoryStream *p_output_stream, unsigned int p_target_driver, size_t p_file_offset)
+{
+	bool success = false;
+
+	output_stream = p_output_stream;
+	file_offset = p_file_offset;
 
-	// Look for an instruction
-	const size_t size_of_instruction = strcspn(line, " \t");
+	error = false;
 
-	if (size_of_instruction != 0)
+	if (!SetTargetDriver(p_target_driver))
 	{
-		size_t size_of_whitespace = strspn(line + size_of_instruction, " \t");
+		PrintError("Error: Unsupported driver version %u\n", p_target_driver);
+		return false;
+	}
 
-		// We found an instruction!
-		line[size_of_instruction] = '\0';
-		char *instruction = line;
+	FillDefaultDictionary();
 
-		// Look for the instruction's arguments
-		line += size_of_instruction + size_of_whitespace;
+	// Assigning addresses has to be done in order, as labels depend on the output position
+	for (size_t i = 0; i < ir->line_count; ++i)
+	{
+		const IRLine *line = &ir->lines[i];
 
-		unsigned int arg_count = 0;
-		char **arg_array = NULL;
+		current_line = line->line;
 
-		for (;;)
-		{
-			const size_t size_of_arg = strcspn(line, " \t,");
-			const size_t size_of_whitespace = strspn(line + size_of_arg, " \t,");
-			const bool is_last_arg = strchr(line, ',') == NULL;
+		if (line->label != IR_NONE)
+			HandleLabel(ir->strings + line->label, line->label_hash);
 
-			if (size_of_arg != 0)
-			{
-				// We found an argument!
-				line[size_of_arg] = '\0';
-				arg_array = realloc(arg_array, sizeof(*arg_array) * (arg_count + 1));
-				arg_array[arg_count++] = line;
+		if (line->instruction != IR_NONE)
+		{
+			const size_t output_position = MemoryStream_GetPosition(output_stream);
 
-				if (is_last_arg)
-					break;
+			undefined_symbol = NULL;
+			AssembleInstruction(ir, line);
 
-				line += size_of_arg + size_of_whitespace;
+			if (undefined_symbol != NULL)
+			{
+				// Instructions that reference undefined symbols can't be
+				// fully-outputted yet, so stick them in a list for later
+				DelayedInstruction *delayed_instruction = malloc(sizeof(*delayed_instruction));
+				delayed_instruction->next = delayed_instruction_list_head;
+				delayed_instruction_list_head = delayed_instruction;
+
+				delayed_instruction->line = line;
+				delayed_instruction->output_position = output_position;
 			}
-			else
-				break;
 
+			if (line_callback != NULL)
+				line_callback(current_line, output_position, MemoryStream_GetPosition(output_stream) - output_position);
 		}
 
-		const size_t output_position = MemoryStream_GetPosition(output_stream);
+		if (error)
+			goto fail;
+	}
 
-		// Now that we've gathered-up the instruction and arguments in a nice format
-		// that we can process, pass them to the function that actually parses them
-		undefined_symbol = NULL;
-		HandleInstruction(instruction, arg_count, arg_array);
+	// Once the entire file is processed, finish any instructions that had to be delayed because of undefined symbols
+	unsigned int import_count = 0;
 
-		if (undefined_symbol != NULL)
-		{
-			// Instructions that reference undefined symbols can't be
-			// fully-outputted yet, so stick them in a list for later
-			DelayedInstruction *delayed_instruction = malloc(sizeof(*delayed_instruction));
-			delayed_instruction->next = delayed_instruction_list_head;
-			delayed_instruction_list_head = delayed_instruction;
-
-			delayed_instruction->instruction = instruction;
-			delayed_instruction->arg_count = arg_count;
-			delayed_instruction->arg_array = arg_array;
-			delayed_instruction->output_position = output_position;
-		}
-		else
+	for (DelayedInstruction *instruction = delayed_instruction_list_head; instruction != NULL; instruction = instruction->next)
+	{
+		current_line = instruction->line->line;
+
+		for (;;)
 		{
-			free(arg_array);
+			undefined_symbol = NULL;
+			MemoryStream_SetPosition(output_stream, instruction->output_position, MEMORYSTREAM_START);
+			AssembleInstruction(ir, instruction->line);
+
+			// When making an object, anything still undefined is assumed to belong to another song
+			if (undefined_symbol == NULL || import_callback == NULL || import_count == MAX_IMPORTS || error)
+				break;
+
+			AddDictionaryEntry(undefined_symbol, GetImportPlaceholder(import_count++));
+			import_callback(undefined_symbol);
 		}
+
+		if (undefined_symbol != NULL)
+			PrintError("Error: symbol '%s' undefined\n", undefined_symbol);
+
+		if (error)
+			goto fail;
+	}
+
+	success = true;
+
+	fail:;
+
+	// Delete the list of delayed instructions
+	DelayedInstruction *entry = delayed_instruction_list_head;
+	while (entry != NULL)
+	{
+		DelayedInstruction *next_entry = entry->next;
+		free(entry);
+		entry = next_entry;
 	}
+
+	delayed_instruction_list_head = NULL;
+
+	ClearDictionary();
+
+	return success;
 }
 
-bool SMPS2ASM2BIN(const char *file_name, MemoryStream *p_output_stream, unsigned int p_target_driver, size_t p_file_offset)
+bool SMPS2ASM2BIN_Buffer(const char *buffer, size_t buffer_size, MemoryStream *p_output_stream, unsigned int p_target_driver, size_t p_file_offset)
 {
-	bool success = false;
+	// The lexer chops up its input, so give it a copy
+	char *buffer_copy = malloc(buffer_size + 1);
+	memcpy(buffer_copy, buffer, buffer_size);
+	buffer_copy[buffer_size] = '\0';
 
-	output_stream = p_output_stream;
-	target_driver = p_target_driver;
-	file_offset = p_file_offset;
+	IR *ir = IR_Lex(buffer_copy, buffer_size);
+	const bool success = SMPS2ASM2BIN_IR(ir, p_output_stream, p_target_driver, p_file_offset);
+	IR_Destroy(ir);
+
+	return success;
+}
+
+IR* SMPS2ASM2BIN_LexFile(const char *file_name, const char *cache_directory)
+{
+	IR *ir = NULL;
 
 	FILE *in_file = fopen(file_name, "rb");
 
@@ -137,61 +195,50 @@ bool SMPS2ASM2BIN(const char *file_name, MemoryStream *p_output_stream, unsigned
 
 		in_file_buffer[in_file_size] = '\0';
 
-		FillDefaultDictionary();
-
-		size_t index = 0;
-
-		// Feed each line into the ParseLine function
-		for (;;)
+		if (cache_directory == NULL)
 		{
-			const size_t size_of_line = strcspn(in_file_buffer + index, "\r\n");
-
-			in_file_buffer[index + size_of_line] = '\0';
-
-			ParseLine(in_file_buffer + index);
-
-			if (index + size_of_line == in_file_size)
-				break;
-
-			index += size_of_line + 1;
-			index += strspn(in_file_buffer + index, "\r\n");
-
-			if (error)
-				goto fail;
+			ir = IR_Lex(in_file_buffer, in_file_size);
 		}
-
-		// Once the entire file is processed, finish any instructions that had to be delayed because of undefined symbols
-		for (DelayedInstruction *instruction = delayed_instruction_list_head; instruction != NULL; instruction = instruction->next)
+		else
 		{
-			undefined_symbol = NULL;
-			MemoryStream_SetPosition(output_stream, instruction->output_position, MEMORYSTREAM_START);
-			HandleInstruction(instruction->instruction, instruction->arg_count, instruction->arg_array);
+			// Sources that have been lexed before can skip straight to assembly
+			const unsigned long long hash = IR_HashSource(in_file_buffer, in_file_size);
 
-			if (undefined_symbol != NULL)
-				PrintError("Error: symbol '%s' undefined\n", undefined_symbol);
+			const size_t cache_file_name_size = strlen(cache_directory) + 1 + 16 + 3 + 1;
+			char *cache_file_name = malloc(cache_file_name_size);
+			sprintf(cache_file_name, "%s/%08lX%08lX.ir", cache_directory, (unsigned long)(hash >> 32), (unsigned long)(hash & 0xFFFFFFFF));
 
-			if (error)
-				goto fail;
-		}
+			ir = IR_Load(cache_file_name, hash, in_file_size);
 
-		success = true;
+			if (ir != NULL)
+			{
+				free(in_file_buffer);
+			}
+			else
+			{
+				ir = IR_Lex(in_file_buffer, in_file_size);
 
-		fail:;
+				if (!IR_Save(ir, cache_file_name, hash, in_file_size))
+					PrintWarning("Warning: Couldn't write IR cache file '%s'\n", cache_file_name);
+			}
 
-		// Delete the list of delayed instructions
-		DelayedInstruction *entry = delayed_instruction_list_head;
-		while (entry != NULL)
-		{
-			DelayedInstruction *next_entry = entry->next;
-			free(entry);
-			entry = next_entry;
+			free(cache_file_name);
 		}
+	}
 
-		delayed_instruction_list_head = NULL;
+	return ir;
+}
 
-		ClearDictionary();
-		free(in_file_buffer);
+bool SMPS2ASM2BIN(const char *file_name, MemoryStream *p_output_stream, unsigned int p_target_driver, size_t p_file_offset)
+{
+	bool success = false;
 
+	IR *ir = SMPS2ASM2BIN_LexFile(file_name, NULL);
+
+	if (ir != NULL)
+	{
+		success = SMPS2ASM2BIN_IR(ir, p_output_stream, p_target_driver, p_file_offset);
+		IR_Destroy(ir);
 	}
 
 	return success;
@@ -3,6 +3,14 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "ir.h"
 #include "memory_stream.h"
 
+extern unsigned long current_line;
+extern void (*line_callback)(unsigned long line, size_t output_position, size_t size);
+extern void (*import_callback)(const char *symbol);
+
+bool SMPS2ASM2BIN_IR(const IR *ir, MemoryStream *p_output_stream, unsigned int p_target_driver, size_t p_file_offset);
+bool SMPS2ASM2BIN_Buffer(const char *buffer, size_t buffer_size, MemoryStream *p_output_stream, unsigned int p_target_driver, size_t p_file_offset);
+IR* SMPS2ASM2BIN_LexFile(const char *file_name, const char *cache_directory);
 bool SMPS2ASM2BIN(const char *file_name, MemoryStream *p_output_stream, unsigned int p_target_driver, size_t p_file_offset);
@@ -0,0 +1,610 @@
+#include "song.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver.h"
+#include "error.h"
+#include "instruction.h"
+#include "object.h"
+
+static unsigned int ReadShort(const unsigned char *bytes, bool big_endian)
+{
+	return big_endian ? (bytes[0] << 8) | bytes[1] : bytes[0] | (bytes[1] << 8);
+}
+
+static void WriteShort(unsigned char *bytes, unsigned int value, bool big_endian)
+{
+	bytes[big_endian ? 0 : 1] = (value >> 8) & 0xFF;
+	bytes[big_endian ? 1 : 0] = value & 0xFF;
+}
+
+static bool HasPosition(const size_t *positions, size_t count, size_t position)
+{
+	for (size_t i = 0; i < count; ++i)
+		if (positions[i] == position)
+			return true;
+
+	return false;
+}
+
+static bool IsFixup(const Object *object, size_t position)
+{
+	for (size_t i = 0; i < object->fixup_count; ++i)
+		if (object->fixups[i].position == position)
+			return true;
+
+	return false;
+}
+
+static bool HasMarker(const Object *object, Marker kind, size_t position)
+{
+	for (size_t i = 0; i < object->marker_count; ++i)
+		if (object->markers[i].kind == kind && object->markers[i].position == position)
+			return true;
+
+	return false;
+}
+
+// Start of the song that a position belongs to
+static size_t FindSongStart(const Object *object, size_t position)
+{
+	size_t start = 0;
+
+	for (size_t i = 0; i < object->marker_count; ++i)
+		if (object->markers[i].kind == MARKER_SONG && object->markers[i].position <= position)
+			start = object->markers[i].position;
+
+	return start;
+}
+
+bool Song_IsCommand(const SongNode *node)
+{
+	return node->kind == SONG_NODE_DURATION || node->kind == SONG_NODE_NOTE || node->kind == SONG_NODE_FLAG;
+}
+
+// Decodes a single command from the start of 'data', without resolving its pointer
+bool Song_DecodeCommand(const Driver *driver, const unsigned char *data, size_t size, SongNode *node)
+{
+	memset(node, 0, sizeof(*node));
+	node->target = SONG_NONE;
+	node->base = SONG_NONE;
+	node->position = SONG_NONE;
+	node->previous = SONG_NONE;
+	node->next = SONG_NONE;
+	node->redirect = SONG_NONE;
+	node->moved_to = SONG_NONE;
+
+	if (size == 0)
+		return false;
+
+	if (data[0] < 0x80)
+	{
+		node->kind = SONG_NODE_DURATION;
+		node->size = 1;
+	}
+	else if (data[0] < 0xE0)
+	{
+		node->kind = SONG_NODE_NOTE;
+		node->size = 1;
+	}
+	else
+	{
+		node->kind = SONG_NODE_FLAG;
+
+		unsigned int flag;
+
+		for (flag = 0; flag < COORDINATION_FLAG_COUNT; ++flag)
+		{
+			const CoordinationFlagEncoding *encoding = &driver->coordination_flags[flag];
+
+			if (encoding->size != 0 && encoding->size <= size && memcmp(encoding->bytes, data, encoding->size) == 0)
+				break;
+		}
+
+		if (flag == COORDINATION_FLAG_COUNT)
+			return false;
+
+		const CoordinationFlagLayout *layout = &coordination_flag_layouts[flag];
+		size_t command_size = driver->coordination_flags[flag].size + layout->arguments;
+
+		// Sonic 3's driver takes the ID of the song that holds the voice too, if the voice's index has bit 7 set
+		if (flag == COORDINATION_FLAG_FM_VOICE && driver->external_voices && command_size <= size && (data[command_size - 1] & 0x80) != 0)
+			++command_size;
+
+		if (layout->flow == FLOW_JUMP || layout->flow == FLOW_CALL || layout->flow == FLOW_BRANCH)
+		{
+			node->pointer = driver->relative_pointers ? SONG_POINTER_TRACK_RELATIVE : SONG_POINTER_ABSOLUTE;
+			node->pointer_offset = command_size;
+			command_size += 2;
+		}
+
+		if (command_size > size)
+			return false;
+
+		node->flag = flag;
+		node->size = command_size;
+	}
+
+	memcpy(node->bytes, data, node->size);
+
+	return true;
+}
+
+size_t Song_AddNode(Song *song, const SongNode *node)
+{
+	if (song->node_count == song->node_capacity)
+	{
+		song->node_capacity = (song->node_capacity == 0) ? 0x100 : song->node_capacity * 2;
+		song->nodes = realloc(song->nodes, sizeof(*song->nodes) * song->node_capacity);
+	}
+
+	song->nodes[song->node_count] = *node;
+	song->nodes[song->node_count].previous = SONG_NONE;
+	song->nodes[song->node_count].next = SONG_NONE;
+
+	return song->node_count++;
+}
+
+// Places a node just before another in the output
+void Song_Insert(Song *song, size_t node, size_t before)
+{
+	SongNode *inserted = &song->nodes[node];
+	SongNode *following = &song->nodes[before];
+
+	inserted->previous = following->previous;
+	inserted->next = before;
+
+	if (following->previous != SONG_NONE)
+		song->nodes[following->previous].next = node;
+	else
+		song->first = node;
+
+	following->previous = node;
+}
+
+// Takes a node out of the output. Anything that pointed to it points to
+// 'redirect' instead, and markers inside of it move to 'moved_to'.
+void Song_Remove(Song *song, size_t node, size_t redirect, size_t moved_to)
+{
+	SongNode *removed = &song->nodes[node];
+
+	if (removed->previous != SONG_NONE)
+		song->nodes[removed->previous].next = removed->next;
+	else
+		song->first = removed->next;
+
+	if (removed->next != SONG_NONE)
+		song->nodes[removed->next].previous = removed->previous;
+
+	removed->removed = true;
+	removed->redirect = redirect;
+	removed->moved_to = moved_to;
+	removed->previous = SONG_NONE;
+	removed->next = SONG_NONE;
+}
+
+// Follows a node's redirections to the node that stands in for it, or
+// SONG_NONE if it was removed outright
+size_t Song_Resolve(const Song *song, size_t node)
+{
+	while (node != SONG_NONE && song->nodes[node].removed)
+		node = song->nodes[node].redirect;
+
+	return node;
+}
+
+static size_t ResolveMove(const Song *song, size_t node)
+{
+	while (node != SONG_NONE && song->nodes[node].removed)
+		node = song->nodes[node].moved_to;
+
+	return node;
+}
+
+// Works out where a pointer goes, as a position within the object
+static bool GetPointerTarget(const Object *object, const Driver *driver, size_t site, SongPointer pointer, size_t *target)
+{
+	const unsigned int value = ReadShort(&object->data[site], driver->big_endian);
+	long position;
+
+	switch (pointer)
+	{
+		case SONG_POINTER_ABSOLUTE:
+			position = (long)value - (long)object->offset;
+			break;
+
+		case SONG_POINTER_SONG_RELATIVE:
+			position = (long)FindSongStart(object, site) + (long)value;
+			break;
+
+		case SONG_POINTER_TRACK_RELATIVE:
+			position = (long)site + 1 + ((value & 0x8000) ? (long)value - 0x10000 : (long)value);
+			break;
+
+		default:
+			return false;
+	}
+
+	if (position < 0 || (size_t)position > object->size)
+		return false;
+
+	*target = (size_t)position;
+	return true;
+}
+
+// Reads every track from the header's channel pointers onwards, following
+// jumps, calls and loops, and records where each command starts
+static bool DecodeTracks(Song *song, unsigned char *command_sizes, bool *covered)
+{
+	const Object *object = song->object;
+	const SongPointer header_pointer = song->driver->relative_pointers ? SONG_POINTER_SONG_RELATIVE : SONG_POINTER_ABSOLUTE;
+
+	size_t *pending = malloc(sizeof(*pending) * (object->size + 1));
+	size_t pending_count = 0;
+
+	song->roots = malloc(sizeof(*song->roots) * (object->marker_count + 1));
+
+	for (size_t i = 0; i < object->marker_count; ++i)
+	{
+		size_t target;
+
+		if (object->markers[i].kind == MARKER_CHANNEL_POINTER && !IsFixup(object, object->markers[i].position) && GetPointerTarget(object, song->driver, object->markers[i].position, header_pointer, &target) && target < object->size)
+		{
+			pending[pending_count++] = target;
+			song->roots[song->root_count++] = target;
+		}
+	}
+
+	while (pending_count != 0 && !error)
+	{
+		size_t position = pending[--pending_count];
+
+		for (;;)
+		{
+			if (command_sizes[position] != 0)
+				break;
+
+			if (position >= object->size)
+			{
+				PrintError("Error: Track at $%zX runs off the end of the data\n", position);
+				break;
+			}
+
+			if (covered[position])
+			{
+				PrintError("Error: Track data at $%zX overlaps another command\n", position);
+				break;
+			}
+
+			if (HasMarker(object, MARKER_VOICE, position))
+			{
+				PrintError("Error: Track at $%zX runs into a voice\n", position);
+				break;
+			}
+
+			SongNode command;
+
+			if (!Song_DecodeCommand(song->driver, &object->data[position], object->size - position, &command))
+			{
+				PrintError("Error: Unknown coordination flag $%02X at $%zX\n", object->data[position], position);
+				break;
+			}
+
+			for (size_t i = 0; i < command.size; ++i)
+			{
+				if (covered[position + i])
+				{
+					PrintError("Error: Track data at $%zX overlaps another command\n", position + i);
+					break;
+				}
+
+				covered[position + i] = true;
+			}
+
+			command_sizes[position] = command.size;
+
+			const FlagFlow flow = (command.kind == SONG_NODE_FLAG) ? coordination_flag_layouts[command.flag].flow : FLOW_NEXT;
+			size_t target;
+
+			if (command.pointer != SONG_POINTER_NONE && !IsFixup(object, position + command.pointer_offset) && GetPointerTarget(object, song->driver, position + command.pointer_offset, command.pointer, &target) && target < object->size)
+				pending[pending_count++] = target;
+
+			if (flow == FLOW_STOP || flow == FLOW_RETURN || flow == FLOW_JUMP || error)
+				break;
+
+			position += command.size;
+		}
+	}
+
+	free(pending);
+
+	return !error;
+}
+
+static void SetPointer(Song *song, SongNode *node, size_t site, SongPointer pointer)
+{
+	const Object *object = song->object;
+	size_t target;
+
+	node->pointer = pointer;
+	node->relocated = HasPosition(object->relocations, object->relocation_count, site);
+
+	if (IsFixup(object, site) || !GetPointerTarget(object, song->driver, site, pointer, &target))
+	{
+		node->pointer = SONG_POINTER_EXTERNAL;
+	}
+	else
+	{
+		node->target = target;	// Turned into a node once they all exist
+
+		if (pointer == SONG_POINTER_SONG_RELATIVE)
+			node->base = FindSongStart(object, site);
+	}
+}
+
+Song* Song_Decode(const Object *object)
+{
+	error = false;
+
+	Song *song = calloc(1, sizeof(*song));
+	song->object = object;
+	song->driver = GetDriver(object->driver);
+	song->first = SONG_NONE;
+	song->last = SONG_NONE;
+
+	if (song->driver == NULL)
+	{
+		PrintError("Error: Unsupported driver version %u\n", object->driver);
+		Song_Destroy(song);
+		return NULL;
+	}
+
+	unsigned char *command_sizes = calloc(object->size + 1, 1);
+	bool *covered = calloc(object->size + 1, sizeof(*covered));
+
+	if (DecodeTracks(song, command_sizes, covered))
+	{
+		song->position_nodes = malloc(sizeof(*song->position_nodes) * (object->size + 1));
+
+		size_t previous = SONG_NONE;
+
+		for (size_t position = 0; position <= object->size; )
+		{
+			SongNode node;
+
+			if (position == object->size)
+			{
+				// Labels and pointers can refer to the end of the data
+				Song_DecodeCommand(song->driver, NULL, 0, &node);
+				node.kind = SONG_NODE_DATA;
+				node.size = 0;
+			}
+			else if (command_sizes[position] != 0)
+			{
+				Song_DecodeCommand(song->driver, &object->data[position], command_sizes[position], &node);
+
+				// smpsCopyData's source isn't part of the track's flow, but it's an
+				// address all the same, and has to follow the data if it moves
+				if (node.kind == SONG_NODE_FLAG && node.flag == COORDINATION_FLAG_COPY_DATA && !song->driver->relative_pointers)
+				{
+					node.pointer = SONG_POINTER_ABSOLUTE;
+					node.pointer_offset = song->driver->coordination_flags[node.flag].size;
+				}
+
+				if (node.pointer != SONG_POINTER_NONE)
+					SetPointer(song, &node, position + node.pointer_offset, node.pointer);
+			}
+			else
+			{
+				Song_DecodeCommand(song->driver, NULL, 0, &node);
+
+				const bool absolute_pointer = !song->driver->relative_pointers && (HasPosition(object->relocations, object->relocation_count, position) || IsFixup(object, position));
+				const bool relative_pointer = song->driver->relative_pointers && (HasMarker(object, MARKER_CHANNEL_POINTER, position) || HasMarker(object, MARKER_VOICE_POINTER, position));
+
+				if ((absolute_pointer || relative_pointer) && position + 2 <= object->size && !covered[position + 1])
+				{
+					node.kind = SONG_NODE_POINTER;
+					node.size = 2;
+					memcpy(node.bytes, &object->data[position], 2);
+					SetPointer(song, &node, position, relative_pointer ? SONG_POINTER_SONG_RELATIVE : SONG_POINTER_ABSOLUTE);
+				}
+				else
+				{
+					node.kind = SONG_NODE_DATA;
+					node.size = 1;
+					node.bytes[0] = object->data[position];
+				}
+			}
+
+			node.position = position;
+
+			const size_t index = Song_AddNode(song, &node);
+
+			song->nodes[index].previous = previous;
+
+			if (previous != SONG_NONE)
+				song->nodes[previous].next = index;
+			else
+				song->first = index;
+
+			previous = index;
+
+			for (size_t i = 0; i < node.size; ++i)
+				song->position_nodes[position + i] = index;
+
+			if (node.size == 0)
+			{
+				song->position_nodes[position] = index;
+				song->last = index;
+				break;
+			}
+
+			position += node.size;
+		}
+
+		// Now that every node exists, turn the pointers' positions into nodes
+		for (size_t i = 0; i < song->node_count && !error; ++i)
+		{
+			SongNode *node = &song->nodes[i];
+
+			if (node->pointer != SONG_POINTER_NONE && node->pointer != SONG_POINTER_EXTERNAL)
+			{
+				const size_t target = song->position_nodes[node->target];
+
+				if (song->nodes[target].position != node->target)
+					PrintError("Error: Pointer at $%zX refers to the middle of a command\n", node->position + node->pointer_offset);
+
+				node->target = target;
+
+				if (node->base != SONG_NONE)
+					node->base = song->position_nodes[node->base];
+			}
+		}
+
+		for (size_t i = 0; i < song->root_count; ++i)
+			song->roots[i] = song->position_nodes[song->roots[i]];
+	}
+
+	free(command_sizes);
+	free(covered);
+
+	if (error)
+	{
+		Song_Destroy(song);
+		return NULL;
+	}
+
+	return song;
+}
+
+void Song_Destroy(Song *song)
+{
+	if (song != NULL)
+	{
+		free(song->nodes);
+		free(song->position_nodes);
+		free(song->roots);
+		free(song);
+	}
+}
+
+// Where a position within the original object has ended up, or SONG_NONE if it was removed
+static size_t MapPosition(const Song *song, const size_t *new_positions, size_t position, bool follow_redirects)
+{
+	const size_t original = song->position_nodes[position];
+	const size_t node = follow_redirects ? Song_Resolve(song, original) : ResolveMove(song, original);
+
+	if (node == SONG_NONE)
+		return SONG_NONE;
+
+	// Redirected labels go to the start of their stand-in
+	if (node != original && follow_redirects)
+		return new_positions[node];
+
+	return new_positions[node] + (position - song->nodes[original].position);
+}
+
+Object* Song_Encode(const Song *song)
+{
+	const Object *object = song->object;
+	const bool big_endian = song->driver->big_endian;
+
+	// Lay out the nodes
+	size_t *new_positions = malloc(sizeof(*new_positions) * (song->node_count + 1));
+	size_t size = 0;
+
+	for (size_t i = song->first; i != SONG_NONE; i = song->nodes[i].next)
+	{
+		new_positions[i] = size;
+		size += song->nodes[i].size;
+	}
+
+	unsigned char *data = malloc(size + 1);
+	Object *encoded = Object_Create(object->driver, object->offset);
+
+	for (size_t i = song->first; i != SONG_NONE; i = song->nodes[i].next)
+	{
+		const SongNode *node = &song->nodes[i];
+		unsigned char *bytes = &data[new_positions[i]];
+		const size_t site = new_positions[i] + node->pointer_offset;
+
+		memcpy(bytes, node->bytes, node->size);
+
+		if (node->pointer == SONG_POINTER_NONE)
+			continue;
+
+		const size_t target = Song_Resolve(song, node->target);
+
+		switch (node->pointer)
+		{
+			case SONG_POINTER_ABSOLUTE:
+				WriteShort(&bytes[node->pointer_offset], object->offset + new_positions[target], false);
+				Object_AddRelocation(encoded, site);
+				break;
+
+			case SONG_POINTER_SONG_RELATIVE:
+				WriteShort(&bytes[node->pointer_offset], new_positions[target] - new_positions[Song_Resolve(song, node->base)], big_endian);
+				break;
+
+			case SONG_POINTER_TRACK_RELATIVE:
+				WriteShort(&bytes[node->pointer_offset], new_positions[target] - site - 1, big_endian);
+				break;
+
+			case SONG_POINTER_EXTERNAL:
+				if (node->relocated)
+					Object_AddRelocation(encoded, site);
+
+				break;
+
+			case SONG_POINTER_NONE:
+				break;
+		}
+	}
+
+	for (size_t i = 0; i < object->export_count; ++i)
+	{
+		const size_t position = MapPosition(song, new_positions, object->exports[i].position, true);
+
+		if (position != SONG_NONE)
+			Object_AddExport(encoded, object->exports[i].name, position);
+	}
+
+	for (size_t i = 0; i < object->import_count; ++i)
+		Object_AddImport(encoded, object->imports[i]);
+
+	for (size_t i = 0; i < object->fixup_count; ++i)
+	{
+		const size_t position = MapPosition(song, new_positions, object->fixups[i].position, false);
+
+		if (position != SONG_NONE)
+			Object_AddFixup(encoded, position, object->fixups[i].import, object->fixups[i].addend);
+	}
+
+	for (size_t i = 0; i < object->marker_count; ++i)
+	{
+		const size_t position = MapPosition(song, new_positions, object->markers[i].position, false);
+
+		if (position == SONG_NONE)
+			continue;
+
+		// Nodes that were moved into the same place only need marking once
+		bool duplicate = false;
+
+		for (size_t j = 0; j < encoded->marker_count; ++j)
+			if (encoded->markers[j].kind == object->markers[i].kind && encoded->markers[j].position == position)
+				duplicate = true;
+
+		if (!duplicate)
+			Object_AddMarker(encoded, object->markers[i].kind, position);
+	}
+
+	Object_SetData(encoded, data, size);
+
+	free(data);
+	free(new_positions);
+
+	return encoded;
+}
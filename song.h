@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "driver.h"
+#include "object.h"
+
+#define SONG_NONE ((size_t)-1)
+
+typedef enum SongNodeKind
+{
+	SONG_NODE_DATA,		// Byte that isn't part of a track, such as a header or voice
+	SONG_NODE_POINTER,	// Pointer that isn't part of a track, such as a header's
+	SONG_NODE_DURATION,
+	SONG_NODE_NOTE,
+	SONG_NODE_FLAG
+} SongNodeKind;
+
+typedef enum SongPointer
+{
+	SONG_POINTER_NONE,
+	SONG_POINTER_ABSOLUTE,		// Address, which has to be relocated
+	SONG_POINTER_SONG_RELATIVE,	// Sonic 1's header pointers, which count from the start of the song
+	SONG_POINTER_TRACK_RELATIVE,	// Sonic 1's track pointers, which count from themselves
+	SONG_POINTER_EXTERNAL		// Refers to something outside of the object, so is left alone
+} SongPointer;
+
+// One command of a track, or one piece of the data around the tracks
+typedef struct SongNode
+{
+	SongNodeKind kind;
+	CoordinationFlag flag;		// For SONG_NODE_FLAG
+	unsigned char bytes[8];
+	unsigned char size;
+
+	SongPointer pointer;
+	unsigned char pointer_offset;	// Where the pointer is within the bytes
+	size_t target;			// Node that the pointer refers to
+	size_t base;			// Start of the song, for SONG_POINTER_SONG_RELATIVE
+	bool relocated;			// For SONG_POINTER_EXTERNAL: whether the object relocated it
+
+	size_t position;		// Within the object, or SONG_NONE for nodes that passes added
+	size_t previous;		// Neighbours in the output
+	size_t next;
+
+	bool removed;
+	size_t redirect;		// Where pointers and labels to a removed node go instead
+	size_t moved_to;		// Copy of a removed node, which takes markers inside of it
+} SongNode;
+
+// An object broken down into its tracks' commands, so that passes can
+// rearrange them without breaking the pointers between them. Absolute and
+// relative pointers alike refer to nodes, and are written back out by
+// Song_Encode.
+typedef struct Song
+{
+	const Object *object;
+	const Driver *driver;
+
+	SongNode *nodes;
+	size_t node_count;
+	size_t node_capacity;
+
+	size_t first;
+	size_t last;			// Zero-sized node that marks the end of the data
+
+	size_t *position_nodes;		// Node containing each position of the object
+	size_t *roots;			// First command of each channel
+	size_t root_count;
+} Song;
+
+Song* Song_Decode(const Object *object);
+void Song_Destroy(Song *song);
+Object* Song_Encode(const Song *song);
+
+bool Song_IsCommand(const SongNode *node);
+bool Song_DecodeCommand(const Driver *driver, const unsigned char *data, size_t size, SongNode *node);
+size_t Song_AddNode(Song *song, const SongNode *node);
+void Song_Insert(Song *song, size_t node, size_t before);
+void Song_Remove(Song *song, size_t node, size_t redirect, size_t moved_to);
+size_t Song_Resolve(const Song *song, size_t node);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+
+// How to convert main tempo modifiers between two drivers
+typedef struct TempoConversion
+{
+	const unsigned char *table;	// Converted form of every tempo modifier
+	long problem_tempo;		// Tempo modifier that doesn't convert cleanly, or -1
+	bool problem_is_error;		// Otherwise it only warrants a warning
+	const char *problem_message;
+} TempoConversion;
+
+const TempoConversion* Tempo_GetConversion(unsigned int source_driver, unsigned int target_driver);
+int Tempo_Verify(void);
@@ -0,0 +1,18 @@
+# Assembles SOURCE with and without '-z COMPRESSION', and checks that
+# decompressing the one gives back the other
+#
+# cmake -DSMPS2ASM2BIN=... -DCOMPRESSION=saxman|kosinski -DSOURCE=... -DOUTPUT=... -P compress.cmake
+
+function(run)
+	execute_process(COMMAND ${ARGV} RESULT_VARIABLE result)
+
+	if(NOT result EQUAL 0)
+		string(REPLACE ";" " " command "${ARGV}")
+		message(FATAL_ERROR "'${command}' failed")
+	endif()
+endfunction()
+
+run("${SMPS2ASM2BIN}" -v 2 "${SOURCE}" "${OUTPUT}.bin")
+run("${SMPS2ASM2BIN}" -v 2 -z ${COMPRESSION} "${SOURCE}" "${OUTPUT}.${COMPRESSION}")
+run("${SMPS2ASM2BIN}" decompress -z ${COMPRESSION} "${OUTPUT}.${COMPRESSION}" "${OUTPUT}.${COMPRESSION}.bin")
+run("${CMAKE_COMMAND}" -E compare_files "${OUTPUT}.bin" "${OUTPUT}.${COMPRESSION}.bin")
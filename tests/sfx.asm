@@ -0,0 +1,33 @@
+Snd_Header:
+	smpsHeaderStartSong 2
+	smpsHeaderVoice Snd_Voices
+	smpsHeaderTempoSFX $01
+	smpsHeaderChanSFX $02
+	smpsHeaderSFXChannel cFM5, Snd_FM5, $00, $00
+	smpsHeaderSFXChannel cPSG3, Snd_PSG3, $F4, $02
+
+Snd_FM5:
+	smpsFMvoice $00
+	dc.b	nC4, $06, nE4, nG4
+	smpsLoop $00, $02, Snd_FM5
+	smpsStop
+
+Snd_PSG3:
+	smpsPSGvoice fTone_03
+	dc.b	nC4, $06, nRst, $03
+	smpsStop
+
+Snd_Voices:
+	smpsVcAlgorithm     $04
+	smpsVcFeedback      $06
+	smpsVcUnusedBits    $00
+	smpsVcDetune        $00, $00, $03, $01
+	smpsVcCoarseFreq    $01, $00, $02, $01
+	smpsVcRateScale     $00, $00, $00, $00
+	smpsVcAttackRate    $1F, $1F, $1F, $1F
+	smpsVcAmpMod        $00, $00, $00, $00
+	smpsVcDecayRate1    $05, $0E, $0C, $0B
+	smpsVcDecayRate2    $00, $00, $00, $00
+	smpsVcDecayLevel    $02, $02, $03, $01
+	smpsVcReleaseRate   $0F, $0F, $0F, $0F
+	smpsVcTotalLevel    $00, $18, $00, $1E
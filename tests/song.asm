@@ -0,0 +1,100 @@
+Mus_Test_Header:
+	smpsHeaderStartSong 2
+	smpsHeaderVoice     Mus_Test_Voices
+	smpsHeaderChan      $03, $02
+	smpsHeaderTempo     $01, $5B
+
+	smpsHeaderDAC       Mus_Test_DAC
+	smpsHeaderFM        Mus_Test_FM1, $00, $0A
+	smpsHeaderFM        Mus_Test_FM2, $0C, $10
+	smpsHeaderPSG       Mus_Test_PSG1, $F4, $02, $00, fTone_05
+	smpsHeaderPSG       Mus_Test_PSG2, $F4, $04, $00, fTone_05
+
+; DAC Data
+Mus_Test_DAC:
+	dc.b	$81, $0C, $82, $81, $81, $82
+	dc.b	$81, $0C, $82, $81, $81, $82
+	dc.b	$81, $0C, $82, $81, $81, $82
+	dc.b	$81, $0C, $82, $81, $81, $82
+	smpsJump            Mus_Test_DAC
+
+; FM1 Data
+Mus_Test_FM1:
+	smpsSetvoice        $00
+	smpsPan             panCenter, $00
+	smpsAlterVol        $02
+	smpsAlterVol        $01
+Mus_Test_Loop01:
+	dc.b	nC4, $0C, nE4, nG4, nC5, $18
+	smpsCall            Mus_Test_Call01
+	smpsLoop            $00, $02, Mus_Test_Loop01
+	dc.b	nC4, $0C, nE4, nG4, nC5, $18
+	dc.b	nC4, $0C, nE4, nG4, nC5, $18
+	dc.b	nC4, $0C, nE4, nG4, nC5, $18
+	dc.b	nC4, $0C, nE4, nG4, nC5, $18
+	smpsJump            Mus_Test_FM1
+
+Mus_Test_Call01:
+	dc.b	nA3, $0C, nB3, $0C, nC4, $0C
+	smpsReturn
+
+; FM2 Data
+Mus_Test_FM2:
+	smpsSetvoice        $01
+	smpsModSet          $0D, $01, $02, $06
+	dc.b	nC3, $30, nG3, nC3, $30
+	smpsSetvoice        $01
+	smpsNop             $01
+	dc.b	nA2, $30, nE3, $30
+	smpsSetTempoMod     $40
+	smpsJump            Mus_Test_FM2
+
+; Unused data
+Mus_Test_Dead:
+	dc.b	nC4, $60
+	smpsStop
+
+; PSG1 Data
+Mus_Test_PSG1:
+	smpsPSGvoice        fTone_08
+	dc.b	nC4, $0C, nE4, nG4, nC5, $18
+	smpsPSGAlterVol     $01
+	smpsJump            Mus_Test_PSG1
+
+; PSG2 Data
+Mus_Test_PSG2:
+	smpsStop
+
+Mus_Test_Voices:
+;	Voice $00
+;	$3A
+;	$01, $07, $01, $01,	$8E, $8E, $8D, $53,	$0E, $0E, $0E, $03
+;	$00, $00, $00, $00,	$1F, $FF, $1F, $0F,	$18, $28, $27, $80
+	smpsVcAlgorithm     $02
+	smpsVcFeedback      $07
+	smpsVcUnusedBits    $00
+	smpsVcDetune        $00, $00, $00, $00
+	smpsVcCoarseFreq    $01, $01, $07, $01
+	smpsVcRateScale     $01, $02, $02, $02
+	smpsVcAttackRate    $13, $0D, $0E, $0E
+	smpsVcAmpMod        $00, $00, $00, $00
+	smpsVcDecayRate1    $03, $0E, $0E, $0E
+	smpsVcDecayRate2    $00, $00, $00, $00
+	smpsVcDecayLevel    $00, $01, $0F, $01
+	smpsVcReleaseRate   $0F, $0F, $0F, $0F
+	smpsVcTotalLevel    $00, $27, $28, $18
+
+;	Voice $01
+	smpsVcAlgorithm     $07
+	smpsVcFeedback      $00
+	smpsVcUnusedBits    $00
+	smpsVcDetune        $03, $00, $00, $00
+	smpsVcCoarseFreq    $02, $01, $01, $01
+	smpsVcRateScale     $00, $00, $00, $00
+	smpsVcAttackRate    $1F, $1F, $1F, $1F
+	smpsVcAmpMod        $00, $00, $00, $00
+	smpsVcDecayRate1    $00, $00, $00, $00
+	smpsVcDecayRate2    $00, $00, $00, $00
+	smpsVcDecayLevel    $00, $00, $00, $00
+	smpsVcReleaseRate   $0F, $0F, $0F, $0F
+	smpsVcTotalLevel    $10, $10, $10, $10
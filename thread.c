@@ -0,0 +1,119 @@
+// Runs jobs on every core when the platform provides threads, and one after
+// another when it doesn't
+
+#if !defined(_WIN32) && defined(SMPS2ASM2BIN_PTHREADS)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "thread.h"
+
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(SMPS2ASM2BIN_PTHREADS)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+typedef struct Job
+{
+	void (*function)(void *user_data, unsigned int index);
+	void *user_data;
+	unsigned int index;
+} Job;
+
+unsigned int Thread_GetCount(void)
+{
+#if defined(_WIN32)
+	SYSTEM_INFO system_info;
+	GetSystemInfo(&system_info);
+	return system_info.dwNumberOfProcessors;
+#elif defined(SMPS2ASM2BIN_PTHREADS)
+	const long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (unsigned int)count : 1;
+#else
+	return 1;
+#endif
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI RunJob(LPVOID parameter)
+{
+	Job *job = (Job*)parameter;
+	job->function(job->user_data, job->index);
+	return 0;
+}
+#elif defined(SMPS2ASM2BIN_PTHREADS)
+static void* RunJob(void *parameter)
+{
+	Job *job = (Job*)parameter;
+	job->function(job->user_data, job->index);
+	return NULL;
+}
+#endif
+
+void Thread_RunParallel(void (*function)(void *user_data, unsigned int index), void *user_data, unsigned int count)
+{
+	if (count == 0)
+		return;
+
+	Job *jobs = malloc(sizeof(*jobs) * count);
+
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		jobs[i].function = function;
+		jobs[i].user_data = user_data;
+		jobs[i].index = i;
+	}
+
+#if defined(_WIN32)
+	HANDLE *threads = malloc(sizeof(*threads) * count);
+
+	// The calling thread does the first job itself
+	for (unsigned int i = 1; i < count; ++i)
+		threads[i] = CreateThread(NULL, 0, RunJob, &jobs[i], 0, NULL);
+
+	function(user_data, 0);
+
+	for (unsigned int i = 1; i < count; ++i)
+	{
+		if (threads[i] == NULL)
+		{
+			function(user_data, i);
+		}
+		else
+		{
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+		}
+	}
+
+	free(threads);
+#elif defined(SMPS2ASM2BIN_PTHREADS)
+	pthread_t *threads = malloc(sizeof(*threads) * count);
+	char *started = malloc(count);
+
+	// The calling thread does the first job itself
+	for (unsigned int i = 1; i < count; ++i)
+		started[i] = pthread_create(&threads[i], NULL, RunJob, &jobs[i]) == 0;
+
+	function(user_data, 0);
+
+	for (unsigned int i = 1; i < count; ++i)
+	{
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		else
+			function(user_data, i);
+	}
+
+	free(started);
+	free(threads);
+#else
+	for (unsigned int i = 0; i < count; ++i)
+		function(user_data, i);
+#endif
+
+	free(jobs);
+}
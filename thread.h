@@ -0,0 +1,4 @@
+#pragma once
+
+unsigned int Thread_GetCount(void);
+void Thread_RunParallel(void (*function)(void *user_data, unsigned int index), void *user_data, unsigned int count);
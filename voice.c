@@ -0,0 +1,248 @@
+#include "voice.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver.h"
+#include "error.h"
+#include "memory_stream.h"
+
+// Where a format keeps each part of a voice
+typedef struct VoiceLayout
+{
+	const char *extension;
+	size_t size;
+	size_t algorithm;
+	size_t feedback;
+	size_t operators;		// Where the first operator starts
+	size_t operator_size;
+	unsigned char operator_order[4];	// Which of the YM2612's operators each one in the file is
+	unsigned char fields[11];		// Which field each byte of an operator is
+} VoiceLayout;
+
+// One of the bytes that make up each of a packed voice's rows, and where its bits go
+typedef struct PackedField
+{
+	OperatorField field;
+	unsigned char shift;
+} PackedField;
+
+static const VoiceLayout layouts[] = {
+	[VOICE_FORMAT_TFI] = {
+		".tfi", 42, 0, 1, 2, 10, {0, 1, 2, 3},
+		{OPERATOR_MULTIPLE, OPERATOR_DETUNE, OPERATOR_TOTAL_LEVEL, OPERATOR_RATE_SCALE, OPERATOR_ATTACK_RATE, OPERATOR_DECAY_RATE_1, OPERATOR_DECAY_RATE_2, OPERATOR_RELEASE_RATE, OPERATOR_DECAY_LEVEL, OPERATOR_SSG_EG}
+	},
+	[VOICE_FORMAT_DMP] = {
+		".dmp", 51, 5, 4, 7, 11, {0, 2, 1, 3},
+		{OPERATOR_MULTIPLE, OPERATOR_TOTAL_LEVEL, OPERATOR_ATTACK_RATE, OPERATOR_DECAY_RATE_1, OPERATOR_DECAY_LEVEL, OPERATOR_RELEASE_RATE, OPERATOR_AMP_MOD, OPERATOR_RATE_SCALE, OPERATOR_DETUNE, OPERATOR_DECAY_RATE_2, OPERATOR_SSG_EG}
+	},
+	// The same as TFI, plus the LFO sensitivity, and the AM bit on top of the first decay rate
+	[VOICE_FORMAT_VGI] = {
+		".vgi", 43, 0, 1, 3, 10, {0, 1, 2, 3},
+		{OPERATOR_MULTIPLE, OPERATOR_DETUNE, OPERATOR_TOTAL_LEVEL, OPERATOR_RATE_SCALE, OPERATOR_ATTACK_RATE, OPERATOR_DECAY_RATE_1, OPERATOR_DECAY_RATE_2, OPERATOR_RELEASE_RATE, OPERATOR_DECAY_LEVEL, OPERATOR_SSG_EG}
+	}
+};
+
+static const unsigned char field_masks[OPERATOR_FIELD_COUNT] = {
+	[OPERATOR_DETUNE] = 7,
+	[OPERATOR_MULTIPLE] = 0xF,
+	[OPERATOR_RATE_SCALE] = 3,
+	[OPERATOR_ATTACK_RATE] = 0x1F,
+	[OPERATOR_AMP_MOD] = 1,
+	[OPERATOR_DECAY_RATE_1] = 0x1F,
+	[OPERATOR_DECAY_RATE_2] = 0x1F,
+	[OPERATOR_DECAY_LEVEL] = 0xF,
+	[OPERATOR_RELEASE_RATE] = 0xF,
+	[OPERATOR_TOTAL_LEVEL] = 0x7F,
+	[OPERATOR_SSG_EG] = 0xF
+};
+
+// The six rows of four bytes that follow a voice's feedback/algorithm byte,
+// in the order that every driver stores them in. Only the order of the
+// operators within each row differs between drivers.
+static const PackedField rows[6][2] = {
+	{{OPERATOR_DETUNE, 4}, {OPERATOR_MULTIPLE, 0}},
+	{{OPERATOR_RATE_SCALE, 6}, {OPERATOR_ATTACK_RATE, 0}},
+	{{OPERATOR_AMP_MOD, 7}, {OPERATOR_DECAY_RATE_1, 0}},
+	{{OPERATOR_DECAY_RATE_2, 0}, {OPERATOR_FIELD_COUNT, 0}},
+	{{OPERATOR_DECAY_LEVEL, 4}, {OPERATOR_RELEASE_RATE, 0}},
+	{{OPERATOR_TOTAL_LEVEL, 0}, {OPERATOR_FIELD_COUNT, 0}}
+};
+
+VoiceFormat FindVoiceFormat(const char *file_path)
+{
+	const char *extension = strrchr(file_path, '.');
+
+	if (extension == NULL)
+		return VOICE_FORMAT_NONE;
+
+	for (unsigned int format = 0; format < sizeof(layouts) / sizeof(layouts[0]); ++format)
+	{
+		if (layouts[format].extension == NULL || strlen(extension) != strlen(layouts[format].extension))
+			continue;
+
+		bool match = true;
+
+		for (size_t i = 0; extension[i] != '\0'; ++i)
+		{
+			const char character = (extension[i] >= 'A' && extension[i] <= 'Z') ? extension[i] - 'A' + 'a' : extension[i];
+
+			if (character != layouts[format].extension[i])
+				match = false;
+		}
+
+		if (match)
+			return (VoiceFormat)format;
+	}
+
+	return VOICE_FORMAT_NONE;
+}
+
+bool Voice_Read(VoiceFormat format, const unsigned char *data, size_t size, Voice *voice)
+{
+	const VoiceLayout *layout = &layouts[format];
+
+	if (size < layout->size)
+	{
+		PrintError("Error: Voice file is $%zX bytes, but should be $%zX\n", size, layout->size);
+		return false;
+	}
+
+	// Older DefleMask presets are laid out differently, and standard ones have no FM at all
+	if (format == VOICE_FORMAT_DMP && (data[0] != 0x0B || data[2] != 1))
+	{
+		PrintError("Error: Only version 11 DefleMask FM presets are supported\n");
+		return false;
+	}
+
+	memset(voice, 0, sizeof(*voice));
+	voice->algorithm = data[layout->algorithm] & 7;
+	voice->feedback = data[layout->feedback] & 7;
+
+	if (format == VOICE_FORMAT_VGI)
+		voice->lfo_sensitivity = data[2];
+	else if (format == VOICE_FORMAT_DMP)
+		voice->lfo_sensitivity = ((data[6] & 3) << 4) | (data[3] & 7);
+
+	for (unsigned int i = 0; i < 4; ++i)
+	{
+		const unsigned char *bytes = &data[layout->operators + i * layout->operator_size];
+		unsigned char *operator = voice->operators[layout->operator_order[i]];
+
+		for (size_t j = 0; j < layout->operator_size; ++j)
+			operator[layout->fields[j]] = bytes[j];
+
+		if (format == VOICE_FORMAT_VGI)
+			operator[OPERATOR_AMP_MOD] = operator[OPERATOR_DECAY_RATE_1] >> 7;
+
+		// Every format counts detune from 3 for none, so 0 to 2 are -3 to -1,
+		// which the register holds as 7 to 5
+		const unsigned int detune = operator[OPERATOR_DETUNE] & 7;
+
+		operator[OPERATOR_DETUNE] = (detune >= 3) ? detune - 3 : 7 - detune;
+
+		for (unsigned int field = 0; field < OPERATOR_FIELD_COUNT; ++field)
+			operator[field] &= field_masks[field];
+	}
+
+	return true;
+}
+
+// Whether the voice uses SSG-EG or the LFO, which packed voices have no room for
+bool Voice_HasExtras(const Voice *voice)
+{
+	if (voice->lfo_sensitivity != 0)
+		return true;
+
+	for (unsigned int i = 0; i < 4; ++i)
+		if (voice->operators[i][OPERATOR_SSG_EG] != 0)
+			return true;
+
+	return false;
+}
+
+// Packs a voice into the 25 bytes that smpsVcTotalLevel would have written for the driver
+void Voice_Pack(const Voice *voice, const Driver *driver, unsigned char packed[VOICE_SIZE])
+{
+	// Which of the YM2612's operators are carriers, for each algorithm
+	const bool carriers[4] = {voice->algorithm == 7, voice->algorithm >= 4, voice->algorithm >= 5, true};
+
+	packed[0] = (voice->feedback << 3) | voice->algorithm;
+
+	for (unsigned int row = 0; row < 6; ++row)
+	{
+		for (unsigned int i = 0; i < 4; ++i)
+		{
+			// The driver's order is of smpsVc* arguments, which go from operator 4 to operator 1
+			const unsigned int operator = 3 - driver->voice_operator_order[i];
+			unsigned char byte = 0;
+
+			for (unsigned int j = 0; j < 2 && rows[row][j].field != OPERATOR_FIELD_COUNT; ++j)
+				byte |= voice->operators[operator][rows[row][j].field] << rows[row][j].shift;
+
+			// Sonic 3's driver finds carriers by bit 7 of their total levels, which the
+			// others ignore, so smpsVcTotalLevel sets it for every driver
+			if (rows[row][0].field == OPERATOR_TOTAL_LEVEL && carriers[operator])
+				byte |= 0x80;
+
+			packed[1 + row * 4 + i] = byte;
+		}
+	}
+}
+
+static unsigned long HashVoice(const unsigned char *voice)
+{
+	unsigned long hash = 2166136261UL;
+
+	for (unsigned int i = 0; i < VOICE_SIZE; ++i)
+		hash = ((hash ^ voice[i]) * 16777619UL) & 0xFFFFFFFFUL;
+
+	return hash;
+}
+
+// Packs every voice and writes one copy of each different one to 'output',
+// in the order that they first appear. 'ids' gets the index in 'output' of
+// each voice. Returns how many were written.
+size_t Voice_PackBank(const Voice *voices, size_t voice_count, const Driver *driver, MemoryStream *output, size_t *ids)
+{
+	unsigned char *packed = malloc(VOICE_SIZE * (voice_count + 1));
+	size_t packed_count = 0;
+
+	// An open-addressed hash table of indices into 'packed', which is kept at
+	// most half full so that libraries of thousands of voices go quickly
+	size_t table_size = 1;
+
+	while (table_size < voice_count * 2)
+		table_size <<= 1;
+
+	size_t *table = malloc(sizeof(*table) * table_size);
+
+	for (size_t i = 0; i < table_size; ++i)
+		table[i] = (size_t)-1;
+
+	for (size_t i = 0; i < voice_count; ++i)
+	{
+		unsigned char *voice = &packed[packed_count * VOICE_SIZE];
+
+		Voice_Pack(&voices[i], driver, voice);
+
+		size_t slot = HashVoice(voice) & (table_size - 1);
+
+		while (table[slot] != (size_t)-1 && memcmp(&packed[table[slot] * VOICE_SIZE], voice, VOICE_SIZE) != 0)
+			slot = (slot + 1) & (table_size - 1);
+
+		if (table[slot] == (size_t)-1)
+			table[slot] = packed_count++;
+
+		ids[i] = table[slot];
+	}
+
+	MemoryStream_WriteBytes(output, packed, packed_count * VOICE_SIZE);
+
+	free(table);
+	free(packed);
+
+	return packed_count;
+}
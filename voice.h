@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "driver.h"
+#include "memory_stream.h"
+
+#define VOICE_SIZE 25
+
+typedef enum VoiceFormat
+{
+	VOICE_FORMAT_NONE,
+	VOICE_FORMAT_TFI,	// TFM Music Maker
+	VOICE_FORMAT_DMP,	// DefleMask, version 11 FM presets
+	VOICE_FORMAT_VGI	// VGM Music Maker
+} VoiceFormat;
+
+typedef enum OperatorField
+{
+	OPERATOR_DETUNE,
+	OPERATOR_MULTIPLE,
+	OPERATOR_RATE_SCALE,
+	OPERATOR_ATTACK_RATE,
+	OPERATOR_AMP_MOD,
+	OPERATOR_DECAY_RATE_1,
+	OPERATOR_DECAY_RATE_2,
+	OPERATOR_DECAY_LEVEL,
+	OPERATOR_RELEASE_RATE,
+	OPERATOR_TOTAL_LEVEL,
+	OPERATOR_SSG_EG,
+	OPERATOR_FIELD_COUNT
+} OperatorField;
+
+// An FM voice, with its operators in the YM2612's numbering (1 to 4) rather
+// than the order that any driver stores them in
+typedef struct Voice
+{
+	unsigned char feedback;
+	unsigned char algorithm;
+	unsigned char lfo_sensitivity;	// AMS and FMS, which only VGI files have
+	unsigned char operators[4][OPERATOR_FIELD_COUNT];
+} Voice;
+
+VoiceFormat FindVoiceFormat(const char *file_path);
+bool Voice_Read(VoiceFormat format, const unsigned char *data, size_t size, Voice *voice);
+bool Voice_HasExtras(const Voice *voice);
+void Voice_Pack(const Voice *voice, const Driver *driver, unsigned char packed[VOICE_SIZE]);
+size_t Voice_PackBank(const Voice *voices, size_t voice_count, const Driver *driver, MemoryStream *output, size_t *ids);
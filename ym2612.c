@@ -0,0 +1,394 @@
+#include "ym2612.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+// How far each detune setting moves the phase increment, by key code
+static const unsigned char detune_table[4][32] = {
+	{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+	{0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5, 5, 6, 6, 7, 8, 8, 8, 8},
+	{1, 1, 1, 1, 2, 2, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5, 5, 6, 6, 7, 8, 8, 9, 10, 11, 12, 13, 14, 16, 16, 16, 16},
+	{2, 2, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5, 5, 6, 6, 7, 8, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 20, 22, 22, 22, 22}
+};
+
+// Which earlier operators modulate each operator, for each algorithm
+static const unsigned char algorithm_routes[8][4] = {
+	{0, 1 << 0, 1 << 1, 1 << 2},
+	{0, 0, (1 << 0) | (1 << 1), 1 << 2},
+	{0, 0, 1 << 1, (1 << 0) | (1 << 2)},
+	{0, 1 << 0, 0, (1 << 1) | (1 << 2)},
+	{0, 1 << 0, 0, 1 << 2},
+	{0, 1 << 0, 1 << 0, 1 << 0},
+	{0, 1 << 0, 0, 0},
+	{0, 0, 0, 0}
+};
+
+static const unsigned char algorithm_carriers[8] = {0x8, 0x8, 0x8, 0x8, 0xA, 0xE, 0xE, 0xF};
+
+// Operator registers go 1, 3, 2, 4
+static const unsigned char slot_operators[4] = {0, 2, 1, 3};
+
+static inline float Abs(float value)
+{
+	return (value < 0.0f) ? -value : value;
+}
+
+// A parabola corrected to within a fraction of a percent of a sine wave,
+// since it needs neither a table nor the maths library. It has to be inlined
+// for the loops that call it to be vectorized.
+static inline float Sine(float phase)
+{
+	float x = phase - (float)(int)phase;
+
+	x += (x < 0.0f) ? 1.0f : 0.0f;
+
+	const float t = x - 0.5f;
+	const float y = 8.0f * t - 16.0f * t * Abs(t);
+
+	return -(0.225f * (y * Abs(y) - y) + y);
+}
+
+static unsigned int GetKeyCode(unsigned int frequency)
+{
+	const unsigned int block = (frequency >> 11) & 7;
+	const unsigned int f11 = (frequency >> 10) & 1;
+	const unsigned int f10 = (frequency >> 9) & 1;
+	const unsigned int f9 = (frequency >> 8) & 1;
+	const unsigned int f8 = (frequency >> 7) & 1;
+
+	return (block << 2) | (f11 << 1) | ((f11 & (f10 | f9 | f8)) | ((f11 ^ 1) & f10 & f9 & f8));
+}
+
+static void UpdateIncrements(YM2612 *ym2612, unsigned int channel)
+{
+	const unsigned int frequency = ym2612->frequencies[channel];
+	const unsigned int key_code = GetKeyCode(frequency);
+
+	for (unsigned int operator = 0; operator < 4; ++operator)
+	{
+		const YM2612Operator *state = &ym2612->operators[channel][operator];
+		const unsigned int detune = detune_table[state->detune & 3][key_code];
+		unsigned long increment = ((frequency & 0x7FF) << ((frequency >> 11) & 7)) >> 1;
+
+		increment = ((state->detune & 4) ? increment - detune : increment + detune) & 0x1FFFF;
+		increment = (state->multiple == 0) ? increment / 2 : increment * state->multiple;
+
+		// The phase counter is 20 bits long
+		ym2612->increments[operator][channel] = (float)increment / (float)(1L << 20);
+	}
+}
+
+static void SetAlgorithm(YM2612 *ym2612, unsigned int channel, unsigned int value)
+{
+	const unsigned int algorithm = value & 7;
+	const unsigned int feedback = (value >> 3) & 7;
+
+	ym2612->algorithms[channel] = algorithm;
+
+	for (unsigned int operator = 0; operator < 4; ++operator)
+	{
+		for (unsigned int source = 0; source < 4; ++source)
+			ym2612->routing[operator][source][channel] = (algorithm_routes[algorithm][operator] >> source) & 1;
+
+		ym2612->carriers[operator][channel] = (algorithm_carriers[algorithm] >> operator) & 1;
+	}
+
+	// Operator 1 modulates itself by the average of its last two outputs
+	ym2612->feedback[channel] = (feedback == 0) ? 0.0f : (float)(1 << feedback) / (float)(1 << 7);
+}
+
+// The rates go up in quarter-octaves, from one step every 2048 envelope
+// updates to several steps every update
+static float GetEnvelopeStep(unsigned int rate)
+{
+	const float step = (float)(4 + (rate & 3)) / 4.0f;
+	const int shift = (int)(rate >> 2) - 11;
+
+	return (shift >= 0) ? step * (float)(1 << shift) : step / (float)(1 << -shift);
+}
+
+static unsigned int GetEnvelopeRate(unsigned int rate, unsigned int key_code, unsigned int key_scale)
+{
+	if (rate == 0)
+		return 0;
+
+	rate = rate * 2 + (key_code >> (3 - key_scale));
+
+	return (rate > 63) ? 63 : rate;
+}
+
+static void UpdateEnvelopes(YM2612 *ym2612)
+{
+	for (unsigned int channel = 0; channel < YM2612_CHANNELS; ++channel)
+	{
+		const unsigned int key_code = GetKeyCode(ym2612->frequencies[channel]);
+
+		for (unsigned int operator = 0; operator < 4; ++operator)
+		{
+			YM2612Operator *state = &ym2612->operators[channel][operator];
+			const float sustain_level = (state->sustain_level == 15) ? 0x3E0 : state->sustain_level * 0x20;
+
+			switch (state->phase)
+			{
+				case YM2612_ATTACK:
+				{
+					const unsigned int rate = GetEnvelopeRate(state->attack_rate, key_code, state->key_scale);
+
+					if (rate >= 62)
+						state->attenuation = 0.0f;
+					else if (rate != 0)
+						state->attenuation -= (state->attenuation + 1.0f) * GetEnvelopeStep(rate) / 16.0f;
+
+					if (state->attenuation <= 0.0f)
+					{
+						state->attenuation = 0.0f;
+						state->phase = YM2612_DECAY;
+					}
+
+					break;
+				}
+
+				case YM2612_DECAY:
+				{
+					const unsigned int rate = GetEnvelopeRate(state->decay_rate, key_code, state->key_scale);
+
+					if (rate != 0)
+						state->attenuation += GetEnvelopeStep(rate);
+
+					if (state->attenuation >= sustain_level)
+					{
+						state->attenuation = sustain_level;
+						state->phase = YM2612_SUSTAIN;
+					}
+
+					break;
+				}
+
+				case YM2612_SUSTAIN:
+				case YM2612_RELEASE:
+				{
+					const unsigned int rate = (state->phase == YM2612_SUSTAIN) ? GetEnvelopeRate(state->sustain_rate, key_code, state->key_scale) : GetEnvelopeRate(state->release_rate * 2 + 1, key_code, state->key_scale);
+
+					if (rate != 0)
+						state->attenuation += GetEnvelopeStep(rate);
+
+					if (state->attenuation > 0x3FF)
+						state->attenuation = 0x3FF;
+
+					break;
+				}
+			}
+
+			const unsigned int attenuation = (unsigned int)state->attenuation + state->total_level * 8;
+
+			ym2612->amplitudes[operator][channel] = (attenuation >= 0x400) ? 0.0f : ym2612->attenuation_table[attenuation];
+		}
+	}
+}
+
+static void SetKeys(YM2612 *ym2612, unsigned int value)
+{
+	const unsigned int channel_id = value & 7;
+
+	if ((channel_id & 3) == 3)
+		return;
+
+	const unsigned int channel = (channel_id & 3) + (channel_id >> 2) * 3;
+
+	for (unsigned int operator = 0; operator < 4; ++operator)
+	{
+		YM2612Operator *state = &ym2612->operators[channel][operator];
+		const bool key_on = (value & (0x10 << operator)) != 0;
+
+		if (key_on && state->phase == YM2612_RELEASE)
+		{
+			state->phase = YM2612_ATTACK;
+			ym2612->phases[operator][channel] = 0.0f;
+		}
+		else if (!key_on)
+		{
+			state->phase = YM2612_RELEASE;
+		}
+	}
+}
+
+void YM2612_Init(YM2612 *ym2612)
+{
+	memset(ym2612, 0, sizeof(*ym2612));
+
+	for (unsigned int channel = 0; channel < YM2612_CHANNELS; ++channel)
+	{
+		for (unsigned int operator = 0; operator < 4; ++operator)
+		{
+			ym2612->operators[channel][operator].phase = YM2612_RELEASE;
+			ym2612->operators[channel][operator].attenuation = 0x3FF;
+		}
+
+		SetAlgorithm(ym2612, channel, 0);
+		ym2612->left[channel] = 1.0f;
+		ym2612->right[channel] = 1.0f;
+	}
+
+	// Every 64 units of attenuation halves the output
+	static const float sixty_fourth_root_of_half = 0.98923270f;
+	float amplitude = 1.0f;
+
+	for (unsigned int i = 0; i < 0x400; ++i)
+	{
+		ym2612->attenuation_table[i] = amplitude;
+		amplitude *= sixty_fourth_root_of_half;
+	}
+
+	ym2612->envelope_divider = 1;
+}
+
+void YM2612_Write(YM2612 *ym2612, unsigned int port, unsigned int address, unsigned int value)
+{
+	const unsigned int channel = (address & 3) + port * 3;
+
+	if (address < 0x30)
+	{
+		if (port != 0)
+			return;
+
+		if (address == 0x28)
+			SetKeys(ym2612, value);
+		else if (address == 0x2A)
+			ym2612->dac_sample = ((float)value - 128.0f) / 128.0f;
+		else if (address == 0x2B)
+			ym2612->dac_enabled = (value & 0x80) != 0;
+
+		return;
+	}
+
+	if ((address & 3) == 3)
+		return;
+
+	if (address < 0xA0)
+	{
+		YM2612Operator *state = &ym2612->operators[channel][slot_operators[(address >> 2) & 3]];
+
+		switch (address & 0xF0)
+		{
+			case 0x30:
+				state->detune = (value >> 4) & 7;
+				state->multiple = value & 0xF;
+				UpdateIncrements(ym2612, channel);
+				break;
+
+			case 0x40:
+				state->total_level = value & 0x7F;
+				break;
+
+			case 0x50:
+				state->key_scale = value >> 6;
+				state->attack_rate = value & 0x1F;
+				break;
+
+			case 0x60:
+				state->decay_rate = value & 0x1F;
+				break;
+
+			case 0x70:
+				state->sustain_rate = value & 0x1F;
+				break;
+
+			case 0x80:
+				state->sustain_level = value >> 4;
+				state->release_rate = value & 0xF;
+				break;
+		}
+	}
+	else if (address >= 0xA4 && address < 0xA8)
+	{
+		ym2612->frequency_latch = value & 0x3F;
+	}
+	else if (address < 0xA4)
+	{
+		ym2612->frequencies[channel] = (ym2612->frequency_latch << 8) | value;
+		UpdateIncrements(ym2612, channel);
+	}
+	else if (address >= 0xB0 && address < 0xB4)
+	{
+		SetAlgorithm(ym2612, channel, value);
+	}
+	else if (address >= 0xB4 && address < 0xB8)
+	{
+		ym2612->left[channel] = (value & 0x80) ? 1.0f : 0.0f;
+		ym2612->right[channel] = (value & 0x40) ? 1.0f : 0.0f;
+	}
+}
+
+// Adds the chip's output to 'left' and 'right'. Each step works on every
+// channel at once, so that the compiler can turn the loops into vector
+// instructions.
+void YM2612_Render(YM2612 *ym2612, float *left, float *right, size_t sample_count)
+{
+	for (size_t sample = 0; sample < sample_count; ++sample)
+	{
+		float outputs[4][YM2612_LANES];
+		float mixed[YM2612_LANES];
+
+		if (--ym2612->envelope_divider == 0)
+		{
+			ym2612->envelope_divider = 3;
+			UpdateEnvelopes(ym2612);
+		}
+
+		for (unsigned int lane = 0; lane < YM2612_LANES; ++lane)
+		{
+			const float feedback = ym2612->feedback[lane] * (ym2612->feedback_history[0][lane] + ym2612->feedback_history[1][lane]);
+
+			outputs[0][lane] = ym2612->amplitudes[0][lane] * Sine(ym2612->phases[0][lane] + feedback);
+			ym2612->feedback_history[1][lane] = ym2612->feedback_history[0][lane];
+			ym2612->feedback_history[0][lane] = outputs[0][lane];
+		}
+
+		// A full-scale modulator moves the phase by four cycles
+		for (unsigned int lane = 0; lane < YM2612_LANES; ++lane)
+			outputs[1][lane] = ym2612->amplitudes[1][lane] * Sine(ym2612->phases[1][lane] + 4.0f * ym2612->routing[1][0][lane] * outputs[0][lane]);
+
+		for (unsigned int lane = 0; lane < YM2612_LANES; ++lane)
+			outputs[2][lane] = ym2612->amplitudes[2][lane] * Sine(ym2612->phases[2][lane] + 4.0f * (ym2612->routing[2][0][lane] * outputs[0][lane] + ym2612->routing[2][1][lane] * outputs[1][lane]));
+
+		for (unsigned int lane = 0; lane < YM2612_LANES; ++lane)
+			outputs[3][lane] = ym2612->amplitudes[3][lane] * Sine(ym2612->phases[3][lane] + 4.0f * (ym2612->routing[3][0][lane] * outputs[0][lane] + ym2612->routing[3][1][lane] * outputs[1][lane] + ym2612->routing[3][2][lane] * outputs[2][lane]));
+
+		for (unsigned int lane = 0; lane < YM2612_LANES; ++lane)
+		{
+			float output = ym2612->carriers[0][lane] * outputs[0][lane] + ym2612->carriers[1][lane] * outputs[1][lane] + ym2612->carriers[2][lane] * outputs[2][lane] + ym2612->carriers[3][lane] * outputs[3][lane];
+
+			// Each channel's output is clipped to 14 bits
+			output = (output > 1.0f) ? 1.0f : output;
+			output = (output < -1.0f) ? -1.0f : output;
+			mixed[lane] = output;
+		}
+
+		// The DAC takes the place of channel 6
+		if (ym2612->dac_enabled)
+			mixed[5] = ym2612->dac_sample;
+
+		float left_sum = 0.0f;
+		float right_sum = 0.0f;
+
+		for (unsigned int lane = 0; lane < YM2612_CHANNELS; ++lane)
+		{
+			left_sum += mixed[lane] * ym2612->left[lane];
+			right_sum += mixed[lane] * ym2612->right[lane];
+		}
+
+		left[sample] += left_sum;
+		right[sample] += right_sum;
+
+		for (unsigned int operator = 0; operator < 4; ++operator)
+		{
+			for (unsigned int lane = 0; lane < YM2612_LANES; ++lane)
+			{
+				const float phase = ym2612->phases[operator][lane] + ym2612->increments[operator][lane];
+
+				ym2612->phases[operator][lane] = phase - (float)(int)phase;
+			}
+		}
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define YM2612_CHANNELS 6
+#define YM2612_LANES 8			// Channels are worked on side by side, padded out to a whole number of vectors
+#define YM2612_SAMPLE_RATE 53267	// An NTSC Mega Drive's 7670453Hz clock divided by 144
+
+typedef enum YM2612EnvelopePhase
+{
+	YM2612_ATTACK,
+	YM2612_DECAY,
+	YM2612_SUSTAIN,
+	YM2612_RELEASE
+} YM2612EnvelopePhase;
+
+typedef struct YM2612Operator
+{
+	unsigned char detune;
+	unsigned char multiple;
+	unsigned char total_level;
+	unsigned char key_scale;
+	unsigned char attack_rate;
+	unsigned char decay_rate;
+	unsigned char sustain_rate;
+	unsigned char sustain_level;
+	unsigned char release_rate;
+
+	YM2612EnvelopePhase phase;
+	float attenuation;		// In the chip's units of 0.09375dB
+} YM2612Operator;
+
+typedef struct YM2612
+{
+	// Operators are numbered the way that the algorithms number them,
+	// rather than in the order of their registers
+	YM2612Operator operators[YM2612_CHANNELS][4];
+	unsigned int frequencies[YM2612_CHANNELS];	// Block and F-number, as written to $A4 and $A0
+	unsigned char frequency_latch;
+	unsigned char algorithms[YM2612_CHANNELS];
+	bool dac_enabled;
+	float dac_sample;
+	unsigned int envelope_divider;		// The envelopes update every third sample
+
+	// What each sample reads, with one lane per channel
+	float phases[4][YM2612_LANES];		// In cycles
+	float increments[4][YM2612_LANES];
+	float amplitudes[4][YM2612_LANES];
+	float routing[4][4][YM2612_LANES];	// How much each operator modulates each later one
+	float carriers[4][YM2612_LANES];
+	float feedback[YM2612_LANES];
+	float feedback_history[2][YM2612_LANES];
+	float left[YM2612_LANES];
+	float right[YM2612_LANES];
+
+	float attenuation_table[0x400];
+} YM2612;
+
+void YM2612_Init(YM2612 *ym2612);
+void YM2612_Write(YM2612 *ym2612, unsigned int port, unsigned int address, unsigned int value);
+void YM2612_Render(YM2612 *ym2612, float *left, float *right, size_t sample_count);